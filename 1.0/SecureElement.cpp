@@ -18,10 +18,16 @@
 #define LOG_TAG "NxpEseHal"
 #define MAX_INIT_RETRY_CNT 5
 #include <log/log.h>
+#include <phNxpEseLog.h>
+#include <chrono>
+#include <thread>
 
 #include "LsClient.h"
 #include "SecureElement.h"
+#include "phNxpEseBerTlv.h"
 #include "phNxpEse_Api.h"
+#include "phNxpEse_Cache.h"
+#include "phNxpEse_Sched.h"
 
 extern bool ese_debug_enabled;
 
@@ -33,9 +39,10 @@ namespace implementation {
 
 sp<V1_0::ISecureElementHalCallback> SecureElement::mCallbackV1_0 = nullptr;
 
-SecureElement::SecureElement()
-    : mOpenedchannelCount(0),
-      mOpenedChannels{false, false, false, false} {}
+SecureElement::SecureElement() {
+  phNxpEse_ChannelReset(&mChannels);
+  std::thread(&SecureElement::spareChannelLoop, this).detach();
+}
 
 Return<void> SecureElement::init(
     const sp<
@@ -43,11 +50,14 @@ Return<void> SecureElement::init(
         clientCallback) {
   ESESTATUS status = ESESTATUS_SUCCESS;
 
+  std::unique_lock<std::mutex> lock(mLock);
   if (clientCallback == nullptr) {
     return Void();
   } else {
     mCallbackV1_0 = clientCallback;
-    if (!mCallbackV1_0->linkToDeath(this, 0 /*cookie*/)) {
+    /*Channels opened from now on are reclaimed when this client dies*/
+    mClientCookie++;
+    if (!mCallbackV1_0->linkToDeath(this, mClientCookie)) {
       ALOGE("%s: Failed to register death notification", __func__);
     }
   }
@@ -64,7 +74,15 @@ Return<void> SecureElement::init(
       initRetryCount ++;
       if (phNxpEse_close() != ESESTATUS_SUCCESS)
         ALOGE("%s: phNxpEse_close failed!!!", __func__);
+      /*Other calls are not held up by the wait between attempts*/
+      lock.unlock();
       usleep(2* 1000 * 1000);
+      lock.lock();
+      /*A client call may have opened the eSE meanwhile*/
+      if (isSeInitialized()) {
+        clientCallback->onStateChange(true);
+        return Void();
+      }
     }else {
       break;
     }
@@ -108,11 +126,14 @@ Return<void> SecureElement::transmit(const hidl_vec<uint8_t>& data,
   phNxpEse_memset(&cmdApdu, 0x00, sizeof(phNxpEse_data));
   phNxpEse_memset(&rspApdu, 0x00, sizeof(phNxpEse_data));
 
+  /*The APDU waits for its channel's turn, behind no open or close, unless
+   *its response is cached*/
+  mActivity++;
   cmdApdu.len = data.size();
   if (cmdApdu.len >= MIN_APDU_LENGTH) {
     cmdApdu.p_data = (uint8_t*)phNxpEse_memalloc(data.size() * sizeof(uint8_t));
     memcpy(cmdApdu.p_data, data.data(), cmdApdu.len);
-    status = phNxpEse_Transceive(&cmdApdu, &rspApdu);
+    status = phNxpEse_CacheTransceive(&cmdApdu, &rspApdu);
   }
 
   hidl_vec<uint8_t> result;
@@ -136,12 +157,12 @@ Return<void> SecureElement::transmit(const hidl_vec<uint8_t>& data,
 Return<void> SecureElement::openLogicalChannel(const hidl_vec<uint8_t>& aid,
                                                uint8_t p2,
                                                openLogicalChannel_cb _hidl_cb) {
-  hidl_vec<uint8_t> manageChannelCommand = {0x00, 0x70, 0x00, 0x00, 0x01};
-
   LogicalChannelResponse resApduBuff;
   resApduBuff.channelNumber = 0xff;
   memset(&resApduBuff, 0x00, sizeof(resApduBuff));
 
+  std::lock_guard<std::mutex> lock(mLock);
+  mActivity++;
   if (!isSeInitialized()) {
     ESESTATUS status = seHalInit();
     if (status != ESESTATUS_SUCCESS) {
@@ -156,42 +177,28 @@ Return<void> SecureElement::openLogicalChannel(const hidl_vec<uint8_t>& aid,
   phNxpEse_data cmdApdu;
   phNxpEse_data rspApdu;
 
-  phNxpEse_memset(&cmdApdu, 0x00, sizeof(phNxpEse_data));
-  phNxpEse_memset(&rspApdu, 0x00, sizeof(phNxpEse_data));
-
-  cmdApdu.len = manageChannelCommand.size();
-  cmdApdu.p_data = (uint8_t*)phNxpEse_memalloc(manageChannelCommand.size() *
-                                               sizeof(uint8_t));
-  if (cmdApdu.p_data != NULL) {
-    memcpy(cmdApdu.p_data, manageChannelCommand.data(), cmdApdu.len);
-    status = phNxpEse_Transceive(&cmdApdu, &rspApdu);
-  }
-  if (status != ESESTATUS_SUCCESS) {
-    /*Transceive failed*/
-    sestatus = SecureElementStatus::IOERROR;
-  } else if (rspApdu.p_data[rspApdu.len - 2] == 0x90 &&
-             rspApdu.p_data[rspApdu.len - 1] == 0x00) {
-    /*ManageChannel successful*/
-    resApduBuff.channelNumber = rspApdu.p_data[0];
-    mOpenedchannelCount++;
-    mOpenedChannels[resApduBuff.channelNumber] = true;
+  /*Take a spare channel if one is open, the SELECT is all that is left*/
+  if (mSpareCount > 0) {
+    resApduBuff.channelNumber = mSpareChannels[--mSpareCount];
     sestatus = SecureElementStatus::SUCCESS;
-  } else if (rspApdu.p_data[rspApdu.len - 2] == 0x6A &&
-             rspApdu.p_data[rspApdu.len - 1] == 0x81) {
-    sestatus = SecureElementStatus::CHANNEL_NOT_AVAILABLE;
-  } else if (((rspApdu.p_data[rspApdu.len - 2] == 0x6E) ||
-              (rspApdu.p_data[rspApdu.len - 2] == 0x6D)) &&
-             rspApdu.p_data[rspApdu.len - 1] == 0x00) {
-    sestatus = SecureElementStatus::UNSUPPORTED_OPERATION;
+  } else {
+    sestatus = manageChannelOpen(&resApduBuff.channelNumber);
+  }
+  if (sestatus == SecureElementStatus::SUCCESS) {
+    if (phNxpEse_ChannelAdd(&mChannels, resApduBuff.channelNumber,
+                            mClientCookie) != ESESTATUS_SUCCESS) {
+      ALOGE("%s: channel %d out of range", __func__,
+            resApduBuff.channelNumber);
+      manageChannelClose(resApduBuff.channelNumber);
+      sestatus = SecureElementStatus::CHANNEL_NOT_AVAILABLE;
+    } else {
+      mSpareCond.notify_one();
+    }
   }
-
-  /*Free the allocations*/
-  phNxpEse_free(cmdApdu.p_data);
-  phNxpEse_free(rspApdu.p_data);
 
   if (sestatus != SecureElementStatus::SUCCESS) {
     /*If first logical channel open fails, DeInit SE*/
-    if (isSeInitialized() && (mOpenedchannelCount == 0)) {
+    if (isSeInitialized() && (mChannels.count == 0)) {
       SecureElementStatus deInitStatus = seHalDeInit();
       if (deInitStatus != SecureElementStatus::SUCCESS) {
         ALOGE("%s: seDeInit Failed", __func__);
@@ -203,7 +210,7 @@ Return<void> SecureElement::openLogicalChannel(const hidl_vec<uint8_t>& aid,
     return Void();
   }
 
-  ALOGD_IF(ese_debug_enabled, "%s: Sending selectApdu", __func__);
+  NXP_LOG_ESE_D("%s: Sending selectApdu", __func__);
   /*Reset variables if manageChannel is success*/
   sestatus = SecureElementStatus::IOERROR;
   status = ESESTATUS_FAILED;
@@ -215,14 +222,15 @@ Return<void> SecureElement::openLogicalChannel(const hidl_vec<uint8_t>& aid,
   cmdApdu.p_data = (uint8_t*)phNxpEse_memalloc(cmdApdu.len * sizeof(uint8_t));
   if (cmdApdu.p_data != NULL) {
     uint8_t xx = 0;
-    cmdApdu.p_data[xx++] = resApduBuff.channelNumber;
+    cmdApdu.p_data[xx++] =
+        phNxpEse_ChannelCla(0x00, resApduBuff.channelNumber);  // CLA
     cmdApdu.p_data[xx++] = 0xA4;        // INS
     cmdApdu.p_data[xx++] = 0x04;        // P1
     cmdApdu.p_data[xx++] = p2;          // P2
     cmdApdu.p_data[xx++] = aid.size();  // Lc
     memcpy(&cmdApdu.p_data[xx], aid.data(), aid.size());
 
-    status = phNxpEse_Transceive(&cmdApdu, &rspApdu);
+    status = phNxpEse_SchedTransceive(&cmdApdu, &rspApdu);
   }
 
   if (status != ESESTATUS_SUCCESS) {
@@ -237,6 +245,9 @@ Return<void> SecureElement::openLogicalChannel(const hidl_vec<uint8_t>& aid,
       /*Copy the response including status word*/
       resApduBuff.selectResponse.resize(rspApdu.len);
       memcpy(&resApduBuff.selectResponse[0], rspApdu.p_data, rspApdu.len);
+      phNxpEse_SchedConfigChannel(resApduBuff.channelNumber, aid.data(),
+                                  aid.size());
+      cacheSelect(resApduBuff.channelNumber, aid, p2, &rspApdu);
       sestatus = SecureElementStatus::SUCCESS;
     }
     /*AID provided doesn't match any applet on the secure element*/
@@ -251,7 +262,7 @@ Return<void> SecureElement::openLogicalChannel(const hidl_vec<uint8_t>& aid,
 
   if (sestatus != SecureElementStatus::SUCCESS) {
     SecureElementStatus closeChannelStatus =
-        closeChannel(resApduBuff.channelNumber);
+        internalCloseChannel(resApduBuff.channelNumber);
     if (closeChannelStatus != SecureElementStatus::SUCCESS) {
       ALOGE("%s: closeChannel Failed", __func__);
     } else {
@@ -270,6 +281,8 @@ Return<void> SecureElement::openBasicChannel(const hidl_vec<uint8_t>& aid,
                                              openBasicChannel_cb _hidl_cb) {
   hidl_vec<uint8_t> result;
 
+  std::lock_guard<std::mutex> lock(mLock);
+  mActivity++;
   if (!isSeInitialized()) {
     ESESTATUS status = seHalInit();
     if (status != ESESTATUS_SUCCESS) {
@@ -298,7 +311,7 @@ Return<void> SecureElement::openBasicChannel(const hidl_vec<uint8_t>& aid,
     cmdApdu.p_data[xx++] = aid.size();  // Lc
     memcpy(&cmdApdu.p_data[xx], aid.data(), aid.size());
 
-    status = phNxpEse_Transceive(&cmdApdu, &rspApdu);
+    status = phNxpEse_SchedTransceive(&cmdApdu, &rspApdu);
   }
 
   if (status != ESESTATUS_SUCCESS) {
@@ -314,10 +327,10 @@ Return<void> SecureElement::openBasicChannel(const hidl_vec<uint8_t>& aid,
       result.resize(rspApdu.len);
       memcpy(&result[0], rspApdu.p_data, rspApdu.len);
       /*Set basic channel reference if it is not set */
-      if (!mOpenedChannels[0]) {
-        mOpenedChannels[0] = true;
-        mOpenedchannelCount++;
+      if (!phNxpEse_ChannelIsOpen(&mChannels, DEFAULT_BASIC_CHANNEL)) {
+        phNxpEse_ChannelAdd(&mChannels, DEFAULT_BASIC_CHANNEL, mClientCookie);
       }
+      cacheSelect(DEFAULT_BASIC_CHANNEL, aid, p2, &rspApdu);
       sestatus = SecureElementStatus::SUCCESS;
     }
     /*AID provided doesn't match any applet on the secure element*/
@@ -330,9 +343,10 @@ Return<void> SecureElement::openBasicChannel(const hidl_vec<uint8_t>& aid,
     }
   }
 
-  if ((sestatus != SecureElementStatus::SUCCESS) && mOpenedChannels[0]) {
+  if ((sestatus != SecureElementStatus::SUCCESS) &&
+      phNxpEse_ChannelIsOpen(&mChannels, DEFAULT_BASIC_CHANNEL)) {
     SecureElementStatus closeChannelStatus =
-        closeChannel(DEFAULT_BASIC_CHANNEL);
+        internalCloseChannel(DEFAULT_BASIC_CHANNEL);
     if (closeChannelStatus != SecureElementStatus::SUCCESS) {
       ALOGE("%s: closeChannel Failed", __func__);
     }
@@ -345,67 +359,282 @@ Return<void> SecureElement::openBasicChannel(const hidl_vec<uint8_t>& aid,
 
 Return<::android::hardware::secure_element::V1_0::SecureElementStatus>
 SecureElement::closeChannel(uint8_t channelNumber) {
-  ESESTATUS status = ESESTATUS_FAILED;
-  SecureElementStatus sestatus = SecureElementStatus::FAILED;
+  std::lock_guard<std::mutex> lock(mLock);
+  mActivity++;
+  return internalCloseChannel(channelNumber);
+}
 
-  phNxpEse_data cmdApdu;
-  phNxpEse_data rspApdu;
+Return<::android::hardware::secure_element::V1_0::SecureElementStatus>
+SecureElement::internalCloseChannel(uint8_t channelNumber) {
+  SecureElementStatus sestatus = SecureElementStatus::FAILED;
 
-  if ((channelNumber < DEFAULT_BASIC_CHANNEL) ||
-      (channelNumber >= MAX_LOGICAL_CHANNELS) ||
-      (mOpenedChannels[channelNumber] == false)) {
+  if (!phNxpEse_ChannelIsOpen(&mChannels, channelNumber)) {
     ALOGE("%s: invalid channel!!!", __func__);
     sestatus = SecureElementStatus::FAILED;
   } else if (channelNumber > DEFAULT_BASIC_CHANNEL) {
-    phNxpEse_memset(&cmdApdu, 0x00, sizeof(phNxpEse_data));
-    phNxpEse_memset(&rspApdu, 0x00, sizeof(phNxpEse_data));
-    cmdApdu.p_data = (uint8_t*)phNxpEse_memalloc(5 * sizeof(uint8_t));
-    if (cmdApdu.p_data != NULL) {
-      uint8_t xx = 0;
-
-      cmdApdu.p_data[xx++] = channelNumber;
-      cmdApdu.p_data[xx++] = 0x70;           // INS
-      cmdApdu.p_data[xx++] = 0x80;           // P1
-      cmdApdu.p_data[xx++] = channelNumber;  // P2
-      cmdApdu.p_data[xx++] = 0x00;           // Lc
-      cmdApdu.len = xx;
-
-      status = phNxpEse_Transceive(&cmdApdu, &rspApdu);
-    }
-    if (status != ESESTATUS_SUCCESS) {
-      sestatus = SecureElementStatus::FAILED;
-    } else if ((rspApdu.p_data[rspApdu.len - 2] == 0x90) &&
-               (rspApdu.p_data[rspApdu.len - 1] == 0x00)) {
-      sestatus = SecureElementStatus::SUCCESS;
-    } else {
-      sestatus = SecureElementStatus::FAILED;
-    }
-    phNxpEse_free(cmdApdu.p_data);
-    phNxpEse_free(rspApdu.p_data);
+    sestatus = manageChannelClose(channelNumber);
   }
 
   if ((channelNumber == DEFAULT_BASIC_CHANNEL) ||
       (sestatus == SecureElementStatus::SUCCESS)) {
-    if(mOpenedChannels[channelNumber] != false)
-      mOpenedchannelCount--;
-    mOpenedChannels[channelNumber] = false;
+    phNxpEse_ChannelRemove(&mChannels, channelNumber);
+    phNxpEse_SchedConfigChannel(channelNumber, NULL, 0);
+    phNxpEse_CacheSelect(channelNumber, NULL, 0);
+    /*The eSE has a free channel again, a spare may be opened*/
+    mSpareRefused = false;
     /*If there are no channels remaining close secureElement*/
-    if (mOpenedchannelCount == 0) {
+    if (mChannels.count == 0) {
       sestatus = seHalDeInit();
     } else {
       sestatus = SecureElementStatus::SUCCESS;
+      mSpareCond.notify_one();
     }
   }
   return sestatus;
 }
 
-void SecureElement::serviceDied(uint64_t /*cookie*/, const wp<IBase>& /*who*/) {
+/*******************************************************************************
+**
+** Function:        manageChannelOpen
+**
+** Description:     Opens a logical channel with MANAGE CHANNEL, without
+**                  selecting an applet on it
+**
+** Returns:         SUCCESS with the channel in pChannelNumber, or why the
+**                  eSE did not open one
+**
+*******************************************************************************/
+SecureElementStatus SecureElement::manageChannelOpen(uint8_t* pChannelNumber) {
+  hidl_vec<uint8_t> manageChannelCommand = {0x00, 0x70, 0x00, 0x00, 0x01};
+  SecureElementStatus sestatus = SecureElementStatus::IOERROR;
+  ESESTATUS status = ESESTATUS_FAILED;
+  phNxpEse_data cmdApdu;
+  phNxpEse_data rspApdu;
+
+  phNxpEse_memset(&cmdApdu, 0x00, sizeof(phNxpEse_data));
+  phNxpEse_memset(&rspApdu, 0x00, sizeof(phNxpEse_data));
+
+  cmdApdu.len = manageChannelCommand.size();
+  cmdApdu.p_data = (uint8_t*)phNxpEse_memalloc(manageChannelCommand.size() *
+                                               sizeof(uint8_t));
+  if (cmdApdu.p_data != NULL) {
+    memcpy(cmdApdu.p_data, manageChannelCommand.data(), cmdApdu.len);
+    status = phNxpEse_SchedTransceive(&cmdApdu, &rspApdu);
+  }
+  if (status != ESESTATUS_SUCCESS) {
+    /*Transceive failed*/
+    sestatus = SecureElementStatus::IOERROR;
+  } else if (rspApdu.p_data[rspApdu.len - 2] == 0x90 &&
+             rspApdu.p_data[rspApdu.len - 1] == 0x00) {
+    /*ManageChannel successful*/
+    *pChannelNumber = rspApdu.p_data[0];
+    sestatus = SecureElementStatus::SUCCESS;
+  } else if (rspApdu.p_data[rspApdu.len - 2] == 0x6A &&
+             rspApdu.p_data[rspApdu.len - 1] == 0x81) {
+    sestatus = SecureElementStatus::CHANNEL_NOT_AVAILABLE;
+  } else if (((rspApdu.p_data[rspApdu.len - 2] == 0x6E) ||
+              (rspApdu.p_data[rspApdu.len - 2] == 0x6D)) &&
+             rspApdu.p_data[rspApdu.len - 1] == 0x00) {
+    sestatus = SecureElementStatus::UNSUPPORTED_OPERATION;
+  }
+
+  /*Free the allocations*/
+  phNxpEse_free(cmdApdu.p_data);
+  phNxpEse_free(rspApdu.p_data);
+  return sestatus;
+}
+
+/*******************************************************************************
+**
+** Function:        manageChannelClose
+**
+** Description:     Closes a logical channel with MANAGE CHANNEL
+**
+** Returns:         SUCCESS if the eSE closed it
+**
+*******************************************************************************/
+SecureElementStatus SecureElement::manageChannelClose(uint8_t channelNumber) {
+  ESESTATUS status = ESESTATUS_FAILED;
+  SecureElementStatus sestatus = SecureElementStatus::FAILED;
+  phNxpEse_data cmdApdu;
+  phNxpEse_data rspApdu;
+
+  phNxpEse_memset(&cmdApdu, 0x00, sizeof(phNxpEse_data));
+  phNxpEse_memset(&rspApdu, 0x00, sizeof(phNxpEse_data));
+  cmdApdu.p_data = (uint8_t*)phNxpEse_memalloc(5 * sizeof(uint8_t));
+  if (cmdApdu.p_data != NULL) {
+    uint8_t xx = 0;
+
+    cmdApdu.p_data[xx++] = phNxpEse_ChannelCla(0x00, channelNumber);  // CLA
+    cmdApdu.p_data[xx++] = 0x70;           // INS
+    cmdApdu.p_data[xx++] = 0x80;           // P1
+    cmdApdu.p_data[xx++] = channelNumber;  // P2
+    cmdApdu.p_data[xx++] = 0x00;           // Lc
+    cmdApdu.len = xx;
+
+    status = phNxpEse_SchedTransceive(&cmdApdu, &rspApdu);
+  }
+  if (status != ESESTATUS_SUCCESS) {
+    sestatus = SecureElementStatus::FAILED;
+  } else if ((rspApdu.p_data[rspApdu.len - 2] == 0x90) &&
+             (rspApdu.p_data[rspApdu.len - 1] == 0x00)) {
+    sestatus = SecureElementStatus::SUCCESS;
+  } else {
+    sestatus = SecureElementStatus::FAILED;
+  }
+  phNxpEse_free(cmdApdu.p_data);
+  phNxpEse_free(rspApdu.p_data);
+  return sestatus;
+}
+
+/*******************************************************************************
+**
+** Function:        cacheSelect
+**
+** Description:     Tells the response cache which applet a successful SELECT
+**                  made current on a channel: the DF name of its FCI, else
+**                  the requested AID for the first or only occurrence (P2
+**                  00). Any other SELECT leaves the channel uncacheable.
+**
+** Returns:         None
+**
+*******************************************************************************/
+void SecureElement::cacheSelect(uint8_t channelNumber,
+                                const hidl_vec<uint8_t>& aid, uint8_t p2,
+                                const phNxpEse_data* pRsp) {
+  phNxpEseBerTlvCursor_t cursor;
+  phNxpEseBerTlv_t tlv;
+  /*FCI template, the status word excluded*/
+  phNxpEseBerTlv_Init(&cursor, pRsp->p_data, pRsp->len - 2);
+  if (phNxpEseBerTlv_Next(&cursor, &tlv) && (tlv.tag == 0x6F)) {
+    phNxpEseBerTlv_Enter(&tlv, &cursor);
+    while (phNxpEseBerTlv_Next(&cursor, &tlv)) {
+      if (tlv.tag == 0x84) {  // DF name
+        phNxpEse_CacheSelect(channelNumber, tlv.pValue, tlv.len);
+        return;
+      }
+    }
+  }
+  if (p2 == 0x00) {
+    phNxpEse_CacheSelect(channelNumber, aid.data(), aid.size());
+  } else {
+    phNxpEse_CacheSelect(channelNumber, NULL, 0);
+  }
+}
+
+/*******************************************************************************
+**
+** Function:        needSpareChannel
+**
+** Description:     Tells whether another spare channel should be opened:
+**                  clients hold channels, so the SE stays open, and the eSE
+**                  has not refused one since the last close
+**
+** Returns:         true if a spare is missing
+**
+*******************************************************************************/
+bool SecureElement::needSpareChannel() {
+  return (mChannels.count > 0) && (mSpareCount < SPARE_LOGICAL_CHANNELS) &&
+         !mSpareRefused &&
+         (mChannels.count + mSpareCount < MAX_LOGICAL_CHANNELS) &&
+         isSeInitialized();
+}
+
+/*******************************************************************************
+**
+** Function:        openSpareChannel
+**
+** Description:     Opens one spare channel. A channel the table cannot hold
+**                  is closed again.
+**
+** Returns:         None
+**
+*******************************************************************************/
+void SecureElement::openSpareChannel() {
+  uint8_t channelNumber = 0xff;
+  if (manageChannelOpen(&channelNumber) != SecureElementStatus::SUCCESS) {
+    mSpareRefused = true;
+    return;
+  }
+  if ((channelNumber == DEFAULT_BASIC_CHANNEL) ||
+      (channelNumber >= MAX_LOGICAL_CHANNELS)) {
+    ALOGE("%s: channel %d out of range", __func__, channelNumber);
+    manageChannelClose(channelNumber);
+    mSpareRefused = true;
+    return;
+  }
+  NXP_LOG_ESE_D("%s: spare channel %d", __func__, channelNumber);
+  mSpareChannels[mSpareCount++] = channelNumber;
+}
+
+/*******************************************************************************
+**
+** Function:        releaseSpareChannels
+**
+** Description:     Closes the spare channels before the SE is closed
+**
+** Returns:         None
+**
+*******************************************************************************/
+void SecureElement::releaseSpareChannels() {
+  while (mSpareCount > 0) {
+    uint8_t channelNumber = mSpareChannels[--mSpareCount];
+    if (manageChannelClose(channelNumber) != SecureElementStatus::SUCCESS) {
+      ALOGE("%s: closing spare channel %d failed", __func__, channelNumber);
+    }
+  }
+}
+
+/*******************************************************************************
+**
+** Function:        spareChannelLoop
+**
+** Description:     Worker keeping SPARE_LOGICAL_CHANNELS channels open. A
+**                  spare is only opened once no client called in for
+**                  SPARE_CHANNEL_IDLE_MS, so it never delays their APDUs.
+**
+** Returns:         Never
+**
+*******************************************************************************/
+void SecureElement::spareChannelLoop() {
+  std::unique_lock<std::mutex> lock(mLock);
+  for (;;) {
+    mSpareCond.wait(lock, [this] { return needSpareChannel(); });
+    uint32_t activity = mActivity;
+    if (mSpareCond.wait_for(lock,
+                            std::chrono::milliseconds(SPARE_CHANNEL_IDLE_MS),
+                            [&] { return mActivity != activity; })) {
+      continue;
+    }
+    if (needSpareChannel()) openSpareChannel();
+  }
+}
+
+void SecureElement::serviceDied(uint64_t cookie, const wp<IBase>& /*who*/) {
   ALOGE("%s: SecureElement serviceDied!!!", __func__);
-  SecureElementStatus sestatus = seHalDeInit();
-  if (sestatus != SecureElementStatus::SUCCESS) {
-    ALOGE("%s: seHalDeInit Faliled!!!", __func__);
+  std::lock_guard<std::mutex> lock(mLock);
+  /*Reclaim the channels the dead client left open, others keep theirs*/
+  uint32_t owned = phNxpEse_ChannelOwnedMask(&mChannels, cookie);
+  for (uint8_t channelNumber = phNxpEse_ChannelNext(&owned);
+       channelNumber < PH_ESE_MAX_CHANNELS;
+       channelNumber = phNxpEse_ChannelNext(&owned)) {
+    if ((channelNumber != DEFAULT_BASIC_CHANNEL) &&
+        (manageChannelClose(channelNumber) != SecureElementStatus::SUCCESS)) {
+      ALOGE("%s: closing channel %d failed", __func__, channelNumber);
+    }
+    phNxpEse_ChannelRemove(&mChannels, channelNumber);
+    phNxpEse_SchedConfigChannel(channelNumber, NULL, 0);
+    phNxpEse_CacheSelect(channelNumber, NULL, 0);
   }
-  if (mCallbackV1_0 != nullptr) {
+  if (mChannels.count == 0) {
+    if (isSeInitialized() && (seHalDeInit() != SecureElementStatus::SUCCESS)) {
+      ALOGE("%s: seHalDeInit Faliled!!!", __func__);
+    }
+  } else {
+    mSpareRefused = false;
+    mSpareCond.notify_one();
+  }
+  if ((cookie == mClientCookie) && (mCallbackV1_0 != nullptr)) {
     mCallbackV1_0->unlinkToDeath(this);
   }
 }
@@ -417,7 +646,12 @@ ESESTATUS SecureElement::seHalInit() {
   phNxpEse_initParams initParams;
   memset(&initParams, 0x00, sizeof(phNxpEse_initParams));
   initParams.initMode = ESE_MODE_NORMAL;
+  /*Spares of an earlier session went away with it*/
+  mSpareCount = 0;
+  mSpareRefused = false;
 
+  /*Transmits without mLock are still scheduled, wait for them to end*/
+  phNxpEse_SchedAcquire(DEFAULT_BASIC_CHANNEL);
   status = phNxpEse_open(initParams);
   if (status != ESESTATUS_SUCCESS) {
     ALOGE("%s: SecureElement open failed!!!", __func__);
@@ -427,6 +661,7 @@ ESESTATUS SecureElement::seHalInit() {
       ALOGE("%s: SecureElement init failed!!!", __func__);
     }
   }
+  phNxpEse_SchedRelease();
   return status;
 }
 
@@ -434,6 +669,8 @@ Return<::android::hardware::secure_element::V1_0::SecureElementStatus>
 SecureElement::seHalDeInit() {
   ESESTATUS status = ESESTATUS_SUCCESS;
   SecureElementStatus sestatus = SecureElementStatus::FAILED;
+  releaseSpareChannels();
+  phNxpEse_SchedAcquire(DEFAULT_BASIC_CHANNEL);
   status = phNxpEse_deInit();
   if (status != ESESTATUS_SUCCESS) {
     sestatus = SecureElementStatus::FAILED;
@@ -444,12 +681,10 @@ SecureElement::seHalDeInit() {
     } else {
       sestatus = SecureElementStatus::SUCCESS;
 
-      for (uint8_t xx = 0; xx < MAX_LOGICAL_CHANNELS; xx++) {
-        mOpenedChannels[xx] = false;
-      }
-      mOpenedchannelCount = 0;
+      phNxpEse_ChannelReset(&mChannels);
     }
   }
+  phNxpEse_SchedRelease();
   return sestatus;
 }
 
@@ -21,7 +21,11 @@
 #include <android/hardware/secure_element/1.0/ISecureElement.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include "phNxpEse_Api.h"
+#include "phNxpEse_Channel.h"
 
 namespace android {
 namespace hardware {
@@ -37,7 +41,7 @@ using ::android::hardware::Void;
 using ::android::sp;
 
 #ifndef MAX_LOGICAL_CHANNELS
-#define MAX_LOGICAL_CHANNELS 0x04
+#define MAX_LOGICAL_CHANNELS PH_ESE_MAX_CHANNELS
 #endif
 #ifndef MIN_APDU_LENGTH
 #define MIN_APDU_LENGTH 0x04
@@ -45,6 +49,14 @@ using ::android::sp;
 #ifndef DEFAULT_BASIC_CHANNEL
 #define DEFAULT_BASIC_CHANNEL 0x00
 #endif
+/* Logical channels kept open ahead of openLogicalChannel while clients use
+ * the SE, and how long the SE must be left alone before one is opened */
+#ifndef SPARE_LOGICAL_CHANNELS
+#define SPARE_LOGICAL_CHANNELS 0x01
+#endif
+#ifndef SPARE_CHANNEL_IDLE_MS
+#define SPARE_CHANNEL_IDLE_MS 20
+#endif
 
 struct SecureElement : public ISecureElement, public hidl_death_recipient {
   SecureElement();
@@ -60,16 +72,37 @@ struct SecureElement : public ISecureElement, public hidl_death_recipient {
                                 openBasicChannel_cb _hidl_cb) override;
   Return<::android::hardware::secure_element::V1_0::SecureElementStatus>
   closeChannel(uint8_t channelNumber) override;
-  void serviceDied(uint64_t /*cookie*/, const wp<IBase>& /*who*/) override;
+  void serviceDied(uint64_t cookie, const wp<IBase>& /*who*/) override;
 
  private:
-  uint8_t mOpenedchannelCount = 0;
-  bool mOpenedChannels[MAX_LOGICAL_CHANNELS];
+  /* Serialises the HIDL calls and the spare channel worker on the eSE */
+  std::mutex mLock;
+  std::condition_variable mSpareCond;
+  /* Client calls so far, to tell when the SE idles. transmit counts itself
+   * without mLock, which it never takes. */
+  std::atomic<uint32_t> mActivity{0};
+  phNxpEse_ChannelTable_t mChannels;
+  uint64_t mClientCookie = PH_ESE_CHANNEL_NO_OWNER; /* owner of new channels */
+  uint8_t mSpareChannels[SPARE_LOGICAL_CHANNELS];
+  uint8_t mSpareCount = 0;
+  bool mSpareRefused = false; /* no spare until a client channel closes */
   static sp<V1_0::ISecureElementHalCallback> mCallbackV1_0;
   Return<::android::hardware::secure_element::V1_0::SecureElementStatus>
   seHalDeInit();
   ESESTATUS seHalInit();
   bool isSeInitialized();
+  Return<::android::hardware::secure_element::V1_0::SecureElementStatus>
+  internalCloseChannel(uint8_t channelNumber);
+  ::android::hardware::secure_element::V1_0::SecureElementStatus
+  manageChannelOpen(uint8_t* pChannelNumber);
+  ::android::hardware::secure_element::V1_0::SecureElementStatus
+  manageChannelClose(uint8_t channelNumber);
+  void cacheSelect(uint8_t channelNumber, const hidl_vec<uint8_t>& aid,
+                   uint8_t p2, const phNxpEse_data* pRsp);
+  bool needSpareChannel();
+  void openSpareChannel();
+  void releaseSpareChannels();
+  void spareChannelLoop();
 };
 
 }  // namespace implementation
@@ -0,0 +1,87 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/* Simulated eSE behind the phPalEse_spi_* interface. It speaks the T=1 frame
+ * format of phNxpEseProto7816_3.cpp: chained command I-frames are
+ * acknowledged, complete C-APDUs are answered with a queued recorded R-APDU
+ * or a configurable amount of data plus SW 9000 (chained when longer than
+ * one frame), R-NACKs and repeated frames trigger a retransmission and
+ * S-frame requests get their response. MANAGE CHANNEL opens and closes
+ * logical channels like a card would, and APDUs on a channel that is not
+ * open get SW 6881. Every PAL entry point takes one lock, so callers that
+ * race past the serialisation of the library cannot corrupt the model. */
+#pragma once
+
+#include <stdint.h>
+
+typedef struct FakeEse_Counters {
+  uint64_t apdus;        /* complete C-APDUs received */
+  uint64_t framesRx;     /* frames written by the host */
+  uint64_t framesTx;     /* frames returned to the host */
+  uint64_t bytesRx;      /* bytes written by the host */
+  uint64_t bytesTx;      /* bytes returned to the host */
+  uint64_t faults;       /* faults injected */
+  uint64_t closedChApdus; /* APDUs on a logical channel that is not open */
+} FakeEse_Counters_t;
+
+/* Faults the eSE side can inject. Frame faults hit frames sent by the eSE,
+ * write faults hit phPalEse_spi_write calls of the host. */
+typedef enum {
+  FAKE_ESE_FAULT_LRC = 0,     /* frame with a corrupted LRC */
+  FAKE_ESE_FAULT_SOF_DROP,    /* frame lost, the host sees no SOF */
+  FAKE_ESE_FAULT_TRUNCATE,    /* frame cut after half of its INF */
+  FAKE_ESE_FAULT_DUP_SEQ,     /* I-frame repeating the previous N(S) */
+  FAKE_ESE_FAULT_WTX_STORM,   /* burst of S(WTX) requests before a frame */
+  FAKE_ESE_FAULT_WRITE_EOF,   /* host write fails, device gone */
+  FAKE_ESE_FAULT_WRITE_EAGAIN, /* host write fails with EAGAIN */
+  FAKE_ESE_FAULT_MAX
+} FakeEse_Fault_t;
+
+/* Number of data bytes put in front of SW 9000 in every R-APDU */
+void FakeEse_SetResponseLen(uint32_t len);
+
+/* eSE processing time before a generated R-APDU, 0 by default */
+void FakeEse_SetThinkTime(uint32_t thinkUs);
+
+/* Number of logical channels besides the basic channel, 19 by default */
+void FakeEse_SetLogicalChannels(uint8_t count);
+
+/* Queues a recorded R-APDU. Each queued response answers the next C-APDU in
+ * place of the generated one, and its first frame is held back until
+ * thinkUs after the C-APDU arrived, so the host polls for SOF meanwhile. */
+void FakeEse_QueueResponse(const uint8_t* p_data, uint32_t len,
+                           uint32_t thinkUs);
+
+/* Parses and installs a fault script: a comma separated list of
+ *   <fault>[@<frame>][*<count>]
+ * with <fault> one of the names returned by FakeEse_FaultName. The fault
+ * hits <count> consecutive frames (default 1) starting at frame <frame>
+ * (default 0), counted from the last FakeEse_ArmFaults. For wtx, <count> is
+ * the number of S(WTX) requests sent before that frame. An empty script
+ * removes all faults. Returns false on a syntax error. */
+bool FakeEse_SetFaultScript(const char* script);
+
+/* Enables the installed script and restarts its frame count, typically
+ * before each transceive so that every APDU sees the same faults. Faults
+ * are disabled until the first call. */
+void FakeEse_ArmFaults(bool armed);
+
+const char* FakeEse_FaultName(FakeEse_Fault_t fault);
+
+void FakeEse_GetCounters(FakeEse_Counters_t* pCounters);
+void FakeEse_ResetCounters(void);
@@ -0,0 +1,84 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/* Host replacement of ese_config.cpp. The real one CHECK-fails when no
+ * libese-nxp.conf is installed, so the benchmarks use the P73 defaults from
+ * libese-spi/p73/libese-nxp-P73.conf with debug logs turned off. */
+
+#include <ese_config.h>
+
+#include <map>
+
+namespace {
+
+const std::map<std::string, unsigned>& numbers() {
+  static const std::map<std::string, unsigned> sNumbers = {
+      {NAME_SE_DEBUG_ENABLED, 0},
+      {NAME_NXP_WTX_COUNT_VALUE, 9000},
+      {NAME_NXP_POWER_SCHEME, 0x02},
+      {NAME_NXP_SOF_WRITE, 0x01},
+      {NAME_NXP_TP_MEASUREMENT, 0x00},
+      {NAME_NXP_SPI_INTF_RST_ENABLE, 0x01},
+      {NAME_NXP_SPI_WRITE_TIMEOUT, 0x14},
+      {NAME_NXP_MAX_RNACK_RETRY, 0x0A},
+      {NAME_NXP_OMAPI_APP_TIMEOUT, 60},
+  };
+  return sNumbers;
+}
+
+const std::map<std::string, std::string>& strings() {
+  static const std::map<std::string, std::string> sStrings = {
+      {NAME_NXP_ESE_DEV_NODE, "/dev/p73"},
+      {NAME_NXP_SPI_TERMINAL_NAME, "eSE1"},
+  };
+  return sStrings;
+}
+
+}  // namespace
+
+bool EseConfig::hasKey(const std::string& key) {
+  return numbers().count(key) || strings().count(key);
+}
+
+std::string EseConfig::getString(const std::string& key) {
+  auto it = strings().find(key);
+  return it == strings().end() ? "" : it->second;
+}
+
+std::string EseConfig::getString(const std::string& key,
+                                 std::string default_value) {
+  if (hasKey(key)) return getString(key);
+  return default_value;
+}
+
+unsigned EseConfig::getUnsigned(const std::string& key) {
+  auto it = numbers().find(key);
+  return it == numbers().end() ? 0 : it->second;
+}
+
+unsigned EseConfig::getUnsigned(const std::string& key,
+                                unsigned default_value) {
+  if (hasKey(key)) return getUnsigned(key);
+  return default_value;
+}
+
+std::vector<uint8_t> EseConfig::getBytes(const std::string& /* key */) {
+  return std::vector<uint8_t>();
+}
+
+void EseConfig::clear() {}
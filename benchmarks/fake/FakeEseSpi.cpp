@@ -0,0 +1,449 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/* Implements phPalEse_spi_* on top of the simulated eSE of FakeEse.h, in
+ * place of pal/spi/phNxpEsePal_spi.cpp. */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include <phNxpEsePal_spi.h>
+#include <phNxpEse_Internal.h>
+
+#include "FakeEse.h"
+
+#define FAKE_ESE_SOF 0xA5
+#define FAKE_ESE_IFSD 254
+#define FAKE_ESE_PCB_I_MORE 0x20
+#define FAKE_ESE_PCB_R 0x80
+#define FAKE_ESE_PCB_S 0xC0
+#define FAKE_ESE_PCB_S_RSP 0x20
+#define FAKE_ESE_PCB_R_ERR 0x03
+#define FAKE_ESE_S_RESYNCH 0x00
+#define FAKE_ESE_S_WTX 0x03
+#define FAKE_ESE_S_INTF_RESET 0x04
+#define FAKE_ESE_INS_MANAGE_CHANNEL 0x70
+#define FAKE_ESE_MAX_CHANNELS 19
+
+/* Globals owned by phNxpEsePal_spi.cpp in the real library */
+uint8_t gMfcAppSessionCount = 0;
+unsigned long gFelicaAppTimeout = 0;
+
+namespace {
+
+struct FaultStep {
+  FakeEse_Fault_t fault;
+  uint32_t frame;
+  uint32_t count;
+};
+
+struct QueuedResponse {
+  std::vector<uint8_t> rsp;
+  uint32_t thinkUs;
+};
+
+struct Card {
+  uint32_t rspLen = 0;
+  uint8_t txSeq = 0;         /* N(S) of the next I-frame sent to the host */
+  uint8_t rxSeq = 0;         /* N(S) expected in the next host I-frame */
+  std::vector<uint8_t> cmd;  /* C-APDU being reassembled */
+  std::vector<uint8_t> rsp;  /* R-APDU being sent */
+  size_t rspOffset = 0;
+  std::vector<uint8_t> out;  /* frame the host reads next */
+  size_t outOffset = 0;
+  std::vector<uint8_t> last; /* last frame sent, for retransmission */
+  std::vector<uint8_t> held; /* frame held back by a WTX storm */
+  uint32_t wtxLeft = 0;
+  std::deque<QueuedResponse> queued;
+  uint32_t thinkUs = 0;
+  uint64_t readyUs = 0;      /* no SOF is returned before this time */
+  uint8_t logicalChannels = FAKE_ESE_MAX_CHANNELS;
+  uint32_t openChannels = 1; /* bit per channel, basic channel always open */
+  std::vector<FaultStep> script;
+  bool armed = false;
+  uint32_t txFrame = 0; /* frames sent since FakeEse_ArmFaults */
+  uint32_t rxFrame = 0; /* host writes since FakeEse_ArmFaults */
+  FakeEse_Counters_t counters = {};
+};
+
+Card gCard;
+std::mutex gCardLock;
+
+const char* const gFaultNames[FAKE_ESE_FAULT_MAX] = {
+    "lrc", "sof", "trunc", "dupseq", "wtx", "eof", "eagain",
+};
+
+uint64_t nowUs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+uint8_t lrc(const uint8_t* p, size_t len) {
+  uint8_t x = 0;
+  for (size_t i = 0; i < len; i++) x ^= p[i];
+  return x;
+}
+
+std::vector<uint8_t> buildFrame(uint8_t pcb, const uint8_t* p_data,
+                                uint8_t len) {
+  std::vector<uint8_t> frame(len + 4);
+  frame[0] = FAKE_ESE_SOF;
+  frame[1] = pcb;
+  frame[2] = len;
+  if (len) memcpy(&frame[3], p_data, len);
+  frame[len + 3] = lrc(&frame[1], len + 2);
+  return frame;
+}
+
+/* Returns the script step covering the given frame index, if any */
+const FaultStep* findFault(uint32_t index, bool writeFault) {
+  if (!gCard.armed) return NULL;
+  for (const FaultStep& step : gCard.script) {
+    bool isWrite = (step.fault == FAKE_ESE_FAULT_WRITE_EOF ||
+                    step.fault == FAKE_ESE_FAULT_WRITE_EAGAIN);
+    if (isWrite != writeFault || index < step.frame) continue;
+    /* A storm is a single event in front of one frame */
+    uint32_t span = (step.fault == FAKE_ESE_FAULT_WTX_STORM) ? 1 : step.count;
+    if (index < step.frame + span) return &step;
+  }
+  return NULL;
+}
+
+void deliver(const std::vector<uint8_t>& frame) {
+  gCard.out = frame;
+  gCard.outOffset = 0;
+  gCard.counters.framesTx++;
+  gCard.counters.bytesTx += frame.size();
+}
+
+void sendWtxRequest() {
+  const uint8_t bwtMultiplier = 0x01;
+  gCard.last = buildFrame(FAKE_ESE_PCB_S | FAKE_ESE_S_WTX, &bwtMultiplier, 1);
+  gCard.wtxLeft--;
+  deliver(gCard.last);
+}
+
+/* Puts a frame on the wire, passing it through the fault script first.
+ * Retransmissions count as frames too, so a fault with a count above one
+ * also hits the repeated copies. */
+void emit(const std::vector<uint8_t>& clean) {
+  const FaultStep* step = findFault(gCard.txFrame++, false);
+  if (step == NULL) {
+    deliver(clean);
+    return;
+  }
+  gCard.counters.faults++;
+  std::vector<uint8_t> frame = clean;
+  size_t len = frame[2];
+  switch (step->fault) {
+    case FAKE_ESE_FAULT_LRC:
+      frame[len + 3] ^= 0xFF;
+      break;
+    case FAKE_ESE_FAULT_SOF_DROP:
+      frame.clear();
+      break;
+    case FAKE_ESE_FAULT_TRUNCATE:
+      frame.resize(3 + len / 2);
+      break;
+    case FAKE_ESE_FAULT_DUP_SEQ:
+      if (!(frame[1] & 0x80)) {
+        frame[1] ^= 0x40;
+        frame[len + 3] = lrc(&frame[1], len + 2);
+      }
+      break;
+    case FAKE_ESE_FAULT_WTX_STORM:
+      gCard.held = frame;
+      gCard.wtxLeft = step->count;
+      sendWtxRequest();
+      return;
+    default:
+      break;
+  }
+  deliver(frame);
+}
+
+void sendFrame(uint8_t pcb, const uint8_t* p_data, uint8_t len) {
+  gCard.last = buildFrame(pcb, p_data, len);
+  emit(gCard.last);
+}
+
+void sendNextResponseChunk() {
+  size_t left = gCard.rsp.size() - gCard.rspOffset;
+  uint8_t len = (left > FAKE_ESE_IFSD) ? FAKE_ESE_IFSD : left;
+  uint8_t pcb = gCard.txSeq << 6;
+  if (left > len) pcb |= FAKE_ESE_PCB_I_MORE;
+  sendFrame(pcb, &gCard.rsp[gCard.rspOffset], len);
+  gCard.rspOffset += len;
+  gCard.txSeq ^= 1;
+}
+
+void retransmit() { emit(gCard.last); }
+
+void setStatusWord(uint8_t sw1, uint8_t sw2) {
+  gCard.rsp.push_back(sw1);
+  gCard.rsp.push_back(sw2);
+}
+
+/* Answers MANAGE CHANNEL and APDUs sent on a closed channel. Returns false
+ * for APDUs that get the generated response. */
+bool onChannelApdu() {
+  const std::vector<uint8_t>& cmd = gCard.cmd;
+  if (cmd.size() < 4) return false;
+  uint8_t cla = cmd[0];
+  uint8_t channel = (cla & 0x40) ? 4 + (cla & 0x0F) : (cla & 0x03);
+  gCard.rsp.clear();
+  if (!(gCard.openChannels & (1u << channel))) {
+    gCard.counters.closedChApdus++;
+    setStatusWord(0x68, 0x81);
+    return true;
+  }
+  if (cmd[1] != FAKE_ESE_INS_MANAGE_CHANNEL) return false;
+  if (cmd[2] == 0x00) { /* open, the card picks the channel */
+    for (uint8_t ch = 1; ch <= gCard.logicalChannels; ch++) {
+      if (gCard.openChannels & (1u << ch)) continue;
+      gCard.openChannels |= (1u << ch);
+      gCard.rsp.push_back(ch);
+      setStatusWord(0x90, 0x00);
+      return true;
+    }
+    setStatusWord(0x6A, 0x81);
+  } else if (cmd[2] == 0x80 && cmd[3] != 0 && cmd[3] < 32 &&
+             (gCard.openChannels & (1u << cmd[3]))) {
+    gCard.openChannels &= ~(1u << cmd[3]);
+    setStatusWord(0x90, 0x00);
+  } else {
+    setStatusWord(0x6A, 0x86);
+  }
+  return true;
+}
+
+void onApdu() {
+  gCard.counters.apdus++;
+  if (!gCard.queued.empty()) {
+    gCard.rsp.swap(gCard.queued.front().rsp);
+    gCard.readyUs = nowUs() + gCard.queued.front().thinkUs;
+    gCard.queued.pop_front();
+  } else if (!onChannelApdu()) {
+    gCard.rsp.resize(gCard.rspLen + 2);
+    for (uint32_t i = 0; i < gCard.rspLen; i++) gCard.rsp[i] = (uint8_t)i;
+    gCard.rsp[gCard.rspLen] = 0x90;
+    gCard.rsp[gCard.rspLen + 1] = 0x00;
+    gCard.readyUs = gCard.thinkUs ? nowUs() + gCard.thinkUs : 0;
+  }
+  gCard.cmd.clear();
+  gCard.rspOffset = 0;
+  sendNextResponseChunk();
+}
+
+void onSFrame(uint8_t pcb) {
+  uint8_t type = pcb & 0x1F;
+  if (pcb & FAKE_ESE_PCB_S_RSP) {
+    /* Only S(WTX) responses are expected from the host */
+    if (type != FAKE_ESE_S_WTX || gCard.held.empty()) return;
+    if (gCard.wtxLeft) {
+      sendWtxRequest();
+    } else {
+      gCard.last = gCard.held;
+      gCard.held.clear();
+      deliver(gCard.last);
+    }
+    return;
+  }
+  if (type == FAKE_ESE_S_RESYNCH || type == FAKE_ESE_S_INTF_RESET) {
+    gCard.txSeq = 0;
+    gCard.rxSeq = 0;
+    gCard.cmd.clear();
+    gCard.rsp.clear();
+    gCard.rspOffset = 0;
+    gCard.held.clear();
+    gCard.wtxLeft = 0;
+  }
+  sendFrame(FAKE_ESE_PCB_S | FAKE_ESE_PCB_S_RSP | type, NULL, 0);
+}
+
+void onFrame(const uint8_t* p_frame, int len) {
+  gCard.counters.framesRx++;
+  gCard.counters.bytesRx += len;
+  if (len < 4 || p_frame[2] + 4 != len ||
+      lrc(&p_frame[1], len - 2) != p_frame[len - 1]) {
+    /* R-NACK with parity error for the expected host I-frame */
+    sendFrame(FAKE_ESE_PCB_R | (gCard.rxSeq << 4) | 0x01, NULL, 0);
+    return;
+  }
+  uint8_t pcb = p_frame[1];
+  uint8_t infLen = p_frame[2];
+  if (!(pcb & 0x80)) { /* I-frame */
+    if (((pcb >> 6) & 1) != gCard.rxSeq) {
+      /* Host repeats a frame whose answer got lost */
+      retransmit();
+      return;
+    }
+    gCard.cmd.insert(gCard.cmd.end(), &p_frame[3], &p_frame[3] + infLen);
+    gCard.rxSeq ^= 1;
+    if (pcb & FAKE_ESE_PCB_I_MORE) {
+      sendFrame(FAKE_ESE_PCB_R | (gCard.rxSeq << 4), NULL, 0);
+    } else {
+      onApdu();
+    }
+  } else if ((pcb & FAKE_ESE_PCB_S) == FAKE_ESE_PCB_R) { /* R-frame */
+    uint8_t nr = (pcb >> 4) & 1;
+    if ((pcb & FAKE_ESE_PCB_R_ERR) || nr != gCard.txSeq) {
+      retransmit();
+    } else if (gCard.rspOffset < gCard.rsp.size()) {
+      sendNextResponseChunk();
+    }
+  } else {
+    onSFrame(pcb);
+  }
+}
+
+}  // namespace
+
+void FakeEse_SetResponseLen(uint32_t len) { gCard.rspLen = len; }
+
+void FakeEse_SetThinkTime(uint32_t thinkUs) {
+  std::lock_guard<std::mutex> lock(gCardLock);
+  gCard.thinkUs = thinkUs;
+}
+
+void FakeEse_SetLogicalChannels(uint8_t count) {
+  std::lock_guard<std::mutex> lock(gCardLock);
+  gCard.logicalChannels =
+      (count < FAKE_ESE_MAX_CHANNELS) ? count : FAKE_ESE_MAX_CHANNELS;
+}
+
+void FakeEse_QueueResponse(const uint8_t* p_data, uint32_t len,
+                           uint32_t thinkUs) {
+  std::lock_guard<std::mutex> lock(gCardLock);
+  gCard.queued.push_back({std::vector<uint8_t>(p_data, p_data + len), thinkUs});
+}
+
+bool FakeEse_SetFaultScript(const char* script) {
+  std::vector<FaultStep> steps;
+  const char* p = script;
+  while (*p) {
+    size_t nameLen = strcspn(p, "@*,");
+    FaultStep step = {FAKE_ESE_FAULT_MAX, 0, 1};
+    for (int i = 0; i < FAKE_ESE_FAULT_MAX; i++) {
+      if (strlen(gFaultNames[i]) == nameLen &&
+          !strncmp(p, gFaultNames[i], nameLen))
+        step.fault = (FakeEse_Fault_t)i;
+    }
+    if (step.fault == FAKE_ESE_FAULT_MAX) return false;
+    p += nameLen;
+    char* end;
+    if (*p == '@') {
+      step.frame = strtoul(p + 1, &end, 10);
+      if (end == p + 1) return false;
+      p = end;
+    }
+    if (*p == '*') {
+      step.count = strtoul(p + 1, &end, 10);
+      if (end == p + 1 || step.count == 0) return false;
+      p = end;
+    }
+    if (*p == ',') {
+      p++;
+    } else if (*p) {
+      return false;
+    }
+    steps.push_back(step);
+  }
+  gCard.script = steps;
+  return true;
+}
+
+void FakeEse_ArmFaults(bool armed) {
+  gCard.armed = armed;
+  gCard.txFrame = 0;
+  gCard.rxFrame = 0;
+}
+
+const char* FakeEse_FaultName(FakeEse_Fault_t fault) {
+  return (fault < FAKE_ESE_FAULT_MAX) ? gFaultNames[fault] : "unknown";
+}
+
+void FakeEse_GetCounters(FakeEse_Counters_t* pCounters) {
+  *pCounters = gCard.counters;
+}
+
+void FakeEse_ResetCounters(void) { gCard.counters = {}; }
+
+ESESTATUS phPalEse_spi_open_and_configure(pphPalEse_Config_t pConfig) {
+  std::lock_guard<std::mutex> lock(gCardLock);
+  gCard.txSeq = 0;
+  gCard.rxSeq = 0;
+  gCard.cmd.clear();
+  gCard.rsp.clear();
+  gCard.out.clear();
+  gCard.outOffset = 0;
+  gCard.held.clear();
+  gCard.wtxLeft = 0;
+  gCard.readyUs = 0;
+  gCard.openChannels = 1;
+  pConfig->pDevHandle = (void*)(intptr_t)1;
+  return ESESTATUS_SUCCESS;
+}
+
+void phPalEse_spi_close(void* /* pDevHandle */) {}
+
+void phPalEse_spi_dwp_sync_close(void) {}
+
+/* Returns the pending frame, or idle bytes while the host polls for SOF */
+int phPalEse_spi_read(void* /* pDevHandle */, uint8_t* pBuffer,
+                      int nNbBytesToRead) {
+  std::lock_guard<std::mutex> lock(gCardLock);
+  size_t left = gCard.out.size() - gCard.outOffset;
+  if (gCard.readyUs && nowUs() < gCard.readyUs) left = 0;
+  size_t n = ((size_t)nNbBytesToRead < left) ? nNbBytesToRead : left;
+  if (n) memcpy(pBuffer, &gCard.out[gCard.outOffset], n);
+  memset(pBuffer + n, 0x00, nNbBytesToRead - n);
+  gCard.outOffset += n;
+  return nNbBytesToRead;
+}
+
+int phPalEse_spi_write(void* pDevHandle, uint8_t* pBuffer,
+                       int nNbBytesToWrite) {
+  if (NULL == pDevHandle) return -1;
+  std::lock_guard<std::mutex> lock(gCardLock);
+  const FaultStep* step = findFault(gCard.rxFrame++, true);
+  if (step != NULL) {
+    /* Same result as phNxpEsePal_spi.cpp once its own retries ran out */
+    gCard.counters.faults++;
+    errno = (step->fault == FAKE_ESE_FAULT_WRITE_EAGAIN) ? EAGAIN : EIO;
+    return -1;
+  }
+  pBuffer[0] = SEND_PACKET_SOF;
+  onFrame(pBuffer, nNbBytesToWrite);
+  return nNbBytesToWrite;
+}
+
+ESESTATUS phPalEse_spi_ioctl(phPalEse_ControlCode_t eControlCode,
+                             void* /* pDevHandle */, long level) {
+  if (eControlCode == phPalEse_e_GetSPMStatus)
+    *(spm_state_t*)level = SPM_STATE_IDLE;
+  return ESESTATUS_SUCCESS;
+}
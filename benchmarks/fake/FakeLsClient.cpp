@@ -0,0 +1,27 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/* Stands in for ls_client, which links the real ese_spi_nxp. Benchmarks
+ * drive SecureElement without init(), so no script download is needed. */
+
+#include "LsClient.h"
+
+LSCSTATUS LSC_doDownload(
+    const android::sp<ISecureElementHalCallback>& /* clientCallback */) {
+  return LSCSTATUS_SUCCESS;
+}
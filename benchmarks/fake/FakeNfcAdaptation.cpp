@@ -0,0 +1,34 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <NfcAdaptation.h>
+
+/* Status of the last OMAPI request, checked by EseHalStates.cpp */
+int omapi_status;
+
+NfcAdaptation& NfcAdaptation::GetInstance() {
+  static NfcAdaptation sInstance;
+  return sInstance;
+}
+
+/* Every NFC HAL ioctl succeeds immediately: the simulated eSE is never shared
+ * with the NFC controller. */
+ESESTATUS NfcAdaptation::HalIoctl(long /* data_len */, void* /* p_data */) {
+  omapi_status = ESESTATUS_SUCCESS;
+  return ESESTATUS_SUCCESS;
+}
@@ -0,0 +1,31 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+/* Host replacement of libese-spi/src/include/NfcAdaptation.h. The benchmarks
+ * have no NFC HAL service to talk to, so the interface keeps only what
+ * EseHalStates.cpp uses and leaves out the HIDL dependencies. */
+#pragma once
+
+#include <phEseStatus.h>
+#include <stdint.h>
+#include "hal_nxpese.h"
+
+class NfcAdaptation {
+ public:
+  static NfcAdaptation& GetInstance();
+  static ESESTATUS HalIoctl(long data_len, void* p_data);
+};
@@ -0,0 +1,167 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/* Measures how the T=1 engine recovers from faults injected by the
+ * simulated eSE (see FakeEse.h for the script syntax). Every iteration arms
+ * the script and sends one 5-byte C-APDU whose 600-byte R-APDU takes three
+ * chained I-frames, so frame 0 is the first response frame. An APDU that
+ * the engine cannot recover is followed by an untimed phNxpEse_reset so
+ * that the next one starts on a synchronised link.
+ *
+ * Each fault class reports the mean APDU latency (Time column) and:
+ *   success  - share of APDUs completed with the full R-APDU
+ *   recovery - recovery time per APDU from phNxpEse_StatsGetCounters
+ *   resets   - share of APDUs that needed the client reset
+ * plus the protocol health events per APDU that the fault caused.
+ *
+ * Extra classes can be given on the command line:
+ *   --fault_script=<name>:<script>, e.g. --fault_script=lrc3:lrc*3 */
+
+#include <benchmark/benchmark.h>
+#include <phNxpEse_Api.h>
+#include <phNxpEse_Stats.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "FakeEse.h"
+
+static const uint32_t kResponseLen = 600;
+
+struct FaultClass {
+  const char* name;
+  const char* script;
+  int iterations;
+};
+
+/* A lost frame costs a full SOF polling timeout, hence fewer iterations */
+static const FaultClass kFaultClasses[] = {
+    {"none", "", 200},
+    {"lrc", "lrc", 50},
+    {"lrc_burst", "lrc*12", 20},
+    {"sof", "sof", 3},
+    {"trunc", "trunc", 50},
+    {"dupseq", "dupseq", 50},
+    {"wtx_storm", "wtx*20", 10},
+    {"write_eof", "eof", 50},
+    {"write_eagain", "eagain*2", 50},
+};
+
+static bool isComplete(ESESTATUS status, const phNxpEse_data& rsp) {
+  return status == ESESTATUS_SUCCESS && rsp.len == kResponseLen + 2 &&
+         rsp.p_data[kResponseLen] == 0x90 &&
+         rsp.p_data[kResponseLen + 1] == 0x00;
+}
+
+static void BM_Fault(benchmark::State& state, std::string script) {
+  if (!FakeEse_SetFaultScript(script.c_str())) {
+    state.SkipWithError("invalid fault script");
+    return;
+  }
+  FakeEse_SetResponseLen(kResponseLen);
+  FakeEse_ArmFaults(false);
+
+  phNxpEse_initParams initParams;
+  memset(&initParams, 0x00, sizeof(initParams));
+  initParams.initMode = ESE_MODE_NORMAL;
+  if (phNxpEse_open(initParams) != ESESTATUS_SUCCESS ||
+      phNxpEse_init(initParams) != ESESTATUS_SUCCESS) {
+    state.SkipWithError("eSE open failed");
+    return;
+  }
+
+  uint8_t cmd[] = {0x80, 0xCA, 0x00, 0xFE, 0x00};
+  uint64_t completed = 0, resets = 0, recoveryUs = 0;
+  uint64_t events[PH_ESE_CNT_MAX] = {0};
+  for (auto _ : state) {
+    phNxpEse_Counters_t before, after;
+    phNxpEse_StatsGetCounters(PH_ESE_COUNTERS_SESSION, &before);
+    FakeEse_ArmFaults(true);
+
+    phNxpEse_data cmdApdu = {sizeof(cmd), cmd};
+    phNxpEse_data rspApdu = {0, NULL};
+    ESESTATUS status = phNxpEse_Transceive(&cmdApdu, &rspApdu);
+
+    state.PauseTiming();
+    FakeEse_ArmFaults(false);
+    phNxpEse_StatsGetCounters(PH_ESE_COUNTERS_SESSION, &after);
+    for (int i = 0; i < PH_ESE_CNT_MAX; i++) {
+      events[i] += after.events[i] - before.events[i];
+      recoveryUs += after.recoveryUs[i] - before.recoveryUs[i];
+    }
+    if (isComplete(status, rspApdu)) {
+      completed++;
+    } else {
+      resets++;
+      phNxpEse_reset();
+    }
+    if (rspApdu.p_data != NULL) phNxpEse_free(rspApdu.p_data);
+    state.ResumeTiming();
+  }
+
+  state.counters["success"] =
+      benchmark::Counter(completed, benchmark::Counter::kAvgIterations);
+  state.counters["recovery"] =
+      benchmark::Counter(recoveryUs, benchmark::Counter::kAvgIterations);
+  state.counters["resets"] =
+      benchmark::Counter(resets, benchmark::Counter::kAvgIterations);
+  for (int i = 0; i < PH_ESE_CNT_MAX; i++) {
+    if (events[i] == 0) continue;
+    state.counters[phNxpEse_StatsCounterName((phNxpEse_CounterId_t)i)] =
+        benchmark::Counter(events[i], benchmark::Counter::kAvgIterations);
+  }
+
+  phNxpEse_deInit();
+  phNxpEse_close();
+}
+
+static void registerFaultClass(const std::string& name,
+                               const std::string& script, int iterations) {
+  benchmark::RegisterBenchmark(("BM_Fault/" + name).c_str(), BM_Fault, script)
+      ->Iterations(iterations)
+      ->UseRealTime()
+      ->Unit(benchmark::kMicrosecond);
+}
+
+int main(int argc, char** argv) {
+  const char* kScriptFlag = "--fault_script=";
+  int kept = 1;
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], kScriptFlag, strlen(kScriptFlag))) {
+      argv[kept++] = argv[i];
+      continue;
+    }
+    std::string spec = argv[i] + strlen(kScriptFlag);
+    size_t colon = spec.find(':');
+    if (colon == std::string::npos) {
+      fprintf(stderr, "expected %s<name>:<script>\n", kScriptFlag);
+      return 1;
+    }
+    registerFaultClass(spec.substr(0, colon), spec.substr(colon + 1), 20);
+  }
+  argc = kept;
+  for (const FaultClass& fault : kFaultClasses)
+    registerFaultClass(fault.name, fault.script, fault.iterations);
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
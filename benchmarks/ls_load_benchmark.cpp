@@ -0,0 +1,173 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/* Applet loads through the load engine of LsLib against the simulated eSE.
+ * The LS applet on the basic channel is played by queued R-APDUs: every
+ * 9000 forwarded to it with A2 is answered with SW 6310 and the next
+ * command, INSTALL [for load] first and then <blocks> LOAD blocks of
+ * kBlockLen bytes. The card answers the load commands with 9000.
+ *
+ *   BM_Load/<blocks>        a whole load
+ *   BM_LoadFail/<blocks>    the card fails the middle block
+ *   BM_LoadP2Gap/<blocks>   the applet skips a P2 in the middle
+ *
+ * The queued responses only line up if INSTALL and every LOAD reach the
+ * card back to back after the last block, so loads longer than
+ * LS_LOAD_QUEUE_SLOTS check that the spill keeps them contiguous. An
+ * iteration with an unexpected status or APDU count stops the benchmark.
+ * Counters, per iteration:
+ *   apdus - C-APDUs the card received
+ *   bytes - load command bytes handed to the engine */
+
+#include <LsLib.h>
+#include <benchmark/benchmark.h>
+#include <phNxpEse_Api.h>
+#include <string.h>
+
+#include <vector>
+
+#include "FakeEse.h"
+
+static const uint8_t kBlockLen = 240;
+/* INSTALL [for load] of a package, with no security domain, hash,
+ * parameters or token */
+static const uint8_t kInstall[] = {
+    CLA_BYTE, INSTAL_LOAD_ID, PARAM_P1_OFFSET, 0x00, 0x0C, 0x07,
+    0xA0,     0x00,           0x00,            0x03, 0x96, 0x54,
+    0x43,     0x00,           0x00,            0x00, 0x00};
+
+static Lsc_ImageInfo_t gImage;
+static Lsc_TranscieveInfo_t gTransceive;
+
+static bool openEse() {
+  phNxpEse_initParams initParams;
+  memset(&initParams, 0x00, sizeof(initParams));
+  initParams.initMode = ESE_MODE_NORMAL;
+  return phNxpEse_open(initParams) == ESESTATUS_SUCCESS &&
+         phNxpEse_init(initParams) == ESESTATUS_SUCCESS;
+}
+
+static void closeEse() {
+  phNxpEse_deInit();
+  phNxpEse_close();
+}
+
+/* LS applet response carrying cmd, as the engine gets it from A2 */
+static void queueAppletCommand(std::vector<uint8_t> cmd) {
+  cmd.push_back(0x63);
+  cmd.push_back(0x10);
+  FakeEse_QueueResponse(cmd.data(), cmd.size(), 0);
+}
+
+static std::vector<uint8_t> loadBlock(uint8_t p2, bool last) {
+  uint8_t p1 = last ? LOAD_LAST_BLOCK : LOAD_MORE_BLOCKS;
+  std::vector<uint8_t> cmd = {CLA_BYTE, LOAD_CMD_ID, p1, p2, kBlockLen};
+  for (uint8_t i = 0; i < kBlockLen; i++) cmd.push_back((uint8_t)(p2 + i));
+  return cmd;
+}
+
+static void queueCardSw(uint8_t sw1, uint8_t sw2) {
+  const uint8_t sw[] = {sw1, sw2};
+  FakeEse_QueueResponse(sw, sizeof(sw), 0);
+}
+
+/* Hands INSTALL [for load] to the engine, as if the LS applet had sent it,
+ * and returns the status of the whole exchange */
+static LSCSTATUS runLoad() {
+  memset(&gImage, 0x00, sizeof(gImage));
+  gImage.bytes_wrote = 0x55; /* no response file */
+  gImage.script.record = 1;
+  memcpy(gTransceive.sSendData, kInstall, sizeof(kInstall));
+  gTransceive.sSendlength = sizeof(kInstall);
+  return LSC_SendtoEse(&gImage, LSCSTATUS_SUCCESS, &gTransceive);
+}
+
+/* Runs the load the applet hands out, queueing the card responses given
+ * for the drain, and checks its status and the APDUs the card received */
+static void runScenario(benchmark::State& state, int blocks, int gapAt,
+                        int failAt, LSCSTATUS expected) {
+  if (!openEse()) {
+    state.SkipWithError("cannot open the eSE");
+    return;
+  }
+  uint64_t apdus = 0;
+  size_t bytes = 0;
+  for (auto _ : state) {
+    state.PauseTiming();
+    /* A2 of INSTALL, then of each block but the last or the gap */
+    int handedOut = (gapAt >= 0) ? gapAt + 1 : blocks;
+    bytes = sizeof(kInstall);
+    for (int p2 = 0; p2 < handedOut; p2++) {
+      uint8_t sentP2 = (p2 == gapAt) ? p2 + 1 : p2;
+      queueAppletCommand(loadBlock(sentP2, p2 == blocks - 1));
+      bytes += 5 + kBlockLen;
+    }
+    uint64_t expectedApdus = handedOut;
+    if (gapAt < 0) {
+      /* INSTALL and the blocks up to the failing one, then A2 of the last
+       * response, which gets the generated 9000 */
+      int sent = (failAt >= 0) ? failAt + 2 : blocks + 1;
+      for (int i = 0; i < sent - 1; i++) queueCardSw(0x90, 0x00);
+      if (failAt >= 0) queueCardSw(0x6A, 0x80);
+      expectedApdus += sent + 1;
+    }
+    FakeEse_ResetCounters();
+    state.ResumeTiming();
+
+    LSCSTATUS status = runLoad();
+
+    state.PauseTiming();
+    FakeEse_Counters_t counters;
+    FakeEse_GetCounters(&counters);
+    apdus = counters.apdus;
+    state.ResumeTiming();
+    if (status != expected || apdus != expectedApdus) {
+      state.SkipWithError("unexpected status or APDU count");
+      break;
+    }
+  }
+  closeEse();
+  state.counters["apdus"] = apdus;
+  state.counters["bytes"] = bytes;
+}
+
+static void BM_Load(benchmark::State& state) {
+  runScenario(state, state.range(0), -1, -1, LSCSTATUS_SUCCESS);
+}
+BENCHMARK(BM_Load)
+    ->Arg(LS_LOAD_QUEUE_SLOTS - 1)
+    ->Arg(3 * LS_LOAD_QUEUE_SLOTS)
+    ->Arg(LS_LOAD_QUEUE_MAX - 1);
+
+/* The failing response is forwarded to the applet, which accepts it */
+static void BM_LoadFail(benchmark::State& state) {
+  runScenario(state, state.range(0), -1, state.range(0) / 2,
+              LSCSTATUS_SUCCESS);
+}
+BENCHMARK(BM_LoadFail)
+    ->Arg(LS_LOAD_QUEUE_SLOTS - 1)
+    ->Arg(3 * LS_LOAD_QUEUE_SLOTS);
+
+/* The out of sequence block aborts the load before any of it is sent */
+static void BM_LoadP2Gap(benchmark::State& state) {
+  runScenario(state, state.range(0), state.range(0) / 2, -1,
+              LSCSTATUS_FAILED);
+}
+BENCHMARK(BM_LoadP2Gap)->Arg(3 * LS_LOAD_QUEUE_SLOTS);
+
+BENCHMARK_MAIN();
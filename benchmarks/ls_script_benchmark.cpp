@@ -0,0 +1,241 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/* Parsing cost of LS scripts. A synthetic script of <KB> kilobytes of text
+ * is written once: a 7F21 certificate, a 60 signature and then 40 command
+ * records of 240 bytes, one record per line like the scripts shipped on
+ * devices. The file stays in the page cache, so the figures are the parser
+ * cost on top of a warm read.
+ *
+ *   BM_ScriptParse/<KB>   LSC_ScriptOpen and LSC_ScriptNextTlv over the file
+ *   BM_ScriptCached/<KB>  the same from the compiled image of the script
+ *   BM_ScriptFscanf/<KB>  the previous parser: fscanf("%2X") per byte
+ *   BM_DecodeHex/<KB>     LSC_ScriptDecodeHex alone on an in-memory buffer
+ *
+ * bytes_per_second is script text per second, records is per iteration.
+ * The first iteration of BM_ScriptCached compiles and stores the image. */
+
+#include <LsScript.h>
+#include <benchmark/benchmark.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+static const size_t kCommandLen = 240;
+
+static void appendHex(std::string& text, const uint8_t* pData, size_t len) {
+  static const char kDigits[] = "0123456789ABCDEF";
+  for (size_t i = 0; i < len; i++) {
+    text += kDigits[pData[i] >> 4];
+    text += kDigits[pData[i] & 0x0F];
+  }
+}
+
+static void appendRecord(std::string& text, std::vector<uint8_t> header,
+                         size_t valueLen, uint8_t seed) {
+  for (size_t i = 0; i < valueLen; i++)
+    header.push_back((uint8_t)(seed + i * 13));
+  appendHex(text, header.data(), header.size());
+  text += '\n';
+}
+
+static std::string syntheticScript(size_t textLen) {
+  std::string text;
+  appendRecord(text, {0x7F, 0x21, 0x81, 0xC8}, 0xC8, 1);
+  appendRecord(text, {0x60, 0x81, 0x80}, 0x80, 2);
+  for (uint8_t seed = 3; text.size() < textLen; seed++) {
+    appendRecord(text, {0x40, 0x82, 0x00, (uint8_t)kCommandLen}, kCommandLen,
+                 seed);
+  }
+  return text;
+}
+
+static std::string scriptPath(size_t kb) {
+  const char* pTmp = getenv("TMPDIR");
+#ifdef __ANDROID__
+  std::string path = pTmp ? pTmp : "/data/local/tmp";
+#else
+  std::string path = pTmp ? pTmp : "/tmp";
+#endif
+  path += "/ls_script_" + std::to_string(kb) + "k.lss";
+  std::string text = syntheticScript(kb * 1024);
+  FILE* fp = fopen(path.c_str(), "w");
+  if (fp == NULL) return std::string();
+  bool ok = fwrite(text.data(), 1, text.size(), fp) == text.size();
+  if (fclose(fp) != 0 || !ok) return std::string();
+  return path;
+}
+
+static void BM_ScriptParse(benchmark::State& state) {
+  std::string path = scriptPath(state.range(0));
+  if (path.empty()) {
+    state.SkipWithError("cannot write the script");
+    return;
+  }
+  uint8_t record[LS_MAX_SCRIPT_RECORD_LEN];
+  size_t textLen = 0, records = 0;
+  for (auto _ : state) {
+    Lsc_Script_t script;
+    if (LSC_ScriptOpen(path.c_str(), &script) != LSCSTATUS_SUCCESS) {
+      state.SkipWithError("LSC_ScriptOpen failed");
+      break;
+    }
+    textLen = script.size;
+    records = 0;
+    int32_t recLen;
+    while (!LSC_ScriptAtEnd(&script)) {
+      if (LSC_ScriptNextTlv(&script, record, sizeof(record), &recLen) !=
+          LSCSTATUS_SUCCESS) {
+        state.SkipWithError("LSC_ScriptNextTlv failed");
+        break;
+      }
+      benchmark::DoNotOptimize(record);
+      records++;
+    }
+    LSC_ScriptClose(&script);
+  }
+  unlink(path.c_str());
+  state.SetBytesProcessed(state.iterations() * textLen);
+  state.counters["records"] = records;
+}
+BENCHMARK(BM_ScriptParse)->Arg(64)->Arg(256)->Arg(512);
+
+static void BM_ScriptCached(benchmark::State& state) {
+  std::string path = scriptPath(state.range(0));
+  if (path.empty()) {
+    state.SkipWithError("cannot write the script");
+    return;
+  }
+  std::string cachePath = path + ".img";
+  const uint8_t hash[LS_SCRIPT_HASH_LEN] = {0x5A};
+  uint8_t record[LS_MAX_SCRIPT_RECORD_LEN];
+  size_t records = 0;
+  unlink(cachePath.c_str());
+  for (auto _ : state) {
+    Lsc_Script_t script;
+    if (LSC_ScriptOpenCached(path.c_str(), cachePath.c_str(), hash,
+                             &script) != LSCSTATUS_SUCCESS) {
+      state.SkipWithError("LSC_ScriptOpenCached failed");
+      break;
+    }
+    records = 0;
+    int32_t recLen;
+    while (!LSC_ScriptAtEnd(&script)) {
+      if (LSC_ScriptNextTlv(&script, record, sizeof(record), &recLen) !=
+          LSCSTATUS_SUCCESS) {
+        state.SkipWithError("LSC_ScriptNextTlv failed");
+        break;
+      }
+      benchmark::DoNotOptimize(record);
+      records++;
+    }
+    LSC_ScriptClose(&script);
+  }
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0)
+    state.SetBytesProcessed(state.iterations() * st.st_size);
+  unlink(cachePath.c_str());
+  unlink(path.c_str());
+  state.counters["records"] = records;
+}
+BENCHMARK(BM_ScriptCached)->Arg(64)->Arg(256)->Arg(512);
+
+/* Reads one record the way LSC_ReadScript did before LSC_ScriptNextTlv */
+static bool fscanfRecord(FILE* fp, uint8_t* pBuf) {
+  unsigned int val;
+  size_t idx = 0;
+  for (int i = 0; i < 2; i++) {
+    if (fscanf(fp, "%2X", &val) != 1) return false;
+    pBuf[idx++] = (uint8_t)val;
+  }
+  size_t lenOff = 1;
+  if (pBuf[0] == 0x7F) {
+    if (fscanf(fp, "%2X", &val) != 1) return false;
+    pBuf[idx++] = (uint8_t)val;
+    lenOff = 2;
+  }
+  size_t len = pBuf[lenOff];
+  if (len & 0x80) {
+    size_t lenBytes = len & 0x0F;
+    len = 0;
+    for (size_t i = 0; i < lenBytes; i++) {
+      if (fscanf(fp, "%2X", &val) != 1) return false;
+      pBuf[idx++] = (uint8_t)val;
+      len = (len << 8) | val;
+    }
+  }
+  for (size_t i = 0; i < len && !feof(fp); i++) {
+    if (fscanf(fp, "%2X", &val) != 1) return false;
+    pBuf[idx++] = (uint8_t)val;
+  }
+  return true;
+}
+
+static void BM_ScriptFscanf(benchmark::State& state) {
+  std::string path = scriptPath(state.range(0));
+  if (path.empty()) {
+    state.SkipWithError("cannot write the script");
+    return;
+  }
+  uint8_t record[LS_MAX_SCRIPT_RECORD_LEN];
+  size_t textLen = 0, records = 0;
+  for (auto _ : state) {
+    FILE* fp = fopen(path.c_str(), "r");
+    if (fp == NULL) {
+      state.SkipWithError("fopen failed");
+      break;
+    }
+    fseek(fp, 0L, SEEK_END);
+    textLen = ftell(fp);
+    fseek(fp, 0L, SEEK_SET);
+    records = 0;
+    while (fscanfRecord(fp, record)) {
+      benchmark::DoNotOptimize(record);
+      records++;
+    }
+    fclose(fp);
+  }
+  unlink(path.c_str());
+  state.SetBytesProcessed(state.iterations() * textLen);
+  state.counters["records"] = records;
+}
+BENCHMARK(BM_ScriptFscanf)->Arg(64)->Arg(256)->Arg(512);
+
+static void BM_DecodeHex(benchmark::State& state) {
+  std::vector<uint8_t> data(state.range(0) * 512);
+  for (size_t i = 0; i < data.size(); i++) data[i] = (uint8_t)(i * 31);
+  std::string text;
+  appendHex(text, data.data(), data.size());
+  for (auto _ : state) {
+    Lsc_Script_t script = {(const uint8_t*)text.data(), text.size(), 0};
+    if (LSC_ScriptDecodeHex(&script, data.data(), data.size()) !=
+        LSCSTATUS_SUCCESS) {
+      state.SkipWithError("LSC_ScriptDecodeHex failed");
+      break;
+    }
+    benchmark::DoNotOptimize(data.data());
+  }
+  state.SetBytesProcessed(state.iterations() * text.size());
+}
+BENCHMARK(BM_DecodeHex)->Arg(64)->Arg(256)->Arg(512);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,244 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/* Replays an APDU trace captured with phNxpEse_TraceStart (see
+ * NXP_ESE_TRACE_FILE) through phNxpEse_Transceive against the simulated
+ * eSE, which answers every recorded C-APDU with its recorded R-APDU after
+ * the recorded eSE think time. Running the same trace on two builds gives
+ * comparable host latency, e.g. with --benchmark_out and the compare.py
+ * tool of Google Benchmark.
+ *
+ *   ese_spi_replay_benchmark [--trace=<file>] [--speed=<factor>]
+ *
+ * Without --trace a synthetic wallet and transit session is captured first,
+ * which also runs the capture path. Failed transceives in the trace are
+ * skipped. BM_Replay/x1 keeps the recorded think time and gaps between
+ * APDUs, BM_Replay/x10 runs both ten times faster, BM_Replay/max drops
+ * them, --speed adds another factor. Gaps above kMaxGapUs, typically
+ * between two sessions, are cut to kMaxGapUs. One iteration is one pass
+ * over the trace. Counters:
+ *   apdus      - APDUs replayed per pass
+ *   host       - mean host time per APDU: transceive time minus SOF polling
+ *   recorded   - the same figure taken from the trace
+ *   mismatches - R-APDUs differing from the recording, per pass */
+
+#include <benchmark/benchmark.h>
+#include <phNxpEse_Api.h>
+#include <phNxpEse_Stats.h>
+#include <phNxpEse_Trace.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "FakeEse.h"
+
+static const uint64_t kMaxGapUs = 100000;
+
+static phNxpEse_TraceReader_t gReader;
+
+/* One APDU of the synthetic session */
+struct SyntheticApdu {
+  std::vector<uint8_t> cmd;
+  uint32_t rspLen; /* data bytes before SW 9000 */
+  uint32_t thinkUs;
+  uint32_t gapUs; /* idle time before the C-APDU */
+};
+
+static std::vector<SyntheticApdu> syntheticSession() {
+  std::vector<uint8_t> ppse = {0x00, 0xA4, 0x04, 0x00, 0x0E, '2', 'P', 'A',
+                               'Y',  '.',  'S',  'Y',  'S',  '.', 'D', 'D',
+                               'F',  '0',  '1',  0x00};
+  std::vector<uint8_t> genAc = {0x80, 0xAE, 0x80, 0x00, 0x1D};
+  genAc.resize(genAc.size() + 0x1D, 0x5A);
+  genAc.push_back(0x00);
+  std::vector<uint8_t> update = {0x00, 0xD6, 0x00, 0x00, 0x20};
+  update.resize(update.size() + 0x20, 0xA5);
+
+  std::vector<SyntheticApdu> session = {
+      /* payment tap */
+      {ppse, 60, 1800, 0},
+      {{0x00, 0xA4, 0x04, 0x00, 0x07, 0xA0, 0x00, 0x00, 0x00, 0x04, 0x10,
+        0x10, 0x00},
+       80, 1500, 300},
+      {{0x80, 0xA8, 0x00, 0x00, 0x02, 0x83, 0x00, 0x00}, 40, 4500, 300},
+      {{0x00, 0xB2, 0x01, 0x14, 0x00}, 180, 900, 300},
+      {{0x00, 0xB2, 0x02, 0x14, 0x00}, 180, 900, 300},
+      {{0x00, 0xB2, 0x01, 0x1C, 0x00}, 180, 900, 300},
+      {genAc, 32, 12000, 300},
+      /* transit gate, next session */
+      {{0x00, 0xA4, 0x04, 0x00, 0x08, 0xA0, 0x00, 0x00, 0x01, 0x51, 0x00,
+        0x00, 0x00},
+       20, 1200, 50000},
+      {{0x00, 0xB0, 0x00, 0x00, 0x00}, 256, 2500, 300},
+      {{0x00, 0xB0, 0x01, 0x00, 0x00}, 256, 2500, 300},
+      {{0x00, 0xB0, 0x02, 0x00, 0x00}, 256, 2500, 300},
+      {{0x00, 0xB0, 0x03, 0x00, 0x00}, 256, 2500, 300},
+      {update, 0, 6000, 300},
+  };
+  return session;
+}
+
+static bool openEse() {
+  phNxpEse_initParams initParams;
+  memset(&initParams, 0x00, sizeof(initParams));
+  initParams.initMode = ESE_MODE_NORMAL;
+  return phNxpEse_open(initParams) == ESESTATUS_SUCCESS &&
+         phNxpEse_init(initParams) == ESESTATUS_SUCCESS;
+}
+
+static void closeEse() {
+  phNxpEse_deInit();
+  phNxpEse_close();
+}
+
+/* Captures the synthetic session into pPath through the real capture path */
+static bool captureSynthetic(const char* pPath) {
+  unlink(pPath);
+  if (!openEse()) return false;
+  if (phNxpEse_TraceStart(pPath) != ESESTATUS_SUCCESS) {
+    closeEse();
+    return false;
+  }
+  bool ok = true;
+  for (const SyntheticApdu& apdu : syntheticSession()) {
+    std::vector<uint8_t> rsp(apdu.rspLen + 2);
+    for (uint32_t i = 0; i < apdu.rspLen; i++) rsp[i] = (uint8_t)(i * 7);
+    rsp[apdu.rspLen] = 0x90;
+    rsp[apdu.rspLen + 1] = 0x00;
+    FakeEse_QueueResponse(rsp.data(), rsp.size(), apdu.thinkUs);
+    usleep(apdu.gapUs);
+
+    std::vector<uint8_t> cmd = apdu.cmd;
+    phNxpEse_data cmdApdu = {(uint32_t)cmd.size(), cmd.data()};
+    phNxpEse_data rspApdu = {0, NULL};
+    if (phNxpEse_Transceive(&cmdApdu, &rspApdu) != ESESTATUS_SUCCESS)
+      ok = false;
+    if (rspApdu.p_data != NULL) phNxpEse_free(rspApdu.p_data);
+  }
+  closeEse(); /* also stops the capture */
+  return ok;
+}
+
+static void BM_Replay(benchmark::State& state, double speed) {
+  if (!openEse()) {
+    state.SkipWithError("eSE open failed");
+    return;
+  }
+  static phNxpEse_StatsSnapshot_t snapshot;
+  uint64_t apdus = 0, mismatches = 0, hostUs = 0, recordedUs = 0;
+  for (auto _ : state) {
+    gReader.offset = sizeof(phNxpEse_TraceHeader_t);
+    phNxpEse_StatsSnapshot(&snapshot, true);
+    uint64_t prevEndUs = 0, transceiveUs = 0;
+    phNxpEse_TraceEntry_t entry;
+    while (phNxpEse_TraceReadNext(&gReader, &entry) == ESESTATUS_SUCCESS) {
+      const phNxpEse_TraceRecord_t* pRec = entry.pRecord;
+      if (pRec->status != ESESTATUS_SUCCESS || pRec->rspLen == 0) continue;
+      if (speed > 0 && prevEndUs != 0 && pRec->startUs > prevEndUs) {
+        uint64_t gapUs = pRec->startUs - prevEndUs;
+        usleep((gapUs < kMaxGapUs ? gapUs : kMaxGapUs) / speed);
+      }
+      prevEndUs = pRec->startUs + pRec->durationUs;
+      FakeEse_QueueResponse(entry.pRsp, pRec->rspLen,
+                            speed > 0 ? pRec->thinkUs / speed : 0);
+
+      std::vector<uint8_t> cmd(entry.pCmd, entry.pCmd + pRec->cmdLen);
+      phNxpEse_data cmdApdu = {pRec->cmdLen, cmd.data()};
+      phNxpEse_data rspApdu = {0, NULL};
+      uint64_t startUs = phNxpEse_StatsNowUs();
+      ESESTATUS status = phNxpEse_Transceive(&cmdApdu, &rspApdu);
+      transceiveUs += phNxpEse_StatsNowUs() - startUs;
+
+      if (status != ESESTATUS_SUCCESS || rspApdu.len != pRec->rspLen ||
+          memcmp(rspApdu.p_data, entry.pRsp, pRec->rspLen) != 0) {
+        mismatches++;
+      }
+      if (rspApdu.p_data != NULL) phNxpEse_free(rspApdu.p_data);
+      apdus++;
+      recordedUs += pRec->durationUs - pRec->thinkUs;
+    }
+    phNxpEse_StatsSnapshot(&snapshot, true);
+    hostUs += transceiveUs - snapshot.hist[PH_ESE_STAT_SOF_POLL].sum;
+  }
+  closeEse();
+
+  state.counters["apdus"] =
+      benchmark::Counter(apdus, benchmark::Counter::kAvgIterations);
+  state.counters["mismatches"] =
+      benchmark::Counter(mismatches, benchmark::Counter::kAvgIterations);
+  if (apdus != 0) {
+    state.counters["host"] = (double)hostUs / apdus;
+    state.counters["recorded"] = (double)recordedUs / apdus;
+  }
+}
+
+static void registerReplay(const std::string& name, double speed) {
+  benchmark::RegisterBenchmark(("BM_Replay/" + name).c_str(), BM_Replay,
+                               speed)
+      ->UseRealTime()
+      ->Unit(benchmark::kMillisecond);
+}
+
+int main(int argc, char** argv) {
+  const char* kTraceFlag = "--trace=";
+  const char* kSpeedFlag = "--speed=";
+  std::string tracePath;
+  int kept = 1;
+  for (int i = 1; i < argc; i++) {
+    if (!strncmp(argv[i], kTraceFlag, strlen(kTraceFlag))) {
+      tracePath = argv[i] + strlen(kTraceFlag);
+    } else if (!strncmp(argv[i], kSpeedFlag, strlen(kSpeedFlag))) {
+      const char* pSpeed = argv[i] + strlen(kSpeedFlag);
+      registerReplay(std::string("x") + pSpeed, atof(pSpeed));
+    } else {
+      argv[kept++] = argv[i];
+    }
+  }
+  argc = kept;
+  registerReplay("x1", 1);
+  registerReplay("x10", 10);
+  registerReplay("max", 0);
+
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+
+  if (tracePath.empty()) {
+    const char* pTmp = getenv("TMPDIR");
+#ifdef __ANDROID__
+    tracePath = pTmp ? pTmp : "/data/local/tmp";
+#else
+    tracePath = pTmp ? pTmp : "/tmp";
+#endif
+    tracePath += "/ese_replay_synthetic.trace";
+    if (!captureSynthetic(tracePath.c_str())) {
+      fprintf(stderr, "capturing the synthetic session failed\n");
+      return 1;
+    }
+  }
+  if (phNxpEse_TraceOpen(tracePath.c_str(), &gReader) != ESESTATUS_SUCCESS) {
+    fprintf(stderr, "cannot read trace %s\n", tracePath.c_str());
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  phNxpEse_TraceClose(&gReader);
+  return 0;
+}
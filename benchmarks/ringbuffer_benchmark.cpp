@@ -0,0 +1,144 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/* Compares the locked ringbuffer_t with the lock-free SPSC variant, both
+ * single threaded and with a producer and a consumer thread. Chunk sizes
+ * cover a flight recorder record (24), a short frame (64) and a full
+ * 258-byte T=1 frame. */
+
+#include <benchmark/benchmark.h>
+#include <string.h>
+#include <sys/types.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "ringbuffer.h"
+
+static const size_t kRingSize = 16 * 1024;
+static const size_t kMaxChunk = 512;
+
+static void BM_RingbufferInsertPop(benchmark::State& state) {
+  const size_t chunk = state.range(0);
+  uint8_t in[kMaxChunk] = {0x5A}, out[kMaxChunk];
+  ringbuffer_t* rb = ringbuffer_init(kRingSize);
+  for (auto _ : state) {
+    ringbuffer_insert(rb, in, chunk);
+    benchmark::DoNotOptimize(ringbuffer_pop(rb, out, chunk));
+  }
+  state.SetBytesProcessed(state.iterations() * chunk);
+  ringbuffer_free(rb);
+}
+BENCHMARK(BM_RingbufferInsertPop)->Arg(24)->Arg(64)->Arg(258);
+
+static void BM_SpscInsertPop(benchmark::State& state) {
+  const size_t chunk = state.range(0);
+  uint8_t in[kMaxChunk] = {0x5A}, out[kMaxChunk];
+  ringbuffer_spsc_t* rb = ringbuffer_spsc_init(kRingSize);
+  for (auto _ : state) {
+    ringbuffer_spsc_insert(rb, in, chunk);
+    benchmark::DoNotOptimize(ringbuffer_spsc_pop(rb, out, chunk));
+  }
+  state.SetBytesProcessed(state.iterations() * chunk);
+  ringbuffer_spsc_free(rb);
+}
+BENCHMARK(BM_SpscInsertPop)->Arg(24)->Arg(64)->Arg(258);
+
+static void BM_SpscReserveCommit(benchmark::State& state) {
+  const size_t chunk = state.range(0);
+  ringbuffer_spsc_t* rb = ringbuffer_spsc_init(kRingSize);
+  for (auto _ : state) {
+    uint8_t* p;
+    size_t n = ringbuffer_spsc_reserve(rb, &p, chunk);
+    if (n < chunk) {
+      /* Span hits the end of the ring, drop it and start over at the base */
+      ringbuffer_spsc_commit(rb, n);
+      ringbuffer_spsc_delete(rb, ringbuffer_spsc_size(rb));
+      n = ringbuffer_spsc_reserve(rb, &p, chunk);
+    }
+    memset(p, 0x5A, n);
+    ringbuffer_spsc_commit(rb, n);
+    const uint8_t* q;
+    benchmark::DoNotOptimize(ringbuffer_spsc_read(rb, &q));
+    ringbuffer_spsc_delete(rb, n);
+  }
+  state.SetBytesProcessed(state.iterations() * chunk);
+  ringbuffer_spsc_free(rb);
+}
+BENCHMARK(BM_SpscReserveCommit)->Arg(24)->Arg(64)->Arg(258);
+
+/* Producer in the benchmark thread, consumer draining in a second thread.
+ * The locked variant guards ringbuffer_t with a mutex as its header
+ * requires. */
+static void BM_RingbufferTwoThreads(benchmark::State& state) {
+  const size_t chunk = state.range(0);
+  uint8_t in[kMaxChunk] = {0x5A};
+  ringbuffer_t* rb = ringbuffer_init(kRingSize);
+  std::mutex lock;
+  bool done = false;
+  std::thread consumer([&] {
+    uint8_t out[kMaxChunk];
+    for (;;) {
+      std::lock_guard<std::mutex> guard(lock);
+      if (ringbuffer_pop(rb, out, sizeof(out)) == 0 && done) break;
+    }
+  });
+  for (auto _ : state) {
+    size_t sent = 0;
+    while (sent == 0) {
+      std::lock_guard<std::mutex> guard(lock);
+      sent = ringbuffer_insert(rb, in, chunk);
+    }
+  }
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    done = true;
+  }
+  consumer.join();
+  state.SetBytesProcessed(state.iterations() * chunk);
+  ringbuffer_free(rb);
+}
+BENCHMARK(BM_RingbufferTwoThreads)->Arg(24)->Arg(258)->UseRealTime();
+
+static void BM_SpscTwoThreads(benchmark::State& state) {
+  const size_t chunk = state.range(0);
+  uint8_t in[kMaxChunk] = {0x5A};
+  ringbuffer_spsc_t* rb = ringbuffer_spsc_init(kRingSize);
+  std::atomic<bool> done(false);
+  std::thread consumer([&] {
+    uint8_t out[kMaxChunk];
+    for (;;) {
+      if (ringbuffer_spsc_pop(rb, out, sizeof(out)) == 0 &&
+          done.load(std::memory_order_acquire) &&
+          ringbuffer_spsc_size(rb) == 0)
+        break;
+    }
+  });
+  for (auto _ : state) {
+    while (ringbuffer_spsc_available(rb) < chunk) {
+    }
+    ringbuffer_spsc_insert(rb, in, chunk);
+  }
+  done.store(true, std::memory_order_release);
+  consumer.join();
+  state.SetBytesProcessed(state.iterations() * chunk);
+  ringbuffer_spsc_free(rb);
+}
+BENCHMARK(BM_SpscTwoThreads)->Arg(24)->Arg(258)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -0,0 +1,211 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/* Soak test of SecureElement with N concurrent OMAPI-like clients, called
+ * in-process the way binder threads call it, on top of the simulated eSE.
+ * Each client repeats a session of openLogicalChannel, kApdusPerSession
+ * transmits on that channel and closeChannel. The eSE takes kThinkUs per
+ * APDU, so clients overlap the way real applets make them.
+ *
+ * BM_Soak/<clients> runs kSessions sessions per client per iteration.
+ * Counters, per iteration unless noted:
+ *   apdus       - transmits answered with a status word (also as a rate)
+ *   p50, p99    - transmit latency over all clients, us
+ *   p99_worst   - highest per-client p99, us
+ *   max         - slowest transmit, us
+ *   busy        - transmits rejected with an empty response, mostly
+ *                 ESESTATUS_BUSY from a transceive already in progress
+ *   no_channel  - openLogicalChannel answered CHANNEL_NOT_AVAILABLE
+ *   open_fail   - openLogicalChannel failed otherwise
+ *   close_fail  - closeChannel failed for a channel the client held
+ *   anomalies   - channel table errors: a channel handed to two clients,
+ *                 an APDU the eSE saw on a closed channel, the eSE closed
+ *                 while a client held a channel, or left open after all
+ *                 clients closed theirs */
+
+#include <benchmark/benchmark.h>
+#include <phNxpEse_Api.h>
+#include <phNxpEse_Stats.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "FakeEse.h"
+#include "SecureElement.h"
+
+using ::android::hardware::hidl_vec;
+using ::android::hardware::secure_element::V1_0::LogicalChannelResponse;
+using ::android::hardware::secure_element::V1_0::SecureElementStatus;
+using ::android::hardware::secure_element::V1_0::implementation::SecureElement;
+
+static const uint32_t kSessions = 50;
+static const uint32_t kApdusPerSession = 8;
+static const uint32_t kThinkUs = 500;
+/* The HAL channel table has MAX_LOGICAL_CHANNELS entries, so the eSE must
+ * not hand out more channels than that */
+static const uint32_t kMaxChannels = MAX_LOGICAL_CHANNELS;
+
+struct ClientStats {
+  std::vector<uint32_t> latencyUs;
+  uint64_t apdus = 0;
+  uint64_t busy = 0;
+  uint64_t noChannel = 0;
+  uint64_t openFail = 0;
+  uint64_t closeFail = 0;
+  uint64_t anomalies = 0;
+};
+
+/* Which client holds each channel, -1 if none. A channel handed out while
+ * another client still holds it is an anomaly of the HAL channel table. */
+static std::atomic<int> gChannelOwner[kMaxChannels];
+
+static uint8_t channelCla(uint8_t channel) {
+  return (channel < 4) ? channel : (0x40 | (channel - 4));
+}
+
+static uint32_t percentile(std::vector<uint32_t>& samples, double p) {
+  if (samples.empty()) return 0;
+  size_t rank = (size_t)(p * (samples.size() - 1));
+  std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+  return samples[rank];
+}
+
+static void runClient(SecureElement* pSe, int id, ClientStats* pStats) {
+  const hidl_vec<uint8_t> aid = {0xA0, 0x00, 0x00, 0x01, 0x51,
+                                 0x00, 0x00, 0x00, (uint8_t)id};
+  for (uint32_t session = 0; session < kSessions; session++) {
+    uint8_t channel = 0xFF;
+    SecureElementStatus status = SecureElementStatus::FAILED;
+    pSe->openLogicalChannel(
+        aid, 0x00,
+        [&](const LogicalChannelResponse& rsp, SecureElementStatus st) {
+          channel = rsp.channelNumber;
+          status = st;
+        });
+    if (status == SecureElementStatus::CHANNEL_NOT_AVAILABLE) {
+      pStats->noChannel++;
+      std::this_thread::yield();
+      continue;
+    }
+    if (status != SecureElementStatus::SUCCESS || channel >= kMaxChannels) {
+      pStats->openFail++;
+      continue;
+    }
+    int owner = -1;
+    if (!gChannelOwner[channel].compare_exchange_strong(owner, id))
+      pStats->anomalies++;
+
+    for (uint32_t i = 0; i < kApdusPerSession; i++) {
+      hidl_vec<uint8_t> cmd = {channelCla(channel), 0xCA, 0x00, 0xFE, 0x00};
+      hidl_vec<uint8_t> rsp;
+      uint64_t startUs = phNxpEse_StatsNowUs();
+      pSe->transmit(cmd, [&](const hidl_vec<uint8_t>& result) {
+        rsp = result;
+      });
+      pStats->latencyUs.push_back(phNxpEse_StatsNowUs() - startUs);
+      if (rsp.size() < 2) {
+        pStats->busy++;
+        if (!phNxpEse_isOpen()) pStats->anomalies++;
+      } else {
+        pStats->apdus++;
+      }
+    }
+
+    owner = id;
+    gChannelOwner[channel].compare_exchange_strong(owner, -1);
+    if (pSe->closeChannel(channel) != SecureElementStatus::SUCCESS)
+      pStats->closeFail++;
+  }
+}
+
+static void BM_Soak(benchmark::State& state) {
+  int clients = state.range(0);
+  FakeEse_SetResponseLen(32);
+  FakeEse_SetThinkTime(kThinkUs);
+  FakeEse_SetLogicalChannels(kMaxChannels - 1);
+  android::sp<SecureElement> se = new SecureElement();
+
+  std::vector<uint32_t> all;
+  uint64_t apdus = 0, busy = 0, noChannel = 0, openFail = 0, closeFail = 0;
+  uint64_t anomalies = 0;
+  uint32_t worstP99 = 0;
+  for (auto _ : state) {
+    FakeEse_Counters_t before, after;
+    FakeEse_GetCounters(&before);
+    for (uint32_t ch = 0; ch < kMaxChannels; ch++) gChannelOwner[ch] = -1;
+
+    std::vector<ClientStats> stats(clients);
+    std::vector<std::thread> threads;
+    for (int id = 0; id < clients; id++)
+      threads.emplace_back(runClient, se.get(), id, &stats[id]);
+    for (std::thread& thread : threads) thread.join();
+
+    state.PauseTiming();
+    FakeEse_GetCounters(&after);
+    anomalies += after.closedChApdus - before.closedChApdus;
+    if (phNxpEse_isOpen()) {
+      anomalies++;
+      phNxpEse_deInit();
+      phNxpEse_close();
+    }
+    for (ClientStats& client : stats) {
+      worstP99 = std::max(worstP99, percentile(client.latencyUs, 0.99));
+      all.insert(all.end(), client.latencyUs.begin(), client.latencyUs.end());
+      apdus += client.apdus;
+      busy += client.busy;
+      noChannel += client.noChannel;
+      openFail += client.openFail;
+      closeFail += client.closeFail;
+      anomalies += client.anomalies;
+    }
+    state.ResumeTiming();
+  }
+
+  state.counters["apdu_rate"] =
+      benchmark::Counter(apdus, benchmark::Counter::kIsRate);
+  state.counters["apdus"] =
+      benchmark::Counter(apdus, benchmark::Counter::kAvgIterations);
+  state.counters["busy"] =
+      benchmark::Counter(busy, benchmark::Counter::kAvgIterations);
+  state.counters["no_channel"] =
+      benchmark::Counter(noChannel, benchmark::Counter::kAvgIterations);
+  state.counters["open_fail"] =
+      benchmark::Counter(openFail, benchmark::Counter::kAvgIterations);
+  state.counters["close_fail"] =
+      benchmark::Counter(closeFail, benchmark::Counter::kAvgIterations);
+  state.counters["anomalies"] =
+      benchmark::Counter(anomalies, benchmark::Counter::kAvgIterations);
+  state.counters["p99_worst"] = worstP99;
+  state.counters["max"] = all.empty() ? 0 : *std::max_element(all.begin(),
+                                                              all.end());
+  state.counters["p99"] = percentile(all, 0.99);
+  state.counters["p50"] = percentile(all, 0.50);
+}
+BENCHMARK(BM_Soak)
+    ->Arg(1)
+    ->Arg(2)
+    ->Arg(4)
+    ->Arg(8)
+    ->Iterations(3)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
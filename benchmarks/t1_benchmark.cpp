@@ -0,0 +1,162 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/* Runs the T=1 engine (phNxpEse_Api, phNxpEseProto7816_3, phNxpEseDataMgr)
+ * against the simulated eSE in benchmarks/fake. The PAL costs next to
+ * nothing, so the numbers are host CPU spent by the library itself.
+ *
+ * BM_TransceiveCommand sends an N-byte C-APDU and gets SW 9000 back: the
+ * host builds full I-frames and only decodes 4-byte R-frames, so its
+ * per-frame cost is the encode cost. BM_TransceiveResponse sends a 5-byte
+ * C-APDU and gets N bytes back: the host decodes and reassembles full
+ * I-frames and only builds R-frames, so its per-frame cost is the decode
+ * cost. Counters:
+ *   frames     - frames exchanged per APDU, both directions
+ *   allocs     - malloc/calloc calls made by the library per APDU
+ *   frame_time - host CPU time per frame
+ *
+ * BM_GetDataCached/<rule> sends GET DATA CPLC through the response cache to
+ * an eSE taking kThinkUs per APDU, without (0) and with (1) a cache rule for
+ * it. hit_rate is the share of APDUs answered by the cache. */
+
+#include <benchmark/benchmark.h>
+#include <phNxpEse_Api.h>
+#include <phNxpEse_Cache.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "FakeEse.h"
+
+/* The target links with --wrap=malloc and --wrap=calloc, so every
+ * allocation made by the library sources lands here. */
+static uint64_t gAllocs = 0;
+
+extern "C" void* __real_malloc(size_t size);
+extern "C" void* __real_calloc(size_t nmemb, size_t size);
+
+extern "C" void* __wrap_malloc(size_t size) {
+  gAllocs++;
+  return __real_malloc(size);
+}
+
+extern "C" void* __wrap_calloc(size_t nmemb, size_t size) {
+  gAllocs++;
+  return __real_calloc(nmemb, size);
+}
+
+static bool openEse(benchmark::State& state) {
+  phNxpEse_initParams initParams;
+  memset(&initParams, 0x00, sizeof(initParams));
+  initParams.initMode = ESE_MODE_NORMAL;
+  if (phNxpEse_open(initParams) != ESESTATUS_SUCCESS ||
+      phNxpEse_init(initParams) != ESESTATUS_SUCCESS) {
+    state.SkipWithError("eSE open failed");
+    return false;
+  }
+  return true;
+}
+
+static void closeEse() {
+  phNxpEse_deInit();
+  phNxpEse_close();
+}
+
+static void runTransceive(benchmark::State& state, uint32_t cmdLen,
+                          uint32_t rspLen) {
+  std::vector<uint8_t> cmd(cmdLen);
+  for (uint32_t i = 0; i < cmdLen; i++) cmd[i] = (uint8_t)i;
+  cmd[0] = 0x80; /* CLA, INS 0xCA: GET DATA */
+  cmd[1] = 0xCA;
+
+  FakeEse_SetResponseLen(rspLen);
+  if (!openEse(state)) return;
+  FakeEse_ResetCounters();
+  uint64_t allocs = gAllocs;
+
+  for (auto _ : state) {
+    phNxpEse_data cmdApdu = {cmdLen, cmd.data()};
+    phNxpEse_data rspApdu = {0, NULL};
+    if (phNxpEse_Transceive(&cmdApdu, &rspApdu) != ESESTATUS_SUCCESS ||
+        rspApdu.len != rspLen + 2) {
+      state.SkipWithError("transceive failed");
+      break;
+    }
+    phNxpEse_free(rspApdu.p_data);
+  }
+
+  FakeEse_Counters_t counters;
+  FakeEse_GetCounters(&counters);
+  uint64_t frames = counters.framesRx + counters.framesTx;
+  state.SetBytesProcessed(state.iterations() * (cmdLen + rspLen + 2));
+  state.counters["frames"] =
+      benchmark::Counter(frames, benchmark::Counter::kAvgIterations);
+  state.counters["allocs"] = benchmark::Counter(
+      gAllocs - allocs, benchmark::Counter::kAvgIterations);
+  state.counters["frame_time"] = benchmark::Counter(
+      frames, benchmark::Counter::kIsRate | benchmark::Counter::kInvert);
+  closeEse();
+}
+
+static void BM_TransceiveCommand(benchmark::State& state) {
+  runTransceive(state, state.range(0), 0);
+}
+BENCHMARK(BM_TransceiveCommand)->RangeMultiplier(4)->Range(5, 64 << 10);
+
+static void BM_TransceiveResponse(benchmark::State& state) {
+  runTransceive(state, 5, state.range(0));
+}
+BENCHMARK(BM_TransceiveResponse)->RangeMultiplier(4)->Range(5, 64 << 10);
+
+static const uint32_t kThinkUs = 500;
+
+static void BM_GetDataCached(benchmark::State& state) {
+  static const uint8_t kRule[] = {0x04, 0x80, 0xCA, 0x9F, 0x7F};
+  static const uint8_t kAid[] = {0xA0, 0x00, 0x00, 0x01, 0x51, 0x00, 0x00};
+  uint8_t cmd[] = {0x80, 0xCA, 0x9F, 0x7F, 0x00};
+
+  FakeEse_SetResponseLen(0x2D);
+  FakeEse_SetThinkTime(kThinkUs);
+  phNxpEse_CacheSetRules(kRule, state.range(0) ? sizeof(kRule) : 0, 0);
+  if (!openEse(state)) return;
+  /* The session started with no channel selected */
+  phNxpEse_CacheSelect(0, kAid, sizeof(kAid));
+  phNxpEse_CacheCounters_t before, after;
+  phNxpEse_CacheGetCounters(&before);
+
+  for (auto _ : state) {
+    phNxpEse_data cmdApdu = {sizeof(cmd), cmd};
+    phNxpEse_data rspApdu = {0, NULL};
+    if (phNxpEse_CacheTransceive(&cmdApdu, &rspApdu) != ESESTATUS_SUCCESS) {
+      state.SkipWithError("transceive failed");
+      break;
+    }
+    phNxpEse_free(rspApdu.p_data);
+  }
+
+  phNxpEse_CacheGetCounters(&after);
+  state.counters["hit_rate"] = benchmark::Counter(
+      after.hits - before.hits, benchmark::Counter::kAvgIterations);
+  closeEse();
+  phNxpEse_CacheSetRules(NULL, 0, 0);
+  FakeEse_SetThinkTime(0);
+}
+BENCHMARK(BM_GetDataCached)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
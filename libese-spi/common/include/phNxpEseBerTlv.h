@@ -0,0 +1,219 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/*
+ * BER-TLV views over APDU and script buffers, used by the HAL for the FCI
+ * of SELECT responses and by the LS client for scripts, certificates and
+ * applet responses. Nothing is copied: an element points into the buffer
+ * it was parsed from, which must outlive it. Tags of up to three bytes and
+ * length fields of up to four bytes (83 XX XX XX) are supported; every
+ * element is checked against the end of its enclosing buffer.
+ */
+
+#ifndef PHNXPESE_BERTLV_H
+#define PHNXPESE_BERTLV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct phNxpEseBerTlv {
+  uint32_t tag;          /* tag bytes, big endian: 0x7F21, 0x9F08, 0x61 */
+  const uint8_t* pStart; /* first byte of the tag */
+  const uint8_t* pValue; /* first byte of the value, NULL if absent */
+  uint32_t len;          /* length of the value */
+} phNxpEseBerTlv_t;
+
+typedef struct phNxpEseBerTlvCursor {
+  const uint8_t* pPos; /* next element */
+  const uint8_t* pEnd; /* end of the enclosing buffer */
+} phNxpEseBerTlvCursor_t;
+
+/* One expected element of a sequence, see phNxpEseBerTlv_Match */
+typedef struct phNxpEseBerTlvDesc {
+  uint32_t tag;
+  uint32_t minLen;
+  uint32_t maxLen;
+  bool optional;
+} phNxpEseBerTlvDesc_t;
+
+/******************************************************************************
+ * Function         phNxpEseBerTlv_Init
+ *
+ * Description      Positions pCursor on the first element of len bytes at p.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static inline void phNxpEseBerTlv_Init(phNxpEseBerTlvCursor_t* pCursor,
+                                       const uint8_t* p, size_t len) {
+  pCursor->pPos = p;
+  pCursor->pEnd = p + len;
+}
+
+/******************************************************************************
+ * Function         phNxpEseBerTlv_AtEnd
+ *
+ * Description      Tells whether all elements of the buffer were consumed.
+ *
+ * Returns          true at the end
+ *
+ ******************************************************************************/
+static inline bool phNxpEseBerTlv_AtEnd(const phNxpEseBerTlvCursor_t* pCursor) {
+  return pCursor->pPos >= pCursor->pEnd;
+}
+
+/******************************************************************************
+ * Function         phNxpEseBerTlv_Size
+ *
+ * Description      Size of the whole element: tag, length field and value.
+ *
+ * Returns          Size in bytes
+ *
+ ******************************************************************************/
+static inline size_t phNxpEseBerTlv_Size(const phNxpEseBerTlv_t* pTlv) {
+  return (size_t)(pTlv->pValue - pTlv->pStart) + pTlv->len;
+}
+
+/******************************************************************************
+ * Function         phNxpEseBerTlv_Next
+ *
+ * Description      Decodes the element at the cursor into pTlv and moves the
+ *                  cursor past it. The cursor is left alone on failure.
+ *
+ * Returns          true if a complete element was decoded
+ *
+ ******************************************************************************/
+static inline bool phNxpEseBerTlv_Next(phNxpEseBerTlvCursor_t* pCursor,
+                                       phNxpEseBerTlv_t* pTlv) {
+  const uint8_t* p = pCursor->pPos;
+  const uint8_t* pEnd = pCursor->pEnd;
+  if (p >= pEnd) return false;
+
+  /* Tag: a low five bits of 1F announce more tag bytes, each with bit 8 set
+   * but the last one */
+  uint32_t tag = *p++;
+  if ((tag & 0x1F) == 0x1F) {
+    int more = 0;
+    do {
+      if (p >= pEnd || ++more > 2) return false;
+      tag = (tag << 8) | *p;
+    } while (*p++ & 0x80);
+  }
+
+  /* Length: short form, or 81 to 83 followed by that many bytes */
+  if (p >= pEnd) return false;
+  uint32_t len = *p++;
+  if (len & 0x80) {
+    uint32_t count = len & 0x7F;
+    if (count == 0 || count > 3 || (size_t)(pEnd - p) < count) return false;
+    len = 0;
+    while (count-- > 0) len = (len << 8) | *p++;
+  }
+  if ((size_t)(pEnd - p) < len) return false;
+
+  pTlv->tag = tag;
+  pTlv->pStart = pCursor->pPos;
+  pTlv->pValue = p;
+  pTlv->len = len;
+  pCursor->pPos = p + len;
+  return true;
+}
+
+/******************************************************************************
+ * Function         phNxpEseBerTlv_Enter
+ *
+ * Description      Positions pCursor on the first element nested in the value
+ *                  of a constructed element.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static inline void phNxpEseBerTlv_Enter(const phNxpEseBerTlv_t* pTlv,
+                                        phNxpEseBerTlvCursor_t* pCursor) {
+  phNxpEseBerTlv_Init(pCursor, pTlv->pValue, pTlv->len);
+}
+
+/******************************************************************************
+ * Function         phNxpEseBerTlv_Match
+ *
+ * Description      Walks the elements at the cursor once against count
+ *                  descriptors in order. A matching element is stored in the
+ *                  pTlv entry of its descriptor; a missing optional one gets a
+ *                  NULL pValue. Elements after the last descriptor are left to
+ *                  the caller.
+ *
+ * Returns          true if every mandatory element was found in order with a
+ *                  length within its bounds
+ *
+ ******************************************************************************/
+static inline bool phNxpEseBerTlv_Match(phNxpEseBerTlvCursor_t* pCursor,
+                                        const phNxpEseBerTlvDesc_t* pDesc,
+                                        size_t count, phNxpEseBerTlv_t* pTlv) {
+  for (size_t i = 0; i < count; i++) {
+    phNxpEseBerTlvCursor_t peek = *pCursor;
+    phNxpEseBerTlv_t tlv;
+    if (phNxpEseBerTlv_Next(&peek, &tlv) && tlv.tag == pDesc[i].tag) {
+      if (tlv.len < pDesc[i].minLen || tlv.len > pDesc[i].maxLen) return false;
+      pTlv[i] = tlv;
+      *pCursor = peek;
+    } else if (pDesc[i].optional) {
+      pTlv[i].tag = pDesc[i].tag;
+      pTlv[i].pStart = NULL;
+      pTlv[i].pValue = NULL;
+      pTlv[i].len = 0;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+/******************************************************************************
+ * Function         phNxpEseBerTlv_PutHeader
+ *
+ * Description      Writes the tag and the shortest length field for a value
+ *                  of len bytes to pOut, which holds at least 7 bytes.
+ *
+ * Returns          Number of bytes written
+ *
+ ******************************************************************************/
+static inline size_t phNxpEseBerTlv_PutHeader(uint32_t tag, uint32_t len,
+                                              uint8_t* pOut) {
+  size_t n = 0;
+  if (tag > 0xFFFF) pOut[n++] = (uint8_t)(tag >> 16);
+  if (tag > 0xFF) pOut[n++] = (uint8_t)(tag >> 8);
+  pOut[n++] = (uint8_t)tag;
+  if (len < 0x80) {
+    pOut[n++] = (uint8_t)len;
+  } else if (len <= 0xFF) {
+    pOut[n++] = 0x81;
+    pOut[n++] = (uint8_t)len;
+  } else if (len <= 0xFFFF) {
+    pOut[n++] = 0x82;
+    pOut[n++] = (uint8_t)(len >> 8);
+    pOut[n++] = (uint8_t)len;
+  } else {
+    pOut[n++] = 0x83;
+    pOut[n++] = (uint8_t)(len >> 16);
+    pOut[n++] = (uint8_t)(len >> 8);
+    pOut[n++] = (uint8_t)len;
+  }
+  return n;
+}
+
+#endif /* PHNXPESE_BERTLV_H */
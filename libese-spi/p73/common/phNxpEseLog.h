@@ -0,0 +1,57 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/*
+ * NXP ESE build time log level
+ */
+
+#ifndef NXP_ESE_LOG_H
+#define NXP_ESE_LOG_H
+
+#include <log/log.h>
+
+#define NXP_ESE_LOG_LEVEL_ERROR 1
+#define NXP_ESE_LOG_LEVEL_INFO 2
+#define NXP_ESE_LOG_LEVEL_DEBUG 3
+
+/* Debuggable (eng/userdebug) builds keep debug logs, which are then still
+ * gated at runtime by ese_debug_enabled. Other builds drop them entirely.
+ * NXP_ESE_LOG_LEVEL can be set from the build to override either. */
+#ifndef NXP_ESE_LOG_LEVEL
+#ifdef NXP_ESE_DEBUGGABLE
+#define NXP_ESE_LOG_LEVEL NXP_ESE_LOG_LEVEL_DEBUG
+#else
+#define NXP_ESE_LOG_LEVEL NXP_ESE_LOG_LEVEL_INFO
+#endif
+#endif
+
+extern bool ese_debug_enabled;
+
+/* Below the build level the call stays visible to the compiler, so format
+ * arguments are still type checked and variables only used for logging do
+ * not trigger unused warnings, but it is removed as dead code. */
+#if (NXP_ESE_LOG_LEVEL >= NXP_ESE_LOG_LEVEL_DEBUG)
+#define NXP_LOG_ESE_D(...) ALOGD_IF(ese_debug_enabled, __VA_ARGS__)
+#else
+#define NXP_LOG_ESE_D(...)         \
+  do {                             \
+    if (false) ALOGD(__VA_ARGS__); \
+  } while (0)
+#endif
+
+#endif /* end of #ifndef NXP_ESE_LOG_H */
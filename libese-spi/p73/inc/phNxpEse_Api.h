@@ -121,6 +121,7 @@ ESESTATUS phNxpEse_open(phNxpEse_initParams initParams);
  *        for timeout period.
  *
  * \retval ESESTATUS_SUCCESS On Success ESESTATUS_SUCCESS else proper error code
+ * \retval ESESTATUS_BUSY If a priority session is already open
  *
  */
 ESESTATUS phNxpEse_openPrioSession(phNxpEse_initParams initParams);
@@ -0,0 +1,127 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/**
+ * \addtogroup spi_libese
+ * \brief Response cache for idempotent APDUs
+ * @{ */
+
+#ifndef _PHNXPSPILIB_CACHE_H_
+#define _PHNXPSPILIB_CACHE_H_
+
+#include <phNxpEse_Api.h>
+#include <phNxpEse_Channel.h>
+
+/*!
+ * \brief Responses kept unless NXP_ESE_CACHE_ENTRIES sets it, and the most
+ *        it may set.
+ */
+#define PH_ESE_CACHE_ENTRIES_DEFAULT 16
+#define PH_ESE_CACHE_MAX_ENTRIES 32
+
+/*!
+ * \brief Largest AID, command and response an entry holds. Longer ones are
+ *        passed through uncached.
+ */
+#define PH_ESE_CACHE_MAX_AID 16
+#define PH_ESE_CACHE_MAX_CMD 32
+#define PH_ESE_CACHE_MAX_RSP 258
+
+/**
+ * \ingroup spi_libese
+ * \brief Copy of the cache counters since the library was loaded
+ */
+typedef struct phNxpEse_CacheCounters {
+  uint64_t hits;    /*!< cacheable APDUs answered from the cache */
+  uint64_t misses;  /*!< cacheable APDUs sent to the eSE */
+  uint64_t flushes; /*!< times the cache was emptied */
+  uint32_t entries; /*!< responses held now */
+} phNxpEse_CacheCounters_t;
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Empties the cache and loads its rules from NXP_ESE_CACHE_APDUS and
+ *         its size from NXP_ESE_CACHE_ENTRIES. Called when a session is
+ *         opened; without rules nothing is cached.
+ *
+ ******************************************************************************/
+void phNxpEse_CacheInit(void);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Empties the cache and replaces its rules: command prefixes, each
+ *         preceded by its length, that the first bytes of a cacheable APDU
+ *         match once the channel is cleared from its class byte. APDUs
+ *         using secure messaging are never cached. Keeps up to entries
+ *         responses, PH_ESE_CACHE_ENTRIES_DEFAULT if 0.
+ *
+ * \retval ESESTATUS_SUCCESS on success, ESESTATUS_INVALID_PARAMETER if the
+ *         rules are malformed, in which case nothing is cached.
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_CacheSetRules(const uint8_t* pRules, uint32_t len,
+                                 uint32_t entries);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Records the AID the HAL selected on channel, which keys the
+ *         responses of its APDUs. A NULL pAid, on close, makes the APDUs of
+ *         the channel uncacheable until the next select.
+ *
+ ******************************************************************************/
+void phNxpEse_CacheSelect(uint8_t channel, const uint8_t* pAid,
+                          uint32_t aidLen);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Drops every cached response. The card may answer differently
+ *         after an interface or chip reset, an LS download or a JCOP update.
+ *
+ ******************************************************************************/
+void phNxpEse_CacheFlush(const char* pReason);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  phNxpEse_SchedTransceive, unless a cacheable APDU was answered
+ *         with SW 9000 before for the AID selected on its channel: then the
+ *         response is copied into a buffer allocated with phNxpEse_memalloc
+ *         without reaching the eSE.
+ *
+ * \retval Status of phNxpEse_SchedTransceive, ESESTATUS_SUCCESS on a hit.
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_CacheTransceive(phNxpEse_data* pCmd, phNxpEse_data* pRsp);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Copies the cache counters into pCounters.
+ *
+ * \retval ESESTATUS_SUCCESS on success, ESESTATUS_INVALID_PARAMETER if
+ *         pCounters is NULL.
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_CacheGetCounters(phNxpEse_CacheCounters_t* pCounters);
+
+/** @} */
+#endif /* _PHNXPSPILIB_CACHE_H_ */
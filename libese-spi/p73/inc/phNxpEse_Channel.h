@@ -0,0 +1,133 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/**
+ * \addtogroup spi_libese
+ * \brief Logical channel table shared by the SE HALs
+ * @{ */
+
+#ifndef _PHNXPSPILIB_CHANNEL_H_
+#define _PHNXPSPILIB_CHANNEL_H_
+
+#include <phEseStatus.h>
+#include <stdint.h>
+
+/*!
+ * \brief Channels a GlobalPlatform card can have: the basic channel, 3
+ *        logical channels and 16 extended logical channels.
+ */
+#define PH_ESE_MAX_CHANNELS 20
+
+/*!
+ * \brief Owner of a channel no client holds
+ */
+#define PH_ESE_CHANNEL_NO_OWNER 0
+
+/**
+ * \ingroup spi_libese
+ * \brief Channels opened on the eSE and the client holding each one. The eSE
+ *        hands out the channel numbers; the table only records them, so every
+ *        operation but phNxpEse_ChannelOwnedMask is O(1). It has no lock of
+ *        its own: the HAL owning it serialises the calls.
+ */
+typedef struct phNxpEse_ChannelTable {
+  uint32_t openMask; /*!< bit n set: channel n is open */
+  uint8_t count;     /*!< number of open channels */
+  uint64_t owner[PH_ESE_MAX_CHANNELS]; /*!< cookie of the client holding it */
+} phNxpEse_ChannelTable_t;
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Marks every channel closed.
+ *
+ ******************************************************************************/
+void phNxpEse_ChannelReset(phNxpEse_ChannelTable_t* pTable);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Records channel, as opened by the eSE, for the client owner.
+ *
+ * \retval ESESTATUS_SUCCESS if recorded, ESESTATUS_INVALID_PARAMETER if the
+ *         number is out of range or the channel is already open.
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_ChannelAdd(phNxpEse_ChannelTable_t* pTable, uint8_t channel,
+                              uint64_t owner);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Marks channel closed.
+ *
+ * \retval ESESTATUS_SUCCESS if it was open, ESESTATUS_INVALID_PARAMETER
+ *         otherwise.
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_ChannelRemove(phNxpEse_ChannelTable_t* pTable,
+                                 uint8_t channel);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Tells whether channel is a valid number and open.
+ *
+ ******************************************************************************/
+bool phNxpEse_ChannelIsOpen(const phNxpEse_ChannelTable_t* pTable,
+                            uint8_t channel);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Returns the channels held by owner, one bit per channel.
+ *
+ ******************************************************************************/
+uint32_t phNxpEse_ChannelOwnedMask(const phNxpEse_ChannelTable_t* pTable,
+                                   uint64_t owner);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Removes the lowest channel from a mask of channels.
+ *
+ * \retval The channel, or PH_ESE_MAX_CHANNELS once the mask is empty.
+ *
+ ******************************************************************************/
+uint8_t phNxpEse_ChannelNext(uint32_t* pMask);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Encodes channel into the class byte cla, in the first interindustry
+ *         form for channels 0 to 3 and the further one above. The
+ *         proprietary and command chaining bits of cla are kept.
+ *
+ ******************************************************************************/
+uint8_t phNxpEse_ChannelCla(uint8_t cla, uint8_t channel);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Returns the channel a class byte addresses.
+ *
+ ******************************************************************************/
+uint8_t phNxpEse_ChannelFromCla(uint8_t cla);
+
+/** @} */
+#endif /* _PHNXPSPILIB_CHANNEL_H_ */
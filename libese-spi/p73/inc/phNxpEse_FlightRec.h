@@ -0,0 +1,104 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/**
+ * \addtogroup spi_libese
+ * \brief ESE Lib frame flight recorder
+ * @{ */
+
+#ifndef _PHNXPSPILIB_FLIGHTREC_H_
+#define _PHNXPSPILIB_FLIGHTREC_H_
+
+#include <phEseStatus.h>
+#include <stdint.h>
+
+/*!
+ * \brief Number of frame records kept, older records are overwritten.
+ */
+#define PH_ESE_FLIGHTREC_RECORDS 256
+/*!
+ * \brief Number of leading frame bytes (NAD, PCB, LEN, INF...) kept per
+ *        record.
+ */
+#define PH_ESE_FLIGHTREC_PREFIX_LEN 8
+
+/**
+ * \ingroup spi_libese
+ * \brief Direction of a recorded frame
+ */
+typedef enum {
+  PH_ESE_FLIGHTREC_TX = 0,  /*!< frame written to eSE */
+  PH_ESE_FLIGHTREC_RX,      /*!< frame read from eSE */
+  PH_ESE_FLIGHTREC_TX_FAIL, /*!< SPI write failed */
+  PH_ESE_FLIGHTREC_RX_FAIL, /*!< SPI read failed or timed out */
+} phNxpEse_FlightRecDir_t;
+
+/**
+ * \ingroup spi_libese
+ * \brief One fixed-size binary frame record
+ */
+typedef struct phNxpEse_FlightRecord {
+  uint64_t timeUs; /*!< phNxpEse_StatsNowUs() when the frame was seen */
+  uint8_t dir;     /*!< phNxpEse_FlightRecDir_t */
+  uint8_t pcb;     /*!< PCB byte, 0 if the frame is shorter */
+  uint16_t len;    /*!< full frame length */
+  uint32_t hash;   /*!< FNV-1a hash of the full frame */
+  uint8_t prefix[PH_ESE_FLIGHTREC_PREFIX_LEN]; /*!< leading frame bytes */
+} phNxpEse_FlightRecord_t;
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Appends one frame to the flight recorder. Always enabled; the cost
+ *         is one hash pass over the frame and a fixed-size copy.
+ *
+ ******************************************************************************/
+void phNxpEse_FlightRecAdd(phNxpEse_FlightRecDir_t dir, const uint8_t* p_data,
+                           uint32_t len);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Logs and removes all records currently held, oldest first, so that
+ *         consecutive dumps do not repeat frames. pReason is printed in the
+ *         dump header.
+ *
+ ******************************************************************************/
+void phNxpEse_FlightRecDump(const char* pReason);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Takes the records for a dump logged later by
+ *         phNxpEse_FlightRecDumpPending, for callers on the APDU path.
+ *         pReason must be a string literal or otherwise outlive the dump.
+ *
+ ******************************************************************************/
+void phNxpEse_FlightRecMarkDump(const char* pReason);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Logs the dump marked by phNxpEse_FlightRecMarkDump, if any.
+ *         Costs one atomic load when none is pending.
+ *
+ ******************************************************************************/
+void phNxpEse_FlightRecDumpPending(void);
+
+/** @} */
+#endif /* _PHNXPSPILIB_FLIGHTREC_H_ */
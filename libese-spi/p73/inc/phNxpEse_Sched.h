@@ -0,0 +1,154 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/**
+ * \addtogroup spi_libese
+ * \brief APDU scheduling between logical channels
+ * @{ */
+
+#ifndef _PHNXPSPILIB_SCHED_H_
+#define _PHNXPSPILIB_SCHED_H_
+
+#include <phNxpEse_Api.h>
+#include <phNxpEse_Channel.h>
+
+/*!
+ * \brief Share of the eSE a channel gets by default, the share of channels
+ *        selecting an AID of NXP_ESE_SCHED_PRIO_AIDS unless
+ *        NXP_ESE_SCHED_PRIO_WEIGHT sets it, and the largest share.
+ */
+#define PH_ESE_SCHED_WEIGHT_DEFAULT 1
+#define PH_ESE_SCHED_WEIGHT_PRIO 4
+#define PH_ESE_SCHED_WEIGHT_MAX 16
+
+/**
+ * \ingroup spi_libese
+ * \brief Class of the APDUs of a channel. Priority APDUs are served in
+ *        arrival order before any normal one, from the next APDU boundary.
+ */
+typedef enum {
+  PH_ESE_SCHED_CLASS_NORMAL = 0, /*!< scheduled by channel weight */
+  PH_ESE_SCHED_CLASS_PRIO,       /*!< overtakes normal APDUs */
+} phNxpEse_SchedClass_t;
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Waits for the turn of channel to use the eSE, in the class of the
+ *         channel. Callers of a channel are served in arrival order.
+ *         Channels with normal callers waiting are served in proportion to
+ *         their weight, lowest virtual time first, so a waiting channel is
+ *         overtaken at most PH_ESE_SCHED_WEIGHT_MAX times by each other
+ *         channel, plus by priority callers.
+ *         Every acquire must be followed by phNxpEse_SchedRelease.
+ *
+ ******************************************************************************/
+void phNxpEse_SchedAcquire(uint8_t channel);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Waits for a turn as a priority caller, whatever the class of
+ *         channel, and even while a priority session holds normal callers.
+ *
+ ******************************************************************************/
+void phNxpEse_SchedAcquirePrio(uint8_t channel);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Ends the turn taken by phNxpEse_SchedAcquire and hands the eSE to
+ *         the next channel.
+ *
+ ******************************************************************************/
+void phNxpEse_SchedRelease(void);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  phNxpEse_Transceive in the turn of the channel named by the class
+ *         byte of pCmd. Unlike phNxpEse_Transceive it never returns
+ *         ESESTATUS_BUSY because another scheduled caller is in progress.
+ *
+ * \retval Status of phNxpEse_Transceive
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_SchedTransceive(phNxpEse_data* pCmd, phNxpEse_data* pRsp);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  phNxpEse_SchedTransceive in a priority turn.
+ *
+ * \retval Status of phNxpEse_Transceive
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_SchedTransceivePrio(phNxpEse_data* pCmd,
+                                       phNxpEse_data* pRsp);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Starts a priority session: once the APDU in progress is answered
+ *         only priority callers are served, until the matching
+ *         phNxpEse_SchedPrioSessionEnd. phNxpEse_openPrioSession starts one
+ *         and phNxpEse_close ends it.
+ *
+ ******************************************************************************/
+void phNxpEse_SchedPrioSessionBegin(void);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Ends a priority session; the normal callers held are served again
+ *         once no session is left.
+ *
+ ******************************************************************************/
+void phNxpEse_SchedPrioSessionEnd(void);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Sets the share of channel, from 1 to PH_ESE_SCHED_WEIGHT_MAX.
+ *
+ ******************************************************************************/
+void phNxpEse_SchedSetWeight(uint8_t channel, uint8_t weight);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Sets the class of channel, PH_ESE_SCHED_CLASS_NORMAL by default.
+ *
+ ******************************************************************************/
+void phNxpEse_SchedSetClass(uint8_t channel, phNxpEse_SchedClass_t schedClass);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Configures channel for the AID it selected. Its weight is
+ *         NXP_ESE_SCHED_PRIO_WEIGHT if the AID is listed in
+ *         NXP_ESE_SCHED_PRIO_AIDS, and its class PH_ESE_SCHED_CLASS_PRIO if
+ *         it is listed in NXP_ESE_SCHED_PREEMPT_AIDS. A NULL pAid restores
+ *         the defaults, as for a closed channel.
+ *
+ ******************************************************************************/
+void phNxpEse_SchedConfigChannel(uint8_t channel, const uint8_t* pAid,
+                                 uint32_t aidLen);
+
+/** @} */
+#endif /* _PHNXPSPILIB_SCHED_H_ */
@@ -0,0 +1,226 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/**
+ * \addtogroup spi_libese
+ * \brief ESE Lib runtime statistics
+ * @{ */
+
+#ifndef _PHNXPSPILIB_STATS_H_
+#define _PHNXPSPILIB_STATS_H_
+
+#include <phEseStatus.h>
+#include <stdint.h>
+
+/**
+ * \ingroup spi_libese
+ * \brief Transceive phases tracked by the latency histograms.
+ *        All values are in microseconds except PH_ESE_STAT_SOF_POLL_COUNT
+ *        which records the number of SOF polls per received frame.
+ */
+typedef enum {
+  PH_ESE_STAT_QUEUE_WAIT = 0, /*!< wait to acquire the SPI transmit lock */
+  PH_ESE_STAT_RF_WAIT,        /*!< wait for RF-OFF in TransceiveProcess */
+  PH_ESE_STAT_SPI_WRITE,      /*!< phPalEse_write of one frame */
+  PH_ESE_STAT_SOF_POLL,       /*!< SOF polling time of one frame */
+  PH_ESE_STAT_SOF_POLL_COUNT, /*!< SOF polls needed for one frame */
+  PH_ESE_STAT_PAYLOAD_READ,   /*!< header and payload read after SOF */
+  PH_ESE_STAT_DECODE,         /*!< LRC check and frame decode */
+  PH_ESE_STAT_REASSEMBLY,     /*!< phNxpEse_GetData of the response */
+  PH_ESE_STAT_TRANSCEIVE,     /*!< complete phNxpEse_Transceive */
+  PH_ESE_STAT_SCHED_WAIT,     /*!< wait for a turn in phNxpEse_SchedAcquire */
+  PH_ESE_STAT_MAX
+} phNxpEse_StatId_t;
+
+/*!
+ * \brief Number of histogram buckets. Values below 8 get one bucket each,
+ *        above that every power of two is split into 8 linear sub-buckets,
+ *        which bounds the relative error to 12.5%.
+ */
+#define PH_ESE_STATS_SUB_BUCKET_BITS 3
+#define PH_ESE_STATS_BUCKETS 256
+
+/**
+ * \ingroup spi_libese
+ * \brief Copy of one histogram taken by phNxpEse_StatsSnapshot
+ */
+typedef struct phNxpEse_Histogram {
+  uint64_t count;                         /*!< number of samples */
+  uint64_t sum;                           /*!< sum of all samples */
+  uint64_t max;                           /*!< largest sample */
+  uint64_t buckets[PH_ESE_STATS_BUCKETS]; /*!< samples per bucket */
+} phNxpEse_Histogram_t;
+
+/**
+ * \ingroup spi_libese
+ * \brief Copy of all phase histograms
+ */
+typedef struct phNxpEse_StatsSnapshot {
+  uint64_t elapsedUs; /*!< time covered since the last reset */
+  phNxpEse_Histogram_t hist[PH_ESE_STAT_MAX];
+} phNxpEse_StatsSnapshot_t;
+
+/**
+ * \ingroup spi_libese
+ * \brief Protocol health events. Each one carries an occurrence count and the
+ *        wall time spent recovering from it: from the first error of a
+ *        recovery sequence until a valid non-error frame is decoded or the
+ *        transceive ends. Time is charged to the event that started the
+ *        sequence; follow-up events in the same sequence are only counted.
+ *        PH_ESE_CNT_CHIP_RESET time covers the whole phNxpEse_chipReset,
+ *        including its nested RESYNCH.
+ */
+typedef enum {
+  PH_ESE_CNT_LRC_FAIL = 0, /*!< received frame with wrong LRC */
+  PH_ESE_CNT_RNACK_SENT,   /*!< R-NACK sent to eSE */
+  PH_ESE_CNT_RNACK_RCVD,   /*!< R-NACK received from eSE */
+  PH_ESE_CNT_RESYNCH,      /*!< S(RESYNCH) request sent */
+  PH_ESE_CNT_INTF_RESET,   /*!< S(INTF RESET) request sent */
+  PH_ESE_CNT_CHIP_RESET,   /*!< phNxpEse_chipReset */
+  PH_ESE_CNT_WTX_REQ,      /*!< S(WTX) request received */
+  PH_ESE_CNT_TIMEOUT,      /*!< no response frame from eSE */
+  PH_ESE_CNT_MAX
+} phNxpEse_CounterId_t;
+
+/**
+ * \ingroup spi_libese
+ * \brief Lifetime of a counter set
+ */
+typedef enum {
+  PH_ESE_COUNTERS_SESSION = 0, /*!< since the last phNxpEse_open */
+  PH_ESE_COUNTERS_BOOT,        /*!< since the library was loaded */
+} phNxpEse_CounterScope_t;
+
+/**
+ * \ingroup spi_libese
+ * \brief Copy of one counter set
+ */
+typedef struct phNxpEse_Counters {
+  uint64_t elapsedUs;   /*!< time covered by the counters */
+  uint64_t transceives; /*!< completed phNxpEse_Transceive calls */
+  uint64_t events[PH_ESE_CNT_MAX];     /*!< occurrences per event */
+  uint64_t recoveryUs[PH_ESE_CNT_MAX]; /*!< recovery time per event */
+} phNxpEse_Counters_t;
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Returns monotonic time in microseconds, used as the time base of
+ *         all statistics.
+ *
+ ******************************************************************************/
+uint64_t phNxpEse_StatsNowUs(void);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Adds one sample to the histogram of the given phase. Lock-free and
+ *         safe to call from any thread.
+ *
+ ******************************************************************************/
+void phNxpEse_StatsRecord(phNxpEse_StatId_t id, uint64_t value);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Copies all phase histograms into pSnapshot, optionally clearing
+ *         them at the same time.
+ *
+ * \retval ESESTATUS_SUCCESS on success, ESESTATUS_INVALID_PARAMETER if
+ *         pSnapshot is NULL.
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_StatsSnapshot(phNxpEse_StatsSnapshot_t* pSnapshot,
+                                 bool reset);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Clears all phase histograms.
+ *
+ ******************************************************************************/
+void phNxpEse_StatsReset(void);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Returns the value at the given percentile (0-100) of a histogram
+ *         copy. The result is the upper bound of the matching bucket.
+ *
+ ******************************************************************************/
+uint64_t phNxpEse_StatsPercentile(const phNxpEse_Histogram_t* pHist,
+                                  uint32_t percentile);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Counts one occurrence of a protocol health event in both the
+ *         session and the boot counters.
+ *
+ ******************************************************************************/
+void phNxpEse_StatsCount(phNxpEse_CounterId_t id);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Charges recovery wall time to a protocol health event.
+ *
+ ******************************************************************************/
+void phNxpEse_StatsRecoveryTime(phNxpEse_CounterId_t id, uint64_t timeUs);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Returns the short name of a protocol health event, as used in
+ *         phNxpEse_StatsDump.
+ *
+ ******************************************************************************/
+const char* phNxpEse_StatsCounterName(phNxpEse_CounterId_t id);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Clears the session counters. Called when a new eSE session is
+ *         opened.
+ *
+ ******************************************************************************/
+void phNxpEse_StatsSessionStart(void);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Copies the session or boot counters into pCounters.
+ *
+ * \retval ESESTATUS_SUCCESS on success, ESESTATUS_INVALID_PARAMETER if
+ *         pCounters is NULL or the scope is unknown.
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_StatsGetCounters(phNxpEse_CounterScope_t scope,
+                                    phNxpEse_Counters_t* pCounters);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Logs count, mean, p50, p90, p99 and max of every phase, followed
+ *         by the session and boot protocol health counters.
+ *
+ ******************************************************************************/
+void phNxpEse_StatsDump(void);
+
+/** @} */
+#endif /* _PHNXPSPILIB_STATS_H_ */
@@ -0,0 +1,169 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+/**
+ * \addtogroup spi_libese
+ * \brief ESE Lib APDU trace capture and reader
+ *
+ * A trace file is a phNxpEse_TraceHeader_t followed by one record per
+ * phNxpEse_Transceive call. Each record is a phNxpEse_TraceRecord_t, then
+ * the C-APDU, then the R-APDU, zero padded to the next multiple of 8 bytes
+ * so that a mapped file can be walked without copying. All fields are in
+ * host byte order.
+ * @{ */
+
+#ifndef _PHNXPSPILIB_TRACE_H_
+#define _PHNXPSPILIB_TRACE_H_
+
+#include <phEseStatus.h>
+#include <phNxpEse_Api.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*!
+ * \brief Trace file magic and format version
+ */
+#define PH_ESE_TRACE_MAGIC "ESETRACE"
+#define PH_ESE_TRACE_VERSION 1
+
+/**
+ * \ingroup spi_libese
+ * \brief Header at offset 0 of a trace file
+ */
+typedef struct phNxpEse_TraceHeader {
+  char magic[8];      /*!< PH_ESE_TRACE_MAGIC, not NUL terminated */
+  uint16_t version;   /*!< PH_ESE_TRACE_VERSION */
+  uint16_t headerLen; /*!< sizeof(phNxpEse_TraceHeader_t) */
+  uint32_t reserved;
+} phNxpEse_TraceHeader_t;
+
+/**
+ * \ingroup spi_libese
+ * \brief Fixed part of one transceive record
+ */
+typedef struct phNxpEse_TraceRecord {
+  uint64_t startUs;    /*!< phNxpEse_StatsNowUs() at transceive start */
+  uint32_t durationUs; /*!< complete phNxpEse_Transceive time */
+  uint32_t thinkUs;    /*!< part of durationUs spent polling for the eSE */
+  uint32_t cmdLen;     /*!< C-APDU length */
+  uint32_t rspLen;     /*!< R-APDU length, 0 if the transceive failed */
+  uint32_t status;     /*!< ESESTATUS returned by the transceive */
+  uint32_t recordLen;  /*!< whole record including payload and padding */
+} phNxpEse_TraceRecord_t;
+
+/**
+ * \ingroup spi_libese
+ * \brief Read position in a mapped trace file
+ */
+typedef struct phNxpEse_TraceReader {
+  const uint8_t* pBase; /*!< start of the mapping */
+  size_t size;          /*!< file size */
+  size_t offset;        /*!< offset of the next record */
+} phNxpEse_TraceReader_t;
+
+/**
+ * \ingroup spi_libese
+ * \brief One record returned by phNxpEse_TraceReadNext, pointing into the
+ *        mapping
+ */
+typedef struct phNxpEse_TraceEntry {
+  const phNxpEse_TraceRecord_t* pRecord;
+  const uint8_t* pCmd; /*!< pRecord->cmdLen bytes */
+  const uint8_t* pRsp; /*!< pRecord->rspLen bytes */
+} phNxpEse_TraceEntry_t;
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Starts appending transceive records to the trace file at pPath,
+ *         creating it if needed. A running capture is stopped first.
+ *         phNxpEse_open starts a capture itself when NXP_ESE_TRACE_FILE is
+ *         set and the build is debuggable.
+ *
+ * \retval ESESTATUS_SUCCESS on success, ESESTATUS_INVALID_PARAMETER if pPath
+ *         is NULL, ESESTATUS_INVALID_FORMAT if the file exists and is not a
+ *         trace file, ESESTATUS_FAILED on an I/O error.
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_TraceStart(const char* pPath);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Stops the capture and closes the trace file.
+ *
+ ******************************************************************************/
+void phNxpEse_TraceStop(void);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Adds timeUs of SOF polling to the think time of the transceive in
+ *         progress. No-op when no capture is running.
+ *
+ ******************************************************************************/
+void phNxpEse_TraceThinkTime(uint64_t timeUs);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Appends the record of one completed phNxpEse_Transceive and
+ *         clears the accumulated think time. No-op when no capture is
+ *         running.
+ *
+ ******************************************************************************/
+void phNxpEse_TraceTransceive(const phNxpEse_data* pCmd,
+                              const phNxpEse_data* pRsp, ESESTATUS status,
+                              uint64_t startUs, uint64_t endUs);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Maps the trace file at pPath read-only and checks its header.
+ *
+ * \retval ESESTATUS_SUCCESS on success, ESESTATUS_INVALID_PARAMETER on NULL
+ *         arguments, ESESTATUS_INVALID_FORMAT if the header does not match,
+ *         ESESTATUS_FAILED on an I/O error.
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_TraceOpen(const char* pPath,
+                             phNxpEse_TraceReader_t* pReader);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Returns the next record of the trace in pEntry.
+ *
+ * \retval ESESTATUS_SUCCESS if a record was returned, ESESTATUS_FAILED at
+ *         the end of the trace, ESESTATUS_INVALID_FORMAT if the next record
+ *         is truncated or inconsistent.
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_TraceReadNext(phNxpEse_TraceReader_t* pReader,
+                                 phNxpEse_TraceEntry_t* pEntry);
+
+/******************************************************************************
+ * \ingroup spi_libese
+ *
+ * \brief  Unmaps a trace opened by phNxpEse_TraceOpen.
+ *
+ ******************************************************************************/
+void phNxpEse_TraceClose(phNxpEse_TraceReader_t* pReader);
+
+/** @} */
+#endif /* _PHNXPSPILIB_TRACE_H_ */
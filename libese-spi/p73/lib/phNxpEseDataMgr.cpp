@@ -17,6 +17,7 @@
  ******************************************************************************/
 #define LOG_TAG "NxpEseHal"
 #include <log/log.h>
+#include <phNxpEseLog.h>
 #include <phNxpEseDataMgr.h>
 #include <phNxpEsePal.h>
 
@@ -38,6 +39,7 @@ static ESESTATUS phNxpEse_GetDataFromList(uint32_t* data_len, uint8_t* pbuff);
 ESESTATUS phNxpEse_GetData(uint32_t* data_len, uint8_t** pbuffer) {
   uint32_t total_data_len = 0;
   uint8_t* pbuff = NULL;
+  uint64_t startUs = phNxpEse_StatsNowUs();
 
   if (total_len == 0) {
     ALOGE("%s total_len = %d", __FUNCTION__, total_len);
@@ -67,6 +69,7 @@ ESESTATUS phNxpEse_GetData(uint32_t* data_len, uint8_t** pbuffer) {
   total_len = 0;
   head = NULL;
   current = NULL;
+  phNxpEse_StatsRecord(PH_ESE_STAT_REASSEMBLY, phNxpEse_StatsNowUs() - startUs);
 
   return ESESTATUS_SUCCESS;
 }
@@ -111,7 +114,7 @@ ESESTATUS phNxpEse_StoreDatainList(uint32_t data_len, uint8_t* pbuff) {
 static ESESTATUS phNxpEse_GetDataFromList(uint32_t* data_len, uint8_t* pbuff) {
   phNxpEse_sCoreRecvBuff_List_t* new_node;
   uint32_t offset = 0;
-  ALOGD_IF(ese_debug_enabled, "%s Enter ", __FUNCTION__);
+  NXP_LOG_ESE_D("%s Enter ", __FUNCTION__);
   if (head == NULL || pbuff == NULL) {
     return ESESTATUS_FAILED;
   }
@@ -124,7 +127,7 @@ static ESESTATUS phNxpEse_GetDataFromList(uint32_t* data_len, uint8_t* pbuff) {
     new_node = new_node->pNext;
   }
   *data_len = offset;
-  ALOGD_IF(ese_debug_enabled, "%s Exit ", __FUNCTION__);
+  NXP_LOG_ESE_D("%s Exit ", __FUNCTION__);
   return ESESTATUS_SUCCESS;
 }
 
@@ -20,6 +20,7 @@
 #include "StateMachineInfo.h"
 #include "SyncEvent.h"
 #include <log/log.h>
+#include <phNxpEseLog.h>
 #include <phNxpEseProto7816_3.h>
 
 SyncEvent gSpiTxLock;
@@ -27,6 +28,15 @@ SyncEvent gSpiTxLock;
 extern bool ese_debug_enabled;
 extern bool gMfcAppSessionCount;
 
+/* Event that started the recovery sequence in progress, PH_ESE_CNT_MAX when
+ * the link is healthy, and the time it started at. Only touched from the
+ * transceive path which is serialized by the caller. */
+static phNxpEse_CounterId_t gRecoveryCause = PH_ESE_CNT_MAX;
+static uint64_t gRecoveryStartUs = 0;
+/* Set when the sequence saw a link error, so the flight recorder is dumped
+ * at its end. Requested RESYNCH/interface resets and WTX alone are not. */
+static bool gRecoveryDump = false;
+
 /******************************************************************************
 \section Introduction Introduction
 
@@ -56,6 +66,11 @@ static ESESTATUS phNxpEseProto7816_ProcessResponse(void);
 static ESESTATUS TransceiveProcess(void);
 static ESESTATUS phNxpEseProto7816_RSync(void);
 static ESESTATUS phNxpEseProto7816_ResetProtoParams(void);
+static void phNxpEseProto7816_RecoveryBegin(phNxpEse_CounterId_t event);
+static void phNxpEseProto7816_RecoveryStartTimer(phNxpEse_CounterId_t event);
+static void phNxpEseProto7816_RecoveryEnd(void);
+static bool phNxpEseProto7816_IsRecovered(void);
+static void phNxpEseProto7816_ReleaseSpi(void);
 
 /******************************************************************************
  * Function         phNxpEseProto7816_SendRawFrame
@@ -68,15 +83,14 @@ static ESESTATUS phNxpEseProto7816_ResetProtoParams(void);
 static ESESTATUS phNxpEseProto7816_SendRawFrame(uint32_t data_len,
                                                 uint8_t* p_data) {
   ESESTATUS status = ESESTATUS_FAILED;
-  ALOGD_IF(ese_debug_enabled, "Enter %s ", __FUNCTION__);
+  NXP_LOG_ESE_D("Enter %s ", __FUNCTION__);
   status = phNxpEse_WriteFrame(data_len, p_data);
   if (ESESTATUS_SUCCESS != status) {
     ALOGE("%s Error phNxpEse_WriteFrame\n", __FUNCTION__);
   } else {
-    ALOGD_IF(ese_debug_enabled, "%s phNxpEse_WriteFrame Success \n",
-             __FUNCTION__);
+    NXP_LOG_ESE_D("%s phNxpEse_WriteFrame Success \n", __FUNCTION__);
   }
-  ALOGD_IF(ese_debug_enabled, "Exit %s ", __FUNCTION__);
+  NXP_LOG_ESE_D("Exit %s ", __FUNCTION__);
   return status;
 }
 
@@ -110,11 +124,11 @@ static ESESTATUS phNxpEseProto7816_GetRawFrame(uint32_t* data_len,
 static uint8_t phNxpEseProto7816_ComputeLRC(unsigned char* p_buff,
                                             uint32_t offset, uint32_t length) {
   uint32_t LRC = 0, i = 0;
-  ALOGD_IF(ese_debug_enabled, "Enter %s ", __FUNCTION__);
+  NXP_LOG_ESE_D("Enter %s ", __FUNCTION__);
   for (i = offset; i < length; i++) {
     LRC = LRC ^ p_buff[i];
   }
-  ALOGD_IF(ese_debug_enabled, "Exit %s ", __FUNCTION__);
+  NXP_LOG_ESE_D("Exit %s ", __FUNCTION__);
   return (uint8_t)LRC;
 }
 
@@ -132,18 +146,17 @@ static ESESTATUS phNxpEseProto7816_CheckLRC(uint32_t data_len,
   ESESTATUS status = ESESTATUS_SUCCESS;
   uint8_t calc_crc = 0;
   uint8_t recv_crc = 0;
-  ALOGD_IF(ese_debug_enabled, "Enter %s ", __FUNCTION__);
+  NXP_LOG_ESE_D("Enter %s ", __FUNCTION__);
   recv_crc = p_data[data_len - 1];
 
   /* calculate the CRC after excluding CRC  */
   calc_crc = phNxpEseProto7816_ComputeLRC(p_data, 1, (data_len - 1));
-  ALOGD_IF(ese_debug_enabled, "Received LRC:0x%x Calculated LRC:0x%x", recv_crc,
-           calc_crc);
+  NXP_LOG_ESE_D("Received LRC:0x%x Calculated LRC:0x%x", recv_crc, calc_crc);
   if (recv_crc != calc_crc) {
     status = ESESTATUS_FAILED;
     ALOGE("%s LRC failed", __FUNCTION__);
   }
-  ALOGD_IF(ese_debug_enabled, "Exit %s ", __FUNCTION__);
+  NXP_LOG_ESE_D("Exit %s ", __FUNCTION__);
   return status;
 }
 
@@ -161,7 +174,7 @@ static ESESTATUS phNxpEseProto7816_SendSFrame(sFrameInfo_t sFrameData) {
   uint32_t frame_len = 0;
   uint8_t* p_framebuff = NULL;
   uint8_t pcb_byte = 0;
-  ALOGD_IF(ese_debug_enabled, "Enter %s ", __FUNCTION__);
+  NXP_LOG_ESE_D("Enter %s ", __FUNCTION__);
   sFrameInfo_t sframeData = sFrameData;
   /* This update is helpful in-case a R-NACK is transmitted from the MW */
   phNxpEseProto7816_3_Var.lastSentNonErrorframeType = SFRAME;
@@ -226,13 +239,13 @@ static ESESTATUS phNxpEseProto7816_SendSFrame(sFrameInfo_t sFrameData) {
 
     p_framebuff[frame_len - 1] =
         phNxpEseProto7816_ComputeLRC(p_framebuff, 0, (frame_len - 1));
-    ALOGD_IF(ese_debug_enabled, "S-Frame PCB: %x\n", p_framebuff[1]);
+    NXP_LOG_ESE_D("S-Frame PCB: %x\n", p_framebuff[1]);
     status = phNxpEseProto7816_SendRawFrame(frame_len, p_framebuff);
     phNxpEse_free(p_framebuff);
   } else {
     ALOGE("Invalid S-block or malloc for s-block failed");
   }
-  ALOGD_IF(ese_debug_enabled, "Exit %s ", __FUNCTION__);
+  NXP_LOG_ESE_D("Exit %s ", __FUNCTION__);
   return status;
 }
 
@@ -259,7 +272,7 @@ static ESESTATUS phNxpEseProto7816_sendRframe(rFrameTypes_t rFrameType) {
   recv_ack[1] |=
       ((phNxpEseProto7816_3_Var.phNxpEseRx_Cntx.lastRcvdIframeInfo.seqNo ^ 1)
        << 4);
-  ALOGD_IF(ese_debug_enabled, "%s recv_ack[1]:0x%x", __FUNCTION__, recv_ack[1]);
+  NXP_LOG_ESE_D("%s recv_ack[1]:0x%x", __FUNCTION__, recv_ack[1]);
   recv_ack[3] =
       phNxpEseProto7816_ComputeLRC(recv_ack, 0x00, (sizeof(recv_ack) - 1));
   status = phNxpEseProto7816_SendRawFrame(sizeof(recv_ack), recv_ack);
@@ -280,7 +293,7 @@ static ESESTATUS phNxpEseProto7816_SendIframe(iFrameInfo_t iFrameData) {
   uint32_t frame_len = 0;
   uint8_t* p_framebuff = NULL;
   uint8_t pcb_byte = 0;
-  ALOGD_IF(ese_debug_enabled, "Enter %s ", __FUNCTION__);
+  NXP_LOG_ESE_D("Enter %s ", __FUNCTION__);
   if (0 == iFrameData.sendDataLen) {
     ALOGE("I frame Len is 0, INVALID");
     return ESESTATUS_FAILED;
@@ -322,7 +335,7 @@ static ESESTATUS phNxpEseProto7816_SendIframe(iFrameInfo_t iFrameData) {
   status = phNxpEseProto7816_SendRawFrame(frame_len, p_framebuff);
 
   phNxpEse_free(p_framebuff);
-  ALOGD_IF(ese_debug_enabled, "Exit %s ", __FUNCTION__);
+  NXP_LOG_ESE_D("Exit %s ", __FUNCTION__);
   return status;
 }
 
@@ -337,7 +350,7 @@ static ESESTATUS phNxpEseProto7816_SendIframe(iFrameInfo_t iFrameData) {
  *
  ******************************************************************************/
 static ESESTATUS phNxpEseProto7816_SetFirstIframeContxt(void) {
-  ALOGD_IF(ese_debug_enabled, "Enter %s ", __FUNCTION__);
+  NXP_LOG_ESE_D("Enter %s ", __FUNCTION__);
   phNxpEseProto7816_3_Var.phNxpEseNextTx_Cntx.IframeInfo.dataOffset = 0;
   phNxpEseProto7816_3_Var.phNxpEseNextTx_Cntx.FrameType = IFRAME;
   phNxpEseProto7816_3_Var.phNxpEseNextTx_Cntx.IframeInfo.seqNo =
@@ -356,10 +369,11 @@ static ESESTATUS phNxpEseProto7816_SetFirstIframeContxt(void) {
         phNxpEseProto7816_3_Var.phNxpEseNextTx_Cntx.IframeInfo.totalDataLen;
     phNxpEseProto7816_3_Var.phNxpEseNextTx_Cntx.IframeInfo.isChained = false;
   }
-  ALOGD_IF(ese_debug_enabled, "I-Frame Data Len: %d Seq. no:%d",
-           phNxpEseProto7816_3_Var.phNxpEseNextTx_Cntx.IframeInfo.sendDataLen,
-           phNxpEseProto7816_3_Var.phNxpEseNextTx_Cntx.IframeInfo.seqNo);
-  ALOGD_IF(ese_debug_enabled, "Exit %s ", __FUNCTION__);
+  NXP_LOG_ESE_D(
+      "I-Frame Data Len: %d Seq. no:%d",
+      phNxpEseProto7816_3_Var.phNxpEseNextTx_Cntx.IframeInfo.sendDataLen,
+      phNxpEseProto7816_3_Var.phNxpEseNextTx_Cntx.IframeInfo.seqNo);
+  NXP_LOG_ESE_D("Exit %s ", __FUNCTION__);
   return ESESTATUS_SUCCESS;
 }
 
@@ -374,7 +388,7 @@ static ESESTATUS phNxpEseProto7816_SetFirstIframeContxt(void) {
  *
  ******************************************************************************/
 static ESESTATUS phNxpEseProto7816_SetNextIframeContxt(void) {
-  ALOGD_IF(ese_debug_enabled, "Enter %s ", __FUNCTION__);
+  NXP_LOG_ESE_D("Enter %s ", __FUNCTION__);
   /* Expecting to reach here only after first of chained I-frame is sent and
    * before the last chained is sent */
   phNxpEseProto7816_3_Var.phNxpEseNextTx_Cntx.FrameType = IFRAME;
@@ -393,7 +407,7 @@ static ESESTATUS phNxpEseProto7816_SetNextIframeContxt(void) {
   // if  chained
   if (phNxpEseProto7816_3_Var.phNxpEseLastTx_Cntx.IframeInfo.totalDataLen >
       phNxpEseProto7816_3_Var.phNxpEseLastTx_Cntx.IframeInfo.maxDataLen) {
-    ALOGD_IF(ese_debug_enabled, "Process Chained Frame");
+    NXP_LOG_ESE_D("Process Chained Frame");
     phNxpEseProto7816_3_Var.phNxpEseNextTx_Cntx.IframeInfo.isChained = true;
     phNxpEseProto7816_3_Var.phNxpEseNextTx_Cntx.IframeInfo.sendDataLen =
         phNxpEseProto7816_3_Var.phNxpEseLastTx_Cntx.IframeInfo.maxDataLen;
@@ -405,9 +419,10 @@ static ESESTATUS phNxpEseProto7816_SetNextIframeContxt(void) {
     phNxpEseProto7816_3_Var.phNxpEseNextTx_Cntx.IframeInfo.sendDataLen =
         phNxpEseProto7816_3_Var.phNxpEseLastTx_Cntx.IframeInfo.totalDataLen;
   }
-  ALOGD_IF(ese_debug_enabled, "I-Frame Data Len: %d",
-           phNxpEseProto7816_3_Var.phNxpEseNextTx_Cntx.IframeInfo.sendDataLen);
-  ALOGD_IF(ese_debug_enabled, "Exit %s ", __FUNCTION__);
+  NXP_LOG_ESE_D(
+      "I-Frame Data Len: %d",
+      phNxpEseProto7816_3_Var.phNxpEseNextTx_Cntx.IframeInfo.sendDataLen);
+  NXP_LOG_ESE_D("Exit %s ", __FUNCTION__);
   return ESESTATUS_SUCCESS;
 }
 
@@ -423,18 +438,18 @@ static ESESTATUS phNxpEseProto7816_SetNextIframeContxt(void) {
 static ESESTATUS phNxpEseProro7816_SaveIframeData(uint8_t* p_data,
                                                   uint32_t data_len) {
   ESESTATUS status = ESESTATUS_SUCCESS;
-  ALOGD_IF(ese_debug_enabled, "Enter %s ", __FUNCTION__);
+  NXP_LOG_ESE_D("Enter %s ", __FUNCTION__);
   if ((p_data == nullptr) || (data_len == 0)) {
     ALOGE("%s -I Frame not stored. data_len = %x", __FUNCTION__, data_len);
     return status;
   }
-  ALOGD_IF(ese_debug_enabled, "Data[0]=0x%x len=%d Data[%d]=0x%x", p_data[0],
-           data_len, data_len - 1, p_data[data_len - 1]);
+  NXP_LOG_ESE_D("Data[0]=0x%x len=%d Data[%d]=0x%x", p_data[0], data_len,
+                data_len - 1, p_data[data_len - 1]);
   if (ESESTATUS_SUCCESS != phNxpEse_StoreDatainList(data_len, p_data)) {
     ALOGE("%s - Error storing chained data in list", __FUNCTION__);
     status = ESESTATUS_FAILED;
   }
-  ALOGD_IF(ese_debug_enabled, "Exit %s ", __FUNCTION__);
+  NXP_LOG_ESE_D("Exit %s ", __FUNCTION__);
   return status;
 }
 
@@ -452,6 +467,103 @@ static ESESTATUS phNxpEseProto7816_ResetRecovery(void) {
   return ESESTATUS_SUCCESS;
 }
 
+/******************************************************************************
+ * Function         phNxpEseProto7816_RecoveryBegin
+ *
+ * Description      This internal function counts a protocol health event and
+ *                  starts the recovery timer if no recovery is in progress.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+static void phNxpEseProto7816_RecoveryBegin(phNxpEse_CounterId_t event) {
+  phNxpEse_StatsCount(event);
+  switch (event) {
+    case PH_ESE_CNT_WTX_REQ:
+      break;
+    case PH_ESE_CNT_RESYNCH:
+    case PH_ESE_CNT_INTF_RESET:
+      if (gRecoveryCause != PH_ESE_CNT_MAX) gRecoveryDump = true;
+      break;
+    default:
+      gRecoveryDump = true;
+      break;
+  }
+  phNxpEseProto7816_RecoveryStartTimer(event);
+}
+
+/******************************************************************************
+ * Function         phNxpEseProto7816_RecoveryStartTimer
+ *
+ * Description      This internal function starts the recovery timer without
+ *                  counting an event, for paths that back off before the
+ *                  event they lead to is sent.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+static void phNxpEseProto7816_RecoveryStartTimer(phNxpEse_CounterId_t event) {
+  if (gRecoveryCause == PH_ESE_CNT_MAX) {
+    gRecoveryCause = event;
+    gRecoveryStartUs = phNxpEse_StatsNowUs();
+  }
+}
+
+/******************************************************************************
+ * Function         phNxpEseProto7816_RecoveryEnd
+ *
+ * Description      This internal function charges the time of the recovery in
+ *                  progress to the event which started it and, if the
+ *                  sequence saw a link error, takes the flight recorder
+ *                  records for a dump logged once the APDU is done.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+static void phNxpEseProto7816_RecoveryEnd(void) {
+  if (gRecoveryCause != PH_ESE_CNT_MAX) {
+    phNxpEse_CounterId_t cause = gRecoveryCause;
+    phNxpEse_StatsRecoveryTime(cause,
+                               phNxpEse_StatsNowUs() - gRecoveryStartUs);
+    gRecoveryCause = PH_ESE_CNT_MAX;
+    if (gRecoveryDump) {
+      gRecoveryDump = false;
+      phNxpEse_FlightRecMarkDump(phNxpEse_StatsCounterName(cause));
+    }
+  }
+}
+
+/******************************************************************************
+ * Function         phNxpEseProto7816_IsRecovered
+ *
+ * Description      This internal function checks whether the last decoded
+ *                  frame carries the exchange forward again, i.e. it is
+ *                  neither an error indication nor a WTX request.
+ *
+ * Returns          true if the link has recovered
+ *
+ ******************************************************************************/
+static bool phNxpEseProto7816_IsRecovered(void) {
+  switch (phNxpEseProto7816_3_Var.phNxpEseProto7816_nextTransceiveState) {
+    case SEND_IFRAME:
+    case SEND_R_ACK:
+    case IDLE_STATE:
+      break;
+    default:
+      return false;
+  }
+  switch (phNxpEseProto7816_3_Var.phNxpEseRx_Cntx.lastRcvdFrameType) {
+    case IFRAME:
+    case SFRAME:
+      return true;
+    case RFRAME:
+      return (phNxpEseProto7816_3_Var.phNxpEseRx_Cntx.lastRcvdRframeInfo
+                  .errCode == NO_ERROR);
+    default:
+      return false;
+  }
+}
+
 /******************************************************************************
  * Function         phNxpEseProto7816_RecoverySteps
  *
@@ -487,21 +599,17 @@ static ESESTATUS phNxpEseProto7816_RecoverySteps(void) {
  * Returns          void
  *
  ******************************************************************************/
-static void phNxpEseProto7816_DecodeSecureTimer(uint8_t* frameOffset,
+static void phNxpEseProto7816_DecodeSecureTimer(uint16_t* frameOffset,
                                                 unsigned int* secureTimer,
                                                 uint8_t* p_data) {
   uint8_t byteCounter = 0;
   uint8_t dataLength = p_data[++(*frameOffset)]; /* To get the L of TLV */
-  if (dataLength > 0) {
-    /* V of TLV: Retrieve each byte(4 byte) and push it to get the secure timer
-     * value (unsigned long) */
-    for (byteCounter = 1; byteCounter <= dataLength; byteCounter++) {
-      (*frameOffset)++;
-      *secureTimer = (*secureTimer) << 8;
-      *secureTimer |= p_data[(*frameOffset)];
-    }
-  } else {
-    (*frameOffset)++; /* Goto the end of current marker if length is zero */
+  /* V of TLV: Retrieve each byte(4 byte) and push it to get the secure timer
+   * value (unsigned long) */
+  for (byteCounter = 1; byteCounter <= dataLength; byteCounter++) {
+    (*frameOffset)++;
+    *secureTimer = (*secureTimer) << 8;
+    *secureTimer |= p_data[(*frameOffset)];
   }
   return;
 }
@@ -510,20 +618,30 @@ static void phNxpEseProto7816_DecodeSecureTimer(uint8_t* frameOffset,
  * Function         phNxpEseProto7816_DecodeSFrameData
  *
  * Description      This internal function is to decode S-frame payload.
+ *                  Markers are a one-byte type and a one-byte length; those
+ *                  other than the timers are skipped whole.
  * Returns          void
  *
  ******************************************************************************/
 static void phNxpEseProto7816_DecodeSFrameData(uint8_t* p_data) {
-  uint8_t maxSframeLen = 0, dataType = 0, frameOffset = 0;
-  frameOffset = PH_PROPTO_7816_FRAME_LENGTH_OFFSET;
+  uint8_t dataType = 0, dataLength = 0;
+  uint16_t maxSframeLen = 0;
+  uint16_t frameOffset = PH_PROPTO_7816_FRAME_LENGTH_OFFSET;
   maxSframeLen =
       p_data[frameOffset] +
       frameOffset; /* to be in sync with offset which starts from index 0 */
-  while (maxSframeLen > frameOffset) {
+  /* A marker needs its type and length, and its value within the payload */
+  while (maxSframeLen >= frameOffset + 2) {
     frameOffset += 1; /* To get the Type (TLV) */
     dataType = p_data[frameOffset];
-    ALOGD_IF(ese_debug_enabled, "%s frameoffset=%d value=0x%x\n", __FUNCTION__,
-             frameOffset, p_data[frameOffset]);
+    dataLength = p_data[frameOffset + 1];
+    NXP_LOG_ESE_D("%s frameoffset=%d value=0x%x\n", __FUNCTION__, frameOffset,
+                  p_data[frameOffset]);
+    if (frameOffset + 1 + dataLength > maxSframeLen) {
+      NXP_LOG_ESE_D("%s marker 0x%x overruns the payload", __FUNCTION__,
+                    dataType);
+      break;
+    }
     switch (dataType) /* Type (TLV) */
     {
       case PH_PROPTO_7816_SFRAME_TIMER1:
@@ -542,15 +660,15 @@ static void phNxpEseProto7816_DecodeSFrameData(uint8_t* p_data) {
             &phNxpEseProto7816_3_Var.secureTimerParams.secureTimer3, p_data);
         break;
       default:
-        frameOffset +=
-            p_data[frameOffset + 1]; /* Goto the end of current marker */
+        /* Skip the length byte and the value */
+        frameOffset += 1 + dataLength;
         break;
     }
   }
-  ALOGD_IF(ese_debug_enabled, "secure timer t1 = 0x%x t2 = 0x%x t3 = 0x%x",
-           phNxpEseProto7816_3_Var.secureTimerParams.secureTimer1,
-           phNxpEseProto7816_3_Var.secureTimerParams.secureTimer2,
-           phNxpEseProto7816_3_Var.secureTimerParams.secureTimer3);
+  NXP_LOG_ESE_D("secure timer t1 = 0x%x t2 = 0x%x t3 = 0x%x",
+                phNxpEseProto7816_3_Var.secureTimerParams.secureTimer1,
+                phNxpEseProto7816_3_Var.secureTimerParams.secureTimer2,
+                phNxpEseProto7816_3_Var.secureTimerParams.secureTimer3);
   return;
 }
 
@@ -576,9 +694,9 @@ static ESESTATUS phNxpEseProto7816_DecodeFrame(uint8_t* p_data,
   ESESTATUS status = ESESTATUS_SUCCESS;
   uint8_t pcb;
   phNxpEseProto7816_PCB_bits_t pcb_bits;
-  ALOGD_IF(ese_debug_enabled, "Enter %s ", __FUNCTION__);
-  ALOGD_IF(ese_debug_enabled, "Retry Counter = %d\n",
-           phNxpEseProto7816_3_Var.recoveryCounter);
+  NXP_LOG_ESE_D("Enter %s ", __FUNCTION__);
+  NXP_LOG_ESE_D("Retry Counter = %d\n",
+                phNxpEseProto7816_3_Var.recoveryCounter);
   pcb = p_data[PH_PROPTO_7816_PCB_OFFSET];
   // memset(&phNxpEseProto7816_3_Var.phNxpEseRx_Cntx.rcvPcbBits, 0x00,
   // sizeof(struct PCB_BITS));
@@ -587,15 +705,15 @@ static ESESTATUS phNxpEseProto7816_DecodeFrame(uint8_t* p_data,
 
   if (0x00 == pcb_bits.msb) /* I-FRAME decoded should come here */
   {
-    ALOGD_IF(ese_debug_enabled, "%s I-Frame Received", __FUNCTION__);
+    NXP_LOG_ESE_D("%s I-Frame Received", __FUNCTION__);
     StateMachine::GetInstance().ProcessExtEvent(EVT_SPI_RX);
     phNxpEseProto7816_3_Var.wtx_counter = 0;
     phNxpEseProto7816_3_Var.phNxpEseRx_Cntx.lastRcvdFrameType = IFRAME;
     if (phNxpEseProto7816_3_Var.phNxpEseRx_Cntx.lastRcvdIframeInfo.seqNo !=
         pcb_bits.bit7)  //   != pcb_bits->bit7)
     {
-      ALOGD_IF(ese_debug_enabled, "%s I-Frame lastRcvdIframeInfo.seqNo:0x%x",
-               __FUNCTION__, pcb_bits.bit7);
+      NXP_LOG_ESE_D("%s I-Frame lastRcvdIframeInfo.seqNo:0x%x", __FUNCTION__,
+                    pcb_bits.bit7);
       phNxpEseProto7816_ResetRecovery();
       phNxpEseProto7816_3_Var.phNxpEseRx_Cntx.lastRcvdIframeInfo.seqNo = 0x00;
       phNxpEseProto7816_3_Var.phNxpEseRx_Cntx.lastRcvdIframeInfo.seqNo |=
@@ -618,6 +736,7 @@ static ESESTATUS phNxpEseProto7816_DecodeFrame(uint8_t* p_data,
         status = phNxpEseProro7816_SaveIframeData(&p_data[3], data_len - 4);
       }
     } else {
+      phNxpEseProto7816_RecoveryStartTimer(PH_ESE_CNT_RNACK_SENT);
       phNxpEse_Sleep(DELAY_ERROR_RECOVERY);
       if (phNxpEseProto7816_3_Var.recoveryCounter <
           PH_PROTO_7816_FRAME_RETRY_COUNT) {
@@ -635,7 +754,7 @@ static ESESTATUS phNxpEseProto7816_DecodeFrame(uint8_t* p_data,
   } else if ((0x01 == pcb_bits.msb) &&
              (0x00 == pcb_bits.bit7)) /* R-FRAME decoded should come here */
   {
-    ALOGD_IF(ese_debug_enabled, "%s R-Frame Received", __FUNCTION__);
+    NXP_LOG_ESE_D("%s R-Frame Received", __FUNCTION__);
     StateMachine::GetInstance().ProcessExtEvent(EVT_SPI_RX);
     phNxpEseProto7816_3_Var.wtx_counter = 0;
     phNxpEseProto7816_3_Var.phNxpEseRx_Cntx.lastRcvdFrameType = RFRAME;
@@ -660,6 +779,7 @@ static ESESTATUS phNxpEseProto7816_DecodeFrame(uint8_t* p_data,
     else if (((pcb_bits.lsb == 0x01) && (pcb_bits.bit2 == 0x00)) ||
              /* Error handling 2: Other indicated error */
              ((pcb_bits.lsb == 0x00) && (pcb_bits.bit2 == 0x01))) {
+      phNxpEseProto7816_RecoveryBegin(PH_ESE_CNT_RNACK_RCVD);
       phNxpEse_Sleep(DELAY_ERROR_RECOVERY);
       if ((pcb_bits.lsb == 0x00) && (pcb_bits.bit2 == 0x01))
         phNxpEseProto7816_3_Var.phNxpEseRx_Cntx.lastRcvdRframeInfo.errCode =
@@ -761,7 +881,7 @@ static ESESTATUS phNxpEseProto7816_DecodeFrame(uint8_t* p_data,
   } else if ((0x01 == pcb_bits.msb) &&
              (0x01 == pcb_bits.bit7)) /* S-FRAME decoded should come here */
   {
-    ALOGD_IF(ese_debug_enabled, "%s S-Frame Received", __FUNCTION__);
+    NXP_LOG_ESE_D("%s S-Frame Received", __FUNCTION__);
     int32_t frameType = (int32_t)(pcb & 0x3F); /*discard upper 2 bits */
     phNxpEseProto7816_3_Var.phNxpEseRx_Cntx.lastRcvdFrameType = SFRAME;
     if (frameType != WTX_REQ) {
@@ -803,11 +923,12 @@ static ESESTATUS phNxpEseProto7816_DecodeFrame(uint8_t* p_data,
             IDLE_STATE;
         break;
       case WTX_REQ:
+        phNxpEseProto7816_RecoveryBegin(PH_ESE_CNT_WTX_REQ);
         phNxpEseProto7816_3_Var.wtx_counter++;
-        ALOGD_IF(ese_debug_enabled, "%s Wtx_counter value - %lu", __FUNCTION__,
-                 phNxpEseProto7816_3_Var.wtx_counter);
-        ALOGD_IF(ese_debug_enabled, "%s Wtx_counter wtx_counter_limit - %lu",
-                 __FUNCTION__, phNxpEseProto7816_3_Var.wtx_counter_limit);
+        NXP_LOG_ESE_D("%s Wtx_counter value - %lu", __FUNCTION__,
+                      phNxpEseProto7816_3_Var.wtx_counter);
+        NXP_LOG_ESE_D("%s Wtx_counter wtx_counter_limit - %lu", __FUNCTION__,
+                      phNxpEseProto7816_3_Var.wtx_counter_limit);
         StateMachine::GetInstance().ProcessExtEvent(EVT_SPI_RX_WTX_REQ);
         /* Previous sent frame is some S-frame but not WTX response S-frame */
         if (phNxpEseProto7816_3_Var.phNxpEseLastTx_Cntx.SframeInfo.sFrameType !=
@@ -860,6 +981,7 @@ static ESESTATUS phNxpEseProto7816_DecodeFrame(uint8_t* p_data,
         break;
       case INTF_RESET_RSP:
         phNxpEseProto7816_ResetProtoParams();
+        phNxpEse_CacheFlush(phNxpEse_StatsCounterName(PH_ESE_CNT_INTF_RESET));
         phNxpEseProto7816_3_Var.phNxpEseRx_Cntx.lastRcvdSframeInfo.sFrameType =
             INTF_RESET_RSP;
         if (p_data[PH_PROPTO_7816_FRAME_LENGTH_OFFSET] > 0)
@@ -888,7 +1010,7 @@ static ESESTATUS phNxpEseProto7816_DecodeFrame(uint8_t* p_data,
   } else {
     ALOGE("%s Wrong-Frame Received", __FUNCTION__);
   }
-  ALOGD_IF(ese_debug_enabled, "Exit %s ", __FUNCTION__);
+  NXP_LOG_ESE_D("Exit %s ", __FUNCTION__);
   return status;
 }
 
@@ -905,11 +1027,12 @@ static ESESTATUS phNxpEseProto7816_ProcessResponse(void) {
   uint32_t data_len = 0;
   uint8_t* p_data = NULL;
   ESESTATUS status = ESESTATUS_FAILED;
-  ALOGD_IF(ese_debug_enabled, "Enter %s", __FUNCTION__);
+  NXP_LOG_ESE_D("Enter %s", __FUNCTION__);
   status = phNxpEseProto7816_GetRawFrame(&data_len, &p_data);
-  ALOGD_IF(ese_debug_enabled, "%s p_data ----> %p len ----> 0x%x", __FUNCTION__,
-           p_data, data_len);
+  NXP_LOG_ESE_D("%s p_data ----> %p len ----> 0x%x", __FUNCTION__, p_data,
+                data_len);
   if (ESESTATUS_SUCCESS == status) {
+    uint64_t decodeStartUs = phNxpEse_StatsNowUs();
     /* Resetting the timeout counter */
     phNxpEseProto7816_3_Var.timeoutCounter = PH_PROTO_7816_VALUE_ZERO;
     /* LRC check followed */
@@ -918,8 +1041,12 @@ static ESESTATUS phNxpEseProto7816_ProcessResponse(void) {
       /* Resetting the RNACK retry counter */
       phNxpEseProto7816_3_Var.rnack_retry_counter = PH_PROTO_7816_VALUE_ZERO;
       status = phNxpEseProto7816_DecodeFrame(p_data, data_len);
+      phNxpEse_StatsRecord(PH_ESE_STAT_DECODE,
+                           phNxpEse_StatsNowUs() - decodeStartUs);
+      if (phNxpEseProto7816_IsRecovered()) phNxpEseProto7816_RecoveryEnd();
     } else {
       ALOGE("%s LRC Check failed", __FUNCTION__);
+      phNxpEseProto7816_RecoveryBegin(PH_ESE_CNT_LRC_FAIL);
       if (phNxpEseProto7816_3_Var.rnack_retry_counter <
           phNxpEseProto7816_3_Var.rnack_retry_limit) {
         phNxpEseProto7816_3_Var.phNxpEseRx_Cntx.lastRcvdFrameType = INVALID;
@@ -942,6 +1069,7 @@ static ESESTATUS phNxpEseProto7816_ProcessResponse(void) {
     }
   } else {
     ALOGE("%s phNxpEseProto7816_GetRawFrame failed", __FUNCTION__);
+    phNxpEseProto7816_RecoveryBegin(PH_ESE_CNT_TIMEOUT);
     if ((SFRAME == phNxpEseProto7816_3_Var.phNxpEseLastTx_Cntx.FrameType) &&
         ((WTX_RSP ==
           phNxpEseProto7816_3_Var.phNxpEseLastTx_Cntx.SframeInfo.sFrameType) ||
@@ -985,10 +1113,36 @@ static ESESTATUS phNxpEseProto7816_ProcessResponse(void) {
       }
     }
   }
-  ALOGD_IF(ese_debug_enabled, "Exit %s Status 0x%x", __FUNCTION__, status);
+  NXP_LOG_ESE_D("Exit %s Status 0x%x", __FUNCTION__, status);
   return status;
 }
 
+/******************************************************************************
+ * Function         phNxpEseProto7816_ReleaseSpi
+ *
+ * Description      This internal function posts the EVT_SPI_RX that a
+ *                  transceive leaving on a write failure or an exhausted
+ *                  retry never decoded, so the state machine does not hold
+ *                  the next transceive for MAX_WAIT_TIME_FOR_RF_OFF. Only
+ *                  the SPI busy states are released: in the RX pending
+ *                  states EVT_SPI_RX would run the NFC coexistence path
+ *                  for a response that never came.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+static void phNxpEseProto7816_ReleaseSpi(void) {
+  switch (StateMachine::GetInstance().GetCurrentState()) {
+    case ST_SPI_BUSY_RF_IDLE:
+    case ST_SPI_BUSY_RF_BUSY:
+    case ST_SPI_BUSY_RF_BUSY_TIMER_EXPIRED:
+      StateMachine::GetInstance().ProcessExtEvent(EVT_SPI_RX);
+      break;
+    default:
+      break;
+  }
+}
+
 /******************************************************************************
  * Function         TransceiveProcess
  *
@@ -1004,26 +1158,35 @@ static ESESTATUS phNxpEseProto7816_ProcessResponse(void) {
 static ESESTATUS TransceiveProcess(void) {
   ESESTATUS status = ESESTATUS_FAILED;
   sFrameInfo_t sFrameInfo;
-  ALOGD_IF(ese_debug_enabled, "Enter %s ", __FUNCTION__);
+  NXP_LOG_ESE_D("Enter %s ", __FUNCTION__);
 
   {
+    uint64_t lockStartUs = phNxpEse_StatsNowUs();
     SyncEventGuard guard(gSpiTxLock);
-    ALOGD_IF(ese_debug_enabled, "%s: CurrentState:%d", __FUNCTION__,
-             StateMachine::GetInstance().GetCurrentState());
+    phNxpEse_StatsRecord(PH_ESE_STAT_QUEUE_WAIT,
+                         phNxpEse_StatsNowUs() - lockStartUs);
+    NXP_LOG_ESE_D("%s: CurrentState:%d", __FUNCTION__,
+                  StateMachine::GetInstance().GetCurrentState());
     if (!StateMachine::GetInstance().isSpiTxRxAllowed()) {
       if (gMfcAppSessionCount) {
-        ALOGD_IF(ese_debug_enabled,
-                 "%s: Waiting for either 2seconds or RF-OFF...", __FUNCTION__);
+        NXP_LOG_ESE_D("%s: Waiting for either 2seconds or RF-OFF...",
+                      __FUNCTION__);
+        uint64_t waitStartUs = phNxpEse_StatsNowUs();
         gSpiTxLock.wait(GUARD_WAIT_TIME_FOR_RF_OFF);
+        phNxpEse_StatsRecord(PH_ESE_STAT_RF_WAIT,
+                             phNxpEse_StatsNowUs() - waitStartUs);
         if (!StateMachine::GetInstance().isSpiTxRxAllowed()) {
           phNxpEseProto7816_3_Var.phNxpEseProto7816_CurrentState =
                PH_NXP_ESE_PROTO_7816_IDLE;
           return ESESTATUS_WRITE_FAILED;
         }
       } else {
-        ALOGD_IF(ese_debug_enabled,
-                 "%s: Waiting for either 10seconds or RF-OFF...", __FUNCTION__);
+        NXP_LOG_ESE_D("%s: Waiting for either 10seconds or RF-OFF...",
+                      __FUNCTION__);
+        uint64_t waitStartUs = phNxpEse_StatsNowUs();
         gSpiTxLock.wait(MAX_WAIT_TIME_FOR_RF_OFF);
+        phNxpEse_StatsRecord(PH_ESE_STAT_RF_WAIT,
+                             phNxpEse_StatsNowUs() - waitStartUs);
         if (!StateMachine::GetInstance().isSpiTxRxAllowed()) {
           phNxpEseProto7816_3_Var.phNxpEseProto7816_CurrentState =
                PH_NXP_ESE_PROTO_7816_IDLE;
@@ -1035,8 +1198,9 @@ static ESESTATUS TransceiveProcess(void) {
 
   while (phNxpEseProto7816_3_Var.phNxpEseProto7816_nextTransceiveState !=
          IDLE_STATE) {
-    ALOGD_IF(ese_debug_enabled, "%s nextTransceiveState %x", __FUNCTION__,
-             phNxpEseProto7816_3_Var.phNxpEseProto7816_nextTransceiveState);
+    NXP_LOG_ESE_D(
+        "%s nextTransceiveState %x", __FUNCTION__,
+        phNxpEseProto7816_3_Var.phNxpEseProto7816_nextTransceiveState);
     StateMachine::GetInstance().ProcessExtEvent(EVT_SPI_TX);
     switch (phNxpEseProto7816_3_Var.phNxpEseProto7816_nextTransceiveState) {
       case SEND_IFRAME:
@@ -1047,13 +1211,16 @@ static ESESTATUS TransceiveProcess(void) {
         status = phNxpEseProto7816_sendRframe(RACK);
         break;
       case SEND_R_NACK:
+        phNxpEseProto7816_RecoveryBegin(PH_ESE_CNT_RNACK_SENT);
         status = phNxpEseProto7816_sendRframe(RNACK);
         break;
       case SEND_S_RSYNC:
+        phNxpEseProto7816_RecoveryBegin(PH_ESE_CNT_RESYNCH);
         sFrameInfo.sFrameType = RESYNCH_REQ;
         status = phNxpEseProto7816_SendSFrame(sFrameInfo);
         break;
       case SEND_S_INTF_RST:
+        phNxpEseProto7816_RecoveryBegin(PH_ESE_CNT_INTF_RESET);
         sFrameInfo.sFrameType = INTF_RESET_REQ;
         status = phNxpEseProto7816_SendSFrame(sFrameInfo);
         break;
@@ -1076,13 +1243,16 @@ static ESESTATUS TransceiveProcess(void) {
                       sizeof(phNxpEseProto7816_NextTx_Info_t));
       status = phNxpEseProto7816_ProcessResponse();
     } else {
-      ALOGD_IF(ese_debug_enabled,
-               "%s Transceive send failed, going to recovery!", __FUNCTION__);
+      NXP_LOG_ESE_D("%s Transceive send failed, going to recovery!",
+                    __FUNCTION__);
       phNxpEseProto7816_3_Var.phNxpEseProto7816_nextTransceiveState =
           IDLE_STATE;
     }
   };
-  ALOGD_IF(ese_debug_enabled, "Exit %s Status 0x%x", __FUNCTION__, status);
+  phNxpEseProto7816_ReleaseSpi();
+  /* A recovery still open here ran until the transceive gave up */
+  phNxpEseProto7816_RecoveryEnd();
+  NXP_LOG_ESE_D("Exit %s Status 0x%x", __FUNCTION__, status);
   return status;
 }
 
@@ -1105,7 +1275,7 @@ ESESTATUS phNxpEseProto7816_Transceive(phNxpEse_data* pCmd,
   ESESTATUS status = ESESTATUS_FAILED;
   ESESTATUS wStatus = ESESTATUS_FAILED;
   phNxpEse_data pRes;
-  ALOGD_IF(ese_debug_enabled, "Enter %s ", __FUNCTION__);
+  NXP_LOG_ESE_D("Enter %s ", __FUNCTION__);
   if ((NULL == pCmd) || (NULL == pRsp) ||
       (phNxpEseProto7816_3_Var.phNxpEseProto7816_CurrentState !=
        PH_NXP_ESE_PROTO_7816_IDLE))
@@ -1117,8 +1287,7 @@ ESESTATUS phNxpEseProto7816_Transceive(phNxpEse_data* pCmd,
   phNxpEseProto7816_3_Var.phNxpEseNextTx_Cntx.IframeInfo.p_data = pCmd->p_data;
   phNxpEseProto7816_3_Var.phNxpEseNextTx_Cntx.IframeInfo.totalDataLen =
       pCmd->len;
-  ALOGD_IF(ese_debug_enabled, "Transceive data ptr 0x%p len:%d", pCmd->p_data,
-           pCmd->len);
+  NXP_LOG_ESE_D("Transceive data ptr 0x%p len:%d", pCmd->p_data, pCmd->len);
   status = phNxpEseProto7816_SetFirstIframeContxt();
   status = TransceiveProcess();
   if (ESESTATUS_FAILED == status) {
@@ -1140,10 +1309,9 @@ ESESTATUS phNxpEseProto7816_Transceive(phNxpEse_data* pCmd,
     // fetch the data info and report to upper layer.
     wStatus = phNxpEse_GetData(&pRes.len, &pRes.p_data);
     if (ESESTATUS_SUCCESS == wStatus) {
-      ALOGD_IF(ese_debug_enabled,
-               "%s Data successfully received at 7816, packaging to "
-               "send upper layers: DataLen = %d",
-               __FUNCTION__, pRes.len);
+      NXP_LOG_ESE_D("%s Data successfully received at 7816, packaging to "
+                    "send upper layers: DataLen = %d",
+                    __FUNCTION__, pRes.len);
       /* Copy the data to be read by the upper layer via transceive api */
       pRsp->len = pRes.len;
       pRsp->p_data = pRes.p_data;
@@ -1152,7 +1320,7 @@ ESESTATUS phNxpEseProto7816_Transceive(phNxpEse_data* pCmd,
   }
   phNxpEseProto7816_3_Var.phNxpEseProto7816_CurrentState =
       PH_NXP_ESE_PROTO_7816_IDLE;
-  ALOGD_IF(ese_debug_enabled, "Exit %s Status 0x%x", __FUNCTION__, status);
+  NXP_LOG_ESE_D("Exit %s Status 0x%x", __FUNCTION__, status);
   return status;
 }
 
@@ -1257,8 +1425,7 @@ ESESTATUS phNxpEseProto7816_Reset(void) {
 ESESTATUS phNxpEseProto7816_Open(phNxpEseProto7816InitParam_t initParam) {
   ESESTATUS status = ESESTATUS_FAILED;
   status = phNxpEseProto7816_ResetProtoParams();
-  ALOGD_IF(ese_debug_enabled, "%s: First open completed, Congratulations",
-           __FUNCTION__);
+  NXP_LOG_ESE_D("%s: First open completed, Congratulations", __FUNCTION__);
   /* Update WTX max. limit */
   phNxpEseProto7816_3_Var.wtx_counter_limit = initParam.wtx_counter_limit;
   phNxpEseProto7816_3_Var.rnack_retry_limit = initParam.rnack_retry_limit;
@@ -1329,7 +1496,7 @@ ESESTATUS phNxpEseProto7816_Close(
 ESESTATUS phNxpEseProto7816_IntfReset(
     phNxpEseProto7816SecureTimer_t* pSecureTimerParam) {
   ESESTATUS status = ESESTATUS_FAILED;
-  ALOGD_IF(ese_debug_enabled, "Enter %s ", __FUNCTION__);
+  NXP_LOG_ESE_D("Enter %s ", __FUNCTION__);
   phNxpEseProto7816_3_Var.phNxpEseProto7816_CurrentState =
       PH_NXP_ESE_PROTO_7816_TRANSCEIVE;
   phNxpEseProto7816_3_Var.phNxpEseNextTx_Cntx.FrameType = SFRAME;
@@ -1350,7 +1517,7 @@ ESESTATUS phNxpEseProto7816_IntfReset(
                   sizeof(phNxpEseProto7816SecureTimer_t));
   phNxpEseProto7816_3_Var.phNxpEseProto7816_CurrentState =
       PH_NXP_ESE_PROTO_7816_IDLE;
-  ALOGD_IF(ese_debug_enabled, "Exit %s ", __FUNCTION__);
+  NXP_LOG_ESE_D("Exit %s ", __FUNCTION__);
   return status;
 }
 
@@ -17,6 +17,7 @@
  ******************************************************************************/
 #define LOG_TAG "NxpEseHal"
 #include <log/log.h>
+#include <phNxpEseLog.h>
 
 #include "StateMachine.h"
 #include "StateMachineInfo.h"
@@ -29,12 +30,18 @@
 #include <phNxpEse_Internal.h>
 
 #define RECIEVE_PACKET_SOF 0xA5
+#if (NXP_ESE_LOG_LEVEL >= NXP_ESE_LOG_LEVEL_DEBUG)
 #define PH_PAL_ESE_PRINT_PACKET_TX(data, len) \
   ({ phPalEse_print_packet("SEND", data, len); })
 #define PH_PAL_ESE_PRINT_PACKET_RX(data, len) \
   ({ phPalEse_print_packet("RECV", data, len); })
+#else
+#define PH_PAL_ESE_PRINT_PACKET_TX(data, len) ({})
+#define PH_PAL_ESE_PRINT_PACKET_RX(data, len) ({})
+#endif
 static int phNxpEse_readPacket(void* pDevHandle, uint8_t* pBuffer,
                                int nNbBytesToRead);
+static void phNxpEse_startConfigTrace(void);
 #ifdef NXP_ESE_JCOP_DWNLD_PROTECTION
 static ESESTATUS phNxpEse_checkJcopDwnldState(void);
 static ESESTATUS phNxpEse_setJcopDwnldState(phNxpEse_JcopDwnldState state);
@@ -54,6 +61,8 @@ static unsigned char* phNxpEse_GgetTimerTlvBuffer(unsigned char* timer_buffer,
 phNxpEse_Context_t nxpese_ctxt;
 bool ese_debug_enabled = true;
 SyncEvent gSpiOpenLock;
+/* phNxpEse_openPrioSession holds scheduled normal APDUs until close */
+static bool gsPrioSessionOpen = false;
 
 /******************************************************************************
  * Function         phNxpLog_InitializeLogLevel
@@ -78,7 +87,7 @@ void phNxpLog_InitializeLogLevel() {
     ese_debug_enabled = (debug_enabled == 0) ? false : true;
   }
 
-  ALOGD_IF(ese_debug_enabled, "%s: level=%u", __func__, ese_debug_enabled);
+  NXP_LOG_ESE_D("%s: level=%u", __func__, ese_debug_enabled);
 }
 
 /******************************************************************************
@@ -104,8 +113,8 @@ ESESTATUS phNxpEse_init(phNxpEse_initParams initParams) {
   if (EseConfig::hasKey(NAME_NXP_WTX_COUNT_VALUE)) {
     num = EseConfig::getUnsigned(NAME_NXP_WTX_COUNT_VALUE);
     protoInitParam.wtx_counter_limit = num;
-    ALOGD_IF(ese_debug_enabled, "Wtx_counter read from config file - %lu",
-             protoInitParam.wtx_counter_limit);
+    NXP_LOG_ESE_D("Wtx_counter read from config file - %lu",
+                  protoInitParam.wtx_counter_limit);
   } else {
     protoInitParam.wtx_counter_limit = PH_PROTO_WTX_DEFAULT_COUNT;
   }
@@ -133,11 +142,10 @@ ESESTATUS phNxpEse_init(phNxpEse_initParams initParams) {
   protoInitParam.pSecureTimerParams =
       (phNxpEseProto7816SecureTimer_t*)&nxpese_ctxt.secureTimerParams;
 
-  ALOGD_IF(ese_debug_enabled,
-           "%s secureTimer1 0x%x secureTimer2 0x%x secureTimer3 0x%x",
-           __FUNCTION__, nxpese_ctxt.secureTimerParams.secureTimer1,
-           nxpese_ctxt.secureTimerParams.secureTimer2,
-           nxpese_ctxt.secureTimerParams.secureTimer3);
+  NXP_LOG_ESE_D("%s secureTimer1 0x%x secureTimer2 0x%x secureTimer3 0x%x",
+                __FUNCTION__, nxpese_ctxt.secureTimerParams.secureTimer1,
+                nxpese_ctxt.secureTimerParams.secureTimer2,
+                nxpese_ctxt.secureTimerParams.secureTimer3);
 
   phNxpEse_GetMaxTimer(&maxTimer);
 
@@ -174,21 +182,23 @@ ESESTATUS phNxpEse_open(phNxpEse_initParams initParams) {
   ALOGD("%s: Enter", __FUNCTION__);
 
   phNxpEse_secureTimerStop();
+  phNxpEse_StatsSessionStart();
+  phNxpEse_CacheInit();
 
   {
     SyncEventGuard guard(gSpiOpenLock);
-    ALOGD_IF(ese_debug_enabled, "%s: CurrentState:%d", __FUNCTION__,
-             StateMachine::GetInstance().GetCurrentState());
+    NXP_LOG_ESE_D("%s: CurrentState:%d", __FUNCTION__,
+                  StateMachine::GetInstance().GetCurrentState());
     if ((eStates_t)ST_SPI_CLOSED_RF_BUSY ==
         (eStates_t)StateMachine::GetInstance().GetCurrentState()) {
-      ALOGD_IF(ese_debug_enabled, "%s: NFC in Use", __FUNCTION__);
+      NXP_LOG_ESE_D("%s: NFC in Use", __FUNCTION__);
       return ESESTATUS_FAILED;
     }
   }
   ALOGD("%s: Proceed with open...", __FUNCTION__);
   /*When spi channel is already opened return status as FAILED*/
   if (nxpese_ctxt.EseLibStatus != ESE_STATUS_CLOSE) {
-    ALOGD_IF(ese_debug_enabled, "already opened\n");
+    NXP_LOG_ESE_D("already opened\n");
     return ESESTATUS_BUSY;
   }
 
@@ -259,8 +269,7 @@ ESESTATUS phNxpEse_open(phNxpEse_initParams initParams) {
 #ifdef NXP_NFCC_SPI_FW_DOWNLOAD_SYNC
   wConfigStatus = phNxpEse_checkFWDwnldStatus();
   if (wConfigStatus != ESESTATUS_SUCCESS) {
-    ALOGD_IF(ese_debug_enabled,
-             "Failed to open SPI due to VEN pin used by FW download \n");
+    NXP_LOG_ESE_D("Failed to open SPI due to VEN pin used by FW download \n");
     wConfigStatus = ESESTATUS_FAILED;
     goto clean_and_return_1;
   }
@@ -312,12 +321,13 @@ ESESTATUS phNxpEse_open(phNxpEse_initParams initParams) {
     }
     goto clean_and_return;
   } else {
-    ALOGD_IF(ese_debug_enabled, "nxpese_ctxt.spm_power_state true");
+    NXP_LOG_ESE_D("nxpese_ctxt.spm_power_state true");
     nxpese_ctxt.spm_power_state = true;
   }
 #endif
 
-  ALOGD_IF(ese_debug_enabled, "wConfigStatus %x", wConfigStatus);
+  NXP_LOG_ESE_D("wConfigStatus %x", wConfigStatus);
+  phNxpEse_startConfigTrace();
   return wConfigStatus;
 
 clean_and_return:
@@ -350,6 +360,23 @@ clean_and_return_2:
  ******************************************************************************/
 bool phNxpEse_isOpen() { return nxpese_ctxt.EseLibStatus != ESE_STATUS_CLOSE; }
 
+/******************************************************************************
+ * Function         phNxpEse_startConfigTrace
+ *
+ * Description      Starts an APDU capture for the session just opened when
+ *                  NXP_ESE_TRACE_FILE is set. Captures hold complete APDUs,
+ *                  so the key is ignored on non-debuggable builds.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+static void phNxpEse_startConfigTrace(void) {
+#ifdef NXP_ESE_DEBUGGABLE
+  std::string tracePath = EseConfig::getString(NAME_NXP_ESE_TRACE_FILE, "");
+  if (!tracePath.empty()) phNxpEse_TraceStart(tracePath.c_str());
+#endif
+}
+
 /******************************************************************************
  * Function         phNxpEse_openPrioSession
  *
@@ -360,7 +387,8 @@ bool phNxpEse_isOpen() { return nxpese_ctxt.EseLibStatus != ESE_STATUS_CLOSE; }
  duration.
 
  * Returns          This function return ESESTATUS_SUCCES (0) in case of success
- *                  In case of failure returns other failure value.
+ *                  In case of failure returns other failure value,
+ *                  ESESTATUS_BUSY if a priority session is already open.
  *
  ******************************************************************************/
 ESESTATUS phNxpEse_openPrioSession(phNxpEse_initParams initParams) {
@@ -369,6 +397,15 @@ ESESTATUS phNxpEse_openPrioSession(phNxpEse_initParams initParams) {
   unsigned long int num = 0, tpm_enable = 0;
 
   ALOGE("phNxpEse_openPrioSession Enter");
+  /*phNxpEse_close ends one priority session, so only one may be open*/
+  if (gsPrioSessionOpen) {
+    ALOGE("%s: priority session already open", __FUNCTION__);
+    return ESESTATUS_BUSY;
+  }
+  phNxpEse_SchedPrioSessionBegin();
+  gsPrioSessionOpen = true;
+  phNxpEse_StatsSessionStart();
+  phNxpEse_CacheInit();
 #ifdef SPM_INTEGRATED
   ESESTATUS wSpmStatus = ESESTATUS_SUCCESS;
   spm_state_t current_spm_state = SPM_STATE_INVALID;
@@ -451,8 +488,7 @@ ESESTATUS phNxpEse_openPrioSession(phNxpEse_initParams initParams) {
 #ifdef NXP_NFCC_SPI_FW_DOWNLOAD_SYNC
     wConfigStatus = phNxpEse_checkFWDwnldStatus();
     if (wConfigStatus != ESESTATUS_SUCCESS) {
-      ALOGD_IF(ese_debug_enabled,
-               "Failed to open SPI due to VEN pin used by FW download \n");
+      NXP_LOG_ESE_D("Failed to open SPI due to VEN pin used by FW download \n");
       wConfigStatus = ESESTATUS_FAILED;
       goto clean_and_return_1;
     }
@@ -517,6 +553,7 @@ ESESTATUS phNxpEse_openPrioSession(phNxpEse_initParams initParams) {
   }
 
   ALOGE("wConfigStatus %x", wConfigStatus);
+  phNxpEse_startConfigTrace();
 
   return wConfigStatus;
 
@@ -536,6 +573,8 @@ clean_and_return_2:
   }
   nxpese_ctxt.EseLibStatus = ESE_STATUS_CLOSE;
   nxpese_ctxt.spm_power_state = false;
+  gsPrioSessionOpen = false;
+  phNxpEse_SchedPrioSessionEnd();
   return ESESTATUS_FAILED;
 }
 #ifdef NXP_ESE_JCOP_DWNLD_PROTECTION
@@ -632,6 +671,7 @@ ESESTATUS phNxpEse_Transceive(phNxpEse_data* pCmd, phNxpEse_data* pRsp) {
     ALOGE(" %s ESE - BUSY \n", __FUNCTION__);
     return ESESTATUS_BUSY;
   } else {
+    uint64_t startUs = phNxpEse_StatsNowUs();
     nxpese_ctxt.EseLibStatus = ESE_STATUS_BUSY;
     status = phNxpEseProto7816_Transceive((phNxpEse_data*)pCmd,
                                           (phNxpEse_data*)pRsp);
@@ -639,9 +679,11 @@ ESESTATUS phNxpEse_Transceive(phNxpEse_data* pCmd, phNxpEse_data* pRsp) {
       ALOGE(" %s phNxpEseProto7816_Transceive- Failed \n", __FUNCTION__);
     }
     nxpese_ctxt.EseLibStatus = ESE_STATUS_IDLE;
+    uint64_t endUs = phNxpEse_StatsNowUs();
+    phNxpEse_StatsRecord(PH_ESE_STAT_TRANSCEIVE, endUs - startUs);
+    phNxpEse_TraceTransceive(pCmd, pRsp, status, startUs, endUs);
 
-    ALOGD_IF(ese_debug_enabled, " %s Exit status 0x%x \n", __FUNCTION__,
-             status);
+    NXP_LOG_ESE_D(" %s Exit status 0x%x \n", __FUNCTION__, status);
     return status;
   }
 }
@@ -663,17 +705,16 @@ ESESTATUS phNxpEse_reset(void) {
 #endif
 
   /* TBD : Call the ioctl to reset the ESE */
-  ALOGD_IF(ese_debug_enabled, " %s Enter \n", __FUNCTION__);
+  NXP_LOG_ESE_D(" %s Enter \n", __FUNCTION__);
   /* Do an interface reset, don't wait to see if JCOP went through a full power
    * cycle or not */
   ESESTATUS bStatus = phNxpEseProto7816_IntfReset(
       (phNxpEseProto7816SecureTimer_t*)&nxpese_ctxt.secureTimerParams);
   if (!bStatus) status = ESESTATUS_FAILED;
-  ALOGD_IF(ese_debug_enabled,
-           "%s secureTimer1 0x%x secureTimer2 0x%x secureTimer3 0x%x",
-           __FUNCTION__, nxpese_ctxt.secureTimerParams.secureTimer1,
-           nxpese_ctxt.secureTimerParams.secureTimer2,
-           nxpese_ctxt.secureTimerParams.secureTimer3);
+  NXP_LOG_ESE_D("%s secureTimer1 0x%x secureTimer2 0x%x secureTimer3 0x%x",
+                __FUNCTION__, nxpese_ctxt.secureTimerParams.secureTimer1,
+                nxpese_ctxt.secureTimerParams.secureTimer2,
+                nxpese_ctxt.secureTimerParams.secureTimer3);
   phNxpEse_GetMaxTimer(&maxTimer);
 #ifdef SPM_INTEGRATED
 #ifdef NXP_SECURE_TIMER_SESSION
@@ -698,7 +739,7 @@ ESESTATUS phNxpEse_reset(void) {
     ALOGE("phNxpEse_reset Failed");
   }
 #endif
-  ALOGD_IF(ese_debug_enabled, " %s Exit \n", __FUNCTION__);
+  NXP_LOG_ESE_D(" %s Exit \n", __FUNCTION__);
   return status;
 }
 
@@ -721,10 +762,11 @@ ESESTATUS phNxpEse_resetJcopUpdate(void) {
 #endif
 
   /* TBD : Call the ioctl to reset the  */
-  ALOGD_IF(ese_debug_enabled, " %s Enter \n", __FUNCTION__);
+  NXP_LOG_ESE_D(" %s Enter \n", __FUNCTION__);
 
   /* Reset interface after every reset irrespective of
   whether JCOP did a full power cycle or not. */
+  phNxpEse_CacheFlush("jcop_update");
   status = phNxpEseProto7816_Reset();
 
 #ifdef SPM_INTEGRATED
@@ -732,21 +774,21 @@ ESESTATUS phNxpEse_resetJcopUpdate(void) {
   if (EseConfig::hasKey(NAME_NXP_POWER_SCHEME)) {
     num = EseConfig::getUnsigned(NAME_NXP_POWER_SCHEME);
     if ((num == 1) || (num == 2)) {
-      ALOGD_IF(ese_debug_enabled, " %s Call Config Pwr Reset \n", __FUNCTION__);
+      NXP_LOG_ESE_D(" %s Call Config Pwr Reset \n", __FUNCTION__);
       status = phNxpEse_SPM_ConfigPwr(SPM_POWER_RESET);
       if (status != ESESTATUS_SUCCESS) {
         ALOGE("phNxpEse_resetJcopUpdate: reset Failed");
         status = ESESTATUS_FAILED;
       }
     } else if (num == 3) {
-      ALOGD_IF(ese_debug_enabled, " %s Call eSE Chip Reset \n", __FUNCTION__);
+      NXP_LOG_ESE_D(" %s Call eSE Chip Reset \n", __FUNCTION__);
       status = phNxpEse_chipReset();
       if (status != ESESTATUS_SUCCESS) {
         ALOGE("phNxpEse_resetJcopUpdate: chip reset Failed");
         status = ESESTATUS_FAILED;
       }
     } else {
-      ALOGD_IF(ese_debug_enabled, " %s Invalid Power scheme \n", __FUNCTION__);
+      NXP_LOG_ESE_D(" %s Invalid Power scheme \n", __FUNCTION__);
     }
   }
 #else
@@ -768,7 +810,7 @@ ESESTATUS phNxpEse_resetJcopUpdate(void) {
   }
 #endif
 
-  ALOGD_IF(ese_debug_enabled, " %s Exit \n", __FUNCTION__);
+  NXP_LOG_ESE_D(" %s Exit \n", __FUNCTION__);
   return status;
 }
 /******************************************************************************
@@ -803,6 +845,9 @@ ESESTATUS phNxpEse_chipReset(void) {
   ESESTATUS status = ESESTATUS_SUCCESS;
   ESESTATUS bStatus = ESESTATUS_FAILED;
   if (nxpese_ctxt.pwr_scheme == PN80T_EXT_PMU_SCHEME) {
+    uint64_t resetStartUs = phNxpEse_StatsNowUs();
+    phNxpEse_StatsCount(PH_ESE_CNT_CHIP_RESET);
+    phNxpEse_CacheFlush(phNxpEse_StatsCounterName(PH_ESE_CNT_CHIP_RESET));
     bStatus = phNxpEseProto7816_Reset();
     if (!bStatus) {
       status = ESESTATUS_FAILED;
@@ -812,6 +857,9 @@ ESESTATUS phNxpEse_chipReset(void) {
     if (status != ESESTATUS_SUCCESS) {
       ALOGE("phNxpEse_chipReset  Failed");
     }
+    phNxpEse_StatsRecoveryTime(PH_ESE_CNT_CHIP_RESET,
+                               phNxpEse_StatsNowUs() - resetStartUs);
+    phNxpEse_FlightRecDump(phNxpEse_StatsCounterName(PH_ESE_CNT_CHIP_RESET));
   } else {
     ALOGE("phNxpEse_chipReset is not supported in legacy power scheme");
     status = ESESTATUS_FAILED;
@@ -829,7 +877,7 @@ ESESTATUS phNxpEse_chipReset(void) {
  ******************************************************************************/
 ESESTATUS phNxpEse_deInit(void) {
   ESESTATUS status = ESESTATUS_SUCCESS;
-  ALOGD_IF(ese_debug_enabled, "%s Enter", __FUNCTION__);
+  NXP_LOG_ESE_D("%s Enter", __FUNCTION__);
   status = phNxpEseProto7816_Close(
       (phNxpEseProto7816SecureTimer_t*)&nxpese_ctxt.secureTimerParams);
   if (status == ESESTATUS_FAILED) {
@@ -849,11 +897,19 @@ ESESTATUS phNxpEse_deInit(void) {
  ******************************************************************************/
 ESESTATUS phNxpEse_close(void) {
   ESESTATUS status = ESESTATUS_SUCCESS;
-  ALOGD_IF(ese_debug_enabled, "%s Enter", __FUNCTION__);
+  NXP_LOG_ESE_D("%s Enter", __FUNCTION__);
+  if (gsPrioSessionOpen) {
+    gsPrioSessionOpen = false;
+    phNxpEse_SchedPrioSessionEnd();
+  }
   if ((ESE_STATUS_CLOSE == nxpese_ctxt.EseLibStatus)) {
     ALOGE(" %s ESE Not Initialized \n", __FUNCTION__);
     return ESESTATUS_NOT_INITIALISED;
   }
+  /* Responses read while the OS was being replaced are stale */
+  if (ESE_MODE_OSU == nxpese_ctxt.initParams.initMode) {
+    phNxpEse_CacheFlush("jcop_update");
+  }
 
 #ifdef SPM_INTEGRATED
   ESESTATUS wSpmStatus = ESESTATUS_SUCCESS;
@@ -884,9 +940,11 @@ ESESTATUS phNxpEse_close(void) {
   if (NULL != nxpese_ctxt.pDevHandle) {
     phPalEse_close(nxpese_ctxt.pDevHandle);
     phNxpEse_memset(&nxpese_ctxt, 0x00, sizeof(nxpese_ctxt));
-    ALOGD_IF(ese_debug_enabled,
-             "phNxpEse_close - ESE Context deinit completed");
+    NXP_LOG_ESE_D("phNxpEse_close - ESE Context deinit completed");
   }
+  phNxpEse_TraceStop();
+  /* A dump left by a recovery outside of a scheduled transceive */
+  phNxpEse_FlightRecDumpPending();
   /* Return success always */
   StateMachine::GetInstance().ProcessExtEvent(EVT_SPI_CLOSE);
   return status;
@@ -909,23 +967,25 @@ ESESTATUS phNxpEse_read(uint32_t* data_len, uint8_t** pp_data) {
   ESESTATUS status = ESESTATUS_SUCCESS;
   int ret = -1;
 
-  ALOGD_IF(ese_debug_enabled, "%s Enter ..", __FUNCTION__);
+  NXP_LOG_ESE_D("%s Enter ..", __FUNCTION__);
 
   ret = phNxpEse_readPacket(nxpese_ctxt.pDevHandle, nxpese_ctxt.p_read_buff,
                             MAX_DATA_LEN);
   if (ret < 0) {
     ALOGE("PAL Read status error status = %x", status);
+    phNxpEse_FlightRecAdd(PH_ESE_FLIGHTREC_RX_FAIL, NULL, 0);
     *data_len = 2;
     *pp_data = nxpese_ctxt.p_read_buff;
     status = ESESTATUS_FAILED;
   } else {
     PH_PAL_ESE_PRINT_PACKET_RX(nxpese_ctxt.p_read_buff, ret);
+    phNxpEse_FlightRecAdd(PH_ESE_FLIGHTREC_RX, nxpese_ctxt.p_read_buff, ret);
     *data_len = ret;
     *pp_data = nxpese_ctxt.p_read_buff;
     status = ESESTATUS_SUCCESS;
   }
 
-  ALOGD_IF(ese_debug_enabled, "%s Exit", __FUNCTION__);
+  NXP_LOG_ESE_D("%s Exit", __FUNCTION__);
   return status;
 }
 
@@ -944,37 +1004,41 @@ static int phNxpEse_readPacket(void* pDevHandle, uint8_t* pBuffer,
   int ret = -1;
   int sof_counter = 0; /* one read may take 1 ms*/
   int total_count = 0, numBytesToRead = 0, headerIndex = 0;
+  uint64_t pollStartUs = phNxpEse_StatsNowUs();
 
-  ALOGD_IF(ese_debug_enabled, "%s Enter", __FUNCTION__);
+  NXP_LOG_ESE_D("%s Enter", __FUNCTION__);
   do {
     sof_counter++;
     ret = -1;
     ret = phPalEse_read(pDevHandle, pBuffer, 2);
     if (ret < 0) {
       /*Polling for read on spi, hence Debug log*/
-      ALOGD_IF(ese_debug_enabled, "_spi_read() [HDR]errno : %x ret : %X", errno,
-               ret);
+      NXP_LOG_ESE_D("_spi_read() [HDR]errno : %x ret : %X", errno, ret);
     }
     if (pBuffer[0] == RECIEVE_PACKET_SOF) {
       /* Read the HEADR of one byte*/
-      ALOGD_IF(ese_debug_enabled, "%s Read HDR", __FUNCTION__);
+      NXP_LOG_ESE_D("%s Read HDR", __FUNCTION__);
       numBytesToRead = 1;
       headerIndex = 1;
       break;
     } else if (pBuffer[1] == RECIEVE_PACKET_SOF) {
       /* Read the HEADR of Two bytes*/
-      ALOGD_IF(ese_debug_enabled, "%s Read HDR", __FUNCTION__);
+      NXP_LOG_ESE_D("%s Read HDR", __FUNCTION__);
       pBuffer[0] = RECIEVE_PACKET_SOF;
       numBytesToRead = 2;
       headerIndex = 0;
       break;
     }
-    ALOGD_IF(ese_debug_enabled, "%s Normal Pkt, delay read %dus", __FUNCTION__,
-             READ_WAKE_UP_DELAY * NAD_POLLING_SCALER);
+    NXP_LOG_ESE_D("%s Normal Pkt, delay read %dus", __FUNCTION__,
+                  READ_WAKE_UP_DELAY * NAD_POLLING_SCALER);
     phPalEse_sleep(READ_WAKE_UP_DELAY * NAD_POLLING_SCALER);
   } while (sof_counter < ESE_NAD_POLLING_MAX);
+  uint64_t readStartUs = phNxpEse_StatsNowUs();
+  phNxpEse_StatsRecord(PH_ESE_STAT_SOF_POLL, readStartUs - pollStartUs);
+  phNxpEse_TraceThinkTime(readStartUs - pollStartUs);
+  phNxpEse_StatsRecord(PH_ESE_STAT_SOF_POLL_COUNT, sof_counter);
   if (pBuffer[0] == RECIEVE_PACKET_SOF) {
-    ALOGD_IF(ese_debug_enabled, "%s SOF FOUND", __FUNCTION__);
+    NXP_LOG_ESE_D("%s SOF FOUND", __FUNCTION__);
     /* Read the HEADR of one/Two bytes based on how two bytes read A5 PCB or 00
      * A5*/
     ret = phPalEse_read(pDevHandle, &pBuffer[1 + headerIndex], numBytesToRead);
@@ -991,6 +1055,8 @@ static int phNxpEse_readPacket(void* pDevHandle, uint8_t* pBuffer,
     } else {
       ret = (total_count + (nNbBytesToRead + 1));
     }
+    phNxpEse_StatsRecord(PH_ESE_STAT_PAYLOAD_READ,
+                         phNxpEse_StatsNowUs() - readStartUs);
   } else if (ret < 0) {
     /*In case of IO Error*/
     ret = -2;
@@ -999,7 +1065,7 @@ static int phNxpEse_readPacket(void* pDevHandle, uint8_t* pBuffer,
   } else {
     ret = -1;
   }
-  ALOGD_IF(ese_debug_enabled, "%s Exit ret = %d", __FUNCTION__, ret);
+  NXP_LOG_ESE_D("%s Exit ret = %d", __FUNCTION__, ret);
   return ret;
 }
 /******************************************************************************
@@ -1017,23 +1083,29 @@ static int phNxpEse_readPacket(void* pDevHandle, uint8_t* pBuffer,
 ESESTATUS phNxpEse_WriteFrame(uint32_t data_len, const uint8_t* p_data) {
   ESESTATUS status = ESESTATUS_INVALID_PARAMETER;
   int32_t dwNoBytesWrRd = 0;
-  ALOGD_IF(ese_debug_enabled, "Enter %s ", __FUNCTION__);
+  NXP_LOG_ESE_D("Enter %s ", __FUNCTION__);
 
   /* Create local copy of cmd_data */
   phNxpEse_memcpy(nxpese_ctxt.p_cmd_data, p_data, data_len);
   nxpese_ctxt.cmd_len = data_len;
 
+  uint64_t startUs = phNxpEse_StatsNowUs();
   dwNoBytesWrRd = phPalEse_write(nxpese_ctxt.pDevHandle, nxpese_ctxt.p_cmd_data,
                                  nxpese_ctxt.cmd_len);
+  phNxpEse_StatsRecord(PH_ESE_STAT_SPI_WRITE, phNxpEse_StatsNowUs() - startUs);
   if (-1 == dwNoBytesWrRd) {
     ALOGE(" - Error in SPI Write.....\n");
+    phNxpEse_FlightRecAdd(PH_ESE_FLIGHTREC_TX_FAIL, nxpese_ctxt.p_cmd_data,
+                          nxpese_ctxt.cmd_len);
     status = ESESTATUS_FAILED;
   } else {
     status = ESESTATUS_SUCCESS;
     PH_PAL_ESE_PRINT_PACKET_TX(nxpese_ctxt.p_cmd_data, nxpese_ctxt.cmd_len);
+    phNxpEse_FlightRecAdd(PH_ESE_FLIGHTREC_TX, nxpese_ctxt.p_cmd_data,
+                          nxpese_ctxt.cmd_len);
   }
 
-  ALOGD_IF(ese_debug_enabled, "Exit %s status %x\n", __FUNCTION__, status);
+  NXP_LOG_ESE_D("Exit %s status %x\n", __FUNCTION__, status);
   return status;
 }
 
@@ -1143,7 +1215,7 @@ void phNxpEse_free(void* ptr) {
  *
  ******************************************************************************/
 void phNxpEse_GetMaxTimer(unsigned long *pMaxTimer) {
-  ALOGD_IF(ese_debug_enabled, "%s Enter", __FUNCTION__);
+  NXP_LOG_ESE_D("%s Enter", __FUNCTION__);
   /* Finding the max. of the timer value */
   *pMaxTimer = nxpese_ctxt.secureTimerParams.secureTimer1;
   if (*pMaxTimer < nxpese_ctxt.secureTimerParams.secureTimer2)
@@ -1250,7 +1322,7 @@ ESESTATUS phNxpEse_GetEseStatus(phNxpEse_data* timer_buffer) {
 
   phNxpEse_SecureTimer_t secureTimerParams;
   uint8_t* temp_timer_buffer = NULL;
-  ALOGD_IF(ese_debug_enabled, "%s Enter", __FUNCTION__);
+  NXP_LOG_ESE_D("%s Enter", __FUNCTION__);
 
   if (timer_buffer != NULL) {
     timer_buffer->len =
@@ -1265,8 +1337,7 @@ ESESTATUS phNxpEse_GetEseStatus(phNxpEse_data* timer_buffer) {
     phNxpEse_memcpy(&secureTimerParams, &nxpese_ctxt.secureTimerParams,
                     sizeof(phNxpEse_SecureTimer_t));
 
-    ALOGD_IF(
-        ese_debug_enabled,
+    NXP_LOG_ESE_D(
         "%s secureTimer1 0x%x secureTimer2 0x%x secureTimer3 0x%x len = %d",
         __FUNCTION__, secureTimerParams.secureTimer1,
         secureTimerParams.secureTimer2, secureTimerParams.secureTimer3,
@@ -1300,7 +1371,7 @@ ESESTATUS phNxpEse_GetEseStatus(phNxpEse_data* timer_buffer) {
     ALOGE("%s Invalid timer buffer ", __FUNCTION__);
   }
 
-  ALOGD_IF(ese_debug_enabled, "%s Exit status = 0x%x", __FUNCTION__, status);
+  NXP_LOG_ESE_D("%s Exit status = 0x%x", __FUNCTION__, status);
   return status;
 }
 #ifdef NXP_SECURE_TIMER_SESSION
@@ -1308,12 +1379,11 @@ static unsigned char* phNxpEse_GgetTimerTlvBuffer(uint8_t* timer_buffer,
                                                   unsigned int value) {
   short int count = 0, shift = 3;
   unsigned int mask = 0x000000FF;
-  ALOGD_IF(ese_debug_enabled, "value = %x \n", value);
+  NXP_LOG_ESE_D("value = %x \n", value);
   for (count = 0; count < 4; count++) {
     if (timer_buffer != NULL) {
       *timer_buffer = (value >> (shift * 8) & mask);
-      ALOGD_IF(ese_debug_enabled, "*timer_buffer=0x%x shift=0x%x",
-               *timer_buffer, shift);
+      NXP_LOG_ESE_D("*timer_buffer=0x%x shift=0x%x", *timer_buffer, shift);
       timer_buffer++;
       shift--;
     } else {
@@ -0,0 +1,427 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+#define LOG_TAG "NxpEseHal"
+#include <ese_config.h>
+#include <log/log.h>
+#include <phNxpEseLog.h>
+#include <phNxpEse_Cache.h>
+#include <phNxpEse_Sched.h>
+#include <string.h>
+#include "Mutex.h"
+
+/* Instructions of the APDUs passing through that change what the cache
+ * holds: SELECT and MANAGE CHANNEL change the AID of a channel, the
+ * GlobalPlatform commands below (CLA 8X) change the card content */
+#define PH_ESE_CACHE_INS_SELECT 0xA4
+#define PH_ESE_CACHE_INS_MANAGE_CHANNEL 0x70
+static const uint8_t gCacheGpWriteIns[] = {
+    0xD8, /* PUT KEY */
+    0xDA, /* PUT DATA */
+    0xDB, /* PUT DATA */
+    0xE2, /* STORE DATA */
+    0xE4, /* DELETE */
+    0xE6, /* INSTALL */
+    0xE8, /* LOAD */
+    0xF0, /* SET STATUS */
+};
+
+/* A response, keyed by the AID selected on the channel of the command and
+ * the command with the channel cleared from its class byte */
+typedef struct phNxpEse_CacheEntry {
+  uint64_t lastUse; /* 0 while free */
+  uint8_t aidLen;
+  uint8_t aid[PH_ESE_CACHE_MAX_AID];
+  uint8_t cmdLen;
+  uint8_t cmd[PH_ESE_CACHE_MAX_CMD];
+  uint16_t rspLen;
+  uint8_t rsp[PH_ESE_CACHE_MAX_RSP];
+} phNxpEse_CacheEntry_t;
+
+/* AID the HAL selected on a channel; seq counts the selects so that a
+ * response is not stored for an AID selected while it was on its way */
+typedef struct phNxpEse_CacheChannel {
+  bool known;
+  uint8_t aidLen;
+  uint8_t aid[PH_ESE_CACHE_MAX_AID];
+  uint32_t seq;
+} phNxpEse_CacheChannel_t;
+
+static Mutex gCacheLock;
+static bool gCacheRulesLoaded;
+static std::vector<uint8_t> gCacheRules;
+static uint32_t gCacheSize;
+static phNxpEse_CacheEntry_t gCacheEntries[PH_ESE_CACHE_MAX_ENTRIES];
+static phNxpEse_CacheChannel_t gCacheChannels[PH_ESE_MAX_CHANNELS];
+static uint64_t gCacheGeneration; /* counts the flushes, see CacheTransceive */
+static uint64_t gCacheTick;
+static uint64_t gCacheHits;
+static uint64_t gCacheMisses;
+
+/******************************************************************************
+ * Function         phNxpEse_CacheFlushLocked
+ *
+ * Description      Drops every entry. Called with gCacheLock.
+ *
+ * Returns          Number of entries dropped
+ *
+ ******************************************************************************/
+static uint32_t phNxpEse_CacheFlushLocked(void) {
+  uint32_t dropped = 0;
+  for (uint32_t i = 0; i < PH_ESE_CACHE_MAX_ENTRIES; i++) {
+    if (gCacheEntries[i].lastUse != 0) dropped++;
+    gCacheEntries[i].lastUse = 0;
+  }
+  gCacheGeneration++;
+  return dropped;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_CacheInit
+ *
+ * Description      Loads the rules once, the config does not change while
+ *                  the library is loaded, and forgets the channel AIDs: a
+ *                  session starts with every logical channel closed.
+ *                  Drops every entry too, the card may have been updated
+ *                  by another process while no session was open.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void phNxpEse_CacheInit(void) {
+  gCacheLock.lock();
+  bool loaded = gCacheRulesLoaded;
+  gCacheRulesLoaded = true;
+  for (uint8_t i = 0; i < PH_ESE_MAX_CHANNELS; i++) {
+    gCacheChannels[i].known = false;
+    gCacheChannels[i].seq++;
+  }
+  gCacheLock.unlock();
+  phNxpEse_CacheFlush("session_open");
+  if (loaded || !EseConfig::hasKey(NAME_NXP_ESE_CACHE_APDUS)) return;
+
+  std::vector<uint8_t> rules = EseConfig::getBytes(NAME_NXP_ESE_CACHE_APDUS);
+  unsigned entries = EseConfig::getUnsigned(NAME_NXP_ESE_CACHE_ENTRIES,
+                                            PH_ESE_CACHE_ENTRIES_DEFAULT);
+  if (phNxpEse_CacheSetRules(rules.data(), rules.size(), entries) !=
+      ESESTATUS_SUCCESS) {
+    ALOGE("%s: malformed %s, nothing cached", __func__,
+          NAME_NXP_ESE_CACHE_APDUS);
+  }
+}
+
+/******************************************************************************
+ * Function         phNxpEse_CacheSetRules
+ *
+ * Description      Checks and installs the rules, each at most
+ *                  PH_ESE_CACHE_MAX_CMD bytes, and the size of the cache.
+ *
+ * Returns          ESESTATUS_SUCCESS or ESESTATUS_INVALID_PARAMETER
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_CacheSetRules(const uint8_t* pRules, uint32_t len,
+                                 uint32_t entries) {
+  ESESTATUS status = ESESTATUS_SUCCESS;
+  uint32_t pos = 0;
+  while ((pRules != NULL) && (pos < len)) {
+    uint32_t ruleLen = pRules[pos++];
+    if ((ruleLen == 0) || (ruleLen > PH_ESE_CACHE_MAX_CMD) ||
+        (ruleLen > len - pos)) {
+      status = ESESTATUS_INVALID_PARAMETER;
+      break;
+    }
+    pos += ruleLen;
+  }
+  if (entries == 0) entries = PH_ESE_CACHE_ENTRIES_DEFAULT;
+  if (entries > PH_ESE_CACHE_MAX_ENTRIES) entries = PH_ESE_CACHE_MAX_ENTRIES;
+
+  gCacheLock.lock();
+  gCacheRulesLoaded = true;
+  if ((status == ESESTATUS_SUCCESS) && (pRules != NULL)) {
+    gCacheRules.assign(pRules, pRules + len);
+  } else {
+    gCacheRules.clear();
+  }
+  gCacheSize = entries;
+  phNxpEse_CacheFlushLocked();
+  gCacheLock.unlock();
+  NXP_LOG_ESE_D("%s: %u bytes of rules, %u entries", __func__,
+                (unsigned)gCacheRules.size(), entries);
+  return status;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_CacheSelect
+ *
+ * Description      Records or forgets the AID selected on channel. AIDs
+ *                  too long for an entry leave the channel uncacheable.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void phNxpEse_CacheSelect(uint8_t channel, const uint8_t* pAid,
+                          uint32_t aidLen) {
+  if (channel >= PH_ESE_MAX_CHANNELS) return;
+  gCacheLock.lock();
+  phNxpEse_CacheChannel_t* pChannel = &gCacheChannels[channel];
+  pChannel->seq++;
+  pChannel->known = (pAid != NULL) && (aidLen <= PH_ESE_CACHE_MAX_AID);
+  if (pChannel->known) {
+    pChannel->aidLen = (uint8_t)aidLen;
+    memcpy(pChannel->aid, pAid, aidLen);
+  }
+  gCacheLock.unlock();
+}
+
+/******************************************************************************
+ * Function         phNxpEse_CacheFlush
+ *
+ * Description      Drops every entry and logs the counters.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void phNxpEse_CacheFlush(const char* pReason) {
+  gCacheLock.lock();
+  uint32_t dropped = phNxpEse_CacheFlushLocked();
+  uint64_t hits = gCacheHits;
+  uint64_t misses = gCacheMisses;
+  gCacheLock.unlock();
+  NXP_LOG_ESE_D("%s: %s, %u dropped, hits %llu misses %llu", __func__,
+                pReason, dropped, (unsigned long long)hits,
+                (unsigned long long)misses);
+}
+
+/******************************************************************************
+ * Function         phNxpEse_CacheRuleMatch
+ *
+ * Description      Tells whether a rule is a prefix of the command key.
+ *                  Called with gCacheLock.
+ *
+ * Returns          true if the command is cacheable
+ *
+ ******************************************************************************/
+static bool phNxpEse_CacheRuleMatch(const uint8_t* pKey, uint32_t keyLen) {
+  size_t pos = 0;
+  while (pos < gCacheRules.size()) {
+    size_t ruleLen = gCacheRules[pos++];
+    if ((ruleLen <= keyLen) && (memcmp(&gCacheRules[pos], pKey, ruleLen) == 0))
+      return true;
+    pos += ruleLen;
+  }
+  return false;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_CacheKeyCla
+ *
+ * Description      Clears the channel from a class byte, in the first
+ *                  interindustry encoding (channel in b2-b1, secure
+ *                  messaging in b4-b3) or the further one (b7 set, channel
+ *                  in b4-b1, secure messaging in b6). Responses to secure
+ *                  messaging depend on the session keys and are never kept.
+ *
+ * Returns          false if the command uses secure messaging
+ *
+ ******************************************************************************/
+static bool phNxpEse_CacheKeyCla(uint8_t cla, uint8_t* pKeyCla) {
+  if (cla & 0x40) {
+    if (cla & 0x20) return false;
+    *pKeyCla = cla & ~0x4F;
+  } else {
+    if (cla & 0x0C) return false;
+    *pKeyCla = cla & ~0x03;
+  }
+  return true;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_CacheFind
+ *
+ * Description      Looks up the entry of a command key on a channel.
+ *                  Called with gCacheLock.
+ *
+ * Returns          The entry, NULL if none
+ *
+ ******************************************************************************/
+static phNxpEse_CacheEntry_t* phNxpEse_CacheFind(
+    const phNxpEse_CacheChannel_t* pChannel, const uint8_t* pKey,
+    uint32_t keyLen) {
+  for (uint32_t i = 0; i < gCacheSize; i++) {
+    phNxpEse_CacheEntry_t* pEntry = &gCacheEntries[i];
+    if ((pEntry->lastUse != 0) && (pEntry->cmdLen == keyLen) &&
+        (pEntry->aidLen == pChannel->aidLen) &&
+        (memcmp(pEntry->cmd, pKey, keyLen) == 0) &&
+        (memcmp(pEntry->aid, pChannel->aid, pChannel->aidLen) == 0)) {
+      return pEntry;
+    }
+  }
+  return NULL;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_CacheStore
+ *
+ * Description      Keeps a response in the entry of its key, a free one or
+ *                  the least recently used one. Called with gCacheLock.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void phNxpEse_CacheStore(const phNxpEse_CacheChannel_t* pChannel,
+                                const uint8_t* pKey, uint32_t keyLen,
+                                const phNxpEse_data* pRsp) {
+  if (gCacheSize == 0) return;
+  phNxpEse_CacheEntry_t* pEntry = phNxpEse_CacheFind(pChannel, pKey, keyLen);
+  if (pEntry == NULL) {
+    /* Free entries have the oldest use of all */
+    pEntry = &gCacheEntries[0];
+    for (uint32_t i = 1; i < gCacheSize; i++) {
+      if (gCacheEntries[i].lastUse < pEntry->lastUse)
+        pEntry = &gCacheEntries[i];
+    }
+  }
+
+  pEntry->lastUse = ++gCacheTick;
+  pEntry->aidLen = pChannel->aidLen;
+  memcpy(pEntry->aid, pChannel->aid, pChannel->aidLen);
+  pEntry->cmdLen = (uint8_t)keyLen;
+  memcpy(pEntry->cmd, pKey, keyLen);
+  pEntry->rspLen = (uint16_t)pRsp->len;
+  memcpy(pEntry->rsp, pRsp->p_data, pRsp->len);
+}
+
+/******************************************************************************
+ * Function         phNxpEse_CacheNoteCommand
+ *
+ * Description      Forgets the AID of the channel of a SELECT or MANAGE
+ *                  CHANNEL passing through, and drops every entry before a
+ *                  GlobalPlatform command changing the card content.
+ *                  Called with gCacheLock.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void phNxpEse_CacheNoteCommand(uint8_t channel, const uint8_t* pCmd,
+                                      uint32_t len) {
+  if (len < 2) return;
+  uint8_t ins = pCmd[1];
+  if ((ins == PH_ESE_CACHE_INS_SELECT) ||
+      (ins == PH_ESE_CACHE_INS_MANAGE_CHANNEL)) {
+    if (channel < PH_ESE_MAX_CHANNELS) {
+      gCacheChannels[channel].known = false;
+      gCacheChannels[channel].seq++;
+    }
+    return;
+  }
+  if (!(pCmd[0] & 0x80)) return;
+  for (size_t i = 0; i < sizeof(gCacheGpWriteIns); i++) {
+    if (ins == gCacheGpWriteIns[i]) {
+      phNxpEse_CacheFlushLocked();
+      return;
+    }
+  }
+}
+
+/******************************************************************************
+ * Function         phNxpEse_CacheTransceive
+ *
+ * Description      Answers a cacheable APDU from the cache, or sends it and
+ *                  keeps a 9000 response. The response is kept only if no
+ *                  flush and no select on its channel happened meanwhile.
+ *
+ * Returns          Status of phNxpEse_SchedTransceive, success on a hit
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_CacheTransceive(phNxpEse_data* pCmd, phNxpEse_data* pRsp) {
+  if ((pCmd == NULL) || (pCmd->p_data == NULL) || (pCmd->len == 0) ||
+      (pRsp == NULL)) {
+    return phNxpEse_SchedTransceive(pCmd, pRsp);
+  }
+  uint8_t channel = phNxpEse_ChannelFromCla(pCmd->p_data[0]);
+  uint8_t key[PH_ESE_CACHE_MAX_CMD];
+  uint32_t keyLen = 0;
+  uint64_t generation = 0;
+  uint32_t seq = 0;
+  bool cacheable = false;
+
+  gCacheLock.lock();
+  if ((channel < PH_ESE_MAX_CHANNELS) && gCacheChannels[channel].known &&
+      (pCmd->len <= PH_ESE_CACHE_MAX_CMD)) {
+    keyLen = pCmd->len;
+    memcpy(key, pCmd->p_data, keyLen);
+    cacheable = phNxpEse_CacheKeyCla(pCmd->p_data[0], &key[0]) &&
+                phNxpEse_CacheRuleMatch(key, keyLen);
+  }
+  if (cacheable) {
+    phNxpEse_CacheEntry_t* pEntry =
+        phNxpEse_CacheFind(&gCacheChannels[channel], key, keyLen);
+    uint8_t* pData =
+        (pEntry != NULL) ? (uint8_t*)phNxpEse_memalloc(pEntry->rspLen) : NULL;
+    if (pData != NULL) {
+      memcpy(pData, pEntry->rsp, pEntry->rspLen);
+      pRsp->p_data = pData;
+      pRsp->len = pEntry->rspLen;
+      pEntry->lastUse = ++gCacheTick;
+      gCacheHits++;
+      gCacheLock.unlock();
+      return ESESTATUS_SUCCESS;
+    }
+    gCacheMisses++;
+    generation = gCacheGeneration;
+    seq = gCacheChannels[channel].seq;
+  } else {
+    phNxpEse_CacheNoteCommand(channel, pCmd->p_data, pCmd->len);
+  }
+  gCacheLock.unlock();
+
+  ESESTATUS status = phNxpEse_SchedTransceive(pCmd, pRsp);
+  if (cacheable && (status == ESESTATUS_SUCCESS) && (pRsp->p_data != NULL) &&
+      (pRsp->len >= 2) && (pRsp->len <= PH_ESE_CACHE_MAX_RSP) &&
+      (pRsp->p_data[pRsp->len - 2] == 0x90) &&
+      (pRsp->p_data[pRsp->len - 1] == 0x00)) {
+    gCacheLock.lock();
+    if ((generation == gCacheGeneration) &&
+        (seq == gCacheChannels[channel].seq)) {
+      phNxpEse_CacheStore(&gCacheChannels[channel], key, keyLen, pRsp);
+    }
+    gCacheLock.unlock();
+  }
+  return status;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_CacheGetCounters
+ *
+ * Description      Copies the counters and the number of entries held.
+ *
+ * Returns          ESESTATUS_SUCCESS or ESESTATUS_INVALID_PARAMETER
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_CacheGetCounters(phNxpEse_CacheCounters_t* pCounters) {
+  if (pCounters == NULL) return ESESTATUS_INVALID_PARAMETER;
+  gCacheLock.lock();
+  pCounters->hits = gCacheHits;
+  pCounters->misses = gCacheMisses;
+  pCounters->flushes = gCacheGeneration;
+  pCounters->entries = 0;
+  for (uint32_t i = 0; i < PH_ESE_CACHE_MAX_ENTRIES; i++) {
+    if (gCacheEntries[i].lastUse != 0) pCounters->entries++;
+  }
+  gCacheLock.unlock();
+  return ESESTATUS_SUCCESS;
+}
@@ -0,0 +1,146 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+#include <phNxpEse_Channel.h>
+#include <string.h>
+
+/******************************************************************************
+ * Function         phNxpEse_ChannelReset
+ *
+ * Description      Marks every channel closed.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void phNxpEse_ChannelReset(phNxpEse_ChannelTable_t* pTable) {
+  memset(pTable, 0x00, sizeof(*pTable));
+}
+
+/******************************************************************************
+ * Function         phNxpEse_ChannelAdd
+ *
+ * Description      Records a channel opened by the eSE for owner.
+ *
+ * Returns          ESESTATUS_SUCCESS, or ESESTATUS_INVALID_PARAMETER for a
+ *                  number out of range or a channel already open
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_ChannelAdd(phNxpEse_ChannelTable_t* pTable, uint8_t channel,
+                              uint64_t owner) {
+  if (channel >= PH_ESE_MAX_CHANNELS || (pTable->openMask & (1u << channel))) {
+    return ESESTATUS_INVALID_PARAMETER;
+  }
+  pTable->openMask |= (1u << channel);
+  pTable->owner[channel] = owner;
+  pTable->count++;
+  return ESESTATUS_SUCCESS;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_ChannelRemove
+ *
+ * Description      Marks a channel closed.
+ *
+ * Returns          ESESTATUS_SUCCESS, or ESESTATUS_INVALID_PARAMETER if the
+ *                  channel was not open
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_ChannelRemove(phNxpEse_ChannelTable_t* pTable,
+                                 uint8_t channel) {
+  if (!phNxpEse_ChannelIsOpen(pTable, channel)) {
+    return ESESTATUS_INVALID_PARAMETER;
+  }
+  pTable->openMask &= ~(1u << channel);
+  pTable->owner[channel] = PH_ESE_CHANNEL_NO_OWNER;
+  pTable->count--;
+  return ESESTATUS_SUCCESS;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_ChannelIsOpen
+ *
+ * Description      Tells whether a channel number is valid and open.
+ *
+ * Returns          true if open
+ *
+ ******************************************************************************/
+bool phNxpEse_ChannelIsOpen(const phNxpEse_ChannelTable_t* pTable,
+                            uint8_t channel) {
+  return (channel < PH_ESE_MAX_CHANNELS) &&
+         (pTable->openMask & (1u << channel));
+}
+
+/******************************************************************************
+ * Function         phNxpEse_ChannelOwnedMask
+ *
+ * Description      Collects the channels held by owner.
+ *
+ * Returns          One bit per channel
+ *
+ ******************************************************************************/
+uint32_t phNxpEse_ChannelOwnedMask(const phNxpEse_ChannelTable_t* pTable,
+                                   uint64_t owner) {
+  uint32_t mask = 0;
+  uint32_t open = pTable->openMask;
+  while (open != 0) {
+    uint8_t channel = phNxpEse_ChannelNext(&open);
+    if (pTable->owner[channel] == owner) mask |= (1u << channel);
+  }
+  return mask;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_ChannelNext
+ *
+ * Description      Removes the lowest channel from a mask.
+ *
+ * Returns          The channel, PH_ESE_MAX_CHANNELS if the mask is empty
+ *
+ ******************************************************************************/
+uint8_t phNxpEse_ChannelNext(uint32_t* pMask) {
+  if (*pMask == 0) return PH_ESE_MAX_CHANNELS;
+  uint8_t channel = (uint8_t)__builtin_ctz(*pMask);
+  *pMask &= *pMask - 1;
+  return channel;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_ChannelCla
+ *
+ * Description      Encodes a channel into a class byte, keeping its
+ *                  proprietary (b8) and command chaining (b5) bits.
+ *
+ * Returns          The class byte
+ *
+ ******************************************************************************/
+uint8_t phNxpEse_ChannelCla(uint8_t cla, uint8_t channel) {
+  cla &= 0x90;
+  if (channel < 4) return cla | channel;
+  return cla | 0x40 | ((channel - 4) & 0x0F);
+}
+
+/******************************************************************************
+ * Function         phNxpEse_ChannelFromCla
+ *
+ * Description      Decodes the channel of a class byte.
+ *
+ * Returns          The channel
+ *
+ ******************************************************************************/
+uint8_t phNxpEse_ChannelFromCla(uint8_t cla) {
+  return (cla & 0x40) ? (uint8_t)(4 + (cla & 0x0F)) : (uint8_t)(cla & 0x03);
+}
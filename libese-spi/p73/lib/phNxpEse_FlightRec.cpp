@@ -0,0 +1,216 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+#define LOG_TAG "NxpEseHal"
+#include <log/log.h>
+#include <phNxpEse_Api.h>
+#include <phNxpEsePal.h>
+#include <phNxpEse_FlightRec.h>
+#include <phNxpEse_Stats.h>
+#include <sys/types.h>
+#include <ringbuffer.h>
+#include <atomic>
+#include "Mutex.h"
+
+/* The ring holds whole phNxpEse_FlightRecord_t entries back to back. It is
+ * created on first use and lives until the process exits. */
+static Mutex gFlightRecLock;
+static ringbuffer_t* gFlightRec = NULL;
+/* Records drained by phNxpEse_FlightRecMarkDump, logged by
+ * phNxpEse_FlightRecDumpPending. gFlightRecHasPending lets the transceive
+ * path skip the lock when nothing is pending. */
+static phNxpEse_FlightRecord_t* gFlightRecPending = NULL;
+static size_t gFlightRecPendingCount;
+static const char* gFlightRecPendingReason;
+static std::atomic<bool> gFlightRecHasPending(false);
+
+static const char* const gFlightRecDirNames[] = {"TX", "RX", "TX_FAIL",
+                                                 "RX_FAIL"};
+
+/******************************************************************************
+ * Function         phNxpEse_FlightRecHash
+ *
+ * Description      32-bit FNV-1a hash of a frame.
+ *
+ * Returns          Hash value
+ *
+ ******************************************************************************/
+static uint32_t phNxpEse_FlightRecHash(const uint8_t* p_data, uint32_t len) {
+  uint32_t hash = 0x811C9DC5;
+  for (uint32_t i = 0; i < len; i++) {
+    hash ^= p_data[i];
+    hash *= 0x01000193;
+  }
+  return hash;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_FlightRecAdd
+ *
+ * Description      Appends one frame record, dropping the oldest record when
+ *                  the ring is full.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+void phNxpEse_FlightRecAdd(phNxpEse_FlightRecDir_t dir, const uint8_t* p_data,
+                           uint32_t len) {
+  phNxpEse_FlightRecord_t rec;
+  if (p_data == NULL) len = 0;
+  phNxpEse_memset(&rec, 0x00, sizeof(rec));
+  rec.timeUs = phNxpEse_StatsNowUs();
+  rec.dir = (uint8_t)dir;
+  rec.len = (len > 0xFFFF) ? 0xFFFF : (uint16_t)len;
+  rec.hash = phNxpEse_FlightRecHash(p_data, len);
+  if (len > 0) {
+    if (len > 1) rec.pcb = p_data[1];
+    phNxpEse_memcpy(rec.prefix, p_data,
+                    (len < PH_ESE_FLIGHTREC_PREFIX_LEN)
+                        ? len
+                        : PH_ESE_FLIGHTREC_PREFIX_LEN);
+  }
+
+  Mutex::Autolock lock(gFlightRecLock);
+  if (gFlightRec == NULL) {
+    gFlightRec = ringbuffer_init(PH_ESE_FLIGHTREC_RECORDS * sizeof(rec));
+    if (gFlightRec == NULL) return;
+  }
+  if (ringbuffer_available(gFlightRec) < sizeof(rec)) {
+    ringbuffer_delete(gFlightRec, sizeof(rec));
+  }
+  ringbuffer_insert(gFlightRec, (const uint8_t*)&rec, sizeof(rec));
+}
+
+/******************************************************************************
+ * Function         phNxpEse_FlightRecDrainLocked
+ *
+ * Description      Moves all records out of the ring. Called with
+ *                  gFlightRecLock.
+ *
+ * Returns          Number of records in *ppRecs, to be freed by the caller
+ *
+ ******************************************************************************/
+static size_t phNxpEse_FlightRecDrainLocked(phNxpEse_FlightRecord_t** ppRecs) {
+  *ppRecs = NULL;
+  if ((gFlightRec == NULL) || (ringbuffer_size(gFlightRec) == 0)) return 0;
+  size_t size = ringbuffer_size(gFlightRec);
+  *ppRecs = (phNxpEse_FlightRecord_t*)phNxpEse_memalloc(size);
+  if (*ppRecs == NULL) return 0;
+  return ringbuffer_pop(gFlightRec, (uint8_t*)*ppRecs, size) /
+         sizeof(phNxpEse_FlightRecord_t);
+}
+
+/******************************************************************************
+ * Function         phNxpEse_FlightRecLog
+ *
+ * Description      Logs drained records and frees them.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+static void phNxpEse_FlightRecLog(const char* pReason,
+                                  phNxpEse_FlightRecord_t* pRecs,
+                                  size_t count) {
+  if (count == 0) {
+    phNxpEse_free(pRecs);
+    return;
+  }
+
+  ALOGI("eSE flight recorder (%s): %zu frames over %llu us", pReason, count,
+        (unsigned long long)(pRecs[count - 1].timeUs - pRecs[0].timeUs));
+  uint64_t prevUs = pRecs[0].timeUs;
+  for (size_t i = 0; i < count; i++) {
+    const phNxpEse_FlightRecord_t* pRec = &pRecs[i];
+    char prefix[(PH_ESE_FLIGHTREC_PREFIX_LEN * 2) + 1];
+    uint32_t shown = (pRec->len < PH_ESE_FLIGHTREC_PREFIX_LEN)
+                         ? pRec->len
+                         : PH_ESE_FLIGHTREC_PREFIX_LEN;
+    phPalEse_hexEncode(prefix, pRec->prefix, shown);
+    ALOGI("  +%8llu us %-7s pcb=%02X len=%4u hash=%08X %s%s",
+          (unsigned long long)(pRec->timeUs - prevUs),
+          (pRec->dir <= PH_ESE_FLIGHTREC_RX_FAIL)
+              ? gFlightRecDirNames[pRec->dir]
+              : "?",
+          pRec->pcb, pRec->len, pRec->hash, prefix,
+          (pRec->len > PH_ESE_FLIGHTREC_PREFIX_LEN) ? ".." : "");
+    prevUs = pRec->timeUs;
+  }
+  phNxpEse_free(pRecs);
+}
+
+/******************************************************************************
+ * Function         phNxpEse_FlightRecDump
+ *
+ * Description      Drains the ring under the lock and logs the records
+ *                  afterwards, so frame recording is blocked only for the
+ *                  copy.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+void phNxpEse_FlightRecDump(const char* pReason) {
+  phNxpEse_FlightRecord_t* pRecs;
+  size_t count;
+  {
+    Mutex::Autolock lock(gFlightRecLock);
+    count = phNxpEse_FlightRecDrainLocked(&pRecs);
+  }
+  phNxpEse_FlightRecLog(pReason, pRecs, count);
+}
+
+/******************************************************************************
+ * Function         phNxpEse_FlightRecMarkDump
+ *
+ * Description      Drains the ring into the pending dump, unless one is
+ *                  pending already: the records then stay in the ring for
+ *                  the next dump.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+void phNxpEse_FlightRecMarkDump(const char* pReason) {
+  Mutex::Autolock lock(gFlightRecLock);
+  if (gFlightRecPending != NULL) return;
+  gFlightRecPendingCount = phNxpEse_FlightRecDrainLocked(&gFlightRecPending);
+  if (gFlightRecPending == NULL) return;
+  gFlightRecPendingReason = pReason;
+  gFlightRecHasPending.store(true, std::memory_order_release);
+}
+
+/******************************************************************************
+ * Function         phNxpEse_FlightRecDumpPending
+ *
+ * Description      Logs the dump phNxpEse_FlightRecMarkDump left, if any.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+void phNxpEse_FlightRecDumpPending(void) {
+  if (!gFlightRecHasPending.load(std::memory_order_acquire)) return;
+  phNxpEse_FlightRecord_t* pRecs;
+  size_t count;
+  const char* pReason;
+  {
+    Mutex::Autolock lock(gFlightRecLock);
+    pRecs = gFlightRecPending;
+    count = gFlightRecPendingCount;
+    pReason = gFlightRecPendingReason;
+    gFlightRecPending = NULL;
+    gFlightRecHasPending.store(false, std::memory_order_relaxed);
+  }
+  phNxpEse_FlightRecLog(pReason, pRecs, count);
+}
@@ -21,6 +21,11 @@
 #include <IntervalTimer.h>
 #include <phNxpEseFeatures.h>
 #include <phNxpEse_Api.h>
+#include <phNxpEse_Cache.h>
+#include <phNxpEse_FlightRec.h>
+#include <phNxpEse_Sched.h>
+#include <phNxpEse_Stats.h>
+#include <phNxpEse_Trace.h>
 
 /* Macro to enable SPM Module */
 #define SPM_INTEGRATED
@@ -0,0 +1,369 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+#define LOG_TAG "NxpEseHal"
+#include <ese_config.h>
+#include <log/log.h>
+#include <phNxpEseLog.h>
+#include <phNxpEse_FlightRec.h>
+#include <phNxpEse_Sched.h>
+#include <phNxpEse_Stats.h>
+#include <string.h>
+#include "CondVar.h"
+#include "Mutex.h"
+
+/* Virtual time a channel of weight 1 is charged per APDU */
+#define PH_ESE_SCHED_STRIDE 0x10000
+
+/* A caller waiting in phNxpEse_SchedAcquire, on its own stack */
+typedef struct phNxpEse_SchedWaiter {
+  CondVar cond;
+  bool granted;
+  struct phNxpEse_SchedWaiter* pNext;
+} phNxpEse_SchedWaiter_t;
+
+/* Callers of one channel in arrival order, and its virtual time */
+typedef struct phNxpEse_SchedQueue {
+  phNxpEse_SchedWaiter_t* pHead;
+  phNxpEse_SchedWaiter_t* pTail;
+  uint64_t pass;
+  uint8_t weight; /* 0 for PH_ESE_SCHED_WEIGHT_DEFAULT */
+  phNxpEse_SchedClass_t schedClass;
+} phNxpEse_SchedQueue_t;
+
+static Mutex gSchedLock;
+static phNxpEse_SchedQueue_t gSchedQueues[PH_ESE_MAX_CHANNELS];
+static uint32_t gSchedWaitMask; /* channels with callers queued */
+static bool gSchedBusy;         /* a turn is taken */
+static uint64_t gSchedPass;     /* virtual time of the last turn */
+static uint8_t gSchedLast;      /* channel of the last turn */
+/* Priority callers of all channels in arrival order, served before any
+ * channel queue, and the open priority sessions holding normal callers */
+static phNxpEse_SchedWaiter_t* gSchedPrioHead;
+static phNxpEse_SchedWaiter_t* gSchedPrioTail;
+static uint32_t gSchedPrioSessions;
+
+/******************************************************************************
+ * Function         phNxpEse_SchedGrant
+ *
+ * Description      Hands the turn to pWaiter. Called with gSchedLock.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void phNxpEse_SchedGrant(phNxpEse_SchedWaiter_t* pWaiter) {
+  gSchedBusy = true;
+  pWaiter->granted = true;
+  pWaiter->cond.notifyOne();
+}
+
+/******************************************************************************
+ * Function         phNxpEse_SchedGrantNext
+ *
+ * Description      Gives the turn to the first priority caller. Without one
+ *                  and unless a priority session holds normal callers, it
+ *                  goes to the first caller of the waiting channel with the
+ *                  lowest virtual time. Ties go to the channel following
+ *                  the last one served. Called with gSchedLock.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void phNxpEse_SchedGrantNext(void) {
+  if (gSchedPrioHead != NULL) {
+    phNxpEse_SchedWaiter_t* pWaiter = gSchedPrioHead;
+    gSchedPrioHead = pWaiter->pNext;
+    if (gSchedPrioHead == NULL) gSchedPrioTail = NULL;
+    phNxpEse_SchedGrant(pWaiter);
+    return;
+  }
+  if ((gSchedWaitMask == 0) || (gSchedPrioSessions > 0)) {
+    gSchedBusy = false;
+    return;
+  }
+  uint8_t next = PH_ESE_MAX_CHANNELS;
+  for (uint8_t i = 1; i <= PH_ESE_MAX_CHANNELS; i++) {
+    uint8_t channel = (gSchedLast + i) % PH_ESE_MAX_CHANNELS;
+    if (!(gSchedWaitMask & (1u << channel))) continue;
+    if (next == PH_ESE_MAX_CHANNELS ||
+        gSchedQueues[channel].pass < gSchedQueues[next].pass) {
+      next = channel;
+    }
+  }
+
+  phNxpEse_SchedQueue_t* pQueue = &gSchedQueues[next];
+  phNxpEse_SchedWaiter_t* pWaiter = pQueue->pHead;
+  pQueue->pHead = pWaiter->pNext;
+  if (pQueue->pHead == NULL) {
+    pQueue->pTail = NULL;
+    gSchedWaitMask &= ~(1u << next);
+  }
+  gSchedPass = pQueue->pass;
+  uint8_t weight = pQueue->weight;
+  if (weight == 0) weight = PH_ESE_SCHED_WEIGHT_DEFAULT;
+  pQueue->pass += PH_ESE_SCHED_STRIDE / weight;
+  gSchedLast = next;
+  phNxpEse_SchedGrant(pWaiter);
+}
+
+/******************************************************************************
+ * Function         phNxpEse_SchedWait
+ *
+ * Description      Queues the caller and waits for its turn: priority
+ *                  callers, prio or of a priority channel, in the priority
+ *                  queue, others on their channel. A channel out of range
+ *                  is the basic channel.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+static void phNxpEse_SchedWait(uint8_t channel, bool prio) {
+  uint64_t startUs = phNxpEse_StatsNowUs();
+  phNxpEse_SchedWaiter_t waiter;
+  waiter.granted = false;
+  waiter.pNext = NULL;
+  if (channel >= PH_ESE_MAX_CHANNELS) channel = 0;
+
+  gSchedLock.lock();
+  phNxpEse_SchedQueue_t* pQueue = &gSchedQueues[channel];
+  if (prio || (pQueue->schedClass == PH_ESE_SCHED_CLASS_PRIO)) {
+    if (gSchedPrioTail == NULL) {
+      gSchedPrioHead = &waiter;
+    } else {
+      gSchedPrioTail->pNext = &waiter;
+    }
+    gSchedPrioTail = &waiter;
+  } else if (pQueue->pHead == NULL) {
+    /* An idle channel banks no time: it rejoins at the current turn */
+    if (pQueue->pass < gSchedPass) pQueue->pass = gSchedPass;
+    pQueue->pHead = &waiter;
+    pQueue->pTail = &waiter;
+    gSchedWaitMask |= (1u << channel);
+  } else {
+    pQueue->pTail->pNext = &waiter;
+    pQueue->pTail = &waiter;
+  }
+  if (!gSchedBusy) phNxpEse_SchedGrantNext();
+  while (!waiter.granted) waiter.cond.wait(gSchedLock);
+  gSchedLock.unlock();
+
+  phNxpEse_StatsRecord(PH_ESE_STAT_SCHED_WAIT,
+                       phNxpEse_StatsNowUs() - startUs);
+}
+
+/******************************************************************************
+ * Function         phNxpEse_SchedAcquire
+ *
+ * Description      Waits for a turn in the class of the channel.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void phNxpEse_SchedAcquire(uint8_t channel) {
+  phNxpEse_SchedWait(channel, false);
+}
+
+/******************************************************************************
+ * Function         phNxpEse_SchedAcquirePrio
+ *
+ * Description      Waits for a turn as a priority caller.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void phNxpEse_SchedAcquirePrio(uint8_t channel) {
+  phNxpEse_SchedWait(channel, true);
+}
+
+/******************************************************************************
+ * Function         phNxpEse_SchedRelease
+ *
+ * Description      Ends the current turn.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void phNxpEse_SchedRelease(void) {
+  gSchedLock.lock();
+  phNxpEse_SchedGrantNext();
+  gSchedLock.unlock();
+}
+
+/******************************************************************************
+ * Function         phNxpEse_SchedTransceive
+ *
+ * Description      phNxpEse_Transceive in the turn of the channel of the
+ *                  class byte. A flight recorder dump the APDU left is
+ *                  logged after the turn.
+ *
+ * Returns          Status of phNxpEse_Transceive
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_SchedTransceive(phNxpEse_data* pCmd, phNxpEse_data* pRsp) {
+  if ((pCmd == NULL) || (pCmd->p_data == NULL) || (pCmd->len == 0)) {
+    return phNxpEse_Transceive(pCmd, pRsp);
+  }
+  phNxpEse_SchedAcquire(phNxpEse_ChannelFromCla(pCmd->p_data[0]));
+  ESESTATUS status = phNxpEse_Transceive(pCmd, pRsp);
+  phNxpEse_SchedRelease();
+  phNxpEse_FlightRecDumpPending();
+  return status;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_SchedTransceivePrio
+ *
+ * Description      phNxpEse_Transceive in a priority turn, see
+ *                  phNxpEse_SchedTransceive.
+ *
+ * Returns          Status of phNxpEse_Transceive
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_SchedTransceivePrio(phNxpEse_data* pCmd,
+                                       phNxpEse_data* pRsp) {
+  if ((pCmd == NULL) || (pCmd->p_data == NULL) || (pCmd->len == 0)) {
+    return phNxpEse_Transceive(pCmd, pRsp);
+  }
+  phNxpEse_SchedAcquirePrio(phNxpEse_ChannelFromCla(pCmd->p_data[0]));
+  ESESTATUS status = phNxpEse_Transceive(pCmd, pRsp);
+  phNxpEse_SchedRelease();
+  phNxpEse_FlightRecDumpPending();
+  return status;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_SchedPrioSessionBegin
+ *
+ * Description      Holds normal callers from the next APDU boundary on. The
+ *                  turn in progress, if any, is waited for.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void phNxpEse_SchedPrioSessionBegin(void) {
+  gSchedLock.lock();
+  gSchedPrioSessions++;
+  gSchedLock.unlock();
+  phNxpEse_SchedAcquirePrio(0);
+  phNxpEse_SchedRelease();
+  NXP_LOG_ESE_D("%s: normal APDUs held", __func__);
+}
+
+/******************************************************************************
+ * Function         phNxpEse_SchedPrioSessionEnd
+ *
+ * Description      Ends a priority session; once none is left the held
+ *                  callers are served again.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void phNxpEse_SchedPrioSessionEnd(void) {
+  gSchedLock.lock();
+  if (gSchedPrioSessions > 0) gSchedPrioSessions--;
+  uint32_t sessions = gSchedPrioSessions;
+  if (!gSchedBusy) phNxpEse_SchedGrantNext();
+  gSchedLock.unlock();
+  NXP_LOG_ESE_D("%s: %u sessions left", __func__, sessions);
+}
+
+/******************************************************************************
+ * Function         phNxpEse_SchedSetWeight
+ *
+ * Description      Sets the share of a channel.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void phNxpEse_SchedSetWeight(uint8_t channel, uint8_t weight) {
+  if (channel >= PH_ESE_MAX_CHANNELS) return;
+  if (weight == 0) weight = PH_ESE_SCHED_WEIGHT_DEFAULT;
+  if (weight > PH_ESE_SCHED_WEIGHT_MAX) weight = PH_ESE_SCHED_WEIGHT_MAX;
+  gSchedLock.lock();
+  gSchedQueues[channel].weight = weight;
+  gSchedLock.unlock();
+  NXP_LOG_ESE_D("%s: channel %d weight %d", __func__, channel, weight);
+}
+
+/******************************************************************************
+ * Function         phNxpEse_SchedSetClass
+ *
+ * Description      Sets the class phNxpEse_SchedAcquire uses for a channel.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void phNxpEse_SchedSetClass(uint8_t channel,
+                            phNxpEse_SchedClass_t schedClass) {
+  if (channel >= PH_ESE_MAX_CHANNELS) return;
+  gSchedLock.lock();
+  gSchedQueues[channel].schedClass = schedClass;
+  gSchedLock.unlock();
+}
+
+/******************************************************************************
+ * Function         phNxpEse_SchedAidListed
+ *
+ * Description      Looks pAid up in a config list of AIDs, each preceded by
+ *                  its length.
+ *
+ * Returns          true if listed
+ *
+ ******************************************************************************/
+static bool phNxpEse_SchedAidListed(const char* pKey, const uint8_t* pAid,
+                                    uint32_t aidLen) {
+  if ((pAid == NULL) || (aidLen == 0) || !EseConfig::hasKey(pKey)) {
+    return false;
+  }
+  std::vector<uint8_t> aids = EseConfig::getBytes(pKey);
+  size_t pos = 0;
+  while (pos < aids.size()) {
+    size_t len = aids[pos++];
+    if (len > aids.size() - pos) {
+      ALOGE("%s: malformed %s", __func__, pKey);
+      break;
+    }
+    if ((len == aidLen) && (memcmp(&aids[pos], pAid, len) == 0)) return true;
+    pos += len;
+  }
+  return false;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_SchedConfigChannel
+ *
+ * Description      Gives a channel the weight and class configured for the
+ *                  AID it selected, the defaults without one.
+ *
+ * Returns          void
+ *
+ ******************************************************************************/
+void phNxpEse_SchedConfigChannel(uint8_t channel, const uint8_t* pAid,
+                                 uint32_t aidLen) {
+  unsigned weight = PH_ESE_SCHED_WEIGHT_DEFAULT;
+  if (phNxpEse_SchedAidListed(NAME_NXP_ESE_SCHED_PRIO_AIDS, pAid, aidLen)) {
+    weight = EseConfig::getUnsigned(NAME_NXP_ESE_SCHED_PRIO_WEIGHT,
+                                    PH_ESE_SCHED_WEIGHT_PRIO);
+    if (weight > PH_ESE_SCHED_WEIGHT_MAX) weight = PH_ESE_SCHED_WEIGHT_MAX;
+  }
+  phNxpEse_SchedSetWeight(channel, (uint8_t)weight);
+  phNxpEse_SchedSetClass(
+      channel,
+      phNxpEse_SchedAidListed(NAME_NXP_ESE_SCHED_PREEMPT_AIDS, pAid, aidLen)
+          ? PH_ESE_SCHED_CLASS_PRIO
+          : PH_ESE_SCHED_CLASS_NORMAL);
+}
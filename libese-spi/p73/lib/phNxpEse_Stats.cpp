@@ -0,0 +1,357 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+#define LOG_TAG "NxpEseHal"
+#include <log/log.h>
+#include <phNxpEse_Api.h>
+#include <phNxpEse_Stats.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+
+/* Live histogram of one phase. Only relaxed atomics are used: samples are
+ * independent and a snapshot does not need to be a consistent cut. */
+typedef struct phNxpEse_LiveHistogram {
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> sum;
+  std::atomic<uint64_t> max;
+  std::atomic<uint64_t> buckets[PH_ESE_STATS_BUCKETS];
+} phNxpEse_LiveHistogram_t;
+
+static phNxpEse_LiveHistogram_t gStatsHist[PH_ESE_STAT_MAX];
+
+static const char* const gStatsNames[PH_ESE_STAT_MAX] = {
+    "queue_wait", "rf_wait", "spi_write", "sof_poll_us", "sof_poll_count",
+    "payload_read", "decode", "reassembly", "transceive", "sched_wait"};
+
+/* Live protocol health counters of one scope */
+typedef struct phNxpEse_LiveCounters {
+  std::atomic<uint64_t> startUs;
+  std::atomic<uint64_t> transceives;
+  std::atomic<uint64_t> events[PH_ESE_CNT_MAX];
+  std::atomic<uint64_t> recoveryUs[PH_ESE_CNT_MAX];
+} phNxpEse_LiveCounters_t;
+
+static phNxpEse_LiveCounters_t gStatsCounters[PH_ESE_COUNTERS_BOOT + 1];
+
+/* Starts the boot scope, the session scope starts at each
+ * phNxpEse_StatsSessionStart. Returns the load time. */
+static uint64_t phNxpEse_StatsLoadTimeUs(void) {
+  uint64_t now = phNxpEse_StatsNowUs();
+  gStatsCounters[PH_ESE_COUNTERS_BOOT].startUs.store(
+      now, std::memory_order_relaxed);
+  return now;
+}
+
+/* The histograms and the boot counters start when the library is loaded */
+static std::atomic<uint64_t> gStatsResetTimeUs(phNxpEse_StatsLoadTimeUs());
+
+static const char* const gCounterNames[PH_ESE_CNT_MAX] = {
+    "lrc_fail",   "rnack_sent", "rnack_rcvd", "resynch",
+    "intf_reset", "chip_reset", "wtx_req",    "timeout"};
+static const char* const gScopeNames[PH_ESE_COUNTERS_BOOT + 1] = {"session",
+                                                                  "boot"};
+
+/******************************************************************************
+ * Function         phNxpEse_StatsBucketIndex
+ *
+ * Description      Maps a value to its log-linear bucket.
+ *
+ * Returns          Bucket index in [0, PH_ESE_STATS_BUCKETS)
+ *
+ ******************************************************************************/
+static inline uint32_t phNxpEse_StatsBucketIndex(uint64_t value) {
+  const uint32_t subCount = 1 << PH_ESE_STATS_SUB_BUCKET_BITS;
+  if (value < subCount) return (uint32_t)value;
+  uint32_t msb = 63 - __builtin_clzll(value);
+  uint32_t sub = (value >> (msb - PH_ESE_STATS_SUB_BUCKET_BITS)) &
+                 (subCount - 1);
+  uint32_t index = subCount * (msb - PH_ESE_STATS_SUB_BUCKET_BITS + 1) + sub;
+  return (index < PH_ESE_STATS_BUCKETS) ? index : (PH_ESE_STATS_BUCKETS - 1);
+}
+
+/******************************************************************************
+ * Function         phNxpEse_StatsBucketUpperBound
+ *
+ * Description      Largest value that maps to the given bucket.
+ *
+ * Returns          Upper bound of the bucket
+ *
+ ******************************************************************************/
+static uint64_t phNxpEse_StatsBucketUpperBound(uint32_t index) {
+  const uint32_t subCount = 1 << PH_ESE_STATS_SUB_BUCKET_BITS;
+  if (index < subCount) return index;
+  uint32_t shift = (index / subCount) - 1;
+  uint64_t lower = (uint64_t)(subCount + (index % subCount)) << shift;
+  return lower + ((uint64_t)1 << shift) - 1;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_StatsNowUs
+ *
+ * Description      Monotonic clock in microseconds.
+ *
+ * Returns          Current time in microseconds
+ *
+ ******************************************************************************/
+uint64_t phNxpEse_StatsNowUs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+/******************************************************************************
+ * Function         phNxpEse_StatsRecord
+ *
+ * Description      Adds one sample to the histogram of the given phase.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+void phNxpEse_StatsRecord(phNxpEse_StatId_t id, uint64_t value) {
+  if (id >= PH_ESE_STAT_MAX) return;
+  phNxpEse_LiveHistogram_t* pHist = &gStatsHist[id];
+  pHist->buckets[phNxpEse_StatsBucketIndex(value)].fetch_add(
+      1, std::memory_order_relaxed);
+  pHist->count.fetch_add(1, std::memory_order_relaxed);
+  pHist->sum.fetch_add(value, std::memory_order_relaxed);
+  uint64_t prevMax = pHist->max.load(std::memory_order_relaxed);
+  while (value > prevMax &&
+         !pHist->max.compare_exchange_weak(prevMax, value,
+                                           std::memory_order_relaxed)) {
+  }
+  if (id == PH_ESE_STAT_TRANSCEIVE) {
+    for (int i = 0; i <= PH_ESE_COUNTERS_BOOT; i++) {
+      gStatsCounters[i].transceives.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
+
+/******************************************************************************
+ * Function         phNxpEse_StatsSnapshot
+ *
+ * Description      Copies all phase histograms, optionally clearing them.
+ *
+ * Returns          ESESTATUS_SUCCESS or ESESTATUS_INVALID_PARAMETER
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_StatsSnapshot(phNxpEse_StatsSnapshot_t* pSnapshot,
+                                 bool reset) {
+  if (pSnapshot == NULL) return ESESTATUS_INVALID_PARAMETER;
+  uint64_t now = phNxpEse_StatsNowUs();
+  uint64_t since = reset ? gStatsResetTimeUs.exchange(now)
+                         : gStatsResetTimeUs.load(std::memory_order_relaxed);
+  pSnapshot->elapsedUs = now - since;
+  for (int i = 0; i < PH_ESE_STAT_MAX; i++) {
+    phNxpEse_LiveHistogram_t* pLive = &gStatsHist[i];
+    phNxpEse_Histogram_t* pOut = &pSnapshot->hist[i];
+    if (reset) {
+      pOut->count = pLive->count.exchange(0, std::memory_order_relaxed);
+      pOut->sum = pLive->sum.exchange(0, std::memory_order_relaxed);
+      pOut->max = pLive->max.exchange(0, std::memory_order_relaxed);
+      for (int b = 0; b < PH_ESE_STATS_BUCKETS; b++) {
+        pOut->buckets[b] =
+            pLive->buckets[b].exchange(0, std::memory_order_relaxed);
+      }
+    } else {
+      pOut->count = pLive->count.load(std::memory_order_relaxed);
+      pOut->sum = pLive->sum.load(std::memory_order_relaxed);
+      pOut->max = pLive->max.load(std::memory_order_relaxed);
+      for (int b = 0; b < PH_ESE_STATS_BUCKETS; b++) {
+        pOut->buckets[b] = pLive->buckets[b].load(std::memory_order_relaxed);
+      }
+    }
+  }
+  return ESESTATUS_SUCCESS;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_StatsReset
+ *
+ * Description      Clears all phase histograms.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+void phNxpEse_StatsReset(void) {
+  for (int i = 0; i < PH_ESE_STAT_MAX; i++) {
+    gStatsHist[i].count.store(0, std::memory_order_relaxed);
+    gStatsHist[i].sum.store(0, std::memory_order_relaxed);
+    gStatsHist[i].max.store(0, std::memory_order_relaxed);
+    for (int b = 0; b < PH_ESE_STATS_BUCKETS; b++) {
+      gStatsHist[i].buckets[b].store(0, std::memory_order_relaxed);
+    }
+  }
+  gStatsResetTimeUs.store(phNxpEse_StatsNowUs(), std::memory_order_relaxed);
+}
+
+/******************************************************************************
+ * Function         phNxpEse_StatsPercentile
+ *
+ * Description      Value at the given percentile of a histogram copy.
+ *
+ * Returns          Upper bound of the matching bucket, 0 if empty
+ *
+ ******************************************************************************/
+uint64_t phNxpEse_StatsPercentile(const phNxpEse_Histogram_t* pHist,
+                                  uint32_t percentile) {
+  if ((pHist == NULL) || (pHist->count == 0)) return 0;
+  if (percentile > 100) percentile = 100;
+  uint64_t target = (pHist->count * percentile + 99) / 100;
+  if (target == 0) target = 1;
+  uint64_t seen = 0;
+  for (uint32_t b = 0; b < PH_ESE_STATS_BUCKETS; b++) {
+    seen += pHist->buckets[b];
+    if (seen >= target) {
+      uint64_t bound = phNxpEse_StatsBucketUpperBound(b);
+      return (bound < pHist->max) ? bound : pHist->max;
+    }
+  }
+  return pHist->max;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_StatsCount
+ *
+ * Description      Counts one protocol health event in all scopes.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+void phNxpEse_StatsCount(phNxpEse_CounterId_t id) {
+  if (id >= PH_ESE_CNT_MAX) return;
+  for (int i = 0; i <= PH_ESE_COUNTERS_BOOT; i++) {
+    gStatsCounters[i].events[id].fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+/******************************************************************************
+ * Function         phNxpEse_StatsRecoveryTime
+ *
+ * Description      Charges recovery time to a protocol health event in all
+ *                  scopes.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+void phNxpEse_StatsRecoveryTime(phNxpEse_CounterId_t id, uint64_t timeUs) {
+  if (id >= PH_ESE_CNT_MAX) return;
+  for (int i = 0; i <= PH_ESE_COUNTERS_BOOT; i++) {
+    gStatsCounters[i].recoveryUs[id].fetch_add(timeUs,
+                                               std::memory_order_relaxed);
+  }
+}
+
+/******************************************************************************
+ * Function         phNxpEse_StatsCounterName
+ *
+ * Description      Short name of a protocol health event.
+ *
+ * Returns          Event name, "unknown" for an invalid id
+ *
+ ******************************************************************************/
+const char* phNxpEse_StatsCounterName(phNxpEse_CounterId_t id) {
+  return (id < PH_ESE_CNT_MAX) ? gCounterNames[id] : "unknown";
+}
+
+/******************************************************************************
+ * Function         phNxpEse_StatsSessionStart
+ *
+ * Description      Clears the session counters. The boot counters keep
+ *                  accumulating.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+void phNxpEse_StatsSessionStart(void) {
+  phNxpEse_LiveCounters_t* pLive = &gStatsCounters[PH_ESE_COUNTERS_SESSION];
+  uint64_t now = phNxpEse_StatsNowUs();
+  pLive->transceives.store(0, std::memory_order_relaxed);
+  for (int i = 0; i < PH_ESE_CNT_MAX; i++) {
+    pLive->events[i].store(0, std::memory_order_relaxed);
+    pLive->recoveryUs[i].store(0, std::memory_order_relaxed);
+  }
+  pLive->startUs.store(now, std::memory_order_relaxed);
+}
+
+/******************************************************************************
+ * Function         phNxpEse_StatsGetCounters
+ *
+ * Description      Copies the counters of the given scope.
+ *
+ * Returns          ESESTATUS_SUCCESS or ESESTATUS_INVALID_PARAMETER
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_StatsGetCounters(phNxpEse_CounterScope_t scope,
+                                    phNxpEse_Counters_t* pCounters) {
+  if ((pCounters == NULL) || (scope > PH_ESE_COUNTERS_BOOT))
+    return ESESTATUS_INVALID_PARAMETER;
+  phNxpEse_LiveCounters_t* pLive = &gStatsCounters[scope];
+  uint64_t startUs = pLive->startUs.load(std::memory_order_relaxed);
+  pCounters->elapsedUs = (startUs == 0) ? 0 : phNxpEse_StatsNowUs() - startUs;
+  pCounters->transceives = pLive->transceives.load(std::memory_order_relaxed);
+  for (int i = 0; i < PH_ESE_CNT_MAX; i++) {
+    pCounters->events[i] = pLive->events[i].load(std::memory_order_relaxed);
+    pCounters->recoveryUs[i] =
+        pLive->recoveryUs[i].load(std::memory_order_relaxed);
+  }
+  return ESESTATUS_SUCCESS;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_StatsDump
+ *
+ * Description      Logs a one line summary per phase and per non-zero
+ *                  protocol health counter.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+void phNxpEse_StatsDump(void) {
+  phNxpEse_StatsSnapshot_t* pSnapshot = (phNxpEse_StatsSnapshot_t*)
+      phNxpEse_memalloc(sizeof(phNxpEse_StatsSnapshot_t));
+  if (pSnapshot == NULL) return;
+  phNxpEse_StatsSnapshot(pSnapshot, false);
+  ALOGI("eSE phase stats over %llu ms",
+        (unsigned long long)(pSnapshot->elapsedUs / 1000));
+  for (int i = 0; i < PH_ESE_STAT_MAX; i++) {
+    const phNxpEse_Histogram_t* pHist = &pSnapshot->hist[i];
+    if (pHist->count == 0) continue;
+    ALOGI("  %-14s n=%llu mean=%llu p50=%llu p90=%llu p99=%llu max=%llu",
+          gStatsNames[i], (unsigned long long)pHist->count,
+          (unsigned long long)(pHist->sum / pHist->count),
+          (unsigned long long)phNxpEse_StatsPercentile(pHist, 50),
+          (unsigned long long)phNxpEse_StatsPercentile(pHist, 90),
+          (unsigned long long)phNxpEse_StatsPercentile(pHist, 99),
+          (unsigned long long)pHist->max);
+  }
+  phNxpEse_free(pSnapshot);
+
+  for (int scope = 0; scope <= PH_ESE_COUNTERS_BOOT; scope++) {
+    phNxpEse_Counters_t counters;
+    phNxpEse_StatsGetCounters((phNxpEse_CounterScope_t)scope, &counters);
+    ALOGI("eSE %s health over %llu ms, %llu transceives", gScopeNames[scope],
+          (unsigned long long)(counters.elapsedUs / 1000),
+          (unsigned long long)counters.transceives);
+    for (int i = 0; i < PH_ESE_CNT_MAX; i++) {
+      if (counters.events[i] == 0) continue;
+      ALOGI("  %-14s n=%llu recovery=%llu us", gCounterNames[i],
+            (unsigned long long)counters.events[i],
+            (unsigned long long)counters.recoveryUs[i]);
+    }
+  }
+}
@@ -0,0 +1,274 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+#define LOG_TAG "NxpEseHal"
+#include <errno.h>
+#include <fcntl.h>
+#include <log/log.h>
+#include <phNxpEsePal.h>
+#include <phNxpEse_Trace.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <atomic>
+#include "Mutex.h"
+
+#define PH_ESE_TRACE_ALIGN 8
+
+/* gTraceOn lets the SOF poll path skip the lock when no capture runs.
+ * gTraceThinkUs is only touched by the transceive thread, transceives are
+ * serialized by phNxpEse_Transceive. */
+static Mutex gTraceLock;
+static int gTraceFd = -1;
+static std::atomic<bool> gTraceOn(false);
+static uint64_t gTraceThinkUs = 0;
+
+/******************************************************************************
+ * Function         phNxpEse_TraceCheckHeader
+ *
+ * Description      Checks magic, version and length of a trace header.
+ *
+ * Returns          true if the header is valid
+ *
+ ******************************************************************************/
+static bool phNxpEse_TraceCheckHeader(const phNxpEse_TraceHeader_t* pHeader) {
+  return (memcmp(pHeader->magic, PH_ESE_TRACE_MAGIC,
+                 sizeof(pHeader->magic)) == 0) &&
+         (pHeader->version == PH_ESE_TRACE_VERSION) &&
+         (pHeader->headerLen == sizeof(phNxpEse_TraceHeader_t));
+}
+
+/******************************************************************************
+ * Function         phNxpEse_TraceStart
+ *
+ * Description      Opens the trace file for appending. A new or empty file
+ *                  gets a header, an existing one must already have one.
+ *
+ * Returns          ESESTATUS_SUCCESS on success, else an error code
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_TraceStart(const char* pPath) {
+  if (pPath == NULL) return ESESTATUS_INVALID_PARAMETER;
+  phNxpEse_TraceStop();
+
+  int fd = open(pPath, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    ALOGE("%s: open %s failed: %s", __FUNCTION__, pPath, strerror(errno));
+    return ESESTATUS_FAILED;
+  }
+  struct stat st;
+  phNxpEse_TraceHeader_t header;
+  ESESTATUS status = ESESTATUS_SUCCESS;
+  if (fstat(fd, &st) != 0) {
+    status = ESESTATUS_FAILED;
+  } else if (st.st_size == 0) {
+    phPalEse_memset(&header, 0x00, sizeof(header));
+    memcpy(header.magic, PH_ESE_TRACE_MAGIC, sizeof(header.magic));
+    header.version = PH_ESE_TRACE_VERSION;
+    header.headerLen = sizeof(header);
+    if (write(fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) {
+      status = ESESTATUS_FAILED;
+    }
+  } else if ((pread(fd, &header, sizeof(header), 0) !=
+              (ssize_t)sizeof(header)) ||
+             !phNxpEse_TraceCheckHeader(&header)) {
+    status = ESESTATUS_INVALID_FORMAT;
+  }
+  if (status != ESESTATUS_SUCCESS) {
+    ALOGE("%s: %s is not usable as a trace file", __FUNCTION__, pPath);
+    close(fd);
+    return status;
+  }
+
+  Mutex::Autolock lock(gTraceLock);
+  gTraceFd = fd;
+  gTraceThinkUs = 0;
+  gTraceOn = true;
+  ALOGD("%s: capturing APDUs to %s", __FUNCTION__, pPath);
+  return ESESTATUS_SUCCESS;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_TraceStop
+ *
+ * Description      Closes the trace file if a capture is running.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+void phNxpEse_TraceStop(void) {
+  Mutex::Autolock lock(gTraceLock);
+  gTraceOn = false;
+  if (gTraceFd >= 0) {
+    close(gTraceFd);
+    gTraceFd = -1;
+  }
+}
+
+/******************************************************************************
+ * Function         phNxpEse_TraceThinkTime
+ *
+ * Description      Accumulates SOF polling time of the current transceive.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+void phNxpEse_TraceThinkTime(uint64_t timeUs) {
+  if (gTraceOn) gTraceThinkUs += timeUs;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_TraceTransceive
+ *
+ * Description      Writes one record with a single writev so that records of
+ *                  a process killed mid-capture are either complete or the
+ *                  last one is truncated. A write error stops the capture.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+void phNxpEse_TraceTransceive(const phNxpEse_data* pCmd,
+                              const phNxpEse_data* pRsp, ESESTATUS status,
+                              uint64_t startUs, uint64_t endUs) {
+  if (!gTraceOn) return;
+  static const uint8_t kPad[PH_ESE_TRACE_ALIGN] = {0};
+  phNxpEse_TraceRecord_t rec;
+  uint32_t cmdLen = (pCmd != NULL && pCmd->p_data != NULL) ? pCmd->len : 0;
+  uint32_t rspLen = (pRsp != NULL && pRsp->p_data != NULL) ? pRsp->len : 0;
+  uint32_t len = sizeof(rec) + cmdLen + rspLen;
+  uint32_t padLen = (PH_ESE_TRACE_ALIGN - (len % PH_ESE_TRACE_ALIGN)) %
+                    PH_ESE_TRACE_ALIGN;
+
+  phPalEse_memset(&rec, 0x00, sizeof(rec));
+  rec.startUs = startUs;
+  rec.durationUs = (uint32_t)(endUs - startUs);
+  rec.thinkUs = (uint32_t)gTraceThinkUs;
+  rec.cmdLen = cmdLen;
+  rec.rspLen = rspLen;
+  rec.status = (uint32_t)status;
+  rec.recordLen = len + padLen;
+  gTraceThinkUs = 0;
+
+  struct iovec iov[4] = {
+      {&rec, sizeof(rec)},
+      {cmdLen ? pCmd->p_data : (uint8_t*)kPad, cmdLen},
+      {rspLen ? pRsp->p_data : (uint8_t*)kPad, rspLen},
+      {(void*)kPad, padLen},
+  };
+  Mutex::Autolock lock(gTraceLock);
+  if (gTraceFd < 0) return;
+  if (writev(gTraceFd, iov, 4) != (ssize_t)rec.recordLen) {
+    ALOGE("%s: trace write failed, capture stopped: %s", __FUNCTION__,
+          strerror(errno));
+    gTraceOn = false;
+    close(gTraceFd);
+    gTraceFd = -1;
+  }
+}
+
+/******************************************************************************
+ * Function         phNxpEse_TraceOpen
+ *
+ * Description      Maps a trace file read-only.
+ *
+ * Returns          ESESTATUS_SUCCESS on success, else an error code
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_TraceOpen(const char* pPath,
+                             phNxpEse_TraceReader_t* pReader) {
+  if (pPath == NULL || pReader == NULL) return ESESTATUS_INVALID_PARAMETER;
+  phPalEse_memset(pReader, 0x00, sizeof(*pReader));
+
+  int fd = open(pPath, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    ALOGE("%s: open %s failed: %s", __FUNCTION__, pPath, strerror(errno));
+    return ESESTATUS_FAILED;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return ESESTATUS_FAILED;
+  }
+  if ((size_t)st.st_size < sizeof(phNxpEse_TraceHeader_t)) {
+    close(fd);
+    return ESESTATUS_INVALID_FORMAT;
+  }
+  void* pBase = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (pBase == MAP_FAILED) {
+    ALOGE("%s: mmap %s failed: %s", __FUNCTION__, pPath, strerror(errno));
+    return ESESTATUS_FAILED;
+  }
+  if (!phNxpEse_TraceCheckHeader((const phNxpEse_TraceHeader_t*)pBase)) {
+    munmap(pBase, st.st_size);
+    return ESESTATUS_INVALID_FORMAT;
+  }
+  madvise(pBase, st.st_size, MADV_SEQUENTIAL);
+  pReader->pBase = (const uint8_t*)pBase;
+  pReader->size = st.st_size;
+  pReader->offset = sizeof(phNxpEse_TraceHeader_t);
+  return ESESTATUS_SUCCESS;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_TraceReadNext
+ *
+ * Description      Returns the record at the reader offset and advances
+ *                  past it.
+ *
+ * Returns          ESESTATUS_SUCCESS, ESESTATUS_FAILED at the end or
+ *                  ESESTATUS_INVALID_FORMAT on a damaged record
+ *
+ ******************************************************************************/
+ESESTATUS phNxpEse_TraceReadNext(phNxpEse_TraceReader_t* pReader,
+                                 phNxpEse_TraceEntry_t* pEntry) {
+  if (pReader == NULL || pEntry == NULL || pReader->pBase == NULL)
+    return ESESTATUS_INVALID_PARAMETER;
+  size_t left = pReader->size - pReader->offset;
+  if (left == 0) return ESESTATUS_FAILED;
+  if (left < sizeof(phNxpEse_TraceRecord_t)) return ESESTATUS_INVALID_FORMAT;
+
+  const phNxpEse_TraceRecord_t* pRec =
+      (const phNxpEse_TraceRecord_t*)(pReader->pBase + pReader->offset);
+  uint64_t payloadLen = (uint64_t)pRec->cmdLen + pRec->rspLen;
+  if ((pRec->recordLen % PH_ESE_TRACE_ALIGN) != 0 ||
+      pRec->recordLen > left ||
+      sizeof(*pRec) + payloadLen > pRec->recordLen) {
+    return ESESTATUS_INVALID_FORMAT;
+  }
+  pEntry->pRecord = pRec;
+  pEntry->pCmd = (const uint8_t*)(pRec + 1);
+  pEntry->pRsp = pEntry->pCmd + pRec->cmdLen;
+  pReader->offset += pRec->recordLen;
+  return ESESTATUS_SUCCESS;
+}
+
+/******************************************************************************
+ * Function         phNxpEse_TraceClose
+ *
+ * Description      Unmaps the trace file.
+ *
+ * Returns          None
+ *
+ ******************************************************************************/
+void phNxpEse_TraceClose(phNxpEse_TraceReader_t* pReader) {
+  if (pReader == NULL || pReader->pBase == NULL) return;
+  munmap((void*)pReader->pBase, pReader->size);
+  phPalEse_memset(pReader, 0x00, sizeof(*pReader));
+}
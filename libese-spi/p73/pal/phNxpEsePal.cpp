@@ -17,11 +17,13 @@
  ******************************************************************************/
 #define LOG_TAG "NxpEseHal"
 #include <log/log.h>
+#include <phNxpEseLog.h>
 
 #include <errno.h>
 #include <fcntl.h>
 #include <stdlib.h>
 #include <sys/ioctl.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <ese_config.h>
@@ -31,6 +33,19 @@
 
 extern bool ese_debug_enabled;
 
+/* Two hex characters for every byte value, built at compile time */
+struct phPalEse_HexTable {
+  char pair[256][2];
+  constexpr phPalEse_HexTable() : pair() {
+    const char digits[] = "0123456789ABCDEF";
+    for (int i = 0; i < 256; i++) {
+      pair[i][0] = digits[i >> 4];
+      pair[i][1] = digits[i & 0x0F];
+    }
+  }
+};
+static constexpr phPalEse_HexTable gsHexTable;
+
 /*!
  * \brief Normal mode header length
  */
@@ -163,8 +178,8 @@ int phPalEse_write(void* pDevHandle, uint8_t* pBuffer, int nNbBytesToWrite) {
 ESESTATUS phPalEse_ioctl(phPalEse_ControlCode_t eControlCode, void* pDevHandle,
                          long level) {
   ESESTATUS ret = ESESTATUS_FAILED;
-  ALOGD_IF(ese_debug_enabled, "phPalEse_spi_ioctl(), ioctl %x , level %lx",
-           eControlCode, level);
+  NXP_LOG_ESE_D("phPalEse_spi_ioctl(), ioctl %x , level %lx", eControlCode,
+                level);
 
   if (NULL == pDevHandle) {
     return ESESTATUS_IOCTL_FAILED;
@@ -188,24 +203,73 @@ ESESTATUS phPalEse_ioctl(phPalEse_ControlCode_t eControlCode, void* pDevHandle,
 *******************************************************************************/
 void phPalEse_print_packet(const char* pString, const uint8_t* p_data,
                            uint16_t len) {
-  uint32_t i;
-  char print_buffer[len * 3 + 1];
+  static time_t sWindowStart = 0;
+  static uint32_t sPrinted = 0;
+  static uint32_t sSuppressed = 0;
+  char print_buffer[(PH_PALESE_PRINT_BYTES_PER_LINE * 2) + 1];
+  const char* pTag;
+  struct timespec now;
 
-  memset(print_buffer, 0, sizeof(print_buffer));
-  for (i = 0; i < len; i++) {
-    snprintf(&print_buffer[i * 2], 3, "%02X", p_data[i]);
+  /* Nothing is formatted unless the line would actually be logged */
+  if (!ese_debug_enabled ||
+      !__android_log_is_loggable(ANDROID_LOG_DEBUG, LOG_TAG,
+                                 ANDROID_LOG_DEBUG)) {
+    return;
   }
   if (0 == memcmp(pString, "SEND", 0x04)) {
-    ALOGD_IF(ese_debug_enabled, "NxpEseDataX len = %3d > %s", len,
-             print_buffer);
+    pTag = "NxpEseDataX";
   } else if (0 == memcmp(pString, "RECV", 0x04)) {
-    ALOGD_IF(ese_debug_enabled, "NxpEseDataR len = %3d > %s", len,
-             print_buffer);
+    pTag = "NxpEseDataR";
+  } else {
+    return;
+  }
+
+  /* Called from the serialized transceive path only */
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (now.tv_sec != sWindowStart) {
+    if (sSuppressed != 0) {
+      ALOGD("NxpEseData %u packets not dumped (rate limit)", sSuppressed);
+    }
+    sWindowStart = now.tv_sec;
+    sPrinted = 0;
+    sSuppressed = 0;
   }
+  if (sPrinted >= PH_PALESE_PRINT_PACKET_PER_SEC) {
+    sSuppressed++;
+    return;
+  }
+  sPrinted++;
+
+  uint16_t offset = 0;
+  do {
+    uint16_t chunk = len - offset;
+    if (chunk > PH_PALESE_PRINT_BYTES_PER_LINE)
+      chunk = PH_PALESE_PRINT_BYTES_PER_LINE;
+    phPalEse_hexEncode(print_buffer, &p_data[offset], chunk);
+    ALOGD("%s len = %3d > %s%s", pTag, len, print_buffer,
+          (offset + chunk < len) ? " .." : "");
+    offset += chunk;
+  } while (offset < len);
 
   return;
 }
 
+/*******************************************************************************
+**
+** Function         phPalEse_hexEncode
+**
+** Description      Table driven hex encoding
+**
+** Returns          None
+**
+*******************************************************************************/
+void phPalEse_hexEncode(char* pOut, const uint8_t* p_data, uint32_t len) {
+  for (uint32_t i = 0; i < len; i++) {
+    memcpy(&pOut[i * 2], gsHexTable.pair[p_data[i]], 2);
+  }
+  pOut[len * 2] = '\0';
+}
+
 /*******************************************************************************
 **
 ** Function         phPalEse_sleep
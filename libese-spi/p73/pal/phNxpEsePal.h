@@ -41,6 +41,16 @@
  *         level 0 = Disable power
  */
 #define P61_SET_SPM_PWR _IOW(P61_MAGIC, 0x04, long)
+/*!
+ * \brief Maximum number of packets dumped per second by
+ *        phPalEse_print_packet, further packets in the same second are only
+ *        counted
+ */
+#define PH_PALESE_PRINT_PACKET_PER_SEC 32
+/*!
+ * \brief Number of data bytes dumped per log line by phPalEse_print_packet
+ */
+#define PH_PALESE_PRINT_BYTES_PER_LINE 128
 /*!
  * \ingroup eSe_PAL
  *
@@ -169,6 +179,21 @@ ESESTATUS phPalEse_ioctl(phPalEse_ControlCode_t eControlCode, void* pDevHandle,
 void phPalEse_print_packet(const char* pString, const uint8_t* p_data,
                            uint16_t len);
 
+/**
+ * \ingroup eSe_PAL
+ * \brief Encodes data as upper case hex, two characters per byte, using a
+ *        lookup table. pOut is NUL terminated and must hold 2 * len + 1
+ *        characters.
+ *
+ * \param[out]   pOut               - hex string
+ * \param[in]    p_data             - data to be encoded
+ * \param[in]    len                - Length of data to be encoded
+ *
+ * \retval   void
+ *
+ */
+void phPalEse_hexEncode(char* pOut, const uint8_t* p_data, uint32_t len);
+
 /**
  * \ingroup eSe_PAL
  * \brief This function  suspends execution of the calling thread for
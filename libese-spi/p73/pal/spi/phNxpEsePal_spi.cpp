@@ -24,6 +24,7 @@
  */
 #define LOG_TAG "NxpEseHal"
 #include <log/log.h>
+#include <phNxpEseLog.h>
 
 #include <errno.h>
 #include <fcntl.h>
@@ -81,7 +82,7 @@ void phPalEse_spi_close(void* pDevHandle) {
   if (NULL != pDevHandle) {
     close((intptr_t)pDevHandle);
   }
-  ALOGD_IF(ese_debug_enabled, "halimpl close exit.");
+  NXP_LOG_ESE_D("halimpl close exit.");
   return;
 }
 /*******************************************************************************
@@ -99,7 +100,7 @@ void phPalEse_spi_dwp_sync_close() {
   ese_nxp_IoctlInOutData_t inpOutData;
   static uint8_t cmd_omapi_concurrent[] = {0x2F, 0x01, 0x01, 0x00};
   int retval;
-  ALOGD_IF(ese_debug_enabled, "halimpl close enter.");
+  NXP_LOG_ESE_D("halimpl close enter.");
 
   NfcAdaptation& pNfcAdapt = NfcAdaptation::GetInstance();
   pNfcAdapt.Initialize();
@@ -111,7 +112,7 @@ void phPalEse_spi_dwp_sync_close() {
   memcpy(inpOutData.inp.data.nxpCmd.p_cmd, cmd_omapi_concurrent,
          sizeof(cmd_omapi_concurrent));
   retval = pNfcAdapt.HalIoctl(HAL_NFC_SPI_DWP_SYNC, &inpOutData);
-  ALOGD_IF(ese_debug_enabled, "_spi_close() status %x", retval);
+  NXP_LOG_ESE_D("_spi_close() status %x", retval);
 }
 
 ESESTATUS phNxpEse_spiIoctl(uint64_t ioctlType, void* p_data) {
@@ -119,15 +120,13 @@ ESESTATUS phNxpEse_spiIoctl(uint64_t ioctlType, void* p_data) {
   ese_nxp_IoctlInOutData_t *inpOutData;
   if (p_data != NULL) {
     inpOutData = (ese_nxp_IoctlInOutData_t *)p_data;
-    ALOGD_IF(ese_debug_enabled, "phNxpEse_spiIoctl(): ioctlType: %ld",
-             (long)ioctlType);
+    NXP_LOG_ESE_D("phNxpEse_spiIoctl(): ioctlType: %ld", (long)ioctlType);
   }
   switch (ioctlType) {
   case HAL_NFC_IOCTL_RF_STATUS_UPDATE: {
     rf_status = inpOutData->inp.data.nxpCmd.p_cmd[0];
     if (rf_status == 1) {
-      ALOGD_IF(
-          ese_debug_enabled,
+      NXP_LOG_ESE_D(
           "*******************RF IS ON*************************************");
       phPalEse_spi_stop_debounce_timer();
       if (gMfcAppSessionCount) {
@@ -136,15 +135,13 @@ ESESTATUS phNxpEse_spiIoctl(uint64_t ioctlType, void* p_data) {
         StateMachine::GetInstance().ProcessExtEvent(EVT_RF_ON);
       }
     } else {
-      ALOGD_IF(
-          ese_debug_enabled,
+      NXP_LOG_ESE_D(
           "*******************RF IS OFF************************************");
       phPalEse_spi_start_debounce_timer(500);
     }
   } break;
   case HAL_NFC_IOCTL_RF_ACTION_NTF: {
-    ALOGD_IF(
-        ese_debug_enabled,
+    NXP_LOG_ESE_D(
         "*******************RF ACT NTF*************************************");
     /* Parsing NFCEE Action Notification to detect type of routing either SCBR
      * or Technology F for ESE to resume SPI session for ESE-UICC concurrency */
@@ -152,8 +149,7 @@ ESESTATUS phNxpEse_spiIoctl(uint64_t ioctlType, void* p_data) {
       StateMachine::GetInstance().ProcessExtEvent(EVT_RF_ACT_NTF_ESE);
       {
         SyncEventGuard guard(gSpiTxLock);
-        ALOGD_IF(ese_debug_enabled, "%s: Notifying SPI_TX Wait if waiting...",
-                 __FUNCTION__);
+        NXP_LOG_ESE_D("%s: Notifying SPI_TX Wait if waiting...", __FUNCTION__);
         gSpiTxLock.notifyOne();
       }
     }
@@ -163,11 +159,11 @@ ESESTATUS phNxpEse_spiIoctl(uint64_t ioctlType, void* p_data) {
                                    inpOutData->inp.data.nxpCmd.p_cmd +
                                        inpOutData->inp.data.nxpCmd.cmd_len);
     if (!phPalEse_spi_match_app_signatures(signature)) {
-      ALOGD_IF(ese_debug_enabled, "****RELEASE SESSION:SIGNATURE MATCHED****");
+      NXP_LOG_ESE_D("****RELEASE SESSION:SIGNATURE MATCHED****");
       if (gMfcAppSessionCount)
         gMfcAppSessionCount--;
     } else {
-      ALOGD_IF(ese_debug_enabled, "**RELEASE SESSION:SIGNATURE NOT MATCHED**");
+      NXP_LOG_ESE_D("**RELEASE SESSION:SIGNATURE NOT MATCHED**");
     }
   } break;
   case HAL_ESE_IOCTL_OMAPI_TRY_GET_ESE_SESSION: {
@@ -175,14 +171,14 @@ ESESTATUS phNxpEse_spiIoctl(uint64_t ioctlType, void* p_data) {
                                    inpOutData->inp.data.nxpCmd.p_cmd +
                                        inpOutData->inp.data.nxpCmd.cmd_len);
     if (!phPalEse_spi_match_app_signatures(signature)) {
-      ALOGD_IF(ese_debug_enabled, "******GET SESSION:SIGNATURE MATCHED******");
+      NXP_LOG_ESE_D("******GET SESSION:SIGNATURE MATCHED******");
       gMfcAppSessionCount++;
       if (rf_status) {
-        ALOGD_IF(ese_debug_enabled, "**GET SESSION:SIGNATURE MATCHED RF ON**");
+        NXP_LOG_ESE_D("**GET SESSION:SIGNATURE MATCHED RF ON**");
         status = ESESTATUS_NOT_ALLOWED;
       }
     } else {
-      ALOGD_IF(ese_debug_enabled, "****GET SESSION:SIGNATURE NOT MATCHED****");
+      NXP_LOG_ESE_D("****GET SESSION:SIGNATURE NOT MATCHED****");
     }
   } break;
   default:
@@ -217,20 +213,18 @@ ESESTATUS phPalEse_spi_open_and_configure(pphPalEse_Config_t pConfig) {
 
   if (EseConfig::hasKey(NAME_NXP_SOF_WRITE)) {
     configNum1 = EseConfig::getUnsigned(NAME_NXP_SOF_WRITE);
-    ALOGD_IF(ese_debug_enabled, "NXP_SOF_WRITE value from config file = %ld",
-             configNum1);
+    NXP_LOG_ESE_D("NXP_SOF_WRITE value from config file = %ld", configNum1);
   }
 
   if (EseConfig::hasKey(NAME_NXP_SPI_WRITE_TIMEOUT)) {
     configNum2 = EseConfig::getUnsigned(NAME_NXP_SPI_WRITE_TIMEOUT);
-    ALOGD_IF(ese_debug_enabled,
-             "NXP_SPI_WRITE_TIMEOUT value from config file = %ld", configNum2);
+    NXP_LOG_ESE_D("NXP_SPI_WRITE_TIMEOUT value from config file = %ld",
+                  configNum2);
   }
   if (EseConfig::hasKey(NAME_NXP_OMAPI_APP_TIMEOUT)) {
     gFelicaAppTimeout = EseConfig::getUnsigned(NAME_NXP_OMAPI_APP_TIMEOUT);
-    ALOGD_IF(ese_debug_enabled,
-             "NXP_OMAPI_APP_TIMEOUT value from config file = %ld",
-             gFelicaAppTimeout);
+    NXP_LOG_ESE_D("NXP_OMAPI_APP_TIMEOUT value from config file = %ld",
+                  gFelicaAppTimeout);
   }
   if (EseConfig::hasKey(NAME_NXP_OMAPI_APP_SIGNATURE_1)) {
     gOmapiAppSignature1 = EseConfig::getBytes(NAME_NXP_OMAPI_APP_SIGNATURE_1);
@@ -248,7 +242,7 @@ ESESTATUS phPalEse_spi_open_and_configure(pphPalEse_Config_t pConfig) {
     gOmapiAppSignature5 = EseConfig::getBytes(NAME_NXP_OMAPI_APP_SIGNATURE_5);
   }
 
-  ALOGD_IF(ese_debug_enabled, "halimpl open enter.");
+  NXP_LOG_ESE_D("halimpl open enter.");
   memset(&inpOutData, 0x00, sizeof(ese_nxp_IoctlInOutData_t));
   inpOutData.inp.data.nxpCmd.cmd_len = sizeof(cmd_omapi_concurrent);
   inpOutData.inp.data_source = 1;
@@ -259,17 +253,16 @@ retry_nfc_access:
   omapi_status = ESESTATUS_FAILED;
   retval = pNfcAdapt.HalIoctl(HAL_NFC_SPI_DWP_SYNC, &inpOutData);
   if (omapi_status != 0) {
-    ALOGD_IF(ese_debug_enabled, "omapi_status return failed.");
+    NXP_LOG_ESE_D("omapi_status return failed.");
     nfc_access_retryCnt++;
     phPalEse_sleep(2000000);
     if (nfc_access_retryCnt < 5) goto retry_nfc_access;
-    ALOGD_IF(ese_debug_enabled, "%s: Return Exception NFC in USE...",
-             __FUNCTION__);
+    NXP_LOG_ESE_D("%s: Return Exception NFC in USE...", __FUNCTION__);
     return ESESTATUS_FAILED;
   }
-  ALOGD_IF(ese_debug_enabled, "halimpl open exit");
+  NXP_LOG_ESE_D("halimpl open exit");
   /* open port */
-  ALOGD_IF(ese_debug_enabled, "Opening port=%s\n", pConfig->pDevName);
+  NXP_LOG_ESE_D("Opening port=%s\n", pConfig->pDevName);
 retry:
   nHandle = open((char const*)pConfig->pDevName, O_RDWR);
   if (nHandle < 0) {
@@ -286,7 +279,7 @@ retry:
     pConfig->pDevHandle = NULL;
     return ESESTATUS_INVALID_DEVICE;
   }
-  ALOGD_IF(ese_debug_enabled, "eSE driver opened :: fd = [%d]", nHandle);
+  NXP_LOG_ESE_D("eSE driver opened :: fd = [%d]", nHandle);
   pConfig->pDevHandle = (void*)((intptr_t)nHandle);
   return ESESTATUS_SUCCESS;
 }
@@ -308,10 +301,9 @@ retry:
 *******************************************************************************/
 int phPalEse_spi_read(void* pDevHandle, uint8_t* pBuffer, int nNbBytesToRead) {
   int ret = -1;
-  ALOGD_IF(ese_debug_enabled, "%s Read Requested %d bytes", __FUNCTION__,
-           nNbBytesToRead);
+  NXP_LOG_ESE_D("%s Read Requested %d bytes", __FUNCTION__, nNbBytesToRead);
   ret = read((intptr_t)pDevHandle, (void*)pBuffer, (nNbBytesToRead));
-  ALOGD_IF(ese_debug_enabled, "Read Returned = %d", ret);
+  NXP_LOG_ESE_D("Read Returned = %d", ret);
   return ret;
 }
 
@@ -387,8 +379,8 @@ int phPalEse_spi_write(void* pDevHandle, uint8_t* pBuffer,
 ESESTATUS phPalEse_spi_ioctl(phPalEse_ControlCode_t eControlCode,
                              void* pDevHandle, long level) {
   ESESTATUS ret = ESESTATUS_IOCTL_FAILED;
-  ALOGD_IF(ese_debug_enabled, "phPalEse_spi_ioctl(), ioctl %x , level %lx",
-           eControlCode, level);
+  NXP_LOG_ESE_D("phPalEse_spi_ioctl(), ioctl %x , level %lx", eControlCode,
+                level);
   ese_nxp_IoctlInOutData_t inpOutData;
   inpOutData.inp.level = level;
   NfcAdaptation& pNfcAdapt = NfcAdaptation::GetInstance();
@@ -450,14 +442,12 @@ void phPalEse_spi_rf_off_timer_expired_cb(union sigval) {
   usleep(100);
   {
     SyncEventGuard guard(gSpiTxLock);
-    ALOGD_IF(ese_debug_enabled, "%s: Notifying SPI_TX Wait if waiting...",
-             __FUNCTION__);
+    NXP_LOG_ESE_D("%s: Notifying SPI_TX Wait if waiting...", __FUNCTION__);
     gSpiTxLock.notifyOne();
   }
   {
     SyncEventGuard guard(gSpiOpenLock);
-    ALOGD_IF(ese_debug_enabled, "%s: Notifying SPI_OPEN Wait if waiting...",
-             __FUNCTION__);
+    NXP_LOG_ESE_D("%s: Notifying SPI_OPEN Wait if waiting...", __FUNCTION__);
     gSpiOpenLock.notifyOne();
   }
 }
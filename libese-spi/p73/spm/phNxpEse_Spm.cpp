@@ -17,6 +17,7 @@
  ******************************************************************************/
 #define LOG_TAG "NxpEseHal"
 #include <log/log.h>
+#include <phNxpEseLog.h>
 
 #include <errno.h>
 #include <fcntl.h>
@@ -72,7 +73,7 @@ ESESTATUS phNxpEse_SPM_Init(void* pDevHandle) {
     ALOGE("%s : failed, device handle is null", __FUNCTION__);
     status = ESESTATUS_FAILED;
   }
-  ALOGD_IF(ese_debug_enabled, "%s : exit status = %d", __FUNCTION__, status);
+  NXP_LOG_ESE_D("%s : exit status = %d", __FUNCTION__, status);
 
   return status;
 }
@@ -107,12 +108,11 @@ ESESTATUS phNxpEse_SPM_ConfigPwr(spm_power_t arg) {
   ESESTATUS wSpmStatus = ESESTATUS_SUCCESS;
   spm_state_t current_spm_state = SPM_STATE_INVALID;
 
-  ALOGD_IF(ese_debug_enabled, "%s Enter", __FUNCTION__);
-  ALOGD_IF(ese_debug_enabled,
-           "%ssecureTimer1 0x%x secureTimer2 0x%x secureTimer3 0x%x",
-           __FUNCTION__, nxpese_ctxt.secureTimerParams.secureTimer1,
-           nxpese_ctxt.secureTimerParams.secureTimer2,
-           nxpese_ctxt.secureTimerParams.secureTimer3);
+  NXP_LOG_ESE_D("%s Enter", __FUNCTION__);
+  NXP_LOG_ESE_D("%ssecureTimer1 0x%x secureTimer2 0x%x secureTimer3 0x%x",
+                __FUNCTION__, nxpese_ctxt.secureTimerParams.secureTimer1,
+                nxpese_ctxt.secureTimerParams.secureTimer2,
+                nxpese_ctxt.secureTimerParams.secureTimer3);
   gsCurIoctlRequest = arg;
   phNxpEse_GetMaxTimer(&timeInMilliSec);
   if (timeInMilliSec != 0 &&
@@ -221,8 +221,8 @@ ESESTATUS phNxpEse_SPM_EnablePwr(void) {
   int32_t ret = -1;
   ESESTATUS wSpmStatus = ESESTATUS_SUCCESS;
   spm_state_t current_spm_state = SPM_STATE_INVALID;
-  ALOGD_IF(ese_debug_enabled, "%s : phNxpEse_SPM_EnablePwr is set to  = 0x%d",
-           __FUNCTION__, 0);
+  NXP_LOG_ESE_D("%s : phNxpEse_SPM_EnablePwr is set to  = 0x%d", __FUNCTION__,
+                0);
   ret = phPalEse_ioctl(phPalEse_e_ChipRst, pEseDeviceHandle, 0);
   if (ret < 0) {
     ALOGE("%s : failed errno = 0x%x", __FUNCTION__, errno);
@@ -260,8 +260,8 @@ ESESTATUS phNxpEse_SPM_EnablePwr(void) {
 ESESTATUS phNxpEse_SPM_DisablePwr(void) {
   int32_t ret = -1;
   ESESTATUS status = ESESTATUS_SUCCESS;
-  ALOGD_IF(ese_debug_enabled, "%s : phNxpEse_SPM_DisablePwr is set to  = 0x%d",
-           __FUNCTION__, 1);
+  NXP_LOG_ESE_D("%s : phNxpEse_SPM_DisablePwr is set to  = 0x%d", __FUNCTION__,
+                1);
   ret = phPalEse_ioctl(phPalEse_e_ChipRst, pEseDeviceHandle, 1);
   if (ret < 0) {
     ALOGE("%s : failed errno = 0x%x", __FUNCTION__, errno);
@@ -283,8 +283,7 @@ ESESTATUS phNxpEse_SPM_SetPwrScheme(long arg) {
   int32_t ret = -1;
   ESESTATUS status = ESESTATUS_SUCCESS;
 
-  ALOGD_IF(ese_debug_enabled, "%s : Power scheme is set to  = 0x%ld",
-           __FUNCTION__, arg);
+  NXP_LOG_ESE_D("%s : Power scheme is set to  = 0x%ld", __FUNCTION__, arg);
   ret = phPalEse_ioctl(phPalEse_e_SetPowerScheme, pEseDeviceHandle, arg);
   if (ret < 0) {
     ALOGE("%s : failed errno = 0x%x", __FUNCTION__, errno);
@@ -307,8 +306,8 @@ ESESTATUS phNxpEse_SPM_DisablePwrControl(unsigned long arg) {
   int32_t ret = -1;
   ESESTATUS status = ESESTATUS_SUCCESS;
 
-  ALOGD_IF(ese_debug_enabled, "%s : Inhibit power control is set to  = 0x%ld",
-           __FUNCTION__, arg);
+  NXP_LOG_ESE_D("%s : Inhibit power control is set to  = 0x%ld", __FUNCTION__,
+                arg);
   ret = phPalEse_ioctl(phPalEse_e_ChipRst, pEseDeviceHandle, arg);
   if (ret < 0) {
     ALOGE("%s : failed errno = 0x%x", __FUNCTION__, errno);
@@ -359,8 +358,8 @@ ESESTATUS phNxpEse_SPM_SetJcopDwnldState(long arg) {
   int ret = -1;
   ESESTATUS status = ESESTATUS_SUCCESS;
 
-  ALOGD_IF(ese_debug_enabled, "%s :phNxpEse_SPM_SetJcopDwnldState  = 0x%ld",
-           __FUNCTION__, arg);
+  NXP_LOG_ESE_D("%s :phNxpEse_SPM_SetJcopDwnldState  = 0x%ld", __FUNCTION__,
+                arg);
   ret = phPalEse_ioctl(phPalEse_e_SetJcopDwnldState, pEseDeviceHandle, arg);
   if (ret < 0) {
     ALOGE("%s : failed errno = 0x%x", __FUNCTION__, errno);
@@ -395,7 +394,7 @@ static IntervalTimer &getSecureTimerInstance() {
  ******************************************************************************/
 static void phNxpEse_secureTimerExpired(union sigval) {
   int32_t ret = -1;
-  ALOGD_IF(ese_debug_enabled, "phNxpEse_secureTimerExpired callback triggered");
+  NXP_LOG_ESE_D("phNxpEse_secureTimerExpired callback triggered");
   if (gsCurIoctlRequest == SPM_POWER_DISABLE) {
     ret = phPalEse_ioctl(phPalEse_e_ChipRst,
                          (void *)((intptr_t)SECURE_TIMER_MAGIC_HANDLE),
@@ -419,14 +418,13 @@ static void phNxpEse_secureTimerExpired(union sigval) {
  ******************************************************************************/
 ESESTATUS phNxpEse_secureTimerStart(unsigned long timeInMilliSec) {
   ESESTATUS wConfigStatus = ESESTATUS_SUCCESS;
-  ALOGD_IF(ese_debug_enabled,
-           "Enter phNxpEse_secureTimerStart time value : %ld ms",
-           timeInMilliSec);
+  NXP_LOG_ESE_D("Enter phNxpEse_secureTimerStart time value : %ld ms",
+                timeInMilliSec);
   if (getSecureTimerInstance().set(timeInMilliSec,
                                    phNxpEse_secureTimerExpired) == true) {
-    ALOGD_IF(ese_debug_enabled, "secure timer started........");
+    NXP_LOG_ESE_D("secure timer started........");
   } else {
-    ALOGD_IF(ese_debug_enabled, "failed to set secure timer");
+    NXP_LOG_ESE_D("failed to set secure timer");
     wConfigStatus = ESESTATUS_FAILED;
   }
 
@@ -445,6 +443,6 @@ ESESTATUS phNxpEse_secureTimerStart(unsigned long timeInMilliSec) {
 **
 *******************************************************************************/
 void phNxpEse_secureTimerStop() {
-  ALOGD_IF(ese_debug_enabled, "Stopping Secure timer...");
+  NXP_LOG_ESE_D("Stopping Secure timer...");
   getSecureTimerInstance().kill();
 }
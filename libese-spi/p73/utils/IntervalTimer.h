@@ -19,6 +19,7 @@
  */
 #pragma once
 
+#include <signal.h>
 #include <time.h>
 
 class IntervalTimer {
@@ -42,6 +42,12 @@
 #define NAME_NXP_OMAPI_APP_SIGNATURE_4 "NXP_OMAPI_APP_SIGNATURE_4"
 #define NAME_NXP_OMAPI_APP_SIGNATURE_5 "NXP_OMAPI_APP_SIGNATURE_5"
 #define NAME_NXP_OMAPI_APP_TIMEOUT "NXP_OMAPI_APP_TIMEOUT"
+#define NAME_NXP_ESE_TRACE_FILE "NXP_ESE_TRACE_FILE"
+#define NAME_NXP_ESE_SCHED_PRIO_AIDS "NXP_ESE_SCHED_PRIO_AIDS"
+#define NAME_NXP_ESE_SCHED_PRIO_WEIGHT "NXP_ESE_SCHED_PRIO_WEIGHT"
+#define NAME_NXP_ESE_SCHED_PREEMPT_AIDS "NXP_ESE_SCHED_PREEMPT_AIDS"
+#define NAME_NXP_ESE_CACHE_APDUS "NXP_ESE_CACHE_APDUS"
+#define NAME_NXP_ESE_CACHE_ENTRIES "NXP_ESE_CACHE_ENTRIES"
 
 class EseConfig {
  public:
@@ -18,6 +18,9 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <new>
 
 #include "ringbuffer.h"
 
@@ -62,10 +65,15 @@ size_t ringbuffer_insert(ringbuffer_t* rb, const uint8_t* p, size_t length) {
 
   if (length > ringbuffer_available(rb)) length = ringbuffer_available(rb);
 
-  for (size_t i = 0; i != length; ++i) {
-    *rb->tail++ = *p++;
-    if (rb->tail >= (rb->base + rb->total)) rb->tail = rb->base;
-  }
+  // Copy in at most two chunks: up to the end of the buffer, then the
+  // wrapped remainder from the start.
+  const size_t to_end = (rb->base + rb->total) - rb->tail;
+  const size_t first = (length < to_end) ? length : to_end;
+  memcpy(rb->tail, p, first);
+  memcpy(rb->base, p + first, length - first);
+
+  rb->tail += length;
+  if (rb->tail >= (rb->base + rb->total)) rb->tail -= rb->total;
 
   rb->available -= length;
   return length;
@@ -95,10 +103,10 @@ size_t ringbuffer_peek(const ringbuffer_t* rb, off_t offset, uint8_t* p,
                                    ? ringbuffer_size(rb) - offset
                                    : length;
 
-  for (size_t copied = 0; copied < bytes_to_copy; ++copied) {
-    *p++ = *b++;
-    if (b >= (rb->base + rb->total)) b = rb->base;
-  }
+  const size_t to_end = (rb->base + rb->total) - b;
+  const size_t first = (bytes_to_copy < to_end) ? bytes_to_copy : to_end;
+  memcpy(p, b, first);
+  memcpy(p + first, rb->base, bytes_to_copy - first);
 
   return bytes_to_copy;
 }
@@ -114,3 +122,153 @@ size_t ringbuffer_pop(ringbuffer_t* rb, uint8_t* p, size_t length) {
   rb->available += copied;
   return copied;
 }
+
+struct ringbuffer_spsc_t {
+  size_t capacity;
+  size_t mask;
+  uint8_t* base;
+  // Free-running byte counters, reduced with |mask| on access. |head| is
+  // only written by the consumer and |tail| only by the producer; each side
+  // publishes with release and observes the other side with acquire. They
+  // sit on separate cache lines so the two threads do not false-share.
+  alignas(64) std::atomic<size_t> head;
+  alignas(64) std::atomic<size_t> tail;
+};
+
+ringbuffer_spsc_t* ringbuffer_spsc_init(const size_t size) {
+  size_t capacity = 1;
+  while (capacity < size) capacity <<= 1;
+
+  ringbuffer_spsc_t* p = new (std::nothrow) ringbuffer_spsc_t();
+  if (p == NULL) return p;
+
+  p->base = static_cast<uint8_t*>(calloc(capacity, sizeof(uint8_t)));
+  if (p->base == NULL) {
+    delete p;
+    return NULL;
+  }
+  p->capacity = capacity;
+  p->mask = capacity - 1;
+  p->head.store(0, std::memory_order_relaxed);
+  p->tail.store(0, std::memory_order_relaxed);
+
+  return p;
+}
+
+void ringbuffer_spsc_free(ringbuffer_spsc_t* rb) {
+  if (rb != NULL) free(rb->base);
+  delete rb;
+}
+
+size_t ringbuffer_spsc_capacity(const ringbuffer_spsc_t* rb) {
+  assert(rb);
+  return rb->capacity;
+}
+
+size_t ringbuffer_spsc_available(const ringbuffer_spsc_t* rb) {
+  assert(rb);
+  return rb->capacity - ringbuffer_spsc_size(rb);
+}
+
+size_t ringbuffer_spsc_size(const ringbuffer_spsc_t* rb) {
+  assert(rb);
+  const size_t head = rb->head.load(std::memory_order_acquire);
+  return rb->tail.load(std::memory_order_acquire) - head;
+}
+
+size_t ringbuffer_spsc_reserve(ringbuffer_spsc_t* rb, uint8_t** p,
+                               size_t length) {
+  assert(rb);
+  assert(p);
+
+  const size_t tail = rb->tail.load(std::memory_order_relaxed);
+  const size_t free_bytes =
+      rb->capacity - (tail - rb->head.load(std::memory_order_acquire));
+  const size_t offset = tail & rb->mask;
+  const size_t to_end = rb->capacity - offset;
+
+  if (length > free_bytes) length = free_bytes;
+  if (length > to_end) length = to_end;
+
+  *p = rb->base + offset;
+  return length;
+}
+
+void ringbuffer_spsc_commit(ringbuffer_spsc_t* rb, size_t length) {
+  assert(rb);
+  rb->tail.store(rb->tail.load(std::memory_order_relaxed) + length,
+                 std::memory_order_release);
+}
+
+size_t ringbuffer_spsc_insert(ringbuffer_spsc_t* rb, const uint8_t* p,
+                              size_t length) {
+  assert(rb);
+  assert(p);
+
+  const size_t tail = rb->tail.load(std::memory_order_relaxed);
+  const size_t free_bytes =
+      rb->capacity - (tail - rb->head.load(std::memory_order_acquire));
+  if (length > free_bytes) length = free_bytes;
+
+  const size_t offset = tail & rb->mask;
+  const size_t to_end = rb->capacity - offset;
+  const size_t first = (length < to_end) ? length : to_end;
+  memcpy(rb->base + offset, p, first);
+  memcpy(rb->base, p + first, length - first);
+
+  rb->tail.store(tail + length, std::memory_order_release);
+  return length;
+}
+
+size_t ringbuffer_spsc_peek(const ringbuffer_spsc_t* rb, size_t offset,
+                            uint8_t* p, size_t length) {
+  assert(rb);
+  assert(p);
+
+  const size_t head = rb->head.load(std::memory_order_relaxed);
+  const size_t used = rb->tail.load(std::memory_order_acquire) - head;
+  if (offset >= used) return 0;
+  if (length > used - offset) length = used - offset;
+
+  const size_t start = (head + offset) & rb->mask;
+  const size_t to_end = rb->capacity - start;
+  const size_t first = (length < to_end) ? length : to_end;
+  memcpy(p, rb->base + start, first);
+  memcpy(p + first, rb->base, length - first);
+
+  return length;
+}
+
+size_t ringbuffer_spsc_pop(ringbuffer_spsc_t* rb, uint8_t* p, size_t length) {
+  assert(rb);
+  assert(p);
+
+  const size_t copied = ringbuffer_spsc_peek(rb, 0, p, length);
+  rb->head.store(rb->head.load(std::memory_order_relaxed) + copied,
+                 std::memory_order_release);
+  return copied;
+}
+
+size_t ringbuffer_spsc_read(const ringbuffer_spsc_t* rb, const uint8_t** p) {
+  assert(rb);
+  assert(p);
+
+  const size_t head = rb->head.load(std::memory_order_relaxed);
+  const size_t used = rb->tail.load(std::memory_order_acquire) - head;
+  const size_t offset = head & rb->mask;
+  const size_t to_end = rb->capacity - offset;
+
+  *p = rb->base + offset;
+  return (used < to_end) ? used : to_end;
+}
+
+size_t ringbuffer_spsc_delete(ringbuffer_spsc_t* rb, size_t length) {
+  assert(rb);
+
+  const size_t head = rb->head.load(std::memory_order_relaxed);
+  const size_t used = rb->tail.load(std::memory_order_acquire) - head;
+  if (length > used) length = used;
+
+  rb->head.store(head + length, std::memory_order_release);
+  return length;
+}
@@ -60,3 +60,66 @@ size_t ringbuffer_pop(ringbuffer_t* rb, uint8_t* p, size_t length);
 // Deletes |length| bytes from the ringbuffer starting from the head
 // Return actual number of bytes deleted.
 size_t ringbuffer_delete(ringbuffer_t* rb, size_t length);
+
+typedef struct ringbuffer_spsc_t ringbuffer_spsc_t;
+
+// Single-producer/single-consumer variant.
+// Unlike |ringbuffer_t|, one thread may insert while another thread pops
+// at the same time without any external lock. Functions marked "producer"
+// must only be called from the one producer thread, functions marked
+// "consumer" only from the one consumer thread. The capacity is a power of
+// two so positions wrap with a mask.
+
+// Create a SPSC ringbuffer holding at least |size| bytes; the capacity is
+// rounded up to the next power of two. Returns NULL if memory allocation
+// failed. Resulting pointer must be freed using |ringbuffer_spsc_free| once
+// both sides are done with it.
+ringbuffer_spsc_t* ringbuffer_spsc_init(const size_t size);
+
+// Frees the ringbuffer structure and buffer
+// Save to call with NULL.
+void ringbuffer_spsc_free(ringbuffer_spsc_t* rb);
+
+// Returns the capacity in bytes
+size_t ringbuffer_spsc_capacity(const ringbuffer_spsc_t* rb);
+
+// Returns remaining buffer size. Only exact on the producer thread, elsewhere
+// the consumer may free more at any time.
+size_t ringbuffer_spsc_available(const ringbuffer_spsc_t* rb);
+
+// Returns size of data in buffer. Only exact on the consumer thread,
+// elsewhere the producer may add more at any time.
+size_t ringbuffer_spsc_size(const ringbuffer_spsc_t* rb);
+
+// Producer: inserts up to |length| bytes of data at |p|. Returns actual
+// number of bytes added, which is less than |length| if the buffer is full.
+size_t ringbuffer_spsc_insert(ringbuffer_spsc_t* rb, const uint8_t* p,
+                              size_t length);
+
+// Producer: zero-copy insert. Stores in |*p| a pointer to contiguous free
+// space and returns its size, at most |length|. The span may be shorter
+// than the free space when it wraps; call again after committing to get
+// the rest. Data written there becomes visible with
+// |ringbuffer_spsc_commit|.
+size_t ringbuffer_spsc_reserve(ringbuffer_spsc_t* rb, uint8_t** p,
+                               size_t length);
+
+// Producer: publishes |length| bytes written into the last reserved span.
+void ringbuffer_spsc_commit(ringbuffer_spsc_t* rb, size_t length);
+
+// Consumer: copies up to |length| bytes starting |offset| bytes after the
+// head into |p| without removing them. Returns the number of bytes copied.
+size_t ringbuffer_spsc_peek(const ringbuffer_spsc_t* rb, size_t offset,
+                            uint8_t* p, size_t length);
+
+// Consumer: does the same as |ringbuffer_spsc_peek| from offset 0, but also
+// frees the copied bytes for the producer.
+size_t ringbuffer_spsc_pop(ringbuffer_spsc_t* rb, uint8_t* p, size_t length);
+
+// Consumer: zero-copy read. Stores in |*p| a pointer to contiguous data at
+// the head and returns its size. Release it with |ringbuffer_spsc_delete|.
+size_t ringbuffer_spsc_read(const ringbuffer_spsc_t* rb, const uint8_t** p);
+
+// Consumer: deletes up to |length| bytes from the head. Returns actual
+// number of bytes deleted.
+size_t ringbuffer_spsc_delete(ringbuffer_spsc_t* rb, size_t length);
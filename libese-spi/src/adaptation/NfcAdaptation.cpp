@@ -21,6 +21,7 @@
 #include <android/hardware/nfc/1.0/types.h>
 #include <hwbinder/ProcessState.h>
 #include <log/log.h>
+#include <phNxpEseLog.h>
 #include <pthread.h>
 
 using android::sp;
@@ -49,16 +50,16 @@ extern bool ese_debug_enabled;
 *******************************************************************************/
 void NfcAdaptation::Initialize() {
   const char* func = "NfcAdaptation::Initialize";
-  ALOGD_IF(ese_debug_enabled, "%s", func);
+  NXP_LOG_ESE_D("%s", func);
   if (mHalNxpNfc != nullptr) return;
   mHalNxpNfc = INxpNfc::tryGetService();
   LOG_FATAL_IF(mHalNxpNfc == nullptr, "Failed to retrieve the NXP NFC HAL!");
   if (mHalNxpNfc != nullptr) {
-    ALOGD_IF(ese_debug_enabled, "%s: INxpNfc::getService() returned %p (%s)",
-             func, mHalNxpNfc.get(),
-             (mHalNxpNfc->isRemote() ? "remote" : "local"));
+    NXP_LOG_ESE_D("%s: INxpNfc::getService() returned %p (%s)", func,
+                  mHalNxpNfc.get(),
+                  (mHalNxpNfc->isRemote() ? "remote" : "local"));
   }
-  ALOGD_IF(ese_debug_enabled, "%s: exit", func);
+  NXP_LOG_ESE_D("%s: exit", func);
 }
 
 /*******************************************************************************
@@ -113,16 +114,14 @@ void IoctlCallback(::android::hardware::nfc::V1_0::NfcData outputData) {
   const char* func = "IoctlCallback";
   ese_nxp_ExtnOutputData_t* pOutData =
       (ese_nxp_ExtnOutputData_t*)&outputData[0];
-  ALOGD_IF(ese_debug_enabled, "%s Ioctl Type=%lu", func,
-           (unsigned long)pOutData->ioctlType);
+  NXP_LOG_ESE_D("%s Ioctl Type=%lu", func, (unsigned long)pOutData->ioctlType);
   NfcAdaptation* pAdaptation = (NfcAdaptation*)pOutData->context;
   /*Output Data from stub->Proxy is copied back to output data
    * This data will be sent back to libnfc*/
   memcpy(&pAdaptation->mCurrentIoctlData->out, &outputData[0],
          sizeof(ese_nxp_ExtnOutputData_t));
-  ALOGD_IF(ese_debug_enabled, "%s Ioctl Type value[0]:0x%x and value[3] 0x%x",
-           func, pOutData->data.nxpRsp.p_rsp[0],
-           pOutData->data.nxpRsp.p_rsp[3]);
+  NXP_LOG_ESE_D("%s Ioctl Type value[0]:0x%x and value[3] 0x%x", func,
+                pOutData->data.nxpRsp.p_rsp[0], pOutData->data.nxpRsp.p_rsp[3]);
   omapi_status = pOutData->data.nxpRsp.p_rsp[3];
 }
 
@@ -148,15 +147,15 @@ ESESTATUS NfcAdaptation::HalIoctl(long arg, void* p_data) {
   ESESTATUS result = ESESTATUS_FAILED;
   AutoMutex guard(sIoctlLock);
   ese_nxp_IoctlInOutData_t* pInpOutData = (ese_nxp_IoctlInOutData_t*)p_data;
-  ALOGD_IF(ese_debug_enabled, "%s arg=%ld", func, arg);
+  NXP_LOG_ESE_D("%s arg=%ld", func, arg);
   pInpOutData->inp.context = &NfcAdaptation::GetInstance();
   NfcAdaptation::GetInstance().mCurrentIoctlData = pInpOutData;
   data.setToExternal((uint8_t*)pInpOutData, sizeof(ese_nxp_IoctlInOutData_t));
   if (mHalNxpNfc != nullptr) {
     mHalNxpNfc->ioctl(arg, data, IoctlCallback);
   }
-  ALOGD_IF(ese_debug_enabled, "%s Ioctl Completed for Type=%lu", func,
-           (unsigned long)pInpOutData->out.ioctlType);
+  NXP_LOG_ESE_D("%s Ioctl Completed for Type=%lu", func,
+                (unsigned long)pInpOutData->out.ioctlType);
   result = (ESESTATUS)(pInpOutData->out.result);
   return result;
 }
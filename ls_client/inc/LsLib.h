@@ -19,8 +19,11 @@
 #ifndef LSC_H_
 #define LSC_H_
 
+#include <openssl/evp.h>
 #include <stdio.h>
 #include "LsClient.h"
+#include "LsScript.h"
+#include "phNxpEseBerTlv.h"
 #include "phNxpEse_Api.h"
 
 typedef struct Lsc_ChannelInfo {
@@ -37,12 +40,61 @@ typedef struct Lsc_TranscieveInfo {
   uint8_t sTemp_recvbuf[1024];
 } Lsc_TranscieveInfo_t;
 
+/* Response out file of a script. Each record is encoded to hex in pBuf and
+ * appended with one write(); the file is synced when the script ends. */
+typedef struct Lsc_RespFile {
+  int fd;
+  char* pBuf;            /* reused for every record */
+  size_t bufLen;         /* allocated size of pBuf */
+  uint64_t len;          /* bytes in the file */
+  EVP_MD_CTX* pHashCtx;  /* SHA-1 of the file so far */
+} Lsc_RespFile_t;
+
+/* Where an interrupted run of a script continues. A script is made of
+ * segments that each start with a certificate (7F21) and are authenticated
+ * anew, so a run can only continue at the start of a segment: the records
+ * before it were all acknowledged by the eSE. */
+typedef struct Lsc_Checkpoint {
+  char magic[8]; /* LS_CHECKPOINT_MAGIC, NUL terminated */
+  uint16_t version;
+  uint16_t reserved;
+  uint32_t record;  /* index of the 7F21 record to continue from */
+  uint64_t respLen; /* response out file length at that record */
+  uint8_t scriptHash[LS_SCRIPT_HASH_LEN];
+  uint8_t respHash[LS_SCRIPT_HASH_LEN]; /* SHA-1 of the respLen bytes */
+} Lsc_Checkpoint_t;
+
+/* Applet load engine. The LS applet hands out INSTALL [for load] and the
+ * LOAD blocks one at a time; they are answered with 9000 at once and queued.
+ * The whole load is sent to the eSE back to back after the last block, as
+ * JCOP needs it with no other APDU in between. The first LS_LOAD_QUEUE_SLOTS
+ * commands are held in place, those of a longer load in a heap spill that
+ * is freed when the load ends. Each entry keeps the script record it came
+ * from so that a failing block can be traced to the script. */
+#define LS_LOAD_QUEUE_SLOTS 16
+#define LS_LOAD_QUEUE_MAX (1 + 256) /* INSTALL and a LOAD per P2 */
+#define LS_LOAD_APDU_MAX_LEN (5 + 255 + 1)
+
+typedef struct Lsc_LoadApdu {
+  uint32_t record; /* index of the script record that produced it */
+  uint16_t len;
+  uint8_t data[LS_LOAD_APDU_MAX_LEN];
+} Lsc_LoadApdu_t;
+
+typedef struct Lsc_LoadQueue {
+  Lsc_LoadApdu_t slot[LS_LOAD_QUEUE_SLOTS];
+  Lsc_LoadApdu_t* pSpill; /* entries past the slots, NULL until needed */
+  uint16_t spillCap;      /* entries pSpill holds */
+  uint16_t count;         /* entries queued */
+  uint8_t nextBlock;      /* P2 of the next LOAD */
+  bool active;            /* between INSTALL [for load] and the last LOAD */
+} Lsc_LoadQueue_t;
+
 typedef struct Lsc_ImageInfo {
-  FILE* fp;
-  int fls_size;
+  Lsc_Script_t script;
   char fls_path[384];
-  int bytes_read;
-  FILE* fResp;
+  const uint8_t* pScriptHash; /* SHA-1 of the script, NULL if not known */
+  Lsc_RespFile_t resp;
   int fls_RespSize;
   char fls_RespPath[384];
   int bytes_wrote;
@@ -51,13 +103,39 @@ typedef struct Lsc_ImageInfo {
   uint8_t initChannelNum;
 } Lsc_ImageInfo_t;
 
+/* A slot of the LS hash applet: SHA-1 of the script and its status byte */
+#define LS_HASH_SLOT_MAX_LEN 32
+
+typedef struct Lsc_SlotHash {
+  LSCSTATUS status; /* result of reading the slot */
+  uint16_t hashLen;
+  uint8_t hash[LS_HASH_SLOT_MAX_LEN];
+} Lsc_SlotHash_t;
+
 typedef struct Lsc_HashInfo {
   uint16_t readHashLen;
-  uint8_t* lsRawScriptBuf = nullptr;
   uint8_t* lsScriptHash = nullptr;
   uint8_t* readBuffHash = nullptr;
 } Lsc_HashInfo_t;
 
+/* Where the time of one LS script goes, in microseconds. readUs and hashUs
+ * come from the prefetch stage; the transceive counters cover every command
+ * sent while the record is attached, certificates and hash slots included. */
+typedef struct Lsc_ScriptTiming {
+  uint64_t totalUs;      /* from the wait for its hash to the hash update */
+  uint64_t readUs;       /* script file reads while hashing */
+  uint64_t hashUs;       /* SHA-1 of the script */
+  uint64_t readHashUs;   /* LSC_ReadLsHash of its slot */
+  uint64_t openUs;       /* opening or compiling the script image */
+  uint64_t certUs;       /* Certificate_Verification */
+  uint64_t updateHashUs; /* LSC_UpdateLsHash of its slot */
+  uint64_t cmdUs;        /* all transceives */
+  uint64_t cmdMaxUs;     /* slowest transceive */
+  uint32_t cmdCount;
+  uint64_t txBytes;
+  uint64_t rxBytes;
+} Lsc_ScriptTiming_t;
+
 typedef enum {
   LS_Default = 0x00,
   LS_Cert = 0x7F21,
@@ -88,6 +166,7 @@ static uint8_t SelectLscSlotHash[] = {0x00, 0xA4, 0x04, 0x00, 0x10, 0xA0, 0x00,
 #define TAG_EXP_DATE 0x5F24
 #define TAG_CCM_PERMISSION 0x53
 #define TAG_SIG_RNS_COMP 0x5F37
+#define TAG_PUBLIC_KEY 0x7F49
 
 #define TAG_LS_VER1 0x9F
 #define TAG_LS_VER2 0x08
@@ -100,6 +179,9 @@ static uint8_t SelectLscSlotHash[] = {0x00, 0xA4, 0x04, 0x00, 0x10, 0xA0, 0x00,
 #define LS_STATUS_PATH "/data/vendor/secure_element/LS_Status.txt"
 #define LS_SRC_BACKUP "/data/vendor/secure_element/LS_Src_Backup.txt"
 #define LS_DST_BACKUP "/data/vendor/secure_element/LS_Dst_Backup.txt"
+#define LS_CHECKPOINT_PATH "/data/vendor/secure_element/LS_Checkpoint.bin"
+#define LS_CHECKPOINT_MAGIC "LSCKPT"
+#define LS_CHECKPOINT_VERSION 1
 #define MAX_CERT_LEN (255 + 137)
 
 /*LSC2*/
@@ -138,13 +220,16 @@ static uint8_t SelectLscSlotHash[] = {0x00, 0xA4, 0x04, 0x00, 0x10, 0xA0, 0x00,
 **
 ** Function:        Perform_LSC
 **
-** Description:     Performs the LSC download sequence
+** Description:     Performs the LSC download sequence. If scriptHash is
+**                  given, the script runs from its compiled image, which is
+**                  built on the first run.
 **
 ** Returns:         Success if ok.
 **
 *******************************************************************************/
 LSCSTATUS Perform_LSC(const char* path, const char* dest, const uint8_t* pdata,
-                      uint16_t len, uint8_t* respSW);
+                      uint16_t len, uint8_t* respSW,
+                      const uint8_t* scriptHash);
 
 /*******************************************************************************
 **
@@ -226,7 +311,8 @@ static LSCSTATUS LSC_loadapplet(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
 static LSCSTATUS LSC_update_seq_handler(
     LSCSTATUS (*seq_handler[])(Lsc_ImageInfo_t* pContext, LSCSTATUS status,
                                Lsc_TranscieveInfo_t* pInfo),
-    const char* name, const char* dest) __attribute__((unused));
+    const char* name, const char* dest, const uint8_t* scriptHash)
+    __attribute__((unused));
 
 /*******************************************************************************
 **
@@ -244,102 +330,117 @@ LSCSTATUS Write_Response_To_OutFile(Lsc_ImageInfo_t* image_info,
 
 /*******************************************************************************
 **
-** Function:        Check_Certificate_Tag
+** Function:        LSC_RespOpen
+**
+** Description:     Opens the response out file at path for appending
+**
+** Returns:         Success if OK
+**
+*******************************************************************************/
+LSCSTATUS LSC_RespOpen(Lsc_RespFile_t* pResp, const char* path);
+
+/*******************************************************************************
+**
+** Function:        LSC_RespRewind
 **
-** Description:     Check certificate Tag presence in script
-**                  by 7F21 .
+** Description:     Cuts the response out file back to its first len bytes,
+**                  which must hash to pHash. len 0 starts an empty file.
 **
-** Returns:         Success if Tag found
+** Returns:         Success if OK, failed if the file does not match
 **
 *******************************************************************************/
-LSCSTATUS Check_Certificate_Tag(uint8_t* read_buf, uint16_t* offset1);
+LSCSTATUS LSC_RespRewind(Lsc_RespFile_t* pResp, uint64_t len,
+                         const uint8_t* pHash);
 
 /*******************************************************************************
 **
-** Function:        Check_SerialNo_Tag
+** Function:        LSC_RespAppend
 **
-** Description:     Check Serial number Tag presence in script
-**                  by 0x93 .
+** Description:     Appends one record: the hex of the tag header and of the
+**                  response data, then a new line
 **
-** Returns:         Success if Tag found
+** Returns:         Success if the whole record was written
 **
 *******************************************************************************/
-LSCSTATUS Check_SerialNo_Tag(uint8_t* read_buf, uint16_t* offset1);
+LSCSTATUS LSC_RespAppend(Lsc_RespFile_t* pResp, const uint8_t* pHdr,
+                         size_t hdrLen, const uint8_t* pData, size_t dataLen);
 
 /*******************************************************************************
 **
-** Function:        Check_LSRootID_Tag
+** Function:        LSC_RespClose
 **
-** Description:     Check LS root ID tag presence in script and compare with
-**                  select response root ID value.
+** Description:     Syncs the response out file to storage and closes it
 **
-** Returns:         Success if Tag found
+** Returns:         None
 **
 *******************************************************************************/
-LSCSTATUS Check_LSRootID_Tag(uint8_t* read_buf, uint16_t* offset1);
+void LSC_RespClose(Lsc_RespFile_t* pResp);
 
 /*******************************************************************************
 **
-** Function:        Check_CertHoldID_Tag
+** Function:        LSC_CheckpointLoad
 **
-** Description:     Check certificate holder ID tag presence in script.
+** Description:     Reads the checkpoint left by an interrupted run of the
+**                  script with SHA-1 pScriptHash
 **
-** Returns:         Success if Tag found
+** Returns:         Success if there is one for this script
 **
 *******************************************************************************/
-LSCSTATUS Check_CertHoldID_Tag(uint8_t* read_buf, uint16_t* offset1);
+LSCSTATUS LSC_CheckpointLoad(const uint8_t* pScriptHash,
+                             Lsc_Checkpoint_t* pCheckpoint);
 
 /*******************************************************************************
 **
-** Function:        Check_Date_Tag
+** Function:        LSC_CheckpointStore
 **
-** Description:     Check date tags presence in script.
+** Description:     Records that the run of the script can continue from
+**                  record, along with the responses written so far
 **
-** Returns:         Success if Tag found
+** Returns:         None
 **
 *******************************************************************************/
-LSCSTATUS Check_Date_Tag(uint8_t* read_buf, uint16_t* offset1);
+void LSC_CheckpointStore(Lsc_ImageInfo_t* Os_info, uint32_t record);
 
 /*******************************************************************************
 **
-** Function:        Check_45_Tag
+** Function:        LSC_CheckpointClear
 **
-** Description:     Check 45 tags presence in script and compare the value
-**                  with select response tag 45 value
+** Description:     Drops the checkpoint once the script has completed
 **
-** Returns:         Success if Tag found
+** Returns:         None
 **
 *******************************************************************************/
-LSCSTATUS Check_45_Tag(uint8_t* read_buf, uint16_t* offset1, uint8_t* tag45Len);
+void LSC_CheckpointClear();
 
 /*******************************************************************************
 **
 ** Function:        Certificate_Verification
 **
 ** Description:     Perform the certificate verification by forwarding it to
-**                  LS applet.
+**                  LS applet. pCert is the 7F21 record and pTlv its elements
+**                  as matched by Check_Complete_7F21_Tag.
 **
 ** Returns:         Success if certificate is verified
 **
 *******************************************************************************/
 LSCSTATUS Certificate_Verification(Lsc_ImageInfo_t* Os_info,
                                    Lsc_TranscieveInfo_t* pTranscv_Info,
-                                   uint8_t* read_buf, uint16_t* offset1,
-                                   uint8_t* tag45Len);
+                                   const phNxpEseBerTlv_t* pCert,
+                                   const phNxpEseBerTlv_t* pTlv);
 
 /*******************************************************************************
 **
 ** Function:        Check_Complete_7F21_Tag
 **
-** Description:     Traverses the 7F21 tag for verification of each sub tag with
-**                  in the 7F21 tag.
+** Description:     Traverses the 7F21 record of len bytes once, checking each
+**                  sub tag in order, and has the certificate verified.
 **
 ** Returns:         Success if all tags are verified
 **
 *******************************************************************************/
 LSCSTATUS Check_Complete_7F21_Tag(Lsc_ImageInfo_t* Os_info,
                                   Lsc_TranscieveInfo_t* pTranscv_Info,
-                                  uint8_t* read_buf, uint16_t* offset);
+                                  const uint8_t* read_buf, int32_t len);
 
 /*******************************************************************************
 **
@@ -430,12 +531,15 @@ LSCSTATUS LSC_Check_KeyIdentifier(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
 **
 ** Function:        LSC_ReadScript
 **
-** Description:     Reads the current line if the script
+** Description:     Reads the next record of the script into read_buf, which
+**                  holds LS_MAX_SCRIPT_RECORD_LEN bytes, and its length
+**                  into pLen
 **
 ** Returns:         Success if ok.
 **
 *******************************************************************************/
-LSCSTATUS LSC_ReadScript(Lsc_ImageInfo_t* Os_info, uint8_t* read_buf);
+LSCSTATUS LSC_ReadScript(Lsc_ImageInfo_t* Os_info, uint8_t* read_buf,
+                         int32_t* pLen);
 
 /*******************************************************************************
 **
@@ -465,7 +569,7 @@ LSCSTATUS Process_SelectRsp(uint8_t* Recv_data, int32_t Recv_len);
 **
 ** Function:        LSC_CloseAllLogicalChannels
 **
-** Description:     Close all opened logical channels
+** Description:     Close the logical channels opened by the LS client
 **
 ** Returns:         SUCCESS/FAILURE
 **
@@ -476,25 +580,51 @@ LSCSTATUS LSC_CloseAllLogicalChannels(Lsc_ImageInfo_t* Os_info);
 **
 ** Function:        LSC_SelectLsHash
 **
-** Description:     Selects LS Hash applet
+** Description:     Selects LS Hash applet on a logical channel opened for it
 **
-** Returns:         SUCCESS/FAILURE
+** Returns:         SUCCESS/FAILURE, the channel in pChannel on success
 **
 *******************************************************************************/
 
-LSCSTATUS LSC_SelectLsHash();
+LSCSTATUS LSC_SelectLsHash(uint8_t* pChannel);
+
+/*******************************************************************************
+**
+** Function:        LSC_CloseLsHash
+**
+** Description:     Closes the channel opened by LSC_SelectLsHash
+**
+** Returns:         None
+**
+*******************************************************************************/
+void LSC_CloseLsHash(uint8_t channel);
 
 /*******************************************************************************
 **
 ** Function:        LSC_ReadLsHash
 **
-** Description:     Read the LS SHA1 for the intended slot
+** Description:     Read the LS SHA1 for the intended slot into hash, which
+**                  holds LS_HASH_SLOT_MAX_LEN bytes
 **
 ** Returns:         SUCCESS/FAILURE
 **
 *******************************************************************************/
 LSCSTATUS LSC_ReadLsHash(uint8_t* hash, uint16_t* readHashLen, uint8_t slotId);
 
+/*******************************************************************************
+**
+** Function:        LSC_ReadAllLsHashes
+**
+** Description:     Selects the LS hash applet once and reads slots 1 to count
+**                  into pSlots[0] to pSlots[count - 1]. Slots after the
+**                  first invalid one are marked invalid without a command.
+**
+** Returns:         SUCCESS if the applet was selected, the result of each
+**                  slot is in its status
+**
+*******************************************************************************/
+LSCSTATUS LSC_ReadAllLsHashes(Lsc_SlotHash_t* pSlots, uint8_t count);
+
 /*******************************************************************************
 **
 ** Function:        LSC_UpdateLsHash
@@ -508,21 +638,59 @@ LSCSTATUS LSC_UpdateLsHash(uint8_t* hash, long hashLen, uint8_t slotId);
 
 /*******************************************************************************
 **
-** Function:        Numof_lengthbytes
+** Function:        LSC_LoadQueueReset
 **
-** Description:     Checks the number of length bytes and assigns
-**                  length value to wLen.
+** Description:     Drops any queued load command, frees the spill and
+**                  leaves load mode
 **
-** Returns:         Number of Length bytes
+** Returns:         None
 **
 *******************************************************************************/
-uint8_t Numof_lengthbytes(uint8_t* read_buf, int32_t* wLen);
+void LSC_LoadQueueReset(Lsc_LoadQueue_t* pQueue);
 
-LSCSTATUS Send_Backall_Loadcmds(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
-                                Lsc_TranscieveInfo_t* pTranscv_Info);
+/*******************************************************************************
+**
+** Function:        LSC_LoadQueuePush
+**
+** Description:     Queues the command in pTranscv_Info->sSendData, produced
+**                  by script record, behind those of the current load
+**
+** Returns:         Success if queued, failed if the command is too long, the
+**                  load has LS_LOAD_QUEUE_MAX commands or the spill cannot
+**                  grow
+**
+*******************************************************************************/
+LSCSTATUS LSC_LoadQueuePush(Lsc_LoadQueue_t* pQueue,
+                            const Lsc_TranscieveInfo_t* pTranscv_Info,
+                            uint32_t record);
 
-LSCSTATUS Bufferize_load_cmds(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
-                              Lsc_TranscieveInfo_t* pTranscv_Info);
+/*******************************************************************************
+**
+** Function:        LSC_LoadQueueDrain
+**
+** Description:     Sends the queued load to the eSE in order, checking each
+**                  response as it arrives, and resets the queue. The
+**                  response of a failing command, or else of the last one,
+**                  is forwarded to the LS applet.
+**
+** Returns:         Status of forwarding the response, failed if the eSE
+**                  could not be reached
+**
+*******************************************************************************/
+LSCSTATUS LSC_LoadQueueDrain(Lsc_LoadQueue_t* pQueue, Lsc_ImageInfo_t* Os_info,
+                             Lsc_TranscieveInfo_t* pTranscv_Info);
+
+/*******************************************************************************
+**
+** Function:        LSC_TimingAttach
+**
+** Description:     Charges the commands sent from now on, and the phases
+**                  timed inside the library, to pTiming. NULL stops it.
+**
+** Returns:         None
+**
+*******************************************************************************/
+void LSC_TimingAttach(Lsc_ScriptTiming_t* pTiming);
 
 inline int FSCANF_BYTE(FILE* stream, const char* format, void* pVal) {
   int Result = 0;
@@ -0,0 +1,176 @@
+/*******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *****************************************************************************/
+#ifndef LSSCRIPT_H_
+#define LSSCRIPT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "LsClient.h"
+
+/* An LS script (.lss) is a text file of hex digit pairs. Each record is a
+ * TLV with tag 7F21 (certificate), 60 (signature) or 40 (command), usually
+ * one record per line. Whitespace may appear between any two bytes. */
+
+/* Largest decoded record, the size of the record buffers of LsLib */
+#define LS_MAX_SCRIPT_RECORD_LEN 1024
+
+/* SHA-1 of the script text, the key of its compiled image */
+#define LS_SCRIPT_HASH_LEN 20
+#define LS_SCRIPT_CACHE_DIR "/data/vendor/secure_element/"
+#define LS_SCRIPT_CACHE_NAME "ls_script_"
+#define LS_SCRIPT_CACHE_PREFIX LS_SCRIPT_CACHE_DIR LS_SCRIPT_CACHE_NAME
+#define LS_SCRIPT_CACHE_SUFFIX ".img"
+/* Size of the path of a compiled image, with its NUL */
+#define LS_SCRIPT_CACHE_PATH_LEN                                \
+  (sizeof(LS_SCRIPT_CACHE_PREFIX) + 2 * LS_SCRIPT_HASH_LEN + \
+   sizeof(LS_SCRIPT_CACHE_SUFFIX) - 1)
+
+/* A compiled image holds the decoded records of one script so that a rerun
+ * of the script, e.g. after a failed or interrupted update, skips the hex
+ * decoding. Layout: Lsc_ScriptImageHeader_t, then recordCount + 1 offsets
+ * (uint32_t) into the record data, then the records back to back. Record i
+ * spans offsets i to i + 1; command records hold the APDU as sent. */
+#define LS_SCRIPT_IMAGE_MAGIC "LSIMAGE"
+#define LS_SCRIPT_IMAGE_VERSION 1
+
+typedef struct Lsc_ScriptImageHeader {
+  char magic[8];      /* LS_SCRIPT_IMAGE_MAGIC, NUL terminated */
+  uint16_t version;   /* LS_SCRIPT_IMAGE_VERSION */
+  uint16_t headerLen; /* sizeof(Lsc_ScriptImageHeader_t) */
+  uint32_t recordCount;
+  uint32_t dataLen; /* size of the record data */
+  uint8_t hash[LS_SCRIPT_HASH_LEN];
+} Lsc_ScriptImageHeader_t;
+
+typedef struct Lsc_Script {
+  const uint8_t* pBase; /* read-only mapping of the script file */
+  size_t size;          /* file size in characters */
+  size_t offset;        /* first character not consumed yet */
+  /* Set when the records come from a compiled image instead */
+  const uint8_t* pImage;
+  size_t imageLen;
+  bool imageMapped; /* mapped from the cache, else allocated */
+  uint32_t record;  /* index of the next record, in either form */
+} Lsc_Script_t;
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptOpen
+**
+** Description:     Maps the script file at path read-only and positions the
+**                  cursor at its start.
+**
+** Returns:         Success if ok.
+**
+*******************************************************************************/
+LSCSTATUS LSC_ScriptOpen(const char* path, Lsc_Script_t* pScript);
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptOpenCached
+**
+** Description:     Opens the compiled image at cachePath if it was built from
+**                  a script with SHA-1 pHash. Otherwise compiles the script
+**                  at path, stores the image at cachePath for the next run
+**                  and reads the records from the new image.
+**
+** Returns:         Success if ok.
+**
+*******************************************************************************/
+LSCSTATUS LSC_ScriptOpenCached(const char* path, const char* cachePath,
+                               const uint8_t* pHash, Lsc_Script_t* pScript);
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptCachePath
+**
+** Description:     Builds the path of the compiled image of the script with
+**                  SHA-1 pHash into path, which holds len characters,
+**                  LS_SCRIPT_CACHE_PATH_LEN for the whole path.
+**
+** Returns:         None
+**
+*******************************************************************************/
+void LSC_ScriptCachePath(const uint8_t* pHash, char* path, size_t len);
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptClose
+**
+** Description:     Releases a script opened by LSC_ScriptOpen or
+**                  LSC_ScriptOpenCached.
+**
+** Returns:         None
+**
+*******************************************************************************/
+void LSC_ScriptClose(Lsc_Script_t* pScript);
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptAtEnd
+**
+** Description:     Tells whether all records of the script were consumed.
+**                  Trailing whitespace is consumed with the last record.
+**
+** Returns:         true at the end of the script
+**
+*******************************************************************************/
+bool LSC_ScriptAtEnd(const Lsc_Script_t* pScript);
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptDecodeHex
+**
+** Description:     Decodes exactly count bytes at the cursor into pDst,
+**                  skipping whitespace between bytes, and advances the cursor.
+**
+** Returns:         Success if count bytes were decoded, failed on a non hex
+**                  character or at the end of the script.
+**
+*******************************************************************************/
+LSCSTATUS LSC_ScriptDecodeHex(Lsc_Script_t* pScript, uint8_t* pDst,
+                              size_t count);
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptNextTlv
+**
+** Description:     Decodes the next record into pBuf: the tag, the length
+**                  field and the value. Only tags 7F21, 60 and 40 and length
+**                  fields of one to three bytes are accepted. Records of a
+**                  compiled image are copied as they are.
+**
+** Returns:         Success if ok, *pRecLen is then the decoded record size.
+**
+*******************************************************************************/
+LSCSTATUS LSC_ScriptNextTlv(Lsc_Script_t* pScript, uint8_t* pBuf,
+                            size_t bufLen, int32_t* pRecLen);
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptSkip
+**
+** Description:     Moves the cursor count records forward without returning
+**                  them, e.g. to the record a resumed run continues from.
+**
+** Returns:         Success if count records were skipped.
+**
+*******************************************************************************/
+LSCSTATUS LSC_ScriptSkip(Lsc_Script_t* pScript, uint32_t count);
+
+#endif /* LSSCRIPT_H_ */
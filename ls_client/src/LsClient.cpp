@@ -19,15 +19,20 @@
 #include "LsClient.h"
 #include <cutils/properties.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <log/log.h>
+#include <phNxpEseLog.h>
+#include <phNxpEse_Stats.h>
 #include <openssl/evp.h>
 #include <pthread.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <string>
 #include "LsLib.h"
 
 uint8_t datahex(char c);
-unsigned char* getHASH(uint8_t* buffer, size_t buffSize);
+static bool getHASH(int fd, uint8_t* outHash, uint64_t* pReadUs);
 extern bool ese_debug_enabled;
 
 #define ls_script_source_prefix "/vendor/etc/loaderservice_updater_"
@@ -37,11 +42,44 @@ extern bool ese_debug_enabled;
 #define ls_script_output_suffix ".txt"
 const size_t HASH_DATA_LENGTH = 21;
 const uint16_t HASH_STATUS_INDEX = 20;
+/* Scripts are hashed in chunks of this size, whatever their length */
+const size_t HASH_CHUNK_LENGTH = 4096;
 const uint8_t LS_MAX_COUNT = 10;
 const uint8_t LS_DOWNLOAD_SUCCESS = 0x00;
 const uint8_t LS_DOWNLOAD_FAILED = 0x01;
 
+/* Hashes of the scripts last found installed, so that a boot with unchanged
+ * scripts can report the SE ready before the applet is asked. The digest
+ * only detects a damaged file; it is not keyed, as the applet stays the
+ * authority and is checked after the early report in any case. */
+#define LS_MANIFEST_PATH "/data/vendor/secure_element/ls_manifest.bin"
+#define LS_MANIFEST_MAGIC "LSMANIF"
+#define LS_MANIFEST_VERSION 1
+
+typedef struct Lsc_Manifest {
+  char magic[8]; /* LS_MANIFEST_MAGIC, NUL terminated */
+  uint16_t version;
+  uint8_t count; /* scripts 1 to count are installed */
+  uint8_t reserved;
+  uint8_t hash[LS_MAX_COUNT][HASH_DATA_LENGTH];
+  uint8_t digest[LS_SCRIPT_HASH_LEN]; /* SHA-1 of the fields above */
+} Lsc_Manifest_t;
+
+/* A script hashed by the prefetch stage, handed over under gsPrefetchLock */
+typedef struct Lsc_ScriptSlot {
+  std::string sourcePath;
+  uint8_t hash[HASH_DATA_LENGTH]; /* SHA-1 and status byte */
+  bool ready;                     /* the prefetch stage is done with it */
+  bool valid;                     /* the script exists and was hashed */
+  uint64_t readUs;                /* time in file reads while hashing */
+  uint64_t hashUs;                /* the rest of the hashing time */
+} Lsc_ScriptSlot_t;
+
 static android::sp<ISecureElementHalCallback> cCallback;
+static Lsc_ScriptSlot_t gsScriptSlot[LS_MAX_COUNT];
+static bool gsPrefetchCancel;
+static pthread_mutex_t gsPrefetchLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t gsPrefetchCond = PTHREAD_COND_INITIALIZER;
 void* performLSDownload_thread(void* data);
 static void getLSScriptSourcePrefix(std::string& prefix);
 
@@ -76,15 +114,15 @@ void getLSScriptSourcePrefix(std::string& prefix) {
 **
 *******************************************************************************/
 LSCSTATUS LSC_Start(const char* name, const char* dest, uint8_t* pdata,
-                    uint16_t len, uint8_t* respSW) {
+                    uint16_t len, uint8_t* respSW, const uint8_t* scriptHash) {
   static const char fn[] = "LSC_Start";
   LSCSTATUS status = LSCSTATUS_FAILED;
   if (name != NULL) {
-    status = Perform_LSC(name, dest, pdata, len, respSW);
+    status = Perform_LSC(name, dest, pdata, len, respSW, scriptHash);
   } else {
     ALOGE("%s: LS script file is missing", fn);
   }
-  ALOGD_IF(ese_debug_enabled, "%s: Exit; status=0x0%X", fn, status);
+  NXP_LOG_ESE_D("%s: Exit; status=0x0%X", fn, status);
   return status;
 }
 
@@ -116,17 +154,331 @@ LSCSTATUS LSC_doDownload(
   return status;
 }
 
+/*******************************************************************************
+**
+** Function:        hashLSScript
+**
+** Description:     Computes the SHA-1 of the script at path into hash,
+**                  followed by a cleared status byte. The time spent reading
+**                  the file is added to pReadUs.
+**
+** Returns:         true if the script exists and was hashed
+**
+*******************************************************************************/
+static bool hashLSScript(const char* path, uint8_t* hash, uint64_t* pReadUs) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    ALOGE("%s Cannot open LS script file %s\n", __func__, path);
+    ALOGE("%s Error : %s", __func__, strerror(errno));
+    return false;
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  bool hashed = getHASH(fd, hash, pReadUs);
+  close(fd);
+  if (!hashed) {
+    ALOGE("%s Cannot hash LS script file %s\n", __func__, path);
+    return false;
+  }
+  hash[HASH_STATUS_INDEX] = LS_DOWNLOAD_SUCCESS;
+  return true;
+}
+
+/*******************************************************************************
+**
+** Function:        prefetchLSScripts_thread
+**
+** Description:     Prefetch stage of the LS download. Hashes the scripts in
+**                  index order while the download thread runs the previous
+**                  ones on the eSE, and stops at the first missing script
+**                  or when the download thread cancels it.
+**
+** Returns:         None
+**
+*******************************************************************************/
+static void* prefetchLSScripts_thread(void* data) {
+  const std::string* pPrefix = (const std::string*)data;
+  for (int index = 1; index <= LS_MAX_COUNT; index++) {
+    Lsc_ScriptSlot_t* pSlot = &gsScriptSlot[index - 1];
+    pSlot->sourcePath.assign(*pPrefix);
+    pSlot->sourcePath += ('0' + index);
+    pSlot->sourcePath += ls_script_source_suffix;
+    uint64_t start = phNxpEse_StatsNowUs();
+    pSlot->readUs = 0;
+    bool valid =
+        hashLSScript(pSlot->sourcePath.c_str(), pSlot->hash, &pSlot->readUs);
+    pSlot->hashUs = phNxpEse_StatsNowUs() - start - pSlot->readUs;
+
+    pthread_mutex_lock(&gsPrefetchLock);
+    pSlot->valid = valid;
+    pSlot->ready = true;
+    bool stop = gsPrefetchCancel || !valid;
+    pthread_cond_signal(&gsPrefetchCond);
+    pthread_mutex_unlock(&gsPrefetchLock);
+    if (stop) break;
+  }
+  return NULL;
+}
+
+/*******************************************************************************
+**
+** Function:        countLSScripts
+**
+** Description:     Counts the scripts present, up to the first missing one
+**                  as the download stops there.
+**
+** Returns:         Number of scripts
+**
+*******************************************************************************/
+static uint8_t countLSScripts(const std::string& prefix) {
+  uint8_t count = 0;
+  std::string path;
+  for (int index = 1; index <= LS_MAX_COUNT; index++) {
+    path.assign(prefix);
+    path += ('0' + index);
+    path += ls_script_source_suffix;
+    if (access(path.c_str(), R_OK) != 0) break;
+    count++;
+  }
+  return count;
+}
+
+/*******************************************************************************
+**
+** Function:        waitLSScript
+**
+** Description:     Waits until the prefetch stage is done with a script.
+**
+** Returns:         The slot of the script
+**
+*******************************************************************************/
+static Lsc_ScriptSlot_t* waitLSScript(int index) {
+  Lsc_ScriptSlot_t* pSlot = &gsScriptSlot[index - 1];
+  pthread_mutex_lock(&gsPrefetchLock);
+  while (!pSlot->ready) pthread_cond_wait(&gsPrefetchCond, &gsPrefetchLock);
+  pthread_mutex_unlock(&gsPrefetchLock);
+  return pSlot;
+}
+
+/*******************************************************************************
+**
+** Function:        digestLSManifest
+**
+** Description:     Computes the digest of the manifest into digest
+**
+** Returns:         true if ok
+**
+*******************************************************************************/
+static bool digestLSManifest(const Lsc_Manifest_t* pManifest,
+                             uint8_t* digest) {
+  unsigned int md_len = 0;
+  return (EVP_Digest(pManifest, offsetof(Lsc_Manifest_t, digest), digest,
+                     &md_len, EVP_sha1(), NULL) == 1) &&
+         (md_len == LS_SCRIPT_HASH_LEN);
+}
+
+/*******************************************************************************
+**
+** Function:        loadLSManifest
+**
+** Description:     Reads the manifest written by the last complete download
+**
+** Returns:         true if the manifest exists and is intact
+**
+*******************************************************************************/
+static bool loadLSManifest(Lsc_Manifest_t* pManifest) {
+  int fd = open(LS_MANIFEST_PATH, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  ssize_t len =
+      TEMP_FAILURE_RETRY(read(fd, pManifest, sizeof(Lsc_Manifest_t)));
+  close(fd);
+  uint8_t digest[LS_SCRIPT_HASH_LEN];
+  if ((len != sizeof(Lsc_Manifest_t)) ||
+      (memcmp(pManifest->magic, LS_MANIFEST_MAGIC, sizeof(pManifest->magic)) !=
+       0) ||
+      (pManifest->version != LS_MANIFEST_VERSION) ||
+      (pManifest->count > LS_MAX_COUNT) ||
+      !digestLSManifest(pManifest, digest) ||
+      (memcmp(digest, pManifest->digest, LS_SCRIPT_HASH_LEN) != 0)) {
+    ALOGE("%s: discarding invalid manifest", __func__);
+    unlink(LS_MANIFEST_PATH);
+    return false;
+  }
+  return true;
+}
+
+/*******************************************************************************
+**
+** Function:        storeLSManifest
+**
+** Description:     Writes the manifest through a temporary file so that an
+**                  interrupted write leaves the previous one or none
+**
+** Returns:         None
+**
+*******************************************************************************/
+static void storeLSManifest(Lsc_Manifest_t* pManifest) {
+  static const char tmpPath[] = LS_MANIFEST_PATH ".tmp";
+  memcpy(pManifest->magic, LS_MANIFEST_MAGIC, sizeof(pManifest->magic));
+  pManifest->version = LS_MANIFEST_VERSION;
+  pManifest->reserved = 0;
+  if (!digestLSManifest(pManifest, pManifest->digest)) return;
+  int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    ALOGE("%s: cannot create %s: %s", __func__, tmpPath, strerror(errno));
+    return;
+  }
+  ssize_t len =
+      TEMP_FAILURE_RETRY(write(fd, pManifest, sizeof(Lsc_Manifest_t)));
+  bool ok = (len == sizeof(Lsc_Manifest_t)) && (fsync(fd) == 0);
+  close(fd);
+  if (!ok || rename(tmpPath, LS_MANIFEST_PATH) != 0) {
+    ALOGE("%s: cannot store manifest: %s", __func__, strerror(errno));
+    unlink(tmpPath);
+  }
+}
+
+/*******************************************************************************
+**
+** Function:        matchLSManifest
+**
+** Description:     Waits for the prefetch stage and compares the hashes of
+**                  the scripts found with the manifest
+**
+** Returns:         true if the same scripts are present, unchanged
+**
+*******************************************************************************/
+static bool matchLSManifest(const Lsc_Manifest_t* pManifest) {
+  for (int index = 1; index <= LS_MAX_COUNT; index++) {
+    Lsc_ScriptSlot_t* pSlot = waitLSScript(index);
+    if (index > pManifest->count) return !pSlot->valid;
+    if (!pSlot->valid || memcmp(pSlot->hash, pManifest->hash[index - 1],
+                                HASH_DATA_LENGTH) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*******************************************************************************
+**
+** Function:        logLSTiming
+**
+** Description:     Logs one timing record, of a script or of the whole
+**                  download, as key=value pairs. Times are in microseconds,
+**                  rate is the bytes per second of the transceives.
+**
+** Returns:         None
+**
+*******************************************************************************/
+static void logLSTiming(const char* what, const char* result,
+                        const Lsc_ScriptTiming_t* pTiming) {
+  uint64_t rate = 0;
+  if (pTiming->cmdUs != 0) {
+    rate = (pTiming->txBytes + pTiming->rxBytes) * 1000000 / pTiming->cmdUs;
+  }
+  ALOGI("LS timing %s: result=%s total=%llu read=%llu hash=%llu "
+        "read_hash=%llu open=%llu cert=%llu update_hash=%llu cmds=%u "
+        "cmd=%llu cmd_max=%llu tx=%llu rx=%llu rate=%llu",
+        what, result, (unsigned long long)pTiming->totalUs,
+        (unsigned long long)pTiming->readUs,
+        (unsigned long long)pTiming->hashUs,
+        (unsigned long long)pTiming->readHashUs,
+        (unsigned long long)pTiming->openUs,
+        (unsigned long long)pTiming->certUs,
+        (unsigned long long)pTiming->updateHashUs, pTiming->cmdCount,
+        (unsigned long long)pTiming->cmdUs,
+        (unsigned long long)pTiming->cmdMaxUs,
+        (unsigned long long)pTiming->txBytes,
+        (unsigned long long)pTiming->rxBytes, (unsigned long long)rate);
+}
+
+/*******************************************************************************
+**
+** Function:        endLSScriptTiming
+**
+** Description:     Closes the timing record of script index, started at
+**                  start, logs it and adds it to pSummary, which the
+**                  following commands are charged to
+**
+** Returns:         None
+**
+*******************************************************************************/
+static void endLSScriptTiming(int index, const char* result, uint64_t start,
+                              Lsc_ScriptTiming_t* pTiming,
+                              Lsc_ScriptTiming_t* pSummary) {
+  LSC_TimingAttach(pSummary);
+  pTiming->totalUs = phNxpEse_StatsNowUs() - start;
+  char what[16];
+  snprintf(what, sizeof(what), "script %d", index);
+  logLSTiming(what, result, pTiming);
+
+  pSummary->readUs += pTiming->readUs;
+  pSummary->hashUs += pTiming->hashUs;
+  pSummary->readHashUs += pTiming->readHashUs;
+  pSummary->openUs += pTiming->openUs;
+  pSummary->certUs += pTiming->certUs;
+  pSummary->updateHashUs += pTiming->updateHashUs;
+  pSummary->cmdUs += pTiming->cmdUs;
+  if (pTiming->cmdMaxUs > pSummary->cmdMaxUs) {
+    pSummary->cmdMaxUs = pTiming->cmdMaxUs;
+  }
+  pSummary->cmdCount += pTiming->cmdCount;
+  pSummary->txBytes += pTiming->txBytes;
+  pSummary->rxBytes += pTiming->rxBytes;
+}
+
+/*******************************************************************************
+**
+** Function:        pruneLSScriptCache
+**
+** Description:     Deletes the compiled images, and any temporary file left
+**                  while storing one, that belong to none of the scripts
+**                  found. Nothing is deleted if the prefetch stage was
+**                  cancelled before it hashed every script.
+**
+** Returns:         None
+**
+*******************************************************************************/
+static void pruneLSScriptCache() {
+  char keep[LS_MAX_COUNT][LS_SCRIPT_CACHE_PATH_LEN];
+  int count = 0;
+  for (int index = 1; index <= LS_MAX_COUNT; index++) {
+    Lsc_ScriptSlot_t* pSlot = &gsScriptSlot[index - 1];
+    if (!pSlot->ready) return;
+    if (!pSlot->valid) break;
+    LSC_ScriptCachePath(pSlot->hash, keep[count++], sizeof(keep[0]));
+  }
+  DIR* pDir = opendir(LS_SCRIPT_CACHE_DIR);
+  if (pDir == NULL) return;
+  struct dirent* pEntry;
+  while ((pEntry = readdir(pDir)) != NULL) {
+    if (strncmp(pEntry->d_name, LS_SCRIPT_CACHE_NAME,
+                sizeof(LS_SCRIPT_CACHE_NAME) - 1) != 0) {
+      continue;
+    }
+    std::string path(LS_SCRIPT_CACHE_DIR);
+    path += pEntry->d_name;
+    bool current = false;
+    for (int i = 0; i < count && !current; i++) current = (path == keep[i]);
+    if (current) continue;
+    NXP_LOG_ESE_D("%s: deleting %s\n", __func__, path.c_str());
+    unlink(path.c_str());
+  }
+  closedir(pDir);
+}
+
 /*******************************************************************************
 **
 ** Function:        performLSDownload_thread
 **
-** Description:     Perform LS during hal init
+** Description:     Perform LS during hal init. This is the execution stage,
+**                  the scripts are hashed by prefetchLSScripts_thread.
 **
 ** Returns:         None
 **
 *******************************************************************************/
 void* performLSDownload_thread(__attribute__((unused)) void* data) {
-  ALOGD_IF(ese_debug_enabled, "%s enter  ", __func__);
+  NXP_LOG_ESE_D("%s enter  ", __func__);
   /*generated SHA-1 string for secureElementLS
   This will remain constant as handled in secureElement HAL*/
   char sha1[] = "6d583e84f2710e6b0f06beebc1a12a1083591373";
@@ -139,64 +491,94 @@ void* performLSDownload_thread(__attribute__((unused)) void* data) {
 
   uint8_t resSW[4] = {0x4e, 0x02, 0x69, 0x87};
 
-  std::string sourcePath;
   std::string sourcePrefix;
   std::string outPath;
-  int index = 1;
   LSCSTATUS status = LSCSTATUS_SUCCESS;
   Lsc_HashInfo_t lsHashInfo;
+  Lsc_SlotHash_t slotHash[LS_MAX_COUNT];
+  Lsc_Manifest_t manifest;
+  bool complete = true;
+  /*Commands outside of a script, like the batch hash read, go to the summary*/
+  Lsc_ScriptTiming_t timing;
+  Lsc_ScriptTiming_t summary;
+  uint64_t downloadStart = phNxpEse_StatsNowUs();
+  memset(&summary, 0x00, sizeof(summary));
+  LSC_TimingAttach(&summary);
 
   getLSScriptSourcePrefix(sourcePrefix);
-  do {
-    /*Open the script file from specified location and name*/
-    sourcePath.assign(sourcePrefix);
-    sourcePath += ('0' + index);
-    sourcePath += ls_script_source_suffix;
-    FILE* fIn = fopen(sourcePath.c_str(), "rb");
-    if (fIn == NULL) {
-      ALOGE("%s Cannot open LS script file %s\n", __func__, sourcePath.c_str());
-      ALOGE("%s Error : %s", __func__, strerror(errno));
-      break;
-    }
-    ALOGD_IF(ese_debug_enabled, "%s File opened %s\n", __func__,
-             sourcePath.c_str());
+  for (int index = 1; index <= LS_MAX_COUNT; index++) {
+    gsScriptSlot[index - 1].ready = false;
+  }
+  gsPrefetchCancel = false;
+  pthread_t prefetchThread;
+  bool prefetching = (pthread_create(&prefetchThread, NULL,
+                                     &prefetchLSScripts_thread,
+                                     &sourcePrefix) == 0);
+  if (!prefetching) {
+    ALOGE("%s: prefetch thread creation failed, hashing inline", __func__);
+    prefetchLSScripts_thread(&sourcePrefix);
+  }
+  /*Unchanged scripts: report ready now, the applet is checked below*/
+  bool earlyReady = loadLSManifest(&manifest) && matchLSManifest(&manifest);
+  /*Once reported, clients may hold channels until the end of the download*/
+  bool readyReported = earlyReady;
+  if (earlyReady) {
+    NXP_LOG_ESE_D("%s scripts match the manifest\n", __func__);
+    cCallback->onStateChange(true);
+  }
+  memset(&manifest, 0x00, sizeof(manifest));
+  /*Read the hashes of the slots of the scripts present from the applet
+  while the scripts are hashed. A slot left out is read alone if needed.*/
+  uint8_t scriptCount = countLSScripts(sourcePrefix);
+  for (int index = scriptCount + 1; index <= LS_MAX_COUNT; index++) {
+    slotHash[index - 1].status = LSCSTATUS_FAILED;
+  }
+  uint64_t start = phNxpEse_StatsNowUs();
+  if ((scriptCount > 0) &&
+      (LSC_ReadAllLsHashes(slotHash, scriptCount) != LSCSTATUS_SUCCESS)) {
+    NXP_LOG_ESE_D("%s LSC_ReadAllLsHashes Failed\n", __func__);
+  }
+  summary.readHashUs += phNxpEse_StatsNowUs() - start;
+
+  for (int index = 1; index <= LS_MAX_COUNT; index++) {
+    uint64_t scriptStart = phNxpEse_StatsNowUs();
+    Lsc_ScriptSlot_t* pSlot = waitLSScript(index);
+    if (!pSlot->valid) break;
+    memset(&timing, 0x00, sizeof(timing));
+    timing.readUs = pSlot->readUs;
+    timing.hashUs = pSlot->hashUs;
+    LSC_TimingAttach(&timing);
+    const std::string& sourcePath = pSlot->sourcePath;
+    NXP_LOG_ESE_D("%s File opened %s\n", __func__, sourcePath.c_str());
 
     outPath.assign(ls_script_output_prefix);
     outPath += ('0' + index);
     outPath += ls_script_output_suffix;
 
-    FILE* fOut = fopen(outPath.c_str(), "wb+");
+    /*Only created here: LSC_loadapplet empties it unless it resumes*/
+    FILE* fOut = fopen(outPath.c_str(), "ab");
     if (fOut == NULL) {
       ALOGE("%s Failed to open file %s\n", __func__, outPath.c_str());
+      complete = false;
+      endLSScriptTiming(index, "no_output", scriptStart, &timing, &summary);
       break;
     }
-    /*Read the script content to a local buffer*/
-    fseek(fIn, 0, SEEK_END);
-    long lsBufSize = ftell(fIn);
-    rewind(fIn);
-    if (lsHashInfo.lsRawScriptBuf == nullptr) {
-      lsHashInfo.lsRawScriptBuf = (uint8_t*)phNxpEse_memalloc(lsBufSize + 1);
-    }
-    memset(lsHashInfo.lsRawScriptBuf, 0x00, (lsBufSize + 1));
-    fread(lsHashInfo.lsRawScriptBuf, lsBufSize, 1, fIn);
+    fclose(fOut);
 
     LSCSTATUS lsHashStatus = LSCSTATUS_FAILED;
+    lsHashInfo.lsScriptHash = pSlot->hash;
 
-    /*Get 20bye SHA1 of the script*/
-    lsHashInfo.lsScriptHash =
-        getHASH(lsHashInfo.lsRawScriptBuf, (size_t)lsBufSize);
-    phNxpEse_free(lsHashInfo.lsRawScriptBuf);
-    lsHashInfo.lsRawScriptBuf = nullptr;
-    if (lsHashInfo.lsScriptHash == nullptr) break;
-
-    if (lsHashInfo.readBuffHash == nullptr) {
-      lsHashInfo.readBuffHash = (uint8_t*)phNxpEse_memalloc(HASH_DATA_LENGTH);
+    /*Hash of the specified slot, read again alone if the batch failed*/
+    Lsc_SlotHash_t* pSlotHash = &slotHash[index - 1];
+    if (pSlotHash->status == LSCSTATUS_FAILED) {
+      start = phNxpEse_StatsNowUs();
+      pSlotHash->status =
+          LSC_ReadLsHash(pSlotHash->hash, &pSlotHash->hashLen, index);
+      timing.readHashUs = phNxpEse_StatsNowUs() - start;
     }
-    memset(lsHashInfo.readBuffHash, 0x00, HASH_DATA_LENGTH);
-
-    /*Read the hash from applet for specified slot*/
-    lsHashStatus =
-        LSC_ReadLsHash(lsHashInfo.readBuffHash, &lsHashInfo.readHashLen, index);
+    lsHashStatus = pSlotHash->status;
+    lsHashInfo.readBuffHash = pSlotHash->hash;
+    lsHashInfo.readHashLen = pSlotHash->hashLen;
 
     /*Check if previously script is successfully installed.
     if yes, continue reading next script else try update wit current script*/
@@ -205,55 +587,105 @@ void* performLSDownload_thread(__attribute__((unused)) void* data) {
         (0 == memcmp(lsHashInfo.lsScriptHash, lsHashInfo.readBuffHash,
                      HASH_DATA_LENGTH)) &&
         (lsHashInfo.readBuffHash[HASH_STATUS_INDEX] == LS_DOWNLOAD_SUCCESS)) {
-      ALOGD_IF(ese_debug_enabled, "%s LS Loader sript is already installed \n",
-               __func__);
+      NXP_LOG_ESE_D("%s LS Loader sript is already installed \n", __func__);
+      memcpy(manifest.hash[index - 1], pSlot->hash, HASH_DATA_LENGTH);
+      manifest.count = index;
+      endLSScriptTiming(index, "installed", scriptStart, &timing, &summary);
       continue;
     }
+    if (earlyReady) {
+      /*The applet could not be asked, keep the manifest for now*/
+      if (lsHashStatus == LSCSTATUS_FAILED) {
+        complete = false;
+        endLSScriptTiming(index, "unchecked", scriptStart, &timing, &summary);
+        continue;
+      }
+      /*The manifest was wrong, withdraw the ready state while updating*/
+      ALOGE("%s slot %d does not match the manifest\n", __func__, index);
+      earlyReady = false;
+      unlink(LS_MANIFEST_PATH);
+      cCallback->onStateChange(false);
+    }
 
     /*Uptdates current script*/
     status = LSC_Start(sourcePath.c_str(), outPath.c_str(), (uint8_t*)hash,
-                       (uint16_t)sizeof(hash), resSW);
-    ALOGD_IF(ese_debug_enabled, "%s script %s perform done, result = %d\n",
-             __func__, sourcePath.c_str(), status);
+                       (uint16_t)sizeof(hash), resSW, lsHashInfo.lsScriptHash);
+    NXP_LOG_ESE_D("%s script %s perform done, result = %d\n", __func__,
+                  sourcePath.c_str(), status);
     if (status != LSCSTATUS_SUCCESS) {
       lsHashInfo.lsScriptHash[HASH_STATUS_INDEX] = LS_DOWNLOAD_FAILED;
       /*If current script updation fails, update the status with hash to the
        * applet then clean and exit*/
+      start = phNxpEse_StatsNowUs();
       lsHashStatus =
           LSC_UpdateLsHash(lsHashInfo.lsScriptHash, HASH_DATA_LENGTH, index);
+      timing.updateHashUs = phNxpEse_StatsNowUs() - start;
       if (lsHashStatus != LSCSTATUS_SUCCESS) {
-        ALOGD_IF(ese_debug_enabled, "%s LSC_UpdateLsHash Failed\n", __func__);
+        NXP_LOG_ESE_D("%s LSC_UpdateLsHash Failed\n", __func__);
       }
-      ESESTATUS estatus = phNxpEse_deInit();
-      if (estatus == ESESTATUS_SUCCESS) {
-        estatus = phNxpEse_close();
+      endLSScriptTiming(index, "failed", scriptStart, &timing, &summary);
+      if (readyReported) {
+        /*SecureElement does not see a close from here: the session is left
+         *to it, it ends with the last channel of the clients*/
+        NXP_LOG_ESE_D("%s: session kept for the clients\n", __func__);
+      } else {
+        ESESTATUS estatus = phNxpEse_deInit();
         if (estatus == ESESTATUS_SUCCESS) {
-          ALOGD_IF(ese_debug_enabled, "%s: Ese_close success\n", __func__);
+          estatus = phNxpEse_close();
+          if (estatus == ESESTATUS_SUCCESS) {
+            NXP_LOG_ESE_D("%s: Ese_close success\n", __func__);
+          }
+        } else {
+          ALOGE("%s: Ese_deInit failed", __func__);
         }
-      } else {
-        ALOGE("%s: Ese_deInit failed", __func__);
       }
+      unlink(LS_MANIFEST_PATH);
       cCallback->onStateChange(false);
       break;
     } else {
       /*If current script execution is succes, update the status along with the
        * hash to the applet*/
       lsHashInfo.lsScriptHash[HASH_STATUS_INDEX] = LS_DOWNLOAD_SUCCESS;
+      /*An installed script is not run again, drop its compiled image*/
+      char cachePath[LS_SCRIPT_CACHE_PATH_LEN];
+      LSC_ScriptCachePath(lsHashInfo.lsScriptHash, cachePath,
+                          sizeof(cachePath));
+      unlink(cachePath);
+      start = phNxpEse_StatsNowUs();
       lsHashStatus =
           LSC_UpdateLsHash(lsHashInfo.lsScriptHash, HASH_DATA_LENGTH, index);
+      timing.updateHashUs = phNxpEse_StatsNowUs() - start;
       if (lsHashStatus != LSCSTATUS_SUCCESS) {
-        ALOGD_IF(ese_debug_enabled, "%s LSC_UpdateLsHash Failed\n", __func__);
+        NXP_LOG_ESE_D("%s LSC_UpdateLsHash Failed\n", __func__);
+        complete = false;
+      } else {
+        memcpy(manifest.hash[index - 1], pSlot->hash, HASH_DATA_LENGTH);
+        manifest.count = index;
       }
+      endLSScriptTiming(index,
+                        (lsHashStatus == LSCSTATUS_SUCCESS) ? "updated"
+                                                            : "unrecorded",
+                        scriptStart, &timing, &summary);
     }
-  } while (++index <= LS_MAX_COUNT);
+  }
 
-  phNxpEse_free(lsHashInfo.readBuffHash);
+  pthread_mutex_lock(&gsPrefetchLock);
+  gsPrefetchCancel = true;
+  pthread_mutex_unlock(&gsPrefetchLock);
+  if (prefetching) pthread_join(prefetchThread, NULL);
+  pruneLSScriptCache();
+  LSC_TimingAttach(NULL);
+  summary.totalUs = phNxpEse_StatsNowUs() - downloadStart;
+  logLSTiming("summary", (status == LSCSTATUS_SUCCESS) ? "ok" : "failed",
+              &summary);
 
   if (status == LSCSTATUS_SUCCESS) {
-    cCallback->onStateChange(true);
+    /*Every script found is installed: remember them for the next boot*/
+    if (complete && !earlyReady) storeLSManifest(&manifest);
+    if (!earlyReady) cCallback->onStateChange(true);
   }
   pthread_exit(NULL);
-  ALOGD_IF(ese_debug_enabled, "%s pthread_exit\n", __func__);
+  NXP_LOG_ESE_D("%s pthread_exit\n", __func__);
   return NULL;
 }
 
@@ -261,24 +693,36 @@ void* performLSDownload_thread(__attribute__((unused)) void* data) {
 **
 ** Function:        getHASH
 **
-** Description:     generates SHA1 of given buffer
+** Description:     generates SHA1 of the file fd, reading it from the current
+**                  offset to its end in HASH_CHUNK_LENGTH chunks, into the
+**                  caller's outHash. The time spent in read is added to
+**                  pReadUs. Safe to call from several threads.
 **
-** Returns:         20 bytes of SHA1
+** Returns:         true if the 20 bytes of SHA1 were written
 **
 *******************************************************************************/
-unsigned char* getHASH(uint8_t* buffer, size_t buffSize) {
-  static uint8_t outHash[HASH_DATA_LENGTH] = {0};
-  unsigned int md_len = -1;
-  const EVP_MD* md = EVP_get_digestbyname("SHA1");
-  if (NULL != md) {
-    EVP_MD_CTX mdctx;
-    EVP_MD_CTX_init(&mdctx);
-    EVP_DigestInit_ex(&mdctx, md, NULL);
-    EVP_DigestUpdate(&mdctx, buffer, buffSize);
-    EVP_DigestFinal_ex(&mdctx, outHash, &md_len);
-    EVP_MD_CTX_cleanup(&mdctx);
+static bool getHASH(int fd, uint8_t* outHash, uint64_t* pReadUs) {
+  EVP_MD_CTX* mdctx = EVP_MD_CTX_new();
+  if (mdctx == NULL) return false;
+  uint8_t chunk[HASH_CHUNK_LENGTH];
+  bool ok = (EVP_DigestInit_ex(mdctx, EVP_sha1(), NULL) == 1);
+  while (ok) {
+    uint64_t start = phNxpEse_StatsNowUs();
+    ssize_t len = TEMP_FAILURE_RETRY(read(fd, chunk, sizeof(chunk)));
+    *pReadUs += phNxpEse_StatsNowUs() - start;
+    if (len <= 0) {
+      ok = (len == 0);
+      break;
+    }
+    ok = (EVP_DigestUpdate(mdctx, chunk, len) == 1);
+  }
+  unsigned int md_len = 0;
+  if (ok) {
+    ok = (EVP_DigestFinal_ex(mdctx, outHash, &md_len) == 1) &&
+         (md_len == LS_SCRIPT_HASH_LEN);
   }
-  return outHash;
+  EVP_MD_CTX_free(mdctx);
+  return ok;
 }
 
 /*******************************************************************************
@@ -19,29 +19,128 @@
 #include <LsClient.h>
 #include <LsLib.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <log/log.h>
+#include <phNxpEseLog.h>
+#include <phNxpEse_Cache.h>
+#include <phNxpEse_Channel.h>
+#include <phNxpEse_Sched.h>
+#include <phNxpEse_Stats.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 extern bool ese_debug_enabled;
 
 static int32_t gsTransceiveTimeout = 120000;
-static uint8_t gsCmd_Buffer[64 * 1024];
-static int32_t gsCmd_count = 0;
-static bool gsIslastcmdLoad;
-static bool gsSendBack_cmds = false;
-static uint8_t* gspBuffer;
+static Lsc_LoadQueue_t gsLoadQueue;
 static uint8_t gsStoreData[22];
 static uint8_t gsTag42Arr[17];
 static uint8_t gsTag45Arr[9];
 static uint8_t gsLsExecuteResp[4];
 static int32_t gsResp_len = 0;
+static Lsc_ScriptTiming_t* gspTiming;
+
+/* Elements of a 7F21 certificate in script order */
+enum {
+  LS_CERT_SERIAL_NO,
+  LS_CERT_ROOT_ID,
+  LS_CERT_HOLDER_ID,
+  LS_CERT_KEY_USAGE,
+  LS_CERT_EFF_DATE,
+  LS_CERT_EXP_DATE,
+  LS_CERT_SIGN_ID,
+  LS_CERT_PERMISSION,
+  LS_CERT_SIGNATURE,
+  LS_CERT_PUBLIC_KEY,
+  LS_CERT_COUNT
+};
+static constexpr phNxpEseBerTlvDesc_t gsCertSchema[LS_CERT_COUNT] = {
+    {TAG_SERIAL_NO, 0, MAX_CERT_LEN, false},
+    {TAG_LSRE_ID, 0, sizeof(gsTag42Arr) - 1, false},
+    {TAG_CERTFHOLD_ID, 0, MAX_CERT_LEN, false},
+    {TAG_KEY_USAGE, 0, MAX_CERT_LEN, false},
+    {TAG_EFF_DATE, 0, MAX_CERT_LEN, true},
+    {TAG_EXP_DATE, 0, MAX_CERT_LEN, true},
+    {TAG_LSRE_SIGNID, 0, sizeof(gsTag45Arr) - 1, false},
+    {TAG_CCM_PERMISSION, 0, MAX_CERT_LEN, false},
+    {TAG_SIG_RNS_COMP, 64, 64, false},
+    {TAG_PUBLIC_KEY, 2, MAX_CERT_LEN, false}};
+
+/* Elements of the SELECT response: 6F{84, 9F08, 65{42, 45}} */
+enum { LS_FCI_AID, LS_FCI_VERSION, LS_FCI_KEY_ID, LS_FCI_COUNT };
+static constexpr phNxpEseBerTlvDesc_t gsFciSchema[LS_FCI_COUNT] = {
+    {TAG_LSC_ID, 0, 0xFF, false},
+    {TAG_LS_VER1 << 8 | TAG_LS_VER2, 0, 0xFF, false},
+    {TAG_RE_KEYID, 0, 0xFF, false}};
+enum { LS_KEY_ROOT_ID, LS_KEY_SIGN_ID, LS_KEY_COUNT };
+static constexpr phNxpEseBerTlvDesc_t gsKeyIdSchema[LS_KEY_COUNT] = {
+    {TAG_LSRE_ID, 0, sizeof(gsTag42Arr) - 1, false},
+    {TAG_LSRE_SIGNID, 0, sizeof(gsTag45Arr) - 1, false}};
 
 LSCSTATUS(*Applet_load_seqhandler[])
 (Lsc_ImageInfo_t* pContext, LSCSTATUS status, Lsc_TranscieveInfo_t* pInfo) = {
     LSC_OpenChannel, LSC_ResetChannel, LSC_SelectLsc,
     LSC_StoreData,   LSC_loadapplet,   NULL};
 
+/*******************************************************************************
+**
+** Function:        LSC_TimingAttach
+**
+** Description:     Charges the commands sent from now on to pTiming
+**
+** Returns:         None
+**
+*******************************************************************************/
+void LSC_TimingAttach(Lsc_ScriptTiming_t* pTiming) { gspTiming = pTiming; }
+
+/*******************************************************************************
+**
+** Function:        LSC_Transceive
+**
+** Description:     Scheduled transceive, accounted to the attached timing.
+**                  The download shares the eSE with the HAL clients.
+**
+** Returns:         Status of phNxpEse_Transceive
+**
+*******************************************************************************/
+static ESESTATUS LSC_Transceive(phNxpEse_data* pCmd, phNxpEse_data* pRsp) {
+  uint64_t start = phNxpEse_StatsNowUs();
+  ESESTATUS eseStat = phNxpEse_SchedTransceive(pCmd, pRsp);
+  Lsc_ScriptTiming_t* pTiming = gspTiming;
+  if (pTiming != NULL) {
+    uint64_t elapsed = phNxpEse_StatsNowUs() - start;
+    pTiming->cmdUs += elapsed;
+    if (elapsed > pTiming->cmdMaxUs) pTiming->cmdMaxUs = elapsed;
+    pTiming->cmdCount++;
+    pTiming->txBytes += pCmd->len;
+    if (eseStat == ESESTATUS_SUCCESS) pTiming->rxBytes += pRsp->len;
+  }
+  return eseStat;
+}
+
+/*******************************************************************************
+**
+** Function:        LSC_RecordChannel
+**
+** Description:     Notes a channel the eSE opened for the download
+**
+** Returns:         FAILED if it is out of range or the table is full
+**
+*******************************************************************************/
+static LSCSTATUS LSC_RecordChannel(Lsc_ImageInfo_t* Os_info, uint8_t channel) {
+  uint8_t cnt = Os_info->channel_cnt;
+  if ((channel >= PH_ESE_MAX_CHANNELS) ||
+      (cnt >= sizeof(Os_info->Channel_Info) / sizeof(Lsc_ChannelInfo_t))) {
+    ALOGE("%s: cannot track channel 0x%02x", __func__, channel);
+    return LSCSTATUS_FAILED;
+  }
+  Os_info->Channel_Info[cnt].channel_id = channel;
+  Os_info->Channel_Info[cnt].isOpend = true;
+  Os_info->channel_cnt++;
+  return LSCSTATUS_SUCCESS;
+}
+
 /*******************************************************************************
 **
 ** Function:        Perform_LSC
@@ -52,9 +151,10 @@ LSCSTATUS(*Applet_load_seqhandler[])
 **
 *******************************************************************************/
 LSCSTATUS Perform_LSC(const char* name, const char* dest, const uint8_t* pdata,
-                      uint16_t len, uint8_t* respSW) {
+                      uint16_t len, uint8_t* respSW,
+                      const uint8_t* scriptHash) {
   static const char fn[] = "Perform_LSC";
-  ALOGD_IF(ese_debug_enabled, "%s: enter; sha-len=%d", fn, len);
+  NXP_LOG_ESE_D("%s: enter; sha-len=%d", fn, len);
   if ((pdata == NULL) || (len == 0x00)) {
     ALOGE("%s: Invalid SHA-data", fn);
     return LSCSTATUS_FAILED;
@@ -62,17 +162,21 @@ LSCSTATUS Perform_LSC(const char* name, const char* dest, const uint8_t* pdata,
   gsStoreData[0] = STORE_DATA_TAG;
   gsStoreData[1] = len;
   memcpy(&gsStoreData[2], pdata, len);
-  LSCSTATUS status = LSC_update_seq_handler(Applet_load_seqhandler, name, dest);
+  /* Responses cached before or during the download may no longer hold */
+  phNxpEse_CacheFlush("ls_download");
+  LSCSTATUS status = LSC_update_seq_handler(Applet_load_seqhandler, name, dest,
+                                            scriptHash);
+  phNxpEse_CacheFlush("ls_download");
   if ((status != LSCSTATUS_SUCCESS) && (gsLsExecuteResp[2] == 0x90) &&
       (gsLsExecuteResp[3] == 0x00)) {
     gsLsExecuteResp[2] = LS_ABORT_SW1;
     gsLsExecuteResp[3] = LS_ABORT_SW2;
   }
   memcpy(&respSW[0], &gsLsExecuteResp[0], 4);
-  ALOGD_IF(ese_debug_enabled, "%s: lsExecuteScript Response SW=%2x%2x", fn,
-           gsLsExecuteResp[2], gsLsExecuteResp[3]);
+  NXP_LOG_ESE_D("%s: lsExecuteScript Response SW=%2x%2x", fn,
+                gsLsExecuteResp[2], gsLsExecuteResp[3]);
 
-  ALOGD_IF(ese_debug_enabled, "%s: exit; status=0x0%x", fn, status);
+  NXP_LOG_ESE_D("%s: exit; status=0x0%x", fn, status);
   return status;
 }
 
@@ -88,16 +192,16 @@ LSCSTATUS Perform_LSC(const char* name, const char* dest, const uint8_t* pdata,
 LSCSTATUS LSC_update_seq_handler(
     LSCSTATUS (*seq_handler[])(Lsc_ImageInfo_t* pContext, LSCSTATUS status,
                                Lsc_TranscieveInfo_t* pInfo),
-    const char* name, const char* dest) {
+    const char* name, const char* dest, const uint8_t* scriptHash) {
   static const char fn[] = "LSC_update_seq_handler";
   Lsc_ImageInfo_t update_info;
 
-  ALOGD_IF(ese_debug_enabled, "%s: enter", fn);
+  NXP_LOG_ESE_D("%s: enter", fn);
   memset(&update_info, 0, sizeof(Lsc_ImageInfo_t));
   if (dest != NULL) {
     strcat(update_info.fls_RespPath, dest);
-    ALOGD_IF(ese_debug_enabled,
-             "%s: Loader Service response data path/destination: %s", fn, dest);
+    NXP_LOG_ESE_D("%s: Loader Service response data path/destination: %s", fn,
+                  dest);
     update_info.bytes_wrote = 0xAA;
   } else {
     update_info.bytes_wrote = 0x55;
@@ -107,8 +211,8 @@ LSCSTATUS LSC_update_seq_handler(
   }
   // memcpy(update_info.fls_path, (char*)Lsc_path, sizeof(Lsc_path));
   strcat(update_info.fls_path, name);
-  ALOGD_IF(ese_debug_enabled, "Selected applet to install is: %s",
-           update_info.fls_path);
+  update_info.pScriptHash = scriptHash;
+  NXP_LOG_ESE_D("Selected applet to install is: %s", update_info.fls_path);
 
   uint16_t seq_counter = 0;
   LSCSTATUS status = LSCSTATUS_FAILED;
@@ -130,7 +234,7 @@ LSCSTATUS LSC_update_seq_handler(
   }
 
   LSC_CloseChannel(&update_info, LSCSTATUS_FAILED, &trans_info);
-  ALOGD_IF(ese_debug_enabled, "%s: exit; status=0x%x", fn, status);
+  NXP_LOG_ESE_D("%s: exit; status=0x%x", fn, status);
   return status;
 }
 
@@ -147,7 +251,7 @@ LSCSTATUS LSC_OpenChannel(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
                           Lsc_TranscieveInfo_t* pTranscv_Info) {
   static const char fn[] = "LSC_OpenChannel";
 
-  ALOGD_IF(ese_debug_enabled, "%s: enter", fn);
+  NXP_LOG_ESE_D("%s: enter", fn);
   if (Os_info == NULL || pTranscv_Info == NULL) {
     ALOGE("%s: Invalid parameter", fn);
     return LSCSTATUS_FAILED;
@@ -160,8 +264,8 @@ LSCSTATUS LSC_OpenChannel(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
   cmdApdu.p_data = (uint8_t*)phNxpEse_memalloc(cmdApdu.len * sizeof(uint8_t));
   memcpy(cmdApdu.p_data, OpenChannel, cmdApdu.len);
 
-  ALOGD_IF(ese_debug_enabled, "%s: Calling Secure Element Transceive", fn);
-  ESESTATUS eseStat = phNxpEse_Transceive(&cmdApdu, &rspApdu);
+  NXP_LOG_ESE_D("%s: Calling Secure Element Transceive", fn);
+  ESESTATUS eseStat = LSC_Transceive(&cmdApdu, &rspApdu);
 
   if (eseStat != ESESTATUS_SUCCESS && (rspApdu.len < 0x03)) {
     if (rspApdu.len == 0x02)
@@ -174,16 +278,12 @@ LSCSTATUS LSC_OpenChannel(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
     status = LSCSTATUS_FAILED;
     ALOGE("%s: invalid response = 0x%X", fn, status);
   } else {
-    uint8_t cnt = Os_info->channel_cnt;
-    Os_info->Channel_Info[cnt].channel_id = rspApdu.p_data[rspApdu.len - 3];
-    Os_info->Channel_Info[cnt].isOpend = true;
-    Os_info->channel_cnt++;
-    status = LSCSTATUS_SUCCESS;
+    status = LSC_RecordChannel(Os_info, rspApdu.p_data[rspApdu.len - 3]);
   }
 
   phNxpEse_free(cmdApdu.p_data);
   phNxpEse_free(rspApdu.p_data);
-  ALOGD_IF(ese_debug_enabled, "%s: exit; status=0x%x", fn, status);
+  NXP_LOG_ESE_D("%s: exit; status=0x%x", fn, status);
   return status;
 }
 /*******************************************************************************
@@ -199,7 +299,7 @@ LSCSTATUS LSC_ResetChannel(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
                            Lsc_TranscieveInfo_t* pTranscv_Info) {
   static const char fn[] = "LSC_ResetChannel";
 
-  ALOGD_IF(ese_debug_enabled, "%s: enter", fn);
+  NXP_LOG_ESE_D("%s: enter", fn);
   if (Os_info == NULL || pTranscv_Info == NULL) {
     ALOGE("%s: Invalid parameter", fn);
     return LSCSTATUS_FAILED;
@@ -216,8 +316,8 @@ LSCSTATUS LSC_ResetChannel(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
   memcpy(cmdApdu.p_data, OpenChannel, cmdApdu.len);
 
   do {
-    ALOGD_IF(ese_debug_enabled, "%s: Calling Secure Element Transceive", fn);
-    eseStat = phNxpEse_Transceive(&cmdApdu, &rspApdu);
+    NXP_LOG_ESE_D("%s: Calling Secure Element Transceive", fn);
+    eseStat = LSC_Transceive(&cmdApdu, &rspApdu);
     if (eseStat != ESESTATUS_SUCCESS && (rspApdu.len < 0x03)) {
       status = LSCSTATUS_FAILED;
       ALOGE("%s: SE transceive failed status = 0x%X", fn, status);
@@ -238,7 +338,7 @@ LSCSTATUS LSC_ResetChannel(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
       phNxpEse_free(rspApdu.p_data);
       status = LSCSTATUS_SUCCESS;
     } else {
-      ALOGD_IF(ese_debug_enabled, "%s: Channel reset success", fn);
+      NXP_LOG_ESE_D("%s: Channel reset success", fn);
       status = LSCSTATUS_SUCCESS;
       break;
     }
@@ -246,7 +346,7 @@ LSCSTATUS LSC_ResetChannel(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
 
   phNxpEse_free(cmdApdu.p_data);
   phNxpEse_free(rspApdu.p_data);
-  ALOGD_IF(ese_debug_enabled, "%s: exit; status=0x%x", fn, status);
+  NXP_LOG_ESE_D("%s: exit; status=0x%x", fn, status);
   return status;
 }
 
@@ -264,7 +364,7 @@ LSCSTATUS LSC_SelectLsc(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
                         Lsc_TranscieveInfo_t* pTranscv_Info) {
   static const char fn[] = "LSC_SelectLsc";
 
-  ALOGD_IF(ese_debug_enabled, "%s: enter", fn);
+  NXP_LOG_ESE_D("%s: enter", fn);
 
   if (Os_info == NULL || pTranscv_Info == NULL) {
     ALOGE("%s: Invalid parameter", fn);
@@ -280,14 +380,15 @@ LSCSTATUS LSC_SelectLsc(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
   /*p_data will have channel_id (1 byte) + SelectLsc APDU*/
   cmdApdu.len = (int32_t)(sizeof(SelectLsc) + 1);
   cmdApdu.p_data = (uint8_t*)phNxpEse_memalloc(cmdApdu.len * sizeof(uint8_t));
-  cmdApdu.p_data[0] = Os_info->Channel_Info[0].channel_id;
+  cmdApdu.p_data[0] =
+      phNxpEse_ChannelCla(0x00, Os_info->Channel_Info[0].channel_id);
 
   memcpy(&(cmdApdu.p_data[1]), SelectLsc, sizeof(SelectLsc));
 
-  ALOGD_IF(ese_debug_enabled,
-           "%s: Calling Secure Element Transceive with Loader service AID", fn);
+  NXP_LOG_ESE_D("%s: Calling Secure Element Transceive with Loader service AID",
+                fn);
 
-  ESESTATUS eseStat = phNxpEse_Transceive(&cmdApdu, &rspApdu);
+  ESESTATUS eseStat = LSC_Transceive(&cmdApdu, &rspApdu);
 
   if (eseStat != ESESTATUS_SUCCESS && (rspApdu.len == 0x00)) {
     status = LSCSTATUS_FAILED;
@@ -307,7 +408,7 @@ LSCSTATUS LSC_SelectLsc(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
   }
   phNxpEse_free(cmdApdu.p_data);
   phNxpEse_free(rspApdu.p_data);
-  ALOGD_IF(ese_debug_enabled, "%s: exit; status=0x%x", fn, status);
+  NXP_LOG_ESE_D("%s: exit; status=0x%x", fn, status);
   return status;
 }
 
@@ -325,7 +426,7 @@ LSCSTATUS LSC_SelectLsc(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
 LSCSTATUS LSC_StoreData(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
                         Lsc_TranscieveInfo_t* pTranscv_Info) {
   static const char fn[] = "LSC_StoreData";
-  ALOGD_IF(ese_debug_enabled, "%s: enter", fn);
+  NXP_LOG_ESE_D("%s: enter", fn);
   if (Os_info == NULL || pTranscv_Info == NULL) {
     ALOGE("%s: Invalid parameter", fn);
     return LSCSTATUS_FAILED;
@@ -341,22 +442,23 @@ LSCSTATUS LSC_StoreData(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
   uint32_t xx = 0;
   int32_t len =
       gsStoreData[1] + 2;  //+2 offset is for tag value and length byte
-  cmdApdu.p_data[xx++] = STORE_DATA_CLA | (Os_info->Channel_Info[0].channel_id);
+  cmdApdu.p_data[xx++] =
+      phNxpEse_ChannelCla(STORE_DATA_CLA, Os_info->Channel_Info[0].channel_id);
   cmdApdu.p_data[xx++] = STORE_DATA_INS;
   cmdApdu.p_data[xx++] = 0x00;  // P1
   cmdApdu.p_data[xx++] = 0x00;  // P2
   cmdApdu.p_data[xx++] = len;
   memcpy(&(cmdApdu.p_data[xx]), gsStoreData, len);
 
-  ALOGD_IF(ese_debug_enabled, "%s: Calling Secure Element Transceive", fn);
-  ESESTATUS eseStat = phNxpEse_Transceive(&cmdApdu, &rspApdu);
+  NXP_LOG_ESE_D("%s: Calling Secure Element Transceive", fn);
+  ESESTATUS eseStat = LSC_Transceive(&cmdApdu, &rspApdu);
 
   if ((eseStat != ESESTATUS_SUCCESS) && (rspApdu.len == 0x00)) {
     status = LSCSTATUS_FAILED;
     ALOGE("%s: SE transceive failed status = 0x%X", fn, status);
   } else if ((rspApdu.p_data[rspApdu.len - 2] == 0x90) &&
              (rspApdu.p_data[rspApdu.len - 1] == 0x00)) {
-    ALOGD_IF(ese_debug_enabled, "%s: STORE CMD is successful", fn);
+    NXP_LOG_ESE_D("%s: STORE CMD is successful", fn);
     status = LSCSTATUS_SUCCESS;
   } else {
     /*Copy the response SW in failure case*/
@@ -365,7 +467,7 @@ LSCSTATUS LSC_StoreData(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
   }
   phNxpEse_free(cmdApdu.p_data);
   phNxpEse_free(rspApdu.p_data);
-  ALOGD_IF(ese_debug_enabled, "%s: exit; status=0x%x", fn, status);
+  NXP_LOG_ESE_D("%s: exit; status=0x%x", fn, status);
   return status;
 }
 
@@ -383,88 +485,105 @@ LSCSTATUS LSC_loadapplet(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
   static const char fn[] = "LSC_loadapplet";
   bool reachEOFCheck = false;
 
-  ALOGD_IF(ese_debug_enabled, "%s: enter", fn);
+  NXP_LOG_ESE_D("%s: enter", fn);
   if (Os_info == NULL || pTranscv_Info == NULL) {
     ALOGE("%s: Invalid parameter", fn);
     return LSCSTATUS_FAILED;
   }
+  LSC_LoadQueueReset(&gsLoadQueue);
+  /*Continue an interrupted run of this script at its last checkpoint*/
+  Lsc_Checkpoint_t checkpoint;
+  bool resume = (LSC_CheckpointLoad(Os_info->pScriptHash, &checkpoint) ==
+                 LSCSTATUS_SUCCESS);
   if (Os_info->bytes_wrote == 0xAA) {
-    Os_info->fResp = fopen(Os_info->fls_RespPath, "a+");
-    if (Os_info->fResp == NULL) {
+    if (LSC_RespOpen(&Os_info->resp, Os_info->fls_RespPath) !=
+        LSCSTATUS_SUCCESS) {
       ALOGE("%s: Error opening response recording file <%s> for reading: %s",
             fn, Os_info->fls_path, strerror(errno));
       return LSCSTATUS_FAILED;
     }
-    ALOGD_IF(ese_debug_enabled,
-             "%s: Response OUT FILE path is successfully created", fn);
+    if (resume && LSC_RespRewind(&Os_info->resp, checkpoint.respLen,
+                                 checkpoint.respHash) != LSCSTATUS_SUCCESS) {
+      ALOGE("%s: Response file does not match the checkpoint", fn);
+      resume = false;
+    }
+    if (!resume && LSC_RespRewind(&Os_info->resp, 0, NULL) !=
+                       LSCSTATUS_SUCCESS) {
+      LSC_RespClose(&Os_info->resp);
+      return LSCSTATUS_FAILED;
+    }
+    NXP_LOG_ESE_D("%s: Response OUT FILE path is successfully created", fn);
   } else {
-    ALOGD_IF(ese_debug_enabled,
-             "%s: Response Out file is optional as per input", fn);
+    NXP_LOG_ESE_D("%s: Response Out file is optional as per input", fn);
   }
 
-  Os_info->fp = fopen(Os_info->fls_path, "r");
-  if (Os_info->fp == NULL) {
-    ALOGE("%s: Error opening OS image file <%s> for reading: %s", fn,
-          Os_info->fls_path, strerror(errno));
-    return LSCSTATUS_FAILED;
+  char cachePath[LS_SCRIPT_CACHE_PATH_LEN];
+  if (Os_info->pScriptHash != NULL) {
+    LSC_ScriptCachePath(Os_info->pScriptHash, cachePath, sizeof(cachePath));
   }
-  int wResult = fseek(Os_info->fp, 0L, SEEK_END);
-  if (wResult) {
-    ALOGE("%s: Error seeking end OS image file %s", fn, strerror(errno));
-    goto exit;
+  uint64_t openStart = phNxpEse_StatsNowUs();
+  status = LSC_ScriptOpenCached(Os_info->fls_path,
+                                Os_info->pScriptHash ? cachePath : NULL,
+                                Os_info->pScriptHash, &Os_info->script);
+  if (gspTiming != NULL) {
+    gspTiming->openUs += phNxpEse_StatsNowUs() - openStart;
   }
-  Os_info->fls_size = ftell(Os_info->fp);
-  if (Os_info->fls_size < 0) {
-    ALOGE("%s: Error ftelling file %s", fn, strerror(errno));
-    goto exit;
+  if (status != LSCSTATUS_SUCCESS) {
+    ALOGE("%s: Error opening OS image file <%s> for reading", fn,
+          Os_info->fls_path);
+    return LSCSTATUS_FAILED;
   }
-  wResult = fseek(Os_info->fp, 0L, SEEK_SET);
-  if (wResult) {
-    ALOGE("%s: Error seeking start image file %s", fn, strerror(errno));
-    goto exit;
+  if (resume) {
+    NXP_LOG_ESE_D("%s: resuming at record %u", fn, checkpoint.record);
+    if (LSC_ScriptSkip(&Os_info->script, checkpoint.record) !=
+        LSCSTATUS_SUCCESS) {
+      ALOGE("%s: checkpoint past the end of the script", fn);
+      LSC_CheckpointClear();
+      status = LSCSTATUS_FAILED;
+      goto exit;
+    }
   }
 
-  Os_info->bytes_read = 0;
   status = LSC_Check_KeyIdentifier(Os_info, status, pTranscv_Info, NULL,
                                    LSCSTATUS_FAILED, 0);
   if (status != LSCSTATUS_SUCCESS) {
     goto exit;
   }
 
-  uint8_t len_byte, offset;
-  while (!feof(Os_info->fp) && (Os_info->bytes_read < Os_info->fls_size)) {
-    len_byte = 0;
-    offset = 0;
+  while (!LSC_ScriptAtEnd(&Os_info->script)) {
     /*Check if the certificate/ is verified or not*/
     if (status != LSCSTATUS_SUCCESS) {
       goto exit;
     }
 
-    uint8_t temp_buf[1024];
+    uint8_t temp_buf[LS_MAX_SCRIPT_RECORD_LEN];
+    int32_t recLen = 0;
     memset(temp_buf, 0, sizeof(temp_buf));
-    status = LSC_ReadScript(Os_info, temp_buf);
+    status = LSC_ReadScript(Os_info, temp_buf, &recLen);
     if (status != LSCSTATUS_SUCCESS) {
       goto exit;
     }
     /*Reset the flag in case further commands exists*/
     reachEOFCheck = false;
 
-    int32_t wLen = 0;
+    phNxpEseBerTlvCursor_t cursor;
+    phNxpEseBerTlv_t record;
+    phNxpEseBerTlv_Init(&cursor, temp_buf, recLen);
+    if (!phNxpEseBerTlv_Next(&cursor, &record)) {
+      record.tag = 0;
+    }
     LSCSTATUS tag40_found = LSCSTATUS_SUCCESS;
-    if (temp_buf[offset] == TAG_LSC_CMD_ID) {
+    if (record.tag == TAG_LSC_CMD_ID) {
       /* start sending the packet to Lsc */
-      offset = offset + 1;
-      len_byte = Numof_lengthbytes(&temp_buf[offset], &wLen);
       /* If the len data not present or len is less than or equal to 32 */
-      if ((len_byte == 0) || (wLen <= 32)) {
+      if (record.len <= 32) {
         ALOGE("%s: Invalid length zero", fn);
         goto exit;
       }
 
       tag40_found = LSCSTATUS_SUCCESS;
-      offset = offset + len_byte;
-      pTranscv_Info->sSendlength = wLen;
-      memcpy(pTranscv_Info->sSendData, &temp_buf[offset], wLen);
+      pTranscv_Info->sSendlength = record.len;
+      memcpy(pTranscv_Info->sSendData, record.pValue, record.len);
 
       status = LSC_SendtoLsc(Os_info, status, pTranscv_Info, LS_Comm);
       if (status != LSCSTATUS_SUCCESS) {
@@ -480,30 +599,29 @@ LSCSTATUS LSC_loadapplet(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
         ALOGE("%s: Sending packet to lsc failed", fn);
         goto exit;
       }
-    } else if ((temp_buf[offset] == (0x7F)) &&
-               (temp_buf[offset + 1] == (0x21))) {
-      ALOGD_IF(ese_debug_enabled,
-               "%s: TAGID: Encountered again certificate tag 7F21", fn);
+    } else if (record.tag == TAG_CERTIFICATE) {
+      NXP_LOG_ESE_D("%s: TAGID: Encountered again certificate tag 7F21", fn);
       if (tag40_found == LSCSTATUS_SUCCESS) {
-        ALOGD_IF(ese_debug_enabled,
-                 "%s: 2nd Script processing starts with reselect", fn);
+        /*Every record before this segment was acknowledged, unless a load
+        is still queued: a resume must replay it from its INSTALL*/
+        if (!gsLoadQueue.active) {
+          LSC_CheckpointStore(Os_info, Os_info->script.record - 1);
+        }
+        NXP_LOG_ESE_D("%s: 2nd Script processing starts with reselect", fn);
         status = LSCSTATUS_FAILED;
         status = LSC_SelectLsc(Os_info, status, pTranscv_Info);
         if (status == LSCSTATUS_SUCCESS) {
-          ALOGD_IF(ese_debug_enabled,
-                   "%s: 2nd Script select success next store data command", fn);
+          NXP_LOG_ESE_D("%s: 2nd Script select success next store data command",
+                        fn);
           status = LSCSTATUS_FAILED;
           status = LSC_StoreData(Os_info, status, pTranscv_Info);
           if (status == LSCSTATUS_SUCCESS) {
-            ALOGD_IF(ese_debug_enabled,
-                     "%s: 2nd Script store data success next certificate "
-                     "verification",
-                     fn);
-            offset = offset + 2;
-            len_byte = Numof_lengthbytes(&temp_buf[offset], &wLen);
+            NXP_LOG_ESE_D("%s: 2nd Script store data success next certificate "
+                          "verification",
+                          fn);
             status = LSC_Check_KeyIdentifier(Os_info, status, pTranscv_Info,
                                              temp_buf, LSCSTATUS_SUCCESS,
-                                             wLen + len_byte + 2);
+                                             recLen);
           }
         }
         /*If the certificate and signature is verified*/
@@ -517,12 +635,12 @@ LSCSTATUS LSC_loadapplet(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
       } else {
         /*Already certificate&Sginature verified previously skip 7f21& tag 60*/
         memset(temp_buf, 0, sizeof(temp_buf));
-        status = LSC_ReadScript(Os_info, temp_buf);
+        status = LSC_ReadScript(Os_info, temp_buf, &recLen);
         if (status != LSCSTATUS_SUCCESS) {
           ALOGE("%s: Next Tag has to TAG 60 not found", fn);
           goto exit;
         }
-        if (temp_buf[offset] == TAG_JSBL_HDR_ID)
+        if (temp_buf[0] == TAG_JSBL_HDR_ID)
           continue;
         else
           goto exit;
@@ -537,23 +655,28 @@ LSCSTATUS LSC_loadapplet(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
     }
   }
   if (Os_info->bytes_wrote == 0xAA) {
-    fclose(Os_info->fResp);
+    LSC_RespClose(&Os_info->resp);
   }
   LSC_UpdateExeStatus(LS_SUCCESS_STATUS);
-  wResult = fclose(Os_info->fp);
-  ALOGD_IF(ese_debug_enabled, "%s: exit, status=0x%x", fn, status);
+  LSC_ScriptClose(&Os_info->script);
+  LSC_LoadQueueReset(&gsLoadQueue);
+  if (status == LSCSTATUS_SUCCESS) LSC_CheckpointClear();
+  NXP_LOG_ESE_D("%s: exit, status=0x%x", fn, status);
   return status;
 exit:
-  wResult = fclose(Os_info->fp);
+  LSC_ScriptClose(&Os_info->script);
+  /*A load cut short keeps no spill until the next script*/
+  LSC_LoadQueueReset(&gsLoadQueue);
   if (Os_info->bytes_wrote == 0xAA) {
-    fclose(Os_info->fResp);
+    LSC_RespClose(&Os_info->resp);
   }
   /*Script ends with SW 6320 and reached END OF FILE*/
   if (reachEOFCheck == true) {
     status = LSCSTATUS_SUCCESS;
     LSC_UpdateExeStatus(LS_SUCCESS_STATUS);
   }
-  ALOGD_IF(ese_debug_enabled, "%s: exit; status= 0x%X", fn, status);
+  if (status == LSCSTATUS_SUCCESS) LSC_CheckpointClear();
+  NXP_LOG_ESE_D("%s: exit; status= 0x%X", fn, status);
   return status;
 }
 
@@ -572,29 +695,27 @@ LSCSTATUS LSC_Check_KeyIdentifier(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
                                   int32_t wNewLen) {
   static const char fn[] = "LSC_Check_KeyIdentifier";
   status = LSCSTATUS_FAILED;
-  uint8_t read_buf[1024];
-  uint16_t offset = 0, len_byte = 0;
-  int32_t wLen;
+  uint8_t read_buf[LS_MAX_SCRIPT_RECORD_LEN];
+  int32_t recLen = 0;
   uint8_t certf_found = LSCSTATUS_FAILED;
 
-  ALOGD_IF(ese_debug_enabled, "%s: enter", fn);
+  NXP_LOG_ESE_D("%s: enter", fn);
 
-  while (!feof(Os_info->fp) && (Os_info->bytes_read < Os_info->fls_size)) {
-    offset = 0x00;
-    wLen = 0;
+  while (!LSC_ScriptAtEnd(&Os_info->script)) {
     if (flag == LSCSTATUS_SUCCESS) {
       /*If the 7F21 TAG is already read: After TAG 40*/
       memcpy(read_buf, temp_buf, wNewLen);
+      recLen = wNewLen;
       status = LSCSTATUS_SUCCESS;
       flag = LSCSTATUS_FAILED;
     } else {
       /*If the 7F21 TAG is not read: Before TAG 40*/
-      status = LSC_ReadScript(Os_info, read_buf);
+      status = LSC_ReadScript(Os_info, read_buf, &recLen);
     }
     if (status != LSCSTATUS_SUCCESS) return status;
     if (LSCSTATUS_SUCCESS ==
-        Check_Complete_7F21_Tag(Os_info, pTranscv_Info, read_buf, &offset)) {
-      ALOGD_IF(ese_debug_enabled, "%s: Certificate is verified", fn);
+        Check_Complete_7F21_Tag(Os_info, pTranscv_Info, read_buf, recLen)) {
+      NXP_LOG_ESE_D("%s: Certificate is verified", fn);
       certf_found = LSCSTATUS_SUCCESS;
       break;
     }
@@ -602,7 +723,7 @@ LSCSTATUS LSC_Check_KeyIdentifier(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
      * The Loader Service Client ignores all subsequent commands starting by tag
      * 7F21 or tag 60 until the first command starting by tag 40 is found
      */
-    else if (((read_buf[offset] == TAG_LSC_CMD_ID) &&
+    else if (((read_buf[0] == TAG_LSC_CMD_ID) &&
               (certf_found != LSCSTATUS_SUCCESS))) {
       ALOGE("%s: NOT FOUND Root entity identifier's certificate", fn);
       status = LSCSTATUS_FAILED;
@@ -611,47 +732,44 @@ LSCSTATUS LSC_Check_KeyIdentifier(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
   }
   memset(read_buf, 0, sizeof(read_buf));
   if (certf_found == LSCSTATUS_SUCCESS) {
-    offset = 0x00;
-    wLen = 0;
-    status = LSC_ReadScript(Os_info, read_buf);
+    status = LSC_ReadScript(Os_info, read_buf, &recLen);
     if (status != LSCSTATUS_SUCCESS) return status;
-    if ((read_buf[offset] == TAG_JSBL_HDR_ID) &&
-        (certf_found != LSCSTATUS_FAILED)) {
+    phNxpEseBerTlvCursor_t cursor;
+    phNxpEseBerTlv_t header, sign;
+    phNxpEseBerTlv_Init(&cursor, read_buf, recLen);
+    if (phNxpEseBerTlv_Next(&cursor, &header) &&
+        header.tag == TAG_JSBL_HDR_ID) {
       // TODO check the SElect cmd response and return status accordingly
-      ALOGD_IF(ese_debug_enabled, "%s: TAGID: TAG_JSBL_HDR_ID", fn);
-      offset = offset + 1;
-      len_byte = Numof_lengthbytes(&read_buf[offset], &wLen);
-      offset = offset + len_byte;
-      if (read_buf[offset] == TAG_SIGNATURE_ID) {
-        offset = offset + 1;
-        len_byte = Numof_lengthbytes(&read_buf[offset], &wLen);
-        offset = offset + len_byte;
-        ALOGD_IF(ese_debug_enabled, "%s: TAGID: TAG_SIGNATURE_ID", fn);
-
-        pTranscv_Info->sSendlength = wLen + 5;
+      NXP_LOG_ESE_D("%s: TAGID: TAG_JSBL_HDR_ID", fn);
+      phNxpEseBerTlv_Enter(&header, &cursor);
+      if (phNxpEseBerTlv_Next(&cursor, &sign) &&
+          sign.tag == TAG_SIGNATURE_ID) {
+        NXP_LOG_ESE_D("%s: TAGID: TAG_SIGNATURE_ID", fn);
+
+        pTranscv_Info->sSendlength = sign.len + 5;
 
         pTranscv_Info->sSendData[0] = 0x00;
         pTranscv_Info->sSendData[1] = 0xA0;
         pTranscv_Info->sSendData[2] = 0x00;
         pTranscv_Info->sSendData[3] = 0x00;
-        pTranscv_Info->sSendData[4] = wLen;
+        pTranscv_Info->sSendData[4] = sign.len;
 
-        memcpy(&(pTranscv_Info->sSendData[5]), &read_buf[offset], wLen);
-        ALOGD_IF(ese_debug_enabled, "%s: start transceive for length %ld", fn,
-                 (long)pTranscv_Info->sSendlength);
+        memcpy(&(pTranscv_Info->sSendData[5]), sign.pValue, sign.len);
+        NXP_LOG_ESE_D("%s: start transceive for length %ld", fn,
+                      (long)pTranscv_Info->sSendlength);
         status = LSC_SendtoLsc(Os_info, status, pTranscv_Info, LS_Sign);
         if (status != LSCSTATUS_SUCCESS) {
           return status;
         }
       }
-    } else if (read_buf[offset] != TAG_JSBL_HDR_ID) {
+    } else {
       status = LSCSTATUS_FAILED;
     }
   } else {
     ALOGE("%s : Exit certificate verification failed", fn);
   }
 
-  ALOGD_IF(ese_debug_enabled, "%s: exit: status=0x%x", fn, status);
+  NXP_LOG_ESE_D("%s: exit: status=0x%x", fn, status);
   return status;
 }
 
@@ -659,115 +777,15 @@ LSCSTATUS LSC_Check_KeyIdentifier(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
 **
 ** Function:        LSC_ReadScript
 **
-** Description:     Reads the current line if the script
+** Description:     Reads the next record of the script
 **
 ** Returns:         Success if ok.
 **
 *******************************************************************************/
-LSCSTATUS LSC_ReadScript(Lsc_ImageInfo_t* Os_info, uint8_t* read_buf) {
-  static const char fn[] = "LSC_ReadScript";
-  int32_t wResult = 0, wCount, wIndex = 0;
-
-  ALOGD_IF(ese_debug_enabled, "%s: enter", fn);
-
-  for (wCount = 0; (wCount < 2 && !feof(Os_info->fp)); wCount++, wIndex++) {
-    wResult = FSCANF_BYTE(Os_info->fp, "%2X", (unsigned int*)&read_buf[wIndex]);
-  }
-  if (wResult == 0) return LSCSTATUS_FAILED;
-
-  Os_info->bytes_read = Os_info->bytes_read + (wCount * 2);
-
-  int32_t lenOff = 1;
-  if ((read_buf[0] == 0x7f) && (read_buf[1] == 0x21)) {
-    for (wCount = 0; (wCount < 1 && !feof(Os_info->fp)); wCount++, wIndex++) {
-      wResult =
-          FSCANF_BYTE(Os_info->fp, "%2X", (unsigned int*)&read_buf[wIndex]);
-    }
-    if (wResult == 0) {
-      ALOGE("%s: Exit Read Script failed in 7F21 ", fn);
-      return LSCSTATUS_FAILED;
-    }
-    /*Read_Script from wCount*2 to wCount*1 */
-    Os_info->bytes_read = Os_info->bytes_read + (wCount * 2);
-    lenOff = 2;
-  } else if ((read_buf[0] == 0x40) || (read_buf[0] == 0x60)) {
-    lenOff = 1;
-  } else {
-    /*If TAG is neither 7F21 nor 60 nor 40 then ABORT execution*/
-    ALOGE("%s: Invalid TAG 0x%X found in the script", fn, read_buf[0]);
-    return LSCSTATUS_FAILED;
-  }
-
-  uint8_t len_byte = 0;
-  int32_t wLen;
-  if (read_buf[lenOff] == 0x00) {
-    ALOGE("%s: Invalid length zero", fn);
-    len_byte = 0x00;
-    return LSCSTATUS_FAILED;
-  } else if ((read_buf[lenOff] & 0x80) == 0x80) {
-    len_byte = read_buf[lenOff] & 0x0F;
-    len_byte = len_byte + 1;  // 1 byte added for byte 0x81
-
-    ALOGD_IF(ese_debug_enabled, "%s: Length byte Read from 0x80 is 0x%x ", fn,
-             len_byte);
-
-    if (len_byte == 0x02) {
-      for (wCount = 0; (wCount < 1 && !feof(Os_info->fp)); wCount++, wIndex++) {
-        wResult =
-            FSCANF_BYTE(Os_info->fp, "%2X", (unsigned int*)&read_buf[wIndex]);
-      }
-      if (wResult == 0) {
-        ALOGE("%s: Exit Read Script failed in length 0x02 ", fn);
-        return LSCSTATUS_FAILED;
-      }
-
-      wLen = read_buf[lenOff + 1];
-      Os_info->bytes_read = Os_info->bytes_read + (wCount * 2);
-      ALOGD_IF(ese_debug_enabled,
-               "%s: Length of Read Script in len_byte= 0x02 is 0x%x ", fn,
-               wLen);
-    } else if (len_byte == 0x03) {
-      for (wCount = 0; (wCount < 2 && !feof(Os_info->fp)); wCount++, wIndex++) {
-        wResult =
-            FSCANF_BYTE(Os_info->fp, "%2X", (unsigned int*)&read_buf[wIndex]);
-      }
-      if (wResult == 0) {
-        ALOGE("%s: Exit Read Script failed in length 0x03 ", fn);
-        return LSCSTATUS_FAILED;
-      }
-
-      Os_info->bytes_read = Os_info->bytes_read + (wCount * 2);
-      wLen = read_buf[lenOff + 1];  // Length of the packet send to LSC
-      wLen = ((wLen << 8) | (read_buf[lenOff + 2]));
-      ALOGD_IF(ese_debug_enabled,
-               "%s: Length of Read Script in len_byte= 0x03 is 0x%x ", fn,
-               wLen);
-    } else {
-      /*Need to provide the support if length is more than 2 bytes*/
-      ALOGE("Length recived is greater than 3");
-      return LSCSTATUS_FAILED;
-    }
-  } else {
-    len_byte = 0x01;
-    wLen = read_buf[lenOff];
-    ALOGE("%s: Length of Read Script in len_byte= 0x01 is 0x%x ", fn, wLen);
-  }
-
-  for (wCount = 0; (wCount < wLen && !feof(Os_info->fp)); wCount++, wIndex++) {
-    wResult = FSCANF_BYTE(Os_info->fp, "%2X", (unsigned int*)&read_buf[wIndex]);
-  }
-
-  if (wResult == 0) {
-    ALOGE("%s: Exit Read Script failed in fscanf function ", fn);
-    return LSCSTATUS_FAILED;
-  }
-  Os_info->bytes_read =
-      Os_info->bytes_read + (wCount * 2) + 1;  // not sure why 2 added
-
-  ALOGD_IF(ese_debug_enabled, "%s: exit: Num of bytes read=%d and index=%d", fn,
-           Os_info->bytes_read, wIndex);
-
-  return LSCSTATUS_SUCCESS;
+LSCSTATUS LSC_ReadScript(Lsc_ImageInfo_t* Os_info, uint8_t* read_buf,
+                         int32_t* pLen) {
+  return LSC_ScriptNextTlv(&Os_info->script, read_buf,
+                           LS_MAX_SCRIPT_RECORD_LEN, pLen);
 }
 
 /*******************************************************************************
@@ -784,74 +802,90 @@ LSCSTATUS LSC_SendtoEse(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
   static const char fn[] = "LSC_SendtoEse";
   bool chanl_open_cmd = false;
 
-  ALOGD_IF(ese_debug_enabled, "%s: enter", fn);
+  NXP_LOG_ESE_D("%s: enter", fn);
+
+  /* Applet load commands go through the load engine */
+  Lsc_LoadQueue_t* pQueue = &gsLoadQueue;
+  uint8_t* pCmd = pTranscv_Info->sSendData;
+  bool isInstall = (pCmd[1] == INSTAL_LOAD_ID) &&
+                   (pCmd[2] == PARAM_P1_OFFSET) && (pCmd[3] == 0x00);
+  bool isLoad = (pCmd[1] == LOAD_CMD_ID) &&
+                ((pCmd[2] == LOAD_MORE_BLOCKS) ||
+                 (pCmd[2] == LOAD_LAST_BLOCK)) &&
+                (pCmd[3] == pQueue->nextBlock);
+  uint32_t record = Os_info->script.record - 1;
+  if (pQueue->active && !isLoad) {
+    ALOGE("%s: command %02X%02X interrupts the load at script record %u", fn,
+          pCmd[0], pCmd[1], record);
+    LSC_LoadQueueReset(pQueue);
+    return LSCSTATUS_FAILED;
+  }
+  if (isInstall || pQueue->active) {
+    if (LSC_LoadQueuePush(pQueue, pTranscv_Info, record) !=
+        LSCSTATUS_SUCCESS) {
+      ALOGE("%s: cannot queue load command of %d bytes at script record %u",
+            fn, pTranscv_Info->sSendlength, record);
+      LSC_LoadQueueReset(pQueue);
+      return LSCSTATUS_FAILED;
+    }
+    pQueue->active = true;
+    if (isLoad) pQueue->nextBlock++;
+    if (isLoad && pCmd[2] == LOAD_LAST_BLOCK) {
+      status = LSC_LoadQueueDrain(pQueue, Os_info, pTranscv_Info);
+    } else {
+      /* Workaround for issue in JCOP, send the fake response back */
+      int32_t recvBufferActualSize = 0x03;
+      pTranscv_Info->sRecvData[0] = 0x00;
+      pTranscv_Info->sRecvData[1] = 0x90;
+      pTranscv_Info->sRecvData[2] = 0x00;
+      status =
+          Process_EseResponse(pTranscv_Info, recvBufferActualSize, Os_info);
+    }
+    NXP_LOG_ESE_D("%s: exit: status=0x%x", fn, status);
+    return status;
+  }
 
-  /* Bufferize_load_cmds function is implemented in JCOP */
-  status = Bufferize_load_cmds(Os_info, status, pTranscv_Info);
-  if (status != LSCSTATUS_FAILED) {
-    if (pTranscv_Info->sSendData[1] == 0x70) {
-      if (pTranscv_Info->sSendData[2] == 0x00) {
-        chanl_open_cmd = true;
-      } else {
-        for (uint8_t cnt = 0; cnt < Os_info->channel_cnt; cnt++) {
-          if (Os_info->Channel_Info[cnt].channel_id ==
-              pTranscv_Info->sSendData[3]) {
-            ALOGD_IF(ese_debug_enabled, "%s: channel 0%x closed", fn,
-                     Os_info->Channel_Info[cnt].channel_id);
-            Os_info->Channel_Info[cnt].isOpend = false;
-          }
+  if (pTranscv_Info->sSendData[1] == 0x70) {
+    if (pTranscv_Info->sSendData[2] == 0x00) {
+      chanl_open_cmd = true;
+    } else {
+      for (uint8_t cnt = 0; cnt < Os_info->channel_cnt; cnt++) {
+        if (Os_info->Channel_Info[cnt].channel_id ==
+            pTranscv_Info->sSendData[3]) {
+          NXP_LOG_ESE_D("%s: channel 0%x closed", fn,
+                        Os_info->Channel_Info[cnt].channel_id);
+          Os_info->Channel_Info[cnt].isOpend = false;
         }
       }
     }
+  }
 
-    phNxpEse_data cmdApdu;
-    phNxpEse_data rspApdu;
-    phNxpEse_memset(&cmdApdu, 0x00, sizeof(phNxpEse_data));
-    phNxpEse_memset(&rspApdu, 0x00, sizeof(phNxpEse_data));
+  phNxpEse_data cmdApdu;
+  phNxpEse_data rspApdu;
+  phNxpEse_memset(&cmdApdu, 0x00, sizeof(phNxpEse_data));
+  phNxpEse_memset(&rspApdu, 0x00, sizeof(phNxpEse_data));
 
-    cmdApdu.len = (int32_t)(pTranscv_Info->sSendlength);
-    cmdApdu.p_data = (uint8_t*)phNxpEse_memalloc(cmdApdu.len * sizeof(uint8_t));
-    memcpy(cmdApdu.p_data, pTranscv_Info->sSendData, cmdApdu.len);
+  cmdApdu.len = (int32_t)(pTranscv_Info->sSendlength);
+  cmdApdu.p_data = pTranscv_Info->sSendData;
 
-    ESESTATUS eseStat = phNxpEse_Transceive(&cmdApdu, &rspApdu);
+  ESESTATUS eseStat = LSC_Transceive(&cmdApdu, &rspApdu);
 
-    if (eseStat != ESESTATUS_SUCCESS) {
-      ALOGE("%s: Transceive failed; status=0x%X", fn, eseStat);
-      status = LSCSTATUS_FAILED;
-    } else {
-      if (chanl_open_cmd && (rspApdu.len == 0x03) &&
-          ((rspApdu.p_data[rspApdu.len - 2] == 0x90) &&
-           (rspApdu.p_data[rspApdu.len - 1] == 0x00))) {
-        ALOGD_IF(ese_debug_enabled, "%s: open channel success", fn);
-        uint8_t cnt = Os_info->channel_cnt;
-        Os_info->Channel_Info[cnt].channel_id = rspApdu.p_data[rspApdu.len - 3];
-        Os_info->Channel_Info[cnt].isOpend = true;
-        Os_info->channel_cnt++;
-      }
-      memcpy(pTranscv_Info->sRecvData, rspApdu.p_data, rspApdu.len);
-      status = Process_EseResponse(pTranscv_Info, rspApdu.len, Os_info);
-      phNxpEse_free(cmdApdu.p_data);
-      phNxpEse_free(rspApdu.p_data);
-    }
-  } else if (gsSendBack_cmds == false) {
-    /* Workaround for issue in JCOP, send the fake response back */
-    int32_t recvBufferActualSize = 0x03;
-    pTranscv_Info->sRecvData[0] = 0x00;
-    pTranscv_Info->sRecvData[1] = 0x90;
-    pTranscv_Info->sRecvData[2] = 0x00;
-    status = Process_EseResponse(pTranscv_Info, recvBufferActualSize, Os_info);
+  if (eseStat != ESESTATUS_SUCCESS) {
+    ALOGE("%s: Transceive failed; status=0x%X", fn, eseStat);
+    status = LSCSTATUS_FAILED;
   } else {
-    if (gsIslastcmdLoad == true) {
-      status = Send_Backall_Loadcmds(Os_info, status, pTranscv_Info);
-      gsSendBack_cmds = false;
-    } else {
-      memset(gsCmd_Buffer, 0, sizeof(gsCmd_Buffer));
-      gsSendBack_cmds = false;
-      status = LSCSTATUS_FAILED;
+    if (chanl_open_cmd && (rspApdu.len == 0x03) &&
+        ((rspApdu.p_data[rspApdu.len - 2] == 0x90) &&
+         (rspApdu.p_data[rspApdu.len - 1] == 0x00))) {
+      NXP_LOG_ESE_D("%s: open channel success", fn);
+      LSC_RecordChannel(Os_info, rspApdu.p_data[rspApdu.len - 3]);
     }
+    memcpy(pTranscv_Info->sRecvData, rspApdu.p_data, rspApdu.len);
+    status = Process_EseResponse(pTranscv_Info, rspApdu.len, Os_info);
   }
+  phNxpEse_free(rspApdu.p_data);
 
-  ALOGD_IF(ese_debug_enabled, "%s: exit: status=0x%x", fn, status);
+  NXP_LOG_ESE_D("%s: exit: status=0x%x", fn, status);
   return status;
 }
 
@@ -868,8 +902,9 @@ LSCSTATUS LSC_SendtoLsc(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
                         Lsc_TranscieveInfo_t* pTranscv_Info, Ls_TagType tType) {
   static const char fn[] = "LSC_SendtoLsc";
 
-  ALOGD_IF(ese_debug_enabled, "%s: enter", fn);
-  pTranscv_Info->sSendData[0] = (0x80 | Os_info->Channel_Info[0].channel_id);
+  NXP_LOG_ESE_D("%s: enter", fn);
+  pTranscv_Info->sSendData[0] =
+      phNxpEse_ChannelCla(0x80, Os_info->Channel_Info[0].channel_id);
   pTranscv_Info->timeout = gsTransceiveTimeout;
   pTranscv_Info->sRecvlength = 1024;
 
@@ -881,7 +916,7 @@ LSCSTATUS LSC_SendtoLsc(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
   cmdApdu.p_data = (uint8_t*)phNxpEse_memalloc(cmdApdu.len * sizeof(uint8_t));
   memcpy(cmdApdu.p_data, pTranscv_Info->sSendData, cmdApdu.len);
 
-  ESESTATUS eseStat = phNxpEse_Transceive(&cmdApdu, &rspApdu);
+  ESESTATUS eseStat = LSC_Transceive(&cmdApdu, &rspApdu);
 
   if (eseStat != ESESTATUS_SUCCESS) {
     ALOGE("%s: Transceive failed; status=0x%X", fn, eseStat);
@@ -892,7 +927,7 @@ LSCSTATUS LSC_SendtoLsc(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
   }
   phNxpEse_free(cmdApdu.p_data);
   phNxpEse_free(rspApdu.p_data);
-  ALOGD_IF(ese_debug_enabled, "%s: exit: status=0x%x", fn, status);
+  NXP_LOG_ESE_D("%s: exit: status=0x%x", fn, status);
   return status;
 }
 
@@ -910,7 +945,7 @@ LSCSTATUS LSC_CloseChannel(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
   static const char fn[] = "LSC_CloseChannel";
   status = LSCSTATUS_FAILED;
 
-  ALOGD_IF(ese_debug_enabled, "%s: enter", fn);
+  NXP_LOG_ESE_D("%s: enter", fn);
 
   if (Os_info == NULL || pTranscv_Info == NULL) {
     ALOGE("%s: Invalid parameter", fn);
@@ -927,33 +962,33 @@ LSCSTATUS LSC_CloseChannel(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
     cmdApdu.p_data = (uint8_t*)phNxpEse_memalloc(cmdApdu.len * sizeof(uint8_t));
     if (!Os_info->Channel_Info[cnt].isOpend) continue;
     uint8_t xx = 0;
-    cmdApdu.p_data[xx++] = Os_info->Channel_Info[cnt].channel_id;
+    cmdApdu.p_data[xx++] =
+        phNxpEse_ChannelCla(0x00, Os_info->Channel_Info[cnt].channel_id);
     cmdApdu.p_data[xx++] = 0x70;
     cmdApdu.p_data[xx++] = 0x80;
     cmdApdu.p_data[xx++] = Os_info->Channel_Info[cnt].channel_id;
     cmdApdu.p_data[xx++] = 0x00;
 
-    ESESTATUS eseStat = phNxpEse_Transceive(&cmdApdu, &rspApdu);
+    ESESTATUS eseStat = LSC_Transceive(&cmdApdu, &rspApdu);
 
     if (eseStat != ESESTATUS_SUCCESS || rspApdu.len < 2) {
-      ALOGD_IF(ese_debug_enabled, "%s: Transceive failed; status=0x%X", fn,
-               eseStat);
+      NXP_LOG_ESE_D("%s: Transceive failed; status=0x%X", fn, eseStat);
     } else if ((rspApdu.p_data[rspApdu.len - 2] == 0x90) &&
                (rspApdu.p_data[rspApdu.len - 1] == 0x00)) {
-      ALOGD_IF(ese_debug_enabled, "%s: Close channel id = 0x0%x success", fn,
-               Os_info->Channel_Info[cnt].channel_id);
+      NXP_LOG_ESE_D("%s: Close channel id = 0x0%x success", fn,
+                    Os_info->Channel_Info[cnt].channel_id);
       if (Os_info->Channel_Info[cnt].channel_id == Os_info->initChannelNum) {
         Os_info->initChannelNum = 0x00;
       }
       status = LSCSTATUS_SUCCESS;
     } else {
-      ALOGD_IF(ese_debug_enabled, "%s: Close channel id = 0x0%x failed", fn,
-               Os_info->Channel_Info[cnt].channel_id);
+      NXP_LOG_ESE_D("%s: Close channel id = 0x0%x failed", fn,
+                    Os_info->Channel_Info[cnt].channel_id);
     }
     phNxpEse_free(cmdApdu.p_data);
     phNxpEse_free(rspApdu.p_data);
   }
-  ALOGD_IF(ese_debug_enabled, "%s: exit; status=0x0%x", fn, status);
+  NXP_LOG_ESE_D("%s: exit; status=0x0%x", fn, status);
   return status;
 }
 
@@ -971,7 +1006,7 @@ LSCSTATUS LSC_ProcessResp(Lsc_ImageInfo_t* image_info, int32_t recvlen,
   static const char fn[] = "LSC_ProcessResp";
   uint8_t* RecvData = trans_info->sRecvData;
 
-  ALOGD_IF(ese_debug_enabled, "%s: enter", fn);
+  NXP_LOG_ESE_D("%s: enter", fn);
 
   if (RecvData == NULL && recvlen == 0x00) {
     ALOGE("%s: Invalid parameter.", fn);
@@ -984,8 +1019,7 @@ LSCSTATUS LSC_ProcessResp(Lsc_ImageInfo_t* image_info, int32_t recvlen,
   char sw[2];
   sw[0] = RecvData[recvlen - 2];
   sw[1] = RecvData[recvlen - 1];
-  ALOGD_IF(ese_debug_enabled, "%s: Process Response SW, status = 0x%2X%2X", fn,
-           sw[0], sw[1]);
+  NXP_LOG_ESE_D("%s: Process Response SW, status = 0x%2X%2X", fn, sw[0], sw[1]);
 
   /*Update the Global variable for storing response length*/
   gsResp_len = recvlen;
@@ -1020,7 +1054,7 @@ LSCSTATUS LSC_ProcessResp(Lsc_ImageInfo_t* image_info, int32_t recvlen,
              ((sw[0] != 0x90) && (sw[0] != 0x63) && (sw[0] != 0x61))) {
     Write_Response_To_OutFile(image_info, RecvData, recvlen, tType);
   }
-  ALOGD_IF(ese_debug_enabled, "%s: exit: status=0x%x", fn, status);
+  NXP_LOG_ESE_D("%s: exit: status=0x%x", fn, status);
   return status;
 }
 
@@ -1038,10 +1072,10 @@ LSCSTATUS Process_EseResponse(Lsc_TranscieveInfo_t* pTranscv_Info,
   static const char fn[] = "Process_EseResponse";
   LSCSTATUS status = LSCSTATUS_SUCCESS;
   uint8_t xx = 0;
-  ALOGD_IF(ese_debug_enabled, "%s: enter", fn);
+  NXP_LOG_ESE_D("%s: enter", fn);
 
   pTranscv_Info->sSendData[xx++] =
-      (CLA_BYTE | Os_info->Channel_Info[0].channel_id);
+      phNxpEse_ChannelCla(CLA_BYTE, Os_info->Channel_Info[0].channel_id);
   pTranscv_Info->sSendData[xx++] = 0xA2;
 
   if (recv_len <= 0xFF) {
@@ -1079,7 +1113,7 @@ LSCSTATUS Process_EseResponse(Lsc_TranscieveInfo_t* pTranscv_Info,
     pTranscv_Info->sSendlength = xx + recv_len;
     status = LSC_SendtoLsc(Os_info, status, pTranscv_Info, LS_Comm);
   }
-  ALOGD_IF(ese_debug_enabled, "%s: exit: status=0x%x", fn, status);
+  NXP_LOG_ESE_D("%s: exit: status=0x%x", fn, status);
   return status;
 }
 
@@ -1095,263 +1129,175 @@ LSCSTATUS Process_EseResponse(Lsc_TranscieveInfo_t* pTranscv_Info,
 *******************************************************************************/
 LSCSTATUS Process_SelectRsp(uint8_t* Recv_data, int32_t Recv_len) {
   static const char fn[] = "Process_SelectRsp";
-  ALOGD_IF(ese_debug_enabled, "%s: enter", fn);
+  NXP_LOG_ESE_D("%s: enter", fn);
 
   if (Recv_len < 2) {
     ALOGE("%s: Invalid response length %d", fn, Recv_len);
     return LSCSTATUS_FAILED;
   }
 
-  int i = 0;
-  if (Recv_data[i] != TAG_SELECT_ID) {
-    ALOGE("%s: Invalid FCI TAG = 0x%x", fn, Recv_data[i]);
-    return LSCSTATUS_FAILED;
-  }
-  i++;
-  int len = Recv_data[i++];
-  if (Recv_len < len + 2) {
-    ALOGE("%s: Invalid response length %d", fn, Recv_len);
+  phNxpEseBerTlvCursor_t cursor;
+  phNxpEseBerTlv_t fci;
+  phNxpEseBerTlv_Init(&cursor, Recv_data, Recv_len);
+  if (!phNxpEseBerTlv_Next(&cursor, &fci) || fci.tag != TAG_SELECT_ID) {
+    ALOGE("%s: Invalid FCI TAG = 0x%x", fn, Recv_data[0]);
     return LSCSTATUS_FAILED;
   }
-  if (Recv_data[i] != TAG_LSC_ID) {
-    ALOGE("%s: Invalid Loader Service AID TAG ID = 0x%x", fn, Recv_data[i]);
+  phNxpEseBerTlv_t tlv[LS_FCI_COUNT];
+  phNxpEseBerTlv_Enter(&fci, &cursor);
+  if (!phNxpEseBerTlv_Match(&cursor, gsFciSchema, LS_FCI_COUNT, tlv)) {
+    ALOGE("%s: Invalid AID, LS version or root entity key set", fn);
     return LSCSTATUS_FAILED;
   }
-  i++;
-  len = Recv_data[i];
-  i = i + 1 + len;  // points to next tag name A5
-  // points to TAG 9F08 for LS application version
-  if ((Recv_data[i] != TAG_LS_VER1) || (Recv_data[i + 1] != TAG_LS_VER2)) {
-    ALOGE("%s: Invalid LS Version = 0x%2X%2X", fn, Recv_data[i],
-          Recv_data[i + 1]);
+  phNxpEseBerTlv_t keyId[LS_KEY_COUNT];
+  phNxpEseBerTlv_Enter(&tlv[LS_FCI_KEY_ID], &cursor);
+  if (!phNxpEseBerTlv_Match(&cursor, gsKeyIdSchema, LS_KEY_COUNT, keyId)) {
+    ALOGE("%s: Invalid Root entity for TAG 42/45", fn);
     return LSCSTATUS_FAILED;
   }
-  uint8_t lsaVersionLen = 0;
-  i = i + 2;
-  lsaVersionLen = Recv_data[i];
-  // points to TAG 9F08 LS application version
-  i++;
-  // points to Identifier of the Root Entity key set identifier
-  i = i + lsaVersionLen;
-
-  if (Recv_data[i] != TAG_RE_KEYID) {
-    ALOGE("%s: Invalid Root entity key set TAG ID = 0x%x", fn, Recv_data[i]);
-    return LSCSTATUS_FAILED;
-  }
-
-  i = i + 2;
-  if (Recv_data[i] != TAG_LSRE_ID) {
-    ALOGE("%s: Invalid Root entity for TAG 42 = 0x%x", fn, Recv_data[i]);
-    return LSCSTATUS_FAILED;
-  }
-  i++;
-  uint8_t tag42Len = Recv_data[i];
   // copy the data including length
-  memcpy(gsTag42Arr, &Recv_data[i], tag42Len + 1);
-  i = i + tag42Len + 1;
-  ALOGD_IF(ese_debug_enabled, "%s: gsTag42Arr %s", fn, gsTag42Arr);
-  if (Recv_data[i] != TAG_LSRE_SIGNID) {
-    ALOGE("%s: Invalid Root entity for TAG 45 = 0x%x", fn, Recv_data[i]);
-    return LSCSTATUS_FAILED;
-  }
-  uint8_t tag45Len = Recv_data[i + 1];
-  memcpy(gsTag45Arr, &Recv_data[i + 1], tag45Len + 1);
-  ALOGD_IF(ese_debug_enabled, "%s: Exiting", fn);
+  gsTag42Arr[0] = keyId[LS_KEY_ROOT_ID].len;
+  memcpy(&gsTag42Arr[1], keyId[LS_KEY_ROOT_ID].pValue, gsTag42Arr[0]);
+  gsTag45Arr[0] = keyId[LS_KEY_SIGN_ID].len;
+  memcpy(&gsTag45Arr[1], keyId[LS_KEY_SIGN_ID].pValue, gsTag45Arr[0]);
+  NXP_LOG_ESE_D("%s: Exiting", fn);
   return LSCSTATUS_SUCCESS;
 }
 
-LSCSTATUS Bufferize_load_cmds(__attribute__((unused)) Lsc_ImageInfo_t* Os_info,
-                              __attribute__((unused)) LSCSTATUS status,
-                              Lsc_TranscieveInfo_t* pTranscv_Info) {
-  static const char fn[] = "Bufferize_load_cmds";
-
-  if (gsCmd_count == 0x00) {
-    if ((pTranscv_Info->sSendData[1] == INSTAL_LOAD_ID) &&
-        (pTranscv_Info->sSendData[2] == PARAM_P1_OFFSET) &&
-        (pTranscv_Info->sSendData[3] == 0x00)) {
-      ALOGD_IF(ese_debug_enabled, "%s: BUffer: install for load", fn);
-      gspBuffer[0] = pTranscv_Info->sSendlength;
-      memcpy(&gspBuffer[1], &(pTranscv_Info->sSendData[0]),
-             pTranscv_Info->sSendlength);
-      gspBuffer = gspBuffer + pTranscv_Info->sSendlength + 1;
-      gsCmd_count++;
-      return LSCSTATUS_FAILED;
-    }
-    /* Do not buffer this cmd, Send to eSE */
-    return LSCSTATUS_SUCCESS;
-  } else {
-    uint8_t Param_P2 = gsCmd_count - 1;
-    if ((pTranscv_Info->sSendData[1] == LOAD_CMD_ID) &&
-        (pTranscv_Info->sSendData[2] == LOAD_MORE_BLOCKS) &&
-        (pTranscv_Info->sSendData[3] == Param_P2)) {
-      ALOGD_IF(ese_debug_enabled, "%s: BUffer: load", fn);
-      gspBuffer[0] = pTranscv_Info->sSendlength;
-      memcpy(&gspBuffer[1], &(pTranscv_Info->sSendData[0]),
-             pTranscv_Info->sSendlength);
-      gspBuffer = gspBuffer + pTranscv_Info->sSendlength + 1;
-      gsCmd_count++;
-    } else if ((pTranscv_Info->sSendData[1] == LOAD_CMD_ID) &&
-               (pTranscv_Info->sSendData[2] == LOAD_LAST_BLOCK) &&
-               (pTranscv_Info->sSendData[3] == Param_P2)) {
-      ALOGD_IF(ese_debug_enabled, "%s: BUffer: last load", fn);
-      gsSendBack_cmds = true;
-      gspBuffer[0] = pTranscv_Info->sSendlength;
-      memcpy(&gspBuffer[1], &(pTranscv_Info->sSendData[0]),
-             pTranscv_Info->sSendlength);
-      gspBuffer = gspBuffer + pTranscv_Info->sSendlength + 1;
-      gsCmd_count++;
-      gsIslastcmdLoad = true;
-    } else {
-      ALOGD_IF(ese_debug_enabled, "%s: BUffer: Not a load cmd", fn);
-      gsSendBack_cmds = true;
-      gspBuffer[0] = pTranscv_Info->sSendlength;
-      memcpy(&gspBuffer[1], &(pTranscv_Info->sSendData[0]),
-             pTranscv_Info->sSendlength);
-      gspBuffer = gspBuffer + pTranscv_Info->sSendlength + 1;
-      gsIslastcmdLoad = false;
-      gsCmd_count++;
-    }
-  }
-  ALOGD_IF(ese_debug_enabled, "%s: exit", fn);
-  return LSCSTATUS_FAILED;
+/*******************************************************************************
+**
+** Function:        LSC_LoadQueueReset
+**
+** Description:     Drops any queued load command, frees the spill and
+**                  leaves load mode
+**
+** Returns:         None
+**
+*******************************************************************************/
+void LSC_LoadQueueReset(Lsc_LoadQueue_t* pQueue) {
+  phNxpEse_free(pQueue->pSpill);
+  pQueue->pSpill = NULL;
+  pQueue->spillCap = 0;
+  pQueue->count = 0;
+  pQueue->nextBlock = 0;
+  pQueue->active = false;
 }
 
-LSCSTATUS Send_Backall_Loadcmds(Lsc_ImageInfo_t* Os_info, LSCSTATUS status,
-                                Lsc_TranscieveInfo_t* pTranscv_Info) {
-  static const char fn[] = "Send_Backall_Loadcmds";
-  status = LSCSTATUS_FAILED;
-
-  ALOGD_IF(ese_debug_enabled, "%s: enter", fn);
-  gspBuffer = gsCmd_Buffer;  // Points to start of first cmd to send
-  if (gsCmd_count == 0x00) {
-    ALOGD_IF(ese_debug_enabled, "%s: No cmds stored to send to eSE", fn);
-  } else {
-    while (gsCmd_count-- > 0) {
-      phNxpEse_data cmdApdu;
-      phNxpEse_data rspApdu;
-      phNxpEse_memset(&cmdApdu, 0x00, sizeof(phNxpEse_data));
-      phNxpEse_memset(&rspApdu, 0x00, sizeof(phNxpEse_data));
-
-      cmdApdu.len = (int32_t)(gspBuffer[0]);
-      cmdApdu.p_data =
-          (uint8_t*)phNxpEse_memalloc(cmdApdu.len * sizeof(uint8_t));
-      gspBuffer = gspBuffer + 1 + cmdApdu.len;
-
-      memcpy(cmdApdu.p_data, &gspBuffer[1], cmdApdu.len);
-
-      ESESTATUS eseStat = phNxpEse_Transceive(&cmdApdu, &rspApdu);
-      memcpy(pTranscv_Info->sRecvData, rspApdu.p_data, rspApdu.len);
-      int32_t recvBufferActualSize = rspApdu.len;
-      phNxpEse_free(cmdApdu.p_data);
-      phNxpEse_free(rspApdu.p_data);
+/*******************************************************************************
+**
+** Function:        LSC_LoadQueueAt
+**
+** Description:     Entry idx of the load, in a slot or in the spill
+**
+** Returns:         The entry
+**
+*******************************************************************************/
+static Lsc_LoadApdu_t* LSC_LoadQueueAt(Lsc_LoadQueue_t* pQueue, uint16_t idx) {
+  if (idx < LS_LOAD_QUEUE_SLOTS) return &pQueue->slot[idx];
+  return &pQueue->pSpill[idx - LS_LOAD_QUEUE_SLOTS];
+}
 
-      if (eseStat != ESESTATUS_SUCCESS || (recvBufferActualSize < 2)) {
-        ALOGE("%s: Transceive failed; status=0x%X", fn, eseStat);
-      } else if (gsCmd_count == 0x00) {
-        // Last command in the buffer
-        if (gsIslastcmdLoad == false) {
-          status =
-              Process_EseResponse(pTranscv_Info, recvBufferActualSize, Os_info);
-        } else if ((recvBufferActualSize == 0x02) &&
-                   (pTranscv_Info->sRecvData[recvBufferActualSize - 2] ==
-                    0x90) &&
-                   (pTranscv_Info->sRecvData[recvBufferActualSize - 1] ==
-                    0x00)) {
-          recvBufferActualSize = 0x03;
-          pTranscv_Info->sRecvData[0] = 0x00;
-          pTranscv_Info->sRecvData[1] = 0x90;
-          pTranscv_Info->sRecvData[2] = 0x00;
-          status =
-              Process_EseResponse(pTranscv_Info, recvBufferActualSize, Os_info);
-        } else {
-          status =
-              Process_EseResponse(pTranscv_Info, recvBufferActualSize, Os_info);
-        }
-      } else if ((recvBufferActualSize == 0x02) &&
-                 (pTranscv_Info->sRecvData[0] == 0x90) &&
-                 (pTranscv_Info->sRecvData[1] == 0x00)) {
-        /*response ok without data, send next command in the buffer*/
-      } else if ((recvBufferActualSize == 0x03) &&
-                 (pTranscv_Info->sRecvData[0] == 0x00) &&
-                 (pTranscv_Info->sRecvData[1] == 0x90) &&
-                 (pTranscv_Info->sRecvData[2] == 0x00)) {
-        /*response ok without data, send next command in the buffer*/
-      } else if ((pTranscv_Info->sRecvData[recvBufferActualSize - 2] != 0x90) &&
-                 (pTranscv_Info->sRecvData[recvBufferActualSize - 1] != 0x00)) {
-        /*Error condition hence exiting the loop*/
-        status =
-            Process_EseResponse(pTranscv_Info, recvBufferActualSize, Os_info);
-        /*If the sending of Load fails reset the count*/
-        gsCmd_count = 0;
-        break;
-      }
-    }
+/*******************************************************************************
+**
+** Function:        LSC_LoadQueuePush
+**
+** Description:     Queues the command in pTranscv_Info->sSendData behind
+**                  those of the current load
+**
+** Returns:         Success if queued
+**
+*******************************************************************************/
+LSCSTATUS LSC_LoadQueuePush(Lsc_LoadQueue_t* pQueue,
+                            const Lsc_TranscieveInfo_t* pTranscv_Info,
+                            uint32_t record) {
+  if (pQueue->count >= LS_LOAD_QUEUE_MAX || pTranscv_Info->sSendlength <= 0 ||
+      pTranscv_Info->sSendlength > LS_LOAD_APDU_MAX_LEN) {
+    return LSCSTATUS_FAILED;
   }
-  memset(gsCmd_Buffer, 0, sizeof(gsCmd_Buffer));
-  gspBuffer = gsCmd_Buffer;  // point back to start of line
-  gsCmd_count = 0x00;
-  ALOGD_IF(ese_debug_enabled, "%s: exit: status=0x%x", fn, status);
-  return status;
+  if (pQueue->count >= LS_LOAD_QUEUE_SLOTS + pQueue->spillCap) {
+    /*Doubled each time, so a long load only grows it a few times*/
+    uint16_t cap =
+        (pQueue->spillCap == 0) ? LS_LOAD_QUEUE_SLOTS : 2 * pQueue->spillCap;
+    if (cap > LS_LOAD_QUEUE_MAX - LS_LOAD_QUEUE_SLOTS) {
+      cap = LS_LOAD_QUEUE_MAX - LS_LOAD_QUEUE_SLOTS;
+    }
+    Lsc_LoadApdu_t* pSpill =
+        (Lsc_LoadApdu_t*)phNxpEse_memalloc(cap * sizeof(Lsc_LoadApdu_t));
+    if (pSpill == NULL) return LSCSTATUS_FAILED;
+    if (pQueue->spillCap != 0) {
+      memcpy(pSpill, pQueue->pSpill,
+             pQueue->spillCap * sizeof(Lsc_LoadApdu_t));
+    }
+    phNxpEse_free(pQueue->pSpill);
+    pQueue->pSpill = pSpill;
+    pQueue->spillCap = cap;
+  }
+  Lsc_LoadApdu_t* pApdu = LSC_LoadQueueAt(pQueue, pQueue->count);
+  pApdu->record = record;
+  pApdu->len = pTranscv_Info->sSendlength;
+  memcpy(pApdu->data, pTranscv_Info->sSendData, pApdu->len);
+  pQueue->count++;
+  return LSCSTATUS_SUCCESS;
 }
+
 /*******************************************************************************
 **
-** Function:        Numof_lengthbytes
+** Function:        LSC_LoadQueueDrain
 **
-** Description:     Checks the number of length bytes and assigns
-**                  length value to wLen.
+** Description:     Sends the queued load to the eSE in order and resets the
+**                  queue
 **
-** Returns:         Number of Length bytes
+** Returns:         Status of forwarding the last or failing response to the
+**                  LS applet
 **
 *******************************************************************************/
-uint8_t Numof_lengthbytes(uint8_t* read_buf, int32_t* pLen) {
-  static const char fn[] = "Numof_lengthbytes";
-  uint8_t len_byte = 0;
-  ALOGD_IF(ese_debug_enabled, "%s: enter", fn);
-
-  if (read_buf[0] == 0x00) {
-    ALOGE("%s: Invalid length zero", fn);
-    len_byte = 0x00;
-  } else if ((read_buf[0] & 0x80) == 0x80) {
-    len_byte = read_buf[0] & 0x0F;
-    len_byte = len_byte + 1;  // 1 byte added for byte 0x81
-  } else {
-    len_byte = 0x01;
-  }
+LSCSTATUS LSC_LoadQueueDrain(Lsc_LoadQueue_t* pQueue, Lsc_ImageInfo_t* Os_info,
+                             Lsc_TranscieveInfo_t* pTranscv_Info) {
+  static const char fn[] = "LSC_LoadQueueDrain";
+  NXP_LOG_ESE_D("%s: enter; %u commands", fn, pQueue->count);
 
-  /* To get the length of the value field */
-  int32_t wLen = 0;
-  switch (len_byte) {
-    case 0:
-      wLen = read_buf[0];
-      break;
-    case 1:
-      /*1st byte is the length*/
-      wLen = read_buf[0];
-      break;
-    case 2:
-      /*2nd byte is the length*/
-      wLen = read_buf[1];
-      break;
-    case 3:
-      /*1st and 2nd bytes are length*/
-      wLen = read_buf[1];
-      wLen = ((wLen << 8) | (read_buf[2]));
-      break;
-    case 4:
-      /*3bytes are the length*/
-      wLen = read_buf[1];
-      wLen = ((wLen << 16) | (read_buf[2] << 8));
-      wLen = (wLen | (read_buf[3]));
-      break;
-    default:
-      ALOGE("%s: Invalid length %d.", fn, len_byte);
-      break;
-  }
+  uint8_t* RecvData = pTranscv_Info->sRecvData;
+  int32_t recvlen = 0;
+  for (uint16_t idx = 0; idx < pQueue->count; idx++) {
+    Lsc_LoadApdu_t* pApdu = LSC_LoadQueueAt(pQueue, idx);
 
-  *pLen = wLen;
-  ALOGD_IF(ese_debug_enabled, "%s: exit; len_bytes=0x0%x, Length=%d", fn,
-           len_byte, *pLen);
-  return len_byte;
+    /* The protocol layer chains the command in I-blocks of the IFSC */
+    phNxpEse_data cmdApdu;
+    phNxpEse_data rspApdu;
+    phNxpEse_memset(&rspApdu, 0x00, sizeof(phNxpEse_data));
+    cmdApdu.len = pApdu->len;
+    cmdApdu.p_data = pApdu->data;
+    ESESTATUS eseStat = LSC_Transceive(&cmdApdu, &rspApdu);
+    recvlen = rspApdu.len;
+    if (eseStat != ESESTATUS_SUCCESS || recvlen < 2 ||
+        recvlen > (int32_t)sizeof(pTranscv_Info->sRecvData)) {
+      ALOGE("%s: Transceive failed for script record %u; status=0x%X", fn,
+            pApdu->record, eseStat);
+      phNxpEse_free(rspApdu.p_data);
+      LSC_LoadQueueReset(pQueue);
+      return LSCSTATUS_FAILED;
+    }
+    memcpy(RecvData, rspApdu.p_data, recvlen);
+    phNxpEse_free(rspApdu.p_data);
+
+    if ((RecvData[recvlen - 2] != 0x90) || (RecvData[recvlen - 1] != 0x00)) {
+      ALOGE("%s: %02X%02X from script record %u failed; SW=%02X%02X", fn,
+            pApdu->data[1], pApdu->data[3], pApdu->record,
+            RecvData[recvlen - 2], RecvData[recvlen - 1]);
+      LSC_LoadQueueReset(pQueue);
+      return Process_EseResponse(pTranscv_Info, recvlen, Os_info);
+    }
+  }
+  LSC_LoadQueueReset(pQueue);
+  if (recvlen == 0x02) {
+    /*Same form as the responses already given for the other blocks*/
+    recvlen = 0x03;
+    RecvData[0] = 0x00;
+    RecvData[1] = 0x90;
+    RecvData[2] = 0x00;
+  }
+  NXP_LOG_ESE_D("%s: exit", fn);
+  return Process_EseResponse(pTranscv_Info, recvlen, Os_info);
 }
 
 /*******************************************************************************
@@ -1369,310 +1315,284 @@ LSCSTATUS Write_Response_To_OutFile(Lsc_ImageInfo_t* image_info,
                                     Ls_TagType tType) {
   static const char fn[] = "Write_Response_to_OutFile";
 
-  ALOGD_IF(ese_debug_enabled, "%s: Enter", fn);
+  NXP_LOG_ESE_D("%s: Enter", fn);
   /*If the Response out file is NULL or Other than LS commands*/
   if ((image_info->bytes_wrote == 0x55) || (tType == LS_Default)) {
     return LSCSTATUS_SUCCESS;
   }
 
-  uint8_t tag43Len = 1;
-  /*Certificate TAG occupies 2 bytes*/
-  if (tType == LS_Cert) {
-    tag43Len = 2;
-  }
-
   /* |TAG|LEN|                      VAL                      |
    * |61 |XX |TAG|LEN|    VAL   |TAG|    LEN    |     VAL    |
    *         |43 |1/2|7F21/60/40|44 |apduRespLen|apduResponse|
    */
-  int32_t tag44Len = 0;
-  uint8_t ucTag44[3] = {0x00, 0x00, 0x00};
-  int32_t tag61Len = 0;
-  uint8_t tag43off = 0;
-  uint8_t tag44off = 0;
-  uint8_t tagLen = 0;
-  uint8_t tagBuffer[12] = {0x61, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-  if (recvlen < 0x80) {
-    tag44Len = 1;
-    ucTag44[0] = recvlen;
-    tag61Len = recvlen + 4 + tag43Len;
-
-    if (tag61Len & 0x80) {
-      tagBuffer[1] = 0x81;
-      tagBuffer[2] = tag61Len;
-      tag43off = 3;
-      tag44off = 5 + tag43Len;
-      tagLen = tag44off + 2;
-    } else {
-      tagBuffer[1] = tag61Len;
-      tag43off = 2;
-      tag44off = 4 + tag43Len;
-      tagLen = tag44off + 2;
-    }
-  } else if ((recvlen >= 0x80) && (recvlen <= 0xFF)) {
-    ucTag44[0] = 0x81;
-    ucTag44[1] = recvlen;
-    tag61Len = recvlen + 5 + tag43Len;
-    tag44Len = 2;
-
-    if ((tag61Len & 0xFF00) != 0) {
-      tagBuffer[1] = 0x82;
-      tagBuffer[2] = (tag61Len & 0xFF00) >> 8;
-      tagBuffer[3] = (tag61Len & 0xFF);
-      tag43off = 4;
-      tag44off = 6 + tag43Len;
-      tagLen = tag44off + 3;
-    } else {
-      tagBuffer[1] = 0x81;
-      tagBuffer[2] = (tag61Len & 0xFF);
-      tag43off = 3;
-      tag44off = 5 + tag43Len;
-      tagLen = tag44off + 3;
-    }
-  } else if ((recvlen > 0xFF) && (recvlen <= 0xFFFF)) {
-    ucTag44[0] = 0x82;
-    ucTag44[1] = (recvlen & 0xFF00) >> 8;
-    ucTag44[2] = (recvlen & 0xFF);
-    tag44Len = 3;
-
-    tag61Len = recvlen + 6 + tag43Len;
-
-    if ((tag61Len & 0xFF00) != 0) {
-      tagBuffer[1] = 0x82;
-      tagBuffer[2] = (tag61Len & 0xFF00) >> 8;
-      tagBuffer[3] = (tag61Len & 0xFF);
-      tag43off = 4;
-      tag44off = 6 + tag43Len;
-      tagLen = tag44off + 4;
-    }
-  }
-  tagBuffer[tag43off] = 0x43;
-  tagBuffer[tag43off + 1] = tag43Len;
-  tagBuffer[tag44off] = 0x44;
-  memcpy(&tagBuffer[tag44off + 1], &ucTag44[0], tag44Len);
-
+  uint32_t tag43 = 0;
   if (tType == LS_Cert) {
-    tagBuffer[tag43off + 2] = 0x7F;
-    tagBuffer[tag43off + 3] = 0x21;
+    tag43 = TAG_CERTIFICATE;
   } else if (tType == LS_Sign) {
-    tagBuffer[tag43off + 2] = 0x60;
+    tag43 = TAG_JSBL_HDR_ID;
   } else if (tType == LS_Comm) {
-    tagBuffer[tag43off + 2] = 0x40;
+    tag43 = TAG_LSC_CMD_ID;
   } else {
     /*Do nothing*/
   }
-
-  uint8_t tempLen = 0;
-  LSCSTATUS wStatus = LSCSTATUS_FAILED;
-  int32_t status = 0;
-  while (tempLen < tagLen) {
-    status = fprintf(image_info->fResp, "%02X", tagBuffer[tempLen++]);
-    if (status != 2) {
-      ALOGE("%s: Invalid Response during fprintf; status=0x%x", fn, (status));
-      wStatus = LSCSTATUS_FAILED;
-      break;
-    }
-  }
-  /*Updating the response data into out script*/
-  int32_t respLen = 0;
-  while (respLen < recvlen) {
-    status = fprintf(image_info->fResp, "%02X", RecvData[respLen++]);
-    if (status != 2) {
-      ALOGE("%s: Invalid Response during fprintf; status=0x%x", fn, (status));
-      wStatus = LSCSTATUS_FAILED;
-      break;
-    }
-  }
-  if (status == 2) {
-    fprintf(image_info->fResp, "%s\n", "");
-    ALOGD_IF(ese_debug_enabled,
-             "%s: SUCCESS Response written to script out file", fn);
-    wStatus = LSCSTATUS_SUCCESS;
+  /*Certificate TAG occupies 2 bytes*/
+  uint8_t tag43Len = (tag43 > 0xFF) ? 2 : 1;
+  uint8_t tag44Buffer[8];
+  size_t tag44Len = phNxpEseBerTlv_PutHeader(0x44, recvlen, tag44Buffer);
+  uint8_t tagBuffer[16];
+  size_t tagLen = phNxpEseBerTlv_PutHeader(
+      0x61, 2 + tag43Len + tag44Len + recvlen, tagBuffer);
+  tagLen += phNxpEseBerTlv_PutHeader(0x43, tag43Len, &tagBuffer[tagLen]);
+  if (tag43Len == 2) tagBuffer[tagLen++] = tag43 >> 8;
+  tagBuffer[tagLen++] = tag43;
+  memcpy(&tagBuffer[tagLen], tag44Buffer, tag44Len);
+  tagLen += tag44Len;
+
+  LSCSTATUS wStatus = LSC_RespAppend(&image_info->resp, tagBuffer, tagLen,
+                                     RecvData, recvlen);
+  if (wStatus == LSCSTATUS_SUCCESS) {
+    NXP_LOG_ESE_D("%s: SUCCESS Response written to script out file", fn);
+  } else {
+    ALOGE("%s: Invalid Response during write: %s", fn, strerror(errno));
   }
-  fflush(image_info->fResp);
   return wStatus;
 }
 
 /*******************************************************************************
 **
-** Function:        Check_Certificate_Tag
+** Function:        LSC_RespOpen
 **
-** Description:     Check certificate Tag presence in script
-**                  by 7F21 .
+** Description:     Opens the response out file for appending records
 **
-** Returns:         Success if Tag found
+** Returns:         Success if OK
 **
 *******************************************************************************/
-LSCSTATUS Check_Certificate_Tag(uint8_t* read_buf, uint16_t* offset1) {
-  static const char fn[] = "Check_Certificate_Tag";
-  uint16_t offset = *offset1;
-
-  if (((read_buf[offset] << 8 | read_buf[offset + 1]) == TAG_CERTIFICATE)) {
-    ALOGD_IF(ese_debug_enabled, "%s: TAGID: TAG_CERTIFICATE", fn);
-    int32_t wLen;
-    offset = offset + 2;
-    uint16_t len_byte = Numof_lengthbytes(&read_buf[offset], &wLen);
-    offset = offset + len_byte;
-    *offset1 = offset;
-    if (wLen <= MAX_CERT_LEN) return LSCSTATUS_SUCCESS;
-  }
-  return LSCSTATUS_FAILED;
+LSCSTATUS LSC_RespOpen(Lsc_RespFile_t* pResp, const char* path) {
+  pResp->pBuf = NULL;
+  pResp->bufLen = 0;
+  pResp->len = 0;
+  pResp->pHashCtx = EVP_MD_CTX_new();
+  pResp->fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+  if ((pResp->fd < 0) || (pResp->pHashCtx == NULL) ||
+      (EVP_DigestInit_ex(pResp->pHashCtx, EVP_sha1(), NULL) != 1)) {
+    LSC_RespClose(pResp);
+    return LSCSTATUS_FAILED;
+  }
+  return LSCSTATUS_SUCCESS;
 }
 
 /*******************************************************************************
 **
-** Function:        Check_SerialNo_Tag
+** Function:        LSC_RespRewind
 **
-** Description:     Check Serial number Tag presence in script
-**                  by 0x93 .
+** Description:     Rehashes the first len bytes of the out file, checks them
+**                  against pHash and truncates the file after them
 **
-** Returns:         Success if Tag found
+** Returns:         Success if OK, failed if the file does not match
 **
 *******************************************************************************/
-LSCSTATUS Check_SerialNo_Tag(uint8_t* read_buf, uint16_t* offset1) {
-  static const char fn[] = "Check_SerialNo_Tag";
-  uint16_t offset = *offset1;
-
-  if (read_buf[offset] == TAG_SERIAL_NO) {
-    ALOGD_IF(ese_debug_enabled, "%s: TAGID: TAG_SERIAL_NO", fn);
-    uint8_t serNoLen = read_buf[offset + 1];
-    offset = offset + serNoLen + 2;
-    *offset1 = offset;
-    ALOGD_IF(ese_debug_enabled, "%s: TAG_LSROOT_ENTITY is %x", fn,
-             read_buf[offset]);
-    return LSCSTATUS_SUCCESS;
-  }
-  return LSCSTATUS_FAILED;
+LSCSTATUS LSC_RespRewind(Lsc_RespFile_t* pResp, uint64_t len,
+                         const uint8_t* pHash) {
+  if (EVP_DigestInit_ex(pResp->pHashCtx, EVP_sha1(), NULL) != 1)
+    return LSCSTATUS_FAILED;
+  uint8_t chunk[4096];
+  uint64_t done = 0;
+  while (done < len) {
+    size_t want = (len - done < sizeof(chunk)) ? (size_t)(len - done)
+                                               : sizeof(chunk);
+    ssize_t got = TEMP_FAILURE_RETRY(pread(pResp->fd, chunk, want, done));
+    if (got <= 0) return LSCSTATUS_FAILED;
+    EVP_DigestUpdate(pResp->pHashCtx, chunk, got);
+    done += got;
+  }
+  if (len > 0) {
+    EVP_MD_CTX* pCopy = EVP_MD_CTX_new();
+    uint8_t digest[LS_SCRIPT_HASH_LEN];
+    unsigned int md_len = 0;
+    bool match = (pCopy != NULL) &&
+                 (EVP_MD_CTX_copy_ex(pCopy, pResp->pHashCtx) == 1) &&
+                 (EVP_DigestFinal_ex(pCopy, digest, &md_len) == 1) &&
+                 (memcmp(digest, pHash, LS_SCRIPT_HASH_LEN) == 0);
+    EVP_MD_CTX_free(pCopy);
+    if (!match) return LSCSTATUS_FAILED;
+  }
+  if (ftruncate(pResp->fd, len) != 0) return LSCSTATUS_FAILED;
+  pResp->len = len;
+  return LSCSTATUS_SUCCESS;
 }
 
 /*******************************************************************************
 **
-** Function:        Check_LSRootID_Tag
+** Function:        LSC_RespEncodeHex
 **
-** Description:     Check LS root ID tag presence in script and compare with
-**                  select response root ID value.
+** Description:     Writes the upper case hex of len bytes at pData to pDst
 **
-** Returns:         Success if Tag found
+** Returns:         End of the text written
 **
 *******************************************************************************/
-LSCSTATUS Check_LSRootID_Tag(uint8_t* read_buf, uint16_t* offset1) {
-  static const char fn[] = "Check_LSRootID_Tag";
-  uint16_t offset = *offset1;
-
-  if (read_buf[offset] == TAG_LSRE_ID) {
-    ALOGD_IF(ese_debug_enabled, "%s: TAGID: TAG_LSROOT_ENTITY", fn);
-    if (gsTag42Arr[0] == read_buf[offset + 1]) {
-      uint8_t tag42Len = read_buf[offset + 1];
-      offset = offset + 2;
-      if (!memcmp(&read_buf[offset], &gsTag42Arr[1], gsTag42Arr[0])) {
-        ALOGD_IF(ese_debug_enabled, "%s : TAG 42 verified", fn);
-        offset = offset + tag42Len;
-        *offset1 = offset;
-        return LSCSTATUS_SUCCESS;
-      }
-    }
+static char* LSC_RespEncodeHex(char* pDst, const uint8_t* pData, size_t len) {
+  static const char digits[] = "0123456789ABCDEF";
+  for (size_t i = 0; i < len; i++) {
+    *pDst++ = digits[pData[i] >> 4];
+    *pDst++ = digits[pData[i] & 0x0F];
   }
-  return LSCSTATUS_FAILED;
+  return pDst;
 }
 
 /*******************************************************************************
 **
-** Function:        Check_CertHoldID_Tag
+** Function:        LSC_RespAppend
 **
-** Description:     Check certificate holder ID tag presence in script.
+** Description:     Encodes the record into the reusable buffer, growing it
+**                  when needed, and appends it in a single write
 **
-** Returns:         Success if Tag found
+** Returns:         Success if the whole record was written
 **
 *******************************************************************************/
-LSCSTATUS Check_CertHoldID_Tag(uint8_t* read_buf, uint16_t* offset1) {
-  static const char fn[] = "Check_CertHoldID_Tag";
-  uint16_t offset = *offset1;
-
-  if ((read_buf[offset] << 8 | read_buf[offset + 1]) == TAG_CERTFHOLD_ID) {
-    uint8_t certfHoldIDLen = 0;
-    ALOGD_IF(ese_debug_enabled, "%s: TAGID: TAG_CERTFHOLD_ID", fn);
-    certfHoldIDLen = read_buf[offset + 2];
-    offset = offset + certfHoldIDLen + 3;
-    if (read_buf[offset] == TAG_KEY_USAGE) {
-      ALOGD_IF(ese_debug_enabled, "%s: TAGID: TAG_KEY_USAGE", fn);
-      uint8_t keyusgLen = read_buf[offset + 1];
-      offset = offset + keyusgLen + 2;
-      *offset1 = offset;
-      return LSCSTATUS_SUCCESS;
-    }
+LSCSTATUS LSC_RespAppend(Lsc_RespFile_t* pResp, const uint8_t* pHdr,
+                         size_t hdrLen, const uint8_t* pData, size_t dataLen) {
+  size_t textLen = 2 * (hdrLen + dataLen) + 1;
+  if (textLen > pResp->bufLen) {
+    phNxpEse_free(pResp->pBuf);
+    pResp->pBuf = (char*)phNxpEse_memalloc(textLen);
+    pResp->bufLen = (pResp->pBuf == NULL) ? 0 : textLen;
+    if (pResp->pBuf == NULL) return LSCSTATUS_FAILED;
+  }
+  char* pEnd = LSC_RespEncodeHex(pResp->pBuf, pHdr, hdrLen);
+  pEnd = LSC_RespEncodeHex(pEnd, pData, dataLen);
+  *pEnd = '\n';
+
+  EVP_DigestUpdate(pResp->pHashCtx, pResp->pBuf, textLen);
+  pResp->len += textLen;
+  const char* pText = pResp->pBuf;
+  while (textLen > 0) {
+    ssize_t written = write(pResp->fd, pText, textLen);
+    if (written < 0 && errno == EINTR) continue;
+    if (written <= 0) return LSCSTATUS_FAILED;
+    pText += written;
+    textLen -= written;
   }
-  return LSCSTATUS_FAILED;
+  return LSCSTATUS_SUCCESS;
 }
 
 /*******************************************************************************
 **
-** Function:        Check_Date_Tag
+** Function:        LSC_RespClose
 **
-** Description:     Check date tags presence in script.
+** Description:     Syncs the responses of the script, the one durability
+**                  point of the out file, and releases the writer
 **
-** Returns:         Success if Tag found
+** Returns:         None
 **
 *******************************************************************************/
-LSCSTATUS Check_Date_Tag(uint8_t* read_buf, uint16_t* offset1) {
-  static const char fn[] = "Check_Date_Tag";
-  LSCSTATUS status = LSCSTATUS_FAILED;
-  uint16_t offset = *offset1;
-
-  if ((read_buf[offset] << 8 | read_buf[offset + 1]) == TAG_EFF_DATE) {
-    uint8_t effDateLen = read_buf[offset + 2];
-    offset = offset + 3 + effDateLen;
-    ALOGD_IF(ese_debug_enabled, "%s: TAGID: TAG_EFF_DATE", fn);
-    if ((read_buf[offset] << 8 | read_buf[offset + 1]) == TAG_EXP_DATE) {
-      uint8_t effExpLen = read_buf[offset + 2];
-      offset = offset + 3 + effExpLen;
-      ALOGD_IF(ese_debug_enabled, "%s: TAGID: TAG_EXP_DATE", fn);
-      status = LSCSTATUS_SUCCESS;
-    } else if (read_buf[offset] == TAG_LSRE_SIGNID) {
-      status = LSCSTATUS_SUCCESS;
+void LSC_RespClose(Lsc_RespFile_t* pResp) {
+  if (pResp->fd >= 0) {
+    if (fsync(pResp->fd) != 0) {
+      ALOGE("%s: fsync failed: %s", __func__, strerror(errno));
     }
-  } else if ((read_buf[offset] << 8 | read_buf[offset + 1]) == TAG_EXP_DATE) {
-    uint8_t effExpLen = read_buf[offset + 2];
-    offset = offset + 3 + effExpLen;
-    ALOGD_IF(ese_debug_enabled, "%s: TAGID: TAG_EXP_DATE", fn);
-    status = LSCSTATUS_SUCCESS;
-  } else if (read_buf[offset] == TAG_LSRE_SIGNID) {
-    status = LSCSTATUS_SUCCESS;
-  } else {
-    /*LSCSTATUS_FAILED*/
-  }
-  *offset1 = offset;
-  return status;
+    close(pResp->fd);
+    pResp->fd = -1;
+  }
+  phNxpEse_free(pResp->pBuf);
+  pResp->pBuf = NULL;
+  pResp->bufLen = 0;
+  EVP_MD_CTX_free(pResp->pHashCtx);
+  pResp->pHashCtx = NULL;
 }
 
 /*******************************************************************************
 **
-** Function:        Check_45_Tag
+** Function:        LSC_CheckpointLoad
 **
-** Description:     Check 45 tags presence in script and compare the value
-**                  with select response tag 45 value
+** Description:     Reads the checkpoint file and checks that it belongs to
+**                  the script about to run
 **
-** Returns:         Success if Tag found
+** Returns:         Success if there is one for this script
 **
 *******************************************************************************/
-LSCSTATUS Check_45_Tag(uint8_t* read_buf, uint16_t* offset1,
-                       uint8_t* tag45Len) {
-  static const char fn[] = "Check_45_Tag";
-  uint16_t offset = *offset1;
-  if (read_buf[offset] == TAG_LSRE_SIGNID) {
-    *tag45Len = read_buf[offset + 1];
-    offset = offset + 2;
-    if (gsTag45Arr[0] == *tag45Len) {
-      if (!memcmp(&read_buf[offset], &gsTag45Arr[1], gsTag45Arr[0])) {
-        *offset1 = offset;
-        ALOGD_IF(ese_debug_enabled,
-                 "%s: LSC_Check_KeyIdentifier : TAG 45 verified", fn);
-        return LSCSTATUS_SUCCESS;
-      }
-    }
+LSCSTATUS LSC_CheckpointLoad(const uint8_t* pScriptHash,
+                             Lsc_Checkpoint_t* pCheckpoint) {
+  if (pScriptHash == NULL) return LSCSTATUS_FAILED;
+  int fd = open(LS_CHECKPOINT_PATH, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return LSCSTATUS_FAILED;
+  ssize_t len =
+      TEMP_FAILURE_RETRY(read(fd, pCheckpoint, sizeof(Lsc_Checkpoint_t)));
+  close(fd);
+  if ((len != sizeof(Lsc_Checkpoint_t)) ||
+      (memcmp(pCheckpoint->magic, LS_CHECKPOINT_MAGIC,
+              sizeof(LS_CHECKPOINT_MAGIC)) != 0) ||
+      (pCheckpoint->version != LS_CHECKPOINT_VERSION) ||
+      (memcmp(pCheckpoint->scriptHash, pScriptHash, LS_SCRIPT_HASH_LEN) !=
+       0)) {
+    /* Left by another script or damaged */
+    LSC_CheckpointClear();
+    return LSCSTATUS_FAILED;
   }
-  return LSCSTATUS_FAILED;
+  return LSCSTATUS_SUCCESS;
 }
 
+/*******************************************************************************
+**
+** Function:        LSC_CheckpointStore
+**
+** Description:     Syncs the responses written so far, then writes the
+**                  checkpoint through a temporary file, so that a checkpoint
+**                  on storage never covers responses that are not
+**
+** Returns:         None
+**
+*******************************************************************************/
+void LSC_CheckpointStore(Lsc_ImageInfo_t* Os_info, uint32_t record) {
+  static const char tmpPath[] = LS_CHECKPOINT_PATH ".tmp";
+  if (Os_info->pScriptHash == NULL) return;
+
+  Lsc_Checkpoint_t checkpoint;
+  memset(&checkpoint, 0x00, sizeof(checkpoint));
+  memcpy(checkpoint.magic, LS_CHECKPOINT_MAGIC, sizeof(LS_CHECKPOINT_MAGIC));
+  checkpoint.version = LS_CHECKPOINT_VERSION;
+  checkpoint.record = record;
+  memcpy(checkpoint.scriptHash, Os_info->pScriptHash, LS_SCRIPT_HASH_LEN);
+  if (Os_info->bytes_wrote == 0xAA) {
+    Lsc_RespFile_t* pResp = &Os_info->resp;
+    EVP_MD_CTX* pCopy = EVP_MD_CTX_new();
+    unsigned int md_len = 0;
+    bool ok = (pCopy != NULL) &&
+              (EVP_MD_CTX_copy_ex(pCopy, pResp->pHashCtx) == 1) &&
+              (EVP_DigestFinal_ex(pCopy, checkpoint.respHash, &md_len) == 1) &&
+              (fsync(pResp->fd) == 0);
+    EVP_MD_CTX_free(pCopy);
+    if (!ok) return;
+    checkpoint.respLen = pResp->len;
+  }
+
+  int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    ALOGE("%s: cannot create %s: %s", __func__, tmpPath, strerror(errno));
+    return;
+  }
+  ssize_t len = TEMP_FAILURE_RETRY(write(fd, &checkpoint, sizeof(checkpoint)));
+  bool ok = (len == sizeof(checkpoint)) && (fsync(fd) == 0);
+  close(fd);
+  if (!ok || rename(tmpPath, LS_CHECKPOINT_PATH) != 0) {
+    ALOGE("%s: cannot store checkpoint: %s", __func__, strerror(errno));
+    unlink(tmpPath);
+    return;
+  }
+  NXP_LOG_ESE_D("%s: record %u, %llu response bytes", __func__, record,
+                (unsigned long long)checkpoint.respLen);
+}
+
+/*******************************************************************************
+**
+** Function:        LSC_CheckpointClear
+**
+** Description:     Removes the checkpoint file
+**
+** Returns:         None
+**
+*******************************************************************************/
+void LSC_CheckpointClear() { unlink(LS_CHECKPOINT_PATH); }
+
 /*******************************************************************************
 **
 ** Function:        Certificate_Verification
@@ -1685,132 +1605,47 @@ LSCSTATUS Check_45_Tag(uint8_t* read_buf, uint16_t* offset1,
 *******************************************************************************/
 LSCSTATUS Certificate_Verification(Lsc_ImageInfo_t* Os_info,
                                    Lsc_TranscieveInfo_t* pTranscv_Info,
-                                   uint8_t* read_buf, uint16_t* offset1,
-                                   uint8_t* tag45Len) {
+                                   const phNxpEseBerTlv_t* pCert,
+                                   const phNxpEseBerTlv_t* pTlv) {
   static const char fn[] = "Certificate_Verification";
+  const phNxpEseBerTlv_t* pSig = &pTlv[LS_CERT_SIGNATURE];
+  const phNxpEseBerTlv_t* pKey = &pTlv[LS_CERT_PUBLIC_KEY];
 
   pTranscv_Info->sSendData[0] = 0x80;
   pTranscv_Info->sSendData[1] = 0xA0;
   pTranscv_Info->sSendData[2] = 0x01;
   pTranscv_Info->sSendData[3] = 0x00;
 
-  int32_t wCertfLen = (read_buf[2] << 8 | read_buf[3]);
-  uint16_t offset = *offset1;
-  /*If the certificate is less than 255 bytes*/
-  if (wCertfLen <= 251) {
-    uint8_t tag7f49Off = 0;
-    uint8_t u7f49Len = 0;
-    uint8_t tag5f37Len = 0;
-    ALOGD_IF(ese_debug_enabled, "%s: Certificate is less than 255", fn);
-    offset = offset + *tag45Len;
-    ALOGD_IF(ese_debug_enabled, "%s: Before TAG_CCM_PERMISSION = %x", fn,
-             read_buf[offset]);
-    if (read_buf[offset] != TAG_CCM_PERMISSION) {
-      return LSCSTATUS_FAILED;
-    }
-    int32_t tag53Len = 0;
-    uint8_t len_byte = 0;
-    offset = offset + 1;
-    len_byte = Numof_lengthbytes(&read_buf[offset], &tag53Len);
-    offset = offset + tag53Len + len_byte;
-    ALOGD_IF(ese_debug_enabled, "%s: Verified TAG TAG_CCM_PERMISSION = 0x53",
-             fn);
-    if ((uint16_t)(read_buf[offset] << 8 | read_buf[offset + 1]) !=
-        TAG_SIG_RNS_COMP) {
-      return LSCSTATUS_FAILED;
-    }
-    tag7f49Off = offset;
-    u7f49Len = read_buf[offset + 2];
-    offset = offset + 3 + u7f49Len;
-    if (u7f49Len != 64) {
-      return LSCSTATUS_FAILED;
-    }
-    if ((uint16_t)(read_buf[offset] << 8 | read_buf[offset + 1]) != 0x7f49) {
-      return LSCSTATUS_FAILED;
-    }
-    tag5f37Len = read_buf[offset + 2];
-    if (read_buf[offset + 3] != 0x86 || (read_buf[offset + 4] != 65)) {
-      return LSCSTATUS_FAILED;
-    }
-    uint8_t tag_len_byte = Numof_lengthbytes(&read_buf[2], &wCertfLen);
-    pTranscv_Info->sSendData[4] = wCertfLen + 2 + tag_len_byte;
-    pTranscv_Info->sSendlength = wCertfLen + 7 + tag_len_byte;
-    memcpy(&(pTranscv_Info->sSendData[5]), &read_buf[0],
-           wCertfLen + 2 + tag_len_byte);
-
-    ALOGD_IF(ese_debug_enabled, "%s: start transceive for length %d", fn,
-             pTranscv_Info->sSendlength);
-    LSCSTATUS status = LSCSTATUS_FAILED;
-    status = LSC_SendtoLsc(Os_info, status, pTranscv_Info, LS_Cert);
-    if (status == LSCSTATUS_SUCCESS) {
-      ALOGD_IF(ese_debug_enabled, "%s: Certificate is verified", fn);
-    }
-    return status;
-  } else {
-    /*If the certificate is more than 255 bytes*/
-    uint8_t tag7f49Off = 0;
-    uint8_t u7f49Len = 0;
-    uint8_t tag5f37Len = 0;
-    ALOGD_IF(ese_debug_enabled, "%s: Certificate is greater than 255", fn);
-    offset = offset + *tag45Len;
-    ALOGD_IF(ese_debug_enabled, "%s: Before TAG_CCM_PERMISSION = %x", fn,
-             read_buf[offset]);
-    if (read_buf[offset] != TAG_CCM_PERMISSION) {
-      return LSCSTATUS_FAILED;
-    }
-    int32_t tag53Len = 0;
-    uint8_t len_byte = 0;
-    offset = offset + 1;
-    len_byte = Numof_lengthbytes(&read_buf[offset], &tag53Len);
-    offset = offset + tag53Len + len_byte;
-    ALOGD_IF(ese_debug_enabled, "%s: Verified TAG TAG_CCM_PERMISSION = 0x53",
-             fn);
-    if ((uint16_t)(read_buf[offset] << 8 | read_buf[offset + 1]) !=
-        TAG_SIG_RNS_COMP) {
-      return LSCSTATUS_FAILED;
-    }
-    tag7f49Off = offset;
-    u7f49Len = read_buf[offset + 2];
-    offset = offset + 3 + u7f49Len;
-    if (u7f49Len != 64) {
-      return LSCSTATUS_FAILED;
-    }
-    if ((uint16_t)(read_buf[offset] << 8 | read_buf[offset + 1]) != 0x7f49) {
-      return LSCSTATUS_FAILED;
-    }
-    tag5f37Len = read_buf[offset + 2];
-    if (read_buf[offset + 3] != 0x86 || (read_buf[offset + 4] != 65)) {
-      return LSCSTATUS_FAILED;
-    }
-    pTranscv_Info->sSendData[4] = tag7f49Off;
-    memcpy(&(pTranscv_Info->sSendData[5]), &read_buf[0], tag7f49Off);
-    pTranscv_Info->sSendlength = tag7f49Off + 5;
-    ALOGD_IF(ese_debug_enabled, "%s: start transceive for length %d", fn,
-             pTranscv_Info->sSendlength);
-
-    LSCSTATUS status = LSCSTATUS_FAILED;
-    status = LSC_SendtoLsc(Os_info, status, pTranscv_Info, LS_Default);
-    if (status != LSCSTATUS_SUCCESS) {
-      uint8_t* RecvData = pTranscv_Info->sRecvData;
-      Write_Response_To_OutFile(Os_info, RecvData, gsResp_len, LS_Cert);
-      return status;
-    }
+  /*The certificate up to the signature goes first, then the signature and
+   * the public key*/
+  size_t headLen = pSig->pStart - pCert->pStart;
+  pTranscv_Info->sSendData[4] = headLen;
+  memcpy(&(pTranscv_Info->sSendData[5]), pCert->pStart, headLen);
+  pTranscv_Info->sSendlength = headLen + 5;
+  NXP_LOG_ESE_D("%s: start transceive for length %d", fn,
+                pTranscv_Info->sSendlength);
 
-    pTranscv_Info->sSendData[2] = 0x00;
-    pTranscv_Info->sSendData[4] = u7f49Len + tag5f37Len + 6;
-    memcpy(&(pTranscv_Info->sSendData[5]), &read_buf[tag7f49Off],
-           u7f49Len + tag5f37Len + 6);
-    pTranscv_Info->sSendlength = u7f49Len + tag5f37Len + 11;
-    ALOGD_IF(ese_debug_enabled, "%s: start transceive for length %d", fn,
-             pTranscv_Info->sSendlength);
-
-    status = LSC_SendtoLsc(Os_info, status, pTranscv_Info, LS_Cert);
-    if (status == LSCSTATUS_SUCCESS) {
-      ALOGD_IF(ese_debug_enabled, "Certificate is verified");
-    }
+  LSCSTATUS status = LSCSTATUS_FAILED;
+  status = LSC_SendtoLsc(Os_info, status, pTranscv_Info, LS_Default);
+  if (status != LSCSTATUS_SUCCESS) {
+    uint8_t* RecvData = pTranscv_Info->sRecvData;
+    Write_Response_To_OutFile(Os_info, RecvData, gsResp_len, LS_Cert);
     return status;
   }
-  return LSCSTATUS_FAILED;
+
+  size_t tailLen = (pKey->pValue + pKey->len) - pSig->pStart;
+  pTranscv_Info->sSendData[2] = 0x00;
+  pTranscv_Info->sSendData[4] = tailLen;
+  memcpy(&(pTranscv_Info->sSendData[5]), pSig->pStart, tailLen);
+  pTranscv_Info->sSendlength = tailLen + 5;
+  NXP_LOG_ESE_D("%s: start transceive for length %d", fn,
+                pTranscv_Info->sSendlength);
+
+  status = LSC_SendtoLsc(Os_info, status, pTranscv_Info, LS_Cert);
+  if (status == LSCSTATUS_SUCCESS) {
+    NXP_LOG_ESE_D("Certificate is verified");
+  }
+  return status;
 }
 
 /*******************************************************************************
@@ -1825,37 +1660,51 @@ LSCSTATUS Certificate_Verification(Lsc_ImageInfo_t* Os_info,
 *******************************************************************************/
 LSCSTATUS Check_Complete_7F21_Tag(Lsc_ImageInfo_t* Os_info,
                                   Lsc_TranscieveInfo_t* pTranscv_Info,
-                                  uint8_t* read_buf, uint16_t* offset) {
+                                  const uint8_t* read_buf, int32_t len) {
   static const char fn[] = "Check_Complete_7F21_Tag";
+  phNxpEseBerTlvCursor_t cursor;
+  phNxpEseBerTlv_t cert;
 
-  if (LSCSTATUS_SUCCESS != Check_Certificate_Tag(read_buf, offset)) {
-    ALOGE("%s: FAILED in Check_Certificate_Tag", fn);
+  phNxpEseBerTlv_Init(&cursor, read_buf, len);
+  if (!phNxpEseBerTlv_Next(&cursor, &cert) || cert.tag != TAG_CERTIFICATE ||
+      cert.len > MAX_CERT_LEN) {
+    ALOGE("%s: FAILED in certificate tag", fn);
     return LSCSTATUS_FAILED;
   }
-  if (LSCSTATUS_SUCCESS != Check_SerialNo_Tag(read_buf, offset)) {
-    ALOGE("%s: FAILED in Check_SerialNo_Tag", fn);
+  NXP_LOG_ESE_D("%s: TAGID: TAG_CERTIFICATE", fn);
+
+  phNxpEseBerTlv_t tlv[LS_CERT_COUNT];
+  phNxpEseBerTlv_Enter(&cert, &cursor);
+  if (!phNxpEseBerTlv_Match(&cursor, gsCertSchema, LS_CERT_COUNT, tlv)) {
+    ALOGE("%s: FAILED in certificate layout", fn);
     return LSCSTATUS_FAILED;
   }
-  if (LSCSTATUS_SUCCESS != Check_LSRootID_Tag(read_buf, offset)) {
-    ALOGE("%s: FAILED in Check_LSRootID_Tag", fn);
+  const phNxpEseBerTlv_t* pRootId = &tlv[LS_CERT_ROOT_ID];
+  if (pRootId->len != gsTag42Arr[0] ||
+      memcmp(pRootId->pValue, &gsTag42Arr[1], pRootId->len)) {
+    ALOGE("%s: FAILED in TAG 42", fn);
     return LSCSTATUS_FAILED;
   }
-  if (LSCSTATUS_SUCCESS != Check_CertHoldID_Tag(read_buf, offset)) {
-    ALOGE("%s: FAILED in Check_CertHoldID_Tag", fn);
+  const phNxpEseBerTlv_t* pSignId = &tlv[LS_CERT_SIGN_ID];
+  if (pSignId->len != gsTag45Arr[0] ||
+      memcmp(pSignId->pValue, &gsTag45Arr[1], pSignId->len)) {
+    ALOGE("%s: FAILED in TAG 45", fn);
     return LSCSTATUS_FAILED;
   }
-  if (LSCSTATUS_SUCCESS != Check_Date_Tag(read_buf, offset)) {
-    ALOGE("%s: FAILED in Check_CertHoldID_Tag", fn);
+  const phNxpEseBerTlv_t* pKey = &tlv[LS_CERT_PUBLIC_KEY];
+  if (pKey->pValue[0] != 0x86 || pKey->pValue[1] != 65) {
+    ALOGE("%s: FAILED in TAG 7F49", fn);
     return LSCSTATUS_FAILED;
   }
-  uint8_t tag45Len = 0;
-  if (LSCSTATUS_SUCCESS != Check_45_Tag(read_buf, offset, &tag45Len)) {
-    ALOGE("%s: FAILED in Check_CertHoldID_Tag", fn);
-    return LSCSTATUS_FAILED;
+  NXP_LOG_ESE_D("%s: TAG 42 and TAG 45 verified", fn);
+
+  uint64_t certStart = phNxpEse_StatsNowUs();
+  LSCSTATUS status =
+      Certificate_Verification(Os_info, pTranscv_Info, &cert, tlv);
+  if (gspTiming != NULL) {
+    gspTiming->certUs += phNxpEse_StatsNowUs() - certStart;
   }
-  if (LSCSTATUS_SUCCESS != Certificate_Verification(Os_info, pTranscv_Info,
-                                                    read_buf, offset,
-                                                    &tag45Len)) {
+  if (status != LSCSTATUS_SUCCESS) {
     ALOGE("%s: FAILED in Certificate_Verification", fn);
     return LSCSTATUS_FAILED;
   }
@@ -1874,21 +1723,26 @@ LSCSTATUS Check_Complete_7F21_Tag(Lsc_ImageInfo_t* Os_info,
 bool LSC_UpdateExeStatus(uint16_t status) {
   static const char fn[] = "LSC_UpdateExeStatus";
 
-  ALOGD_IF(ese_debug_enabled, "%s: enter", fn);
+  NXP_LOG_ESE_D("%s: enter", fn);
 
-  FILE* fLsStatus = fopen(LS_STATUS_PATH, "w+");
-  if (fLsStatus == NULL) {
+  /* Only the final status of a script is a checkpoint worth a sync */
+  char text[5];
+  snprintf(text, sizeof(text), "%04x", status);
+  int fd = open(LS_STATUS_PATH, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (fd < 0) {
     ALOGE("%s: Error opening LS Status file for backup: %s", fn,
           strerror(errno));
     return false;
   }
-  if ((fprintf(fLsStatus, "%04x", status)) != 4) {
+  ssize_t written = TEMP_FAILURE_RETRY(write(fd, text, 4));
+  if ((written != 4) ||
+      ((status == LS_SUCCESS_STATUS) && (fsync(fd) != 0))) {
     ALOGE("%s: Error updating LS Status backup: %s", fn, strerror(errno));
-    fclose(fLsStatus);
+    close(fd);
     return false;
   }
-  fclose(fLsStatus);
-  ALOGD_IF(ese_debug_enabled, "%s: exit", fn);
+  close(fd);
+  NXP_LOG_ESE_D("%s: exit", fn);
   return true;
 }
 
@@ -1920,8 +1774,7 @@ LSCSTATUS Get_LsStatus(uint8_t* pStatus) {
       return LSCSTATUS_FAILED;
     }
   }
-  ALOGD_IF(ese_debug_enabled, "%s: LS Status 0x%X 0x%X", fn, lsStatus[0],
-           lsStatus[1]);
+  NXP_LOG_ESE_D("%s: LS Status 0x%X 0x%X", fn, lsStatus[0], lsStatus[1]);
   memcpy(pStatus, lsStatus, 2);
   fclose(fLsStatus);
   return LSCSTATUS_SUCCESS;
@@ -1931,42 +1784,47 @@ LSCSTATUS Get_LsStatus(uint8_t* pStatus) {
 **
 ** Function:        LSC_CloseAllLogicalChannels
 **
-** Description:     Close all opened logical channels
+** Description:     Close the logical channels the LS client opened, all but
+**                  the one the download started on. Channels of other
+**                  clients of the eSE are left alone.
 **
 ** Returns:         SUCCESS/FAILURE
 **
 *******************************************************************************/
 LSCSTATUS LSC_CloseAllLogicalChannels(Lsc_ImageInfo_t* Os_info) {
   ESESTATUS status = ESESTATUS_FAILED;
-  LSCSTATUS lsStatus = LSCSTATUS_FAILED;
+  LSCSTATUS lsStatus = LSCSTATUS_SUCCESS;
   phNxpEse_data cmdApdu;
   phNxpEse_data rspApdu;
 
-  ALOGD_IF(ese_debug_enabled, "%s: Enter", __func__);
-  for (uint8_t channelNumber = 0x01; channelNumber < 0x04; channelNumber++) {
-    if (channelNumber == Os_info->initChannelNum) continue;
+  NXP_LOG_ESE_D("%s: Enter", __func__);
+  for (uint8_t cnt = 0; cnt < Os_info->channel_cnt; cnt++) {
+    uint8_t channelNumber = Os_info->Channel_Info[cnt].channel_id;
+    if (!Os_info->Channel_Info[cnt].isOpend ||
+        (channelNumber == Os_info->initChannelNum)) {
+      continue;
+    }
+    status = ESESTATUS_FAILED;
     phNxpEse_memset(&cmdApdu, 0x00, sizeof(phNxpEse_data));
     phNxpEse_memset(&rspApdu, 0x00, sizeof(phNxpEse_data));
     cmdApdu.p_data = (uint8_t*)phNxpEse_memalloc(5 * sizeof(uint8_t));
     if (cmdApdu.p_data != NULL) {
       uint8_t xx = 0;
 
-      cmdApdu.p_data[xx++] = channelNumber;
+      cmdApdu.p_data[xx++] = phNxpEse_ChannelCla(0x00, channelNumber);  // CLA
       cmdApdu.p_data[xx++] = 0x70;           // INS
       cmdApdu.p_data[xx++] = 0x80;           // P1
       cmdApdu.p_data[xx++] = channelNumber;  // P2
       cmdApdu.p_data[xx++] = 0x00;           // Lc
       cmdApdu.len = xx;
 
-      status = phNxpEse_Transceive(&cmdApdu, &rspApdu);
+      status = LSC_Transceive(&cmdApdu, &rspApdu);
     }
     if (status != ESESTATUS_SUCCESS) {
       lsStatus = LSCSTATUS_FAILED;
-    } else if ((rspApdu.p_data[rspApdu.len - 2] == 0x90) &&
-               (rspApdu.p_data[rspApdu.len - 1] == 0x00)) {
-      lsStatus = LSCSTATUS_SUCCESS;
     } else {
-      lsStatus = LSCSTATUS_FAILED;
+      /*LSC_CloseChannel does not close it again*/
+      Os_info->Channel_Info[cnt].isOpend = false;
     }
 
     phNxpEse_free(cmdApdu.p_data);
@@ -1979,87 +1837,138 @@ LSCSTATUS LSC_CloseAllLogicalChannels(Lsc_ImageInfo_t* Os_info) {
 **
 ** Function:        LSC_SelectLsHash
 **
-** Description:     Selects LS Hash applet
+** Description:     Opens a logical channel and selects the LS hash applet on
+**                  it. HAL clients may hold the basic channel while the
+**                  download checks the slots, so it is left alone.
 **
-** Returns:         SUCCESS/FAILURE
+** Returns:         SUCCESS with the channel in pChannel, FAILURE if no
+**                  channel could be opened or the applet selected
 **
 *******************************************************************************/
-LSCSTATUS LSC_SelectLsHash() {
+LSCSTATUS LSC_SelectLsHash(uint8_t* pChannel) {
   phNxpEse_data cmdApdu;
   phNxpEse_data rspApdu;
   LSCSTATUS lsStatus = LSCSTATUS_FAILED;
-  ALOGD_IF(ese_debug_enabled, "%s: Enter ", __func__);
+  NXP_LOG_ESE_D("%s: Enter ", __func__);
   phNxpEse_memset(&cmdApdu, 0x00, sizeof(phNxpEse_data));
   phNxpEse_memset(&rspApdu, 0x00, sizeof(phNxpEse_data));
 
-  cmdApdu.len = (int32_t)(sizeof(SelectLscSlotHash));
+  cmdApdu.len = (int32_t)sizeof(OpenChannel);
   cmdApdu.p_data = (uint8_t*)phNxpEse_memalloc(cmdApdu.len * sizeof(uint8_t));
-  memcpy(cmdApdu.p_data, SelectLscSlotHash, sizeof(SelectLscSlotHash));
+  if (cmdApdu.p_data == NULL) return LSCSTATUS_FAILED;
+  memcpy(cmdApdu.p_data, OpenChannel, cmdApdu.len);
 
-  ESESTATUS eseStat = phNxpEse_Transceive(&cmdApdu, &rspApdu);
+  ESESTATUS eseStat = LSC_Transceive(&cmdApdu, &rspApdu);
+  phNxpEse_free(cmdApdu.p_data);
+  if ((eseStat != ESESTATUS_SUCCESS) || (rspApdu.len != 3) ||
+      (rspApdu.p_data[1] != 0x90) || (rspApdu.p_data[2] != 0x00)) {
+    ALOGE("%s: no logical channel for the LS hash applet", __func__);
+    phNxpEse_free(rspApdu.p_data);
+    return LSCSTATUS_FAILED;
+  }
+  *pChannel = rspApdu.p_data[0];
+  phNxpEse_free(rspApdu.p_data);
 
-  if ((eseStat != ESESTATUS_SUCCESS) ||
-      ((rspApdu.p_data[rspApdu.len - 2] != 0x90) &&
-       (rspApdu.p_data[rspApdu.len - 1] != 0x00))) {
-    lsStatus = LSCSTATUS_FAILED;
-  } else {
-    lsStatus = LSCSTATUS_SUCCESS;
+  phNxpEse_memset(&rspApdu, 0x00, sizeof(phNxpEse_data));
+  cmdApdu.len = (int32_t)(sizeof(SelectLscSlotHash));
+  cmdApdu.p_data = (uint8_t*)phNxpEse_memalloc(cmdApdu.len * sizeof(uint8_t));
+  if (cmdApdu.p_data != NULL) {
+    memcpy(cmdApdu.p_data, SelectLscSlotHash, sizeof(SelectLscSlotHash));
+    cmdApdu.p_data[0] = phNxpEse_ChannelCla(SelectLscSlotHash[0], *pChannel);
+    eseStat = LSC_Transceive(&cmdApdu, &rspApdu);
+    if ((eseStat == ESESTATUS_SUCCESS) && (rspApdu.len >= 2) &&
+        (rspApdu.p_data[rspApdu.len - 2] == 0x90) &&
+        (rspApdu.p_data[rspApdu.len - 1] == 0x00)) {
+      lsStatus = LSCSTATUS_SUCCESS;
+    }
   }
 
   phNxpEse_free(cmdApdu.p_data);
   phNxpEse_free(rspApdu.p_data);
+  if (lsStatus != LSCSTATUS_SUCCESS) LSC_CloseLsHash(*pChannel);
   return lsStatus;
 }
+
 /*******************************************************************************
 **
-** Function:        LSC_ReadLsHash
+** Function:        LSC_CloseLsHash
 **
-** Description:     Read the LS SHA1 for the intended slot
+** Description:     Closes the channel LSC_SelectLsHash opened
+**
+** Returns:         None
+**
+*******************************************************************************/
+void LSC_CloseLsHash(uint8_t channel) {
+  phNxpEse_data cmdApdu;
+  phNxpEse_data rspApdu;
+  phNxpEse_memset(&cmdApdu, 0x00, sizeof(phNxpEse_data));
+  phNxpEse_memset(&rspApdu, 0x00, sizeof(phNxpEse_data));
+  cmdApdu.p_data = (uint8_t*)phNxpEse_memalloc(5 * sizeof(uint8_t));
+  if (cmdApdu.p_data != NULL) {
+    uint8_t xx = 0;
+    cmdApdu.p_data[xx++] = phNxpEse_ChannelCla(0x00, channel);  // CLA
+    cmdApdu.p_data[xx++] = 0x70;                                // INS
+    cmdApdu.p_data[xx++] = 0x80;                                // P1
+    cmdApdu.p_data[xx++] = channel;                             // P2
+    cmdApdu.p_data[xx++] = 0x00;                                // Lc
+    cmdApdu.len = xx;
+    if (LSC_Transceive(&cmdApdu, &rspApdu) != ESESTATUS_SUCCESS) {
+      ALOGE("%s: closing channel %d failed", __func__, channel);
+    }
+  }
+  phNxpEse_free(cmdApdu.p_data);
+  phNxpEse_free(rspApdu.p_data);
+}
+
+/*******************************************************************************
+**
+** Function:        LSC_ReadLsHashSlot
+**
+** Description:     Reads the LS SHA1 of one slot from the LS hash applet
+**                  selected on channel
 **
 ** Returns:         SUCCESS/FAILURE
 **
 *******************************************************************************/
-LSCSTATUS LSC_ReadLsHash(uint8_t* hash, uint16_t* readHashLen, uint8_t slotId) {
+static LSCSTATUS LSC_ReadLsHashSlot(uint8_t channel, uint8_t* hash,
+                                    uint16_t* readHashLen, uint8_t slotId) {
   phNxpEse_data cmdApdu;
   phNxpEse_data rspApdu;
   LSCSTATUS lsStatus = LSCSTATUS_FAILED;
 
-  lsStatus = LSC_SelectLsHash();
-  if (lsStatus != LSCSTATUS_SUCCESS) {
-    return lsStatus;
-  }
-
   phNxpEse_memset(&cmdApdu, 0x00, sizeof(phNxpEse_data));
   phNxpEse_memset(&rspApdu, 0x00, sizeof(phNxpEse_data));
   cmdApdu.p_data = (uint8_t*)phNxpEse_memalloc(5 * sizeof(uint8_t));
 
   if (cmdApdu.p_data != NULL) {
     uint8_t xx = 0;
-    cmdApdu.p_data[xx++] = 0x80;    // CLA
-    cmdApdu.p_data[xx++] = 0x02;    // INS
-    cmdApdu.p_data[xx++] = slotId;  // P1
-    cmdApdu.p_data[xx++] = 0x00;    // P2
+    cmdApdu.p_data[xx++] = phNxpEse_ChannelCla(0x80, channel);  // CLA
+    cmdApdu.p_data[xx++] = 0x02;                                // INS
+    cmdApdu.p_data[xx++] = slotId;                              // P1
+    cmdApdu.p_data[xx++] = 0x00;                                // P2
     cmdApdu.len = xx;
 
-    ESESTATUS eseStat = phNxpEse_Transceive(&cmdApdu, &rspApdu);
+    ESESTATUS eseStat = LSC_Transceive(&cmdApdu, &rspApdu);
 
-    if ((eseStat == ESESTATUS_SUCCESS) &&
-        ((rspApdu.p_data[rspApdu.len - 2] == 0x90) &&
-         (rspApdu.p_data[rspApdu.len - 1] == 0x00))) {
-      ALOGD_IF(ese_debug_enabled, "%s: rspApdu.len : %u", __func__,
-               rspApdu.len);
+    if ((eseStat != ESESTATUS_SUCCESS) || (rspApdu.len < 2)) {
+      lsStatus = LSCSTATUS_FAILED;
+    } else if ((rspApdu.p_data[rspApdu.len - 2] == 0x90) &&
+               (rspApdu.p_data[rspApdu.len - 1] == 0x00)) {
+      NXP_LOG_ESE_D("%s: rspApdu.len : %u", __func__, rspApdu.len);
       *readHashLen = rspApdu.len - 2;
-      memcpy(hash, rspApdu.p_data, rspApdu.len);
+      if (*readHashLen > LS_HASH_SLOT_MAX_LEN)
+        *readHashLen = LS_HASH_SLOT_MAX_LEN;
+      memcpy(hash, rspApdu.p_data, *readHashLen);
 
       lsStatus = LSCSTATUS_SUCCESS;
     } else {
       if ((rspApdu.p_data[rspApdu.len - 2] == 0x6A) &&
           (rspApdu.p_data[rspApdu.len - 1] == 0x86)) {
-        ALOGD_IF(ese_debug_enabled, "%s: slot id is invalid", __func__);
+        NXP_LOG_ESE_D("%s: slot id is invalid", __func__);
         lsStatus = LSCSTATUS_HASH_SLOT_INVALID;
       } else if ((rspApdu.p_data[rspApdu.len - 2] == 0x6A) &&
                  (rspApdu.p_data[rspApdu.len - 1] == 0x83)) {
-        ALOGD_IF(ese_debug_enabled, "%s: slot is empty", __func__);
+        NXP_LOG_ESE_D("%s: slot is empty", __func__);
         lsStatus = LSCSTATUS_HASH_SLOT_EMPTY;
       } else {
         lsStatus = LSCSTATUS_FAILED;
@@ -2071,6 +1980,63 @@ LSCSTATUS LSC_ReadLsHash(uint8_t* hash, uint16_t* readHashLen, uint8_t slotId) {
   return lsStatus;
 }
 
+/*******************************************************************************
+**
+** Function:        LSC_ReadLsHash
+**
+** Description:     Read the LS SHA1 for the intended slot
+**
+** Returns:         SUCCESS/FAILURE
+**
+*******************************************************************************/
+LSCSTATUS LSC_ReadLsHash(uint8_t* hash, uint16_t* readHashLen, uint8_t slotId) {
+  uint8_t channel;
+  LSCSTATUS lsStatus = LSC_SelectLsHash(&channel);
+  if (lsStatus != LSCSTATUS_SUCCESS) {
+    return lsStatus;
+  }
+  lsStatus = LSC_ReadLsHashSlot(channel, hash, readHashLen, slotId);
+  LSC_CloseLsHash(channel);
+  return lsStatus;
+}
+
+/*******************************************************************************
+**
+** Function:        LSC_ReadAllLsHashes
+**
+** Description:     Reads the LS SHA1 of slots 1 to count in one selection of
+**                  the LS hash applet
+**
+** Returns:         SUCCESS/FAILURE
+**
+*******************************************************************************/
+LSCSTATUS LSC_ReadAllLsHashes(Lsc_SlotHash_t* pSlots, uint8_t count) {
+  NXP_LOG_ESE_D("%s: Enter ", __func__);
+  for (uint8_t i = 0; i < count; i++) {
+    pSlots[i].status = LSCSTATUS_FAILED;
+    pSlots[i].hashLen = 0;
+  }
+  uint8_t channel;
+  LSCSTATUS lsStatus = LSC_SelectLsHash(&channel);
+  if (lsStatus != LSCSTATUS_SUCCESS) {
+    return lsStatus;
+  }
+  uint8_t slotId = 1;
+  for (; slotId <= count; slotId++) {
+    Lsc_SlotHash_t* pSlot = &pSlots[slotId - 1];
+    pSlot->status =
+        LSC_ReadLsHashSlot(channel, pSlot->hash, &pSlot->hashLen, slotId);
+    if (pSlot->status == LSCSTATUS_HASH_SLOT_INVALID) break;
+  }
+  LSC_CloseLsHash(channel);
+  /* The applet has fewer slots than scripts */
+  for (; slotId <= count; slotId++) {
+    pSlots[slotId - 1].status = LSCSTATUS_HASH_SLOT_INVALID;
+  }
+  NXP_LOG_ESE_D("%s: Exit ", __func__);
+  return LSCSTATUS_SUCCESS;
+}
+
 /*******************************************************************************
 **
 ** Function:        LSC_UpdateLsHash
@@ -2084,9 +2050,10 @@ LSCSTATUS LSC_UpdateLsHash(uint8_t* hash, long hashLen, uint8_t slotId) {
   phNxpEse_data cmdApdu;
   phNxpEse_data rspApdu;
   LSCSTATUS lsStatus = LSCSTATUS_FAILED;
-  ALOGD_IF(ese_debug_enabled, "%s: Enter ", __func__);
+  NXP_LOG_ESE_D("%s: Enter ", __func__);
 
-  lsStatus = LSC_SelectLsHash();
+  uint8_t channel;
+  lsStatus = LSC_SelectLsHash(&channel);
   if (lsStatus != LSCSTATUS_SUCCESS) {
     return lsStatus;
   }
@@ -2099,14 +2066,14 @@ LSCSTATUS LSC_UpdateLsHash(uint8_t* hash, long hashLen, uint8_t slotId) {
 
   if (cmdApdu.p_data != NULL) {
     uint8_t xx = 0;
-    cmdApdu.p_data[xx++] = 0x80;
-    cmdApdu.p_data[xx++] = 0x01;     // INS
-    cmdApdu.p_data[xx++] = slotId;   // P1
-    cmdApdu.p_data[xx++] = 0x00;     // P2
-    cmdApdu.p_data[xx++] = hashLen;  // Lc
+    cmdApdu.p_data[xx++] = phNxpEse_ChannelCla(0x80, channel);  // CLA
+    cmdApdu.p_data[xx++] = 0x01;                                // INS
+    cmdApdu.p_data[xx++] = slotId;                              // P1
+    cmdApdu.p_data[xx++] = 0x00;                                // P2
+    cmdApdu.p_data[xx++] = hashLen;                             // Lc
     memcpy(&cmdApdu.p_data[xx], hash, hashLen);
 
-    ESESTATUS eseStat = phNxpEse_Transceive(&cmdApdu, &rspApdu);
+    ESESTATUS eseStat = LSC_Transceive(&cmdApdu, &rspApdu);
 
     if ((eseStat == ESESTATUS_SUCCESS) &&
         ((rspApdu.p_data[rspApdu.len - 2] == 0x90) &&
@@ -2115,13 +2082,14 @@ LSCSTATUS LSC_UpdateLsHash(uint8_t* hash, long hashLen, uint8_t slotId) {
     } else {
       if ((rspApdu.p_data[rspApdu.len - 2] == 0x6A) &&
           (rspApdu.p_data[rspApdu.len - 1] == 0x86)) {
-        ALOGD_IF(ese_debug_enabled, "%s: if slot id is invalid", __func__);
+        NXP_LOG_ESE_D("%s: if slot id is invalid", __func__);
       }
       lsStatus = LSCSTATUS_FAILED;
     }
   }
 
-  ALOGD_IF(ese_debug_enabled, "%s: Exit ", __func__);
+  LSC_CloseLsHash(channel);
+  NXP_LOG_ESE_D("%s: Exit ", __func__);
   phNxpEse_free(cmdApdu.p_data);
   phNxpEse_free(rspApdu.p_data);
   return lsStatus;
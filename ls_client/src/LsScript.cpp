@@ -0,0 +1,608 @@
+/*******************************************************************************
+ *
+ *  Copyright 2018 NXP
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+#define LOG_TAG "LSClient"
+#include <LsScript.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <log/log.h>
+#include <phNxpEseBerTlv.h>
+#include <phNxpEseLog.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+extern bool ese_debug_enabled;
+
+#define LS_HEX_SPACE 0x10
+#define LS_HEX_INVALID 0xFF
+
+/* Nibble value of each character, LS_HEX_SPACE for whitespace and
+ * LS_HEX_INVALID for anything else. OR-ing the values of a pair gives a
+ * value below 0x10 only if both characters are hex digits. */
+#define XX LS_HEX_INVALID
+#define SP LS_HEX_SPACE
+static const uint8_t gsHexNibble[256] = {
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, SP, SP, SP, SP, SP, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    SP, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  XX, XX, XX, XX, XX, XX,
+    XX, 10, 11, 12, 13, 14, 15, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, 10, 11, 12, 13, 14, 15, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+    XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX, XX,
+};
+#undef XX
+#undef SP
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptSkipSpace
+**
+** Description:     Advances the cursor past whitespace.
+**
+** Returns:         None
+**
+*******************************************************************************/
+static void LSC_ScriptSkipSpace(Lsc_Script_t* pScript) {
+  while (pScript->offset < pScript->size &&
+         gsHexNibble[pScript->pBase[pScript->offset]] == LS_HEX_SPACE) {
+    pScript->offset++;
+  }
+}
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptOpen
+**
+** Description:     Maps the script file at path read-only and positions the
+**                  cursor at its start.
+**
+** Returns:         Success if ok.
+**
+*******************************************************************************/
+LSCSTATUS LSC_ScriptOpen(const char* path, Lsc_Script_t* pScript) {
+  static const char fn[] = "LSC_ScriptOpen";
+  if (path == NULL || pScript == NULL) return LSCSTATUS_FAILED;
+  memset(pScript, 0x00, sizeof(Lsc_Script_t));
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    ALOGE("%s: Error opening script <%s> for reading: %s", fn, path,
+          strerror(errno));
+    return LSCSTATUS_FAILED;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    ALOGE("%s: Empty or unreadable script <%s>", fn, path);
+    close(fd);
+    return LSCSTATUS_FAILED;
+  }
+  void* pBase = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (pBase == MAP_FAILED) {
+    ALOGE("%s: Error mapping script <%s>: %s", fn, path, strerror(errno));
+    return LSCSTATUS_FAILED;
+  }
+  madvise(pBase, st.st_size, MADV_SEQUENTIAL);
+  pScript->pBase = (const uint8_t*)pBase;
+  pScript->size = st.st_size;
+  LSC_ScriptSkipSpace(pScript);
+  NXP_LOG_ESE_D("%s: mapped %zu bytes of %s", fn, pScript->size, path);
+  return LSCSTATUS_SUCCESS;
+}
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptClose
+**
+** Description:     Releases the script text and the compiled image.
+**
+** Returns:         None
+**
+*******************************************************************************/
+void LSC_ScriptClose(Lsc_Script_t* pScript) {
+  if (pScript == NULL) return;
+  if (pScript->pBase != NULL) munmap((void*)pScript->pBase, pScript->size);
+  if (pScript->pImage != NULL) {
+    if (pScript->imageMapped)
+      munmap((void*)pScript->pImage, pScript->imageLen);
+    else
+      free((void*)pScript->pImage);
+  }
+  memset(pScript, 0x00, sizeof(Lsc_Script_t));
+}
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptAtEnd
+**
+** Description:     Tells whether all records of the script were consumed.
+**
+** Returns:         true at the end of the script
+**
+*******************************************************************************/
+bool LSC_ScriptAtEnd(const Lsc_Script_t* pScript) {
+  if (pScript->pImage != NULL) {
+    const Lsc_ScriptImageHeader_t* pHeader =
+        (const Lsc_ScriptImageHeader_t*)pScript->pImage;
+    return pScript->record >= pHeader->recordCount;
+  }
+  return pScript->offset >= pScript->size;
+}
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptDecodeHex
+**
+** Description:     Decodes exactly count bytes at the cursor into pDst. The
+**                  loop looks up both characters of a pair and takes the
+**                  fast path whenever both are hex digits; whitespace only
+**                  costs an extra iteration.
+**
+** Returns:         Success if count bytes were decoded
+**
+*******************************************************************************/
+LSCSTATUS LSC_ScriptDecodeHex(Lsc_Script_t* pScript, uint8_t* pDst,
+                              size_t count) {
+  const uint8_t* pSrc = pScript->pBase;
+  size_t offset = pScript->offset;
+  /* a pair needs offset < last */
+  size_t last = (pScript->size > 0) ? pScript->size - 1 : 0;
+  size_t done = 0;
+
+  while (done < count && offset < last) {
+    uint8_t hi = gsHexNibble[pSrc[offset]];
+    uint8_t lo = gsHexNibble[pSrc[offset + 1]];
+    if ((hi | lo) < 0x10) {
+      pDst[done++] = (uint8_t)((hi << 4) | lo);
+      offset += 2;
+    } else if (hi == LS_HEX_SPACE) {
+      offset++;
+    } else {
+      break;
+    }
+  }
+  pScript->offset = offset;
+  if (done != count) {
+    ALOGE("LSC_ScriptDecodeHex: bad or missing hex at offset %zu", offset);
+    return LSCSTATUS_FAILED;
+  }
+  return LSCSTATUS_SUCCESS;
+}
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptRecordHeaderLen
+**
+** Description:     Parses the tag and length field of a decoded record of
+**                  len bytes with the rules of LSC_ScriptNextTlv.
+**
+** Returns:         Header length, 0 if the header is invalid or the value
+**                  length does not match len
+**
+*******************************************************************************/
+static size_t LSC_ScriptRecordHeaderLen(const uint8_t* pRec, size_t len) {
+  phNxpEseBerTlvCursor_t cursor;
+  phNxpEseBerTlv_t tlv;
+  phNxpEseBerTlv_Init(&cursor, pRec, len);
+  if (!phNxpEseBerTlv_Next(&cursor, &tlv) || !phNxpEseBerTlv_AtEnd(&cursor))
+    return 0;
+  if (tlv.tag != 0x7F21 && tlv.tag != 0x40 && tlv.tag != 0x60) return 0;
+  if (tlv.len == 0) return 0;
+  return tlv.pValue - pRec;
+}
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptImageIndex
+**
+** Description:     Locates the offsets of a compiled image.
+**
+** Returns:         recordCount + 1 offsets into the record data
+**
+*******************************************************************************/
+static const uint32_t* LSC_ScriptImageIndex(const uint8_t* pImage) {
+  const Lsc_ScriptImageHeader_t* pHeader =
+      (const Lsc_ScriptImageHeader_t*)pImage;
+  return (const uint32_t*)(pImage + pHeader->headerLen);
+}
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptNextImageRecord
+**
+** Description:     Copies the next record of the compiled image into pBuf.
+**
+** Returns:         Success if ok.
+**
+*******************************************************************************/
+static LSCSTATUS LSC_ScriptNextImageRecord(Lsc_Script_t* pScript,
+                                           uint8_t* pBuf, size_t bufLen,
+                                           int32_t* pRecLen) {
+  const Lsc_ScriptImageHeader_t* pHeader =
+      (const Lsc_ScriptImageHeader_t*)pScript->pImage;
+  if (pScript->record >= pHeader->recordCount) return LSCSTATUS_FAILED;
+  const uint32_t* pIndex = LSC_ScriptImageIndex(pScript->pImage);
+  const uint8_t* pData = (const uint8_t*)(pIndex + pHeader->recordCount + 1);
+  uint32_t start = pIndex[pScript->record];
+  size_t len = pIndex[pScript->record + 1] - start;
+  if (len > bufLen) {
+    ALOGE("LSC_ScriptNextImageRecord: record of %zu bytes exceeds %zu", len,
+          bufLen);
+    return LSCSTATUS_FAILED;
+  }
+  memcpy(pBuf, pData + start, len);
+  pScript->record++;
+  *pRecLen = (int32_t)len;
+  return LSCSTATUS_SUCCESS;
+}
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptNextTlv
+**
+** Description:     Decodes the next record into pBuf. The header is decoded
+**                  first so that the value can be bounds checked before it is
+**                  written, then the value is decoded in one call.
+**
+** Returns:         Success if ok.
+**
+*******************************************************************************/
+LSCSTATUS LSC_ScriptNextTlv(Lsc_Script_t* pScript, uint8_t* pBuf,
+                            size_t bufLen, int32_t* pRecLen) {
+  static const char fn[] = "LSC_ScriptNextTlv";
+  if (pScript == NULL || pBuf == NULL || pRecLen == NULL || bufLen < 5)
+    return LSCSTATUS_FAILED;
+  *pRecLen = 0;
+  if (pScript->pImage != NULL)
+    return LSC_ScriptNextImageRecord(pScript, pBuf, bufLen, pRecLen);
+  if (pScript->pBase == NULL) return LSCSTATUS_FAILED;
+
+  /* Tag and the first length byte */
+  size_t lenOff = 1;
+  if (LSC_ScriptDecodeHex(pScript, pBuf, 2) != LSCSTATUS_SUCCESS)
+    return LSCSTATUS_FAILED;
+  if (pBuf[0] == 0x7F && pBuf[1] == 0x21) {
+    if (LSC_ScriptDecodeHex(pScript, &pBuf[2], 1) != LSCSTATUS_SUCCESS) {
+      ALOGE("%s: Exit Read Script failed in 7F21 ", fn);
+      return LSCSTATUS_FAILED;
+    }
+    lenOff = 2;
+  } else if (pBuf[0] != 0x40 && pBuf[0] != 0x60) {
+    /*If TAG is neither 7F21 nor 60 nor 40 then ABORT execution*/
+    ALOGE("%s: Invalid TAG 0x%X found in the script", fn, pBuf[0]);
+    return LSCSTATUS_FAILED;
+  }
+
+  size_t lenBytes;
+  size_t valueLen;
+  if (pBuf[lenOff] == 0x00) {
+    ALOGE("%s: Invalid length zero", fn);
+    return LSCSTATUS_FAILED;
+  } else if ((pBuf[lenOff] & 0x80) == 0x80) {
+    /* 0x81 and 0x82 are followed by one and two length bytes */
+    lenBytes = (pBuf[lenOff] & 0x0F) + 1;
+    if (lenBytes != 2 && lenBytes != 3) {
+      ALOGE("%s: Length field of %zu bytes not supported", fn, lenBytes);
+      return LSCSTATUS_FAILED;
+    }
+    if (LSC_ScriptDecodeHex(pScript, &pBuf[lenOff + 1], lenBytes - 1) !=
+        LSCSTATUS_SUCCESS) {
+      ALOGE("%s: Exit Read Script failed in length 0x%02zx", fn, lenBytes);
+      return LSCSTATUS_FAILED;
+    }
+    valueLen = pBuf[lenOff + 1];
+    if (lenBytes == 3) valueLen = (valueLen << 8) | pBuf[lenOff + 2];
+  } else {
+    lenBytes = 1;
+    valueLen = pBuf[lenOff];
+  }
+
+  size_t hdrLen = lenOff + lenBytes;
+  if (hdrLen + valueLen > bufLen) {
+    ALOGE("%s: Record of %zu bytes exceeds the buffer of %zu", fn,
+          hdrLen + valueLen, bufLen);
+    return LSCSTATUS_FAILED;
+  }
+  if (LSC_ScriptDecodeHex(pScript, &pBuf[hdrLen], valueLen) !=
+      LSCSTATUS_SUCCESS) {
+    ALOGE("%s: Exit Read Script failed in value", fn);
+    return LSCSTATUS_FAILED;
+  }
+  LSC_ScriptSkipSpace(pScript);
+  pScript->record++;
+  *pRecLen = (int32_t)(hdrLen + valueLen);
+  NXP_LOG_ESE_D("%s: tag 0x%02X, record %d bytes, offset %zu", fn, pBuf[0],
+                *pRecLen, pScript->offset);
+  return LSCSTATUS_SUCCESS;
+}
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptSkip
+**
+** Description:     Skips records. A compiled image only moves its record
+**                  index, the text is decoded and dropped.
+**
+** Returns:         Success if count records were skipped.
+**
+*******************************************************************************/
+LSCSTATUS LSC_ScriptSkip(Lsc_Script_t* pScript, uint32_t count) {
+  if (pScript == NULL) return LSCSTATUS_FAILED;
+  if (pScript->pImage != NULL) {
+    const Lsc_ScriptImageHeader_t* pHeader =
+        (const Lsc_ScriptImageHeader_t*)pScript->pImage;
+    if (count > pHeader->recordCount - pScript->record) return LSCSTATUS_FAILED;
+    pScript->record += count;
+    return LSCSTATUS_SUCCESS;
+  }
+  uint8_t record[LS_MAX_SCRIPT_RECORD_LEN];
+  int32_t recLen;
+  for (uint32_t i = 0; i < count; i++) {
+    if (LSC_ScriptAtEnd(pScript) ||
+        LSC_ScriptNextTlv(pScript, record, sizeof(record), &recLen) !=
+            LSCSTATUS_SUCCESS) {
+      return LSCSTATUS_FAILED;
+    }
+  }
+  return LSCSTATUS_SUCCESS;
+}
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptCheckImage
+**
+** Description:     Validates a compiled image of imageLen bytes against the
+**                  script hash. Every record is checked like a decoded one,
+**                  so a damaged image cannot overflow the record buffers.
+**
+** Returns:         true if the image can be used
+**
+*******************************************************************************/
+static bool LSC_ScriptCheckImage(const uint8_t* pImage, size_t imageLen,
+                                 const uint8_t* pHash) {
+  const Lsc_ScriptImageHeader_t* pHeader =
+      (const Lsc_ScriptImageHeader_t*)pImage;
+  if (imageLen < sizeof(Lsc_ScriptImageHeader_t) ||
+      memcmp(pHeader->magic, LS_SCRIPT_IMAGE_MAGIC,
+             sizeof(LS_SCRIPT_IMAGE_MAGIC)) != 0 ||
+      pHeader->version != LS_SCRIPT_IMAGE_VERSION ||
+      pHeader->headerLen != sizeof(Lsc_ScriptImageHeader_t) ||
+      memcmp(pHeader->hash, pHash, LS_SCRIPT_HASH_LEN) != 0) {
+    return false;
+  }
+  uint64_t expectLen = (uint64_t)pHeader->headerLen +
+                       ((uint64_t)pHeader->recordCount + 1) * sizeof(uint32_t) +
+                       pHeader->dataLen;
+  if (expectLen != imageLen) return false;
+
+  const uint32_t* pIndex = LSC_ScriptImageIndex(pImage);
+  const uint8_t* pData = (const uint8_t*)(pIndex + pHeader->recordCount + 1);
+  if (pIndex[0] != 0 || pIndex[pHeader->recordCount] != pHeader->dataLen)
+    return false;
+  for (uint32_t i = 0; i < pHeader->recordCount; i++) {
+    if (pIndex[i + 1] < pIndex[i]) return false;
+    size_t len = pIndex[i + 1] - pIndex[i];
+    if (len > LS_MAX_SCRIPT_RECORD_LEN ||
+        LSC_ScriptRecordHeaderLen(pData + pIndex[i], len) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptLoadImage
+**
+** Description:     Maps the compiled image at cachePath and checks it.
+**
+** Returns:         Success if the image is usable.
+**
+*******************************************************************************/
+static LSCSTATUS LSC_ScriptLoadImage(const char* cachePath,
+                                     const uint8_t* pHash,
+                                     Lsc_Script_t* pScript) {
+  int fd = open(cachePath, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return LSCSTATUS_FAILED;
+  struct stat st;
+  if (fstat(fd, &st) != 0 ||
+      (size_t)st.st_size < sizeof(Lsc_ScriptImageHeader_t)) {
+    close(fd);
+    return LSCSTATUS_FAILED;
+  }
+  void* pImage = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (pImage == MAP_FAILED) return LSCSTATUS_FAILED;
+  if (!LSC_ScriptCheckImage((const uint8_t*)pImage, st.st_size, pHash)) {
+    ALOGE("LSC_ScriptLoadImage: discarding invalid image %s", cachePath);
+    munmap(pImage, st.st_size);
+    unlink(cachePath);
+    return LSCSTATUS_FAILED;
+  }
+  pScript->pImage = (const uint8_t*)pImage;
+  pScript->imageLen = st.st_size;
+  pScript->imageMapped = true;
+  pScript->record = 0;
+  return LSCSTATUS_SUCCESS;
+}
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptCompile
+**
+** Description:     Decodes all records of the script text into a compiled
+**                  image and switches pScript over to it. The text mapping
+**                  is released on success.
+**
+** Returns:         Success if the whole script decoded.
+**
+*******************************************************************************/
+static LSCSTATUS LSC_ScriptCompile(Lsc_Script_t* pScript,
+                                   const uint8_t* pHash) {
+  std::vector<uint32_t> index(1, 0);
+  std::vector<uint8_t> data;
+  uint8_t record[LS_MAX_SCRIPT_RECORD_LEN];
+  int32_t recLen;
+
+  data.reserve(pScript->size / 2);
+  while (!LSC_ScriptAtEnd(pScript)) {
+    if (LSC_ScriptNextTlv(pScript, record, sizeof(record), &recLen) !=
+        LSCSTATUS_SUCCESS) {
+      return LSCSTATUS_FAILED;
+    }
+    data.insert(data.end(), record, record + recLen);
+    index.push_back(data.size());
+  }
+
+  Lsc_ScriptImageHeader_t header;
+  memset(&header, 0x00, sizeof(header));
+  memcpy(header.magic, LS_SCRIPT_IMAGE_MAGIC, sizeof(LS_SCRIPT_IMAGE_MAGIC));
+  header.version = LS_SCRIPT_IMAGE_VERSION;
+  header.headerLen = sizeof(header);
+  header.recordCount = index.size() - 1;
+  header.dataLen = data.size();
+  memcpy(header.hash, pHash, LS_SCRIPT_HASH_LEN);
+
+  size_t indexLen = index.size() * sizeof(uint32_t);
+  size_t imageLen = sizeof(header) + indexLen + data.size();
+  uint8_t* pImage = (uint8_t*)malloc(imageLen);
+  if (pImage == NULL) return LSCSTATUS_FAILED;
+  memcpy(pImage, &header, sizeof(header));
+  memcpy(pImage + sizeof(header), index.data(), indexLen);
+  memcpy(pImage + sizeof(header) + indexLen, data.data(), data.size());
+
+  munmap((void*)pScript->pBase, pScript->size);
+  pScript->pBase = NULL;
+  pScript->size = 0;
+  pScript->offset = 0;
+  pScript->pImage = pImage;
+  pScript->imageLen = imageLen;
+  pScript->imageMapped = false;
+  pScript->record = 0;
+  return LSCSTATUS_SUCCESS;
+}
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptStoreImage
+**
+** Description:     Writes the compiled image to cachePath through a temporary
+**                  file, so that an interrupted write never leaves a partial
+**                  image under the final name.
+**
+** Returns:         None
+**
+*******************************************************************************/
+static void LSC_ScriptStoreImage(const Lsc_Script_t* pScript,
+                                 const char* cachePath) {
+  static const char fn[] = "LSC_ScriptStoreImage";
+  std::string tmpPath(cachePath);
+  tmpPath += ".tmp";
+  int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                0600);
+  if (fd < 0) {
+    ALOGE("%s: cannot create %s: %s", fn, tmpPath.c_str(), strerror(errno));
+    return;
+  }
+  const uint8_t* pData = pScript->pImage;
+  size_t left = pScript->imageLen;
+  while (left > 0) {
+    ssize_t written = write(fd, pData, left);
+    if (written < 0 && errno == EINTR) continue;
+    if (written <= 0) break;
+    pData += written;
+    left -= written;
+  }
+  bool ok = (left == 0) && (fsync(fd) == 0);
+  close(fd);
+  if (!ok || rename(tmpPath.c_str(), cachePath) != 0) {
+    ALOGE("%s: cannot store %s: %s", fn, cachePath, strerror(errno));
+    unlink(tmpPath.c_str());
+    return;
+  }
+  NXP_LOG_ESE_D("%s: %zu bytes stored to %s", fn, pScript->imageLen,
+                cachePath);
+}
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptOpenCached
+**
+** Description:     Opens the compiled image of the script, building it on
+**                  the first run. A script that does not decode completely
+**                  is executed from its text as before, so that the records
+**                  ahead of the damaged one are still sent.
+**
+** Returns:         Success if ok.
+**
+*******************************************************************************/
+LSCSTATUS LSC_ScriptOpenCached(const char* path, const char* cachePath,
+                               const uint8_t* pHash, Lsc_Script_t* pScript) {
+  static const char fn[] = "LSC_ScriptOpenCached";
+  if (cachePath == NULL || pHash == NULL) return LSC_ScriptOpen(path, pScript);
+  if (pScript == NULL) return LSCSTATUS_FAILED;
+  memset(pScript, 0x00, sizeof(Lsc_Script_t));
+
+  if (LSC_ScriptLoadImage(cachePath, pHash, pScript) == LSCSTATUS_SUCCESS) {
+    NXP_LOG_ESE_D("%s: running %s from %s", fn, path, cachePath);
+    return LSCSTATUS_SUCCESS;
+  }
+  if (LSC_ScriptOpen(path, pScript) != LSCSTATUS_SUCCESS)
+    return LSCSTATUS_FAILED;
+  if (LSC_ScriptCompile(pScript, pHash) != LSCSTATUS_SUCCESS) {
+    ALOGE("%s: %s does not compile, running it from text", fn, path);
+    /*Back to the first record, as LSC_ScriptOpen left it*/
+    pScript->offset = 0;
+    pScript->record = 0;
+    LSC_ScriptSkipSpace(pScript);
+    return LSCSTATUS_SUCCESS;
+  }
+  LSC_ScriptStoreImage(pScript, cachePath);
+  return LSCSTATUS_SUCCESS;
+}
+
+/*******************************************************************************
+**
+** Function:        LSC_ScriptCachePath
+**
+** Description:     Builds the path of the compiled image of a script.
+**
+** Returns:         None
+**
+*******************************************************************************/
+void LSC_ScriptCachePath(const uint8_t* pHash, char* path, size_t len) {
+  char hex[2 * LS_SCRIPT_HASH_LEN + 1];
+  for (int i = 0; i < LS_SCRIPT_HASH_LEN; i++)
+    snprintf(&hex[2 * i], 3, "%02x", pHash[i]);
+  snprintf(path, len, "%s%s%s", LS_SCRIPT_CACHE_PREFIX, hex,
+           LS_SCRIPT_CACHE_SUFFIX);
+}
@@ -35,9 +35,7 @@ static hidl_vec<uint8_t> gsRspDataBuff(256);
 static android::sp<ISecureElementHalCallback> gSeHalCallback;
 std::vector<uint8_t> atrResponse;
 
-WiredSe::WiredSe()
-    : mOpenedchannelCount(0), mOpenedChannels{false, false, false, false},
-      mWiredSeHandle(0) {}
+WiredSe::WiredSe() : mWiredSeHandle(0) { phNxpEse_ChannelReset(&mChannels); }
 
 Return<void> WiredSe::init(
     const sp<
@@ -47,7 +45,8 @@ Return<void> WiredSe::init(
     return Void();
   }
   gSeHalCallback = clientCallback;
-  gSeHalCallback->linkToDeath(this, 0 /*cookie*/);
+  /* Channels opened from now on are reclaimed when this client dies */
+  gSeHalCallback->linkToDeath(this, ++mClientCookie);
   if (sWiredCallbackHandle == nullptr) {
     gSeHalCallback->onStateChange(false);
     ALOGE("%s: NfcService callback handle not registered yet!", __func__);
@@ -157,9 +156,15 @@ Return<void> WiredSe::openLogicalChannel(const hidl_vec<uint8_t> &aid,
   } else if (rspApdu.at(rspApdu.size() - 2) == 0x90 &&
              rspApdu.at(rspApdu.size() - 1) == 0x00) {
     resApduBuff.channelNumber = rspApdu.at(0);
-    mOpenedchannelCount++;
-    mOpenedChannels[resApduBuff.channelNumber] = true;
-    sestatus = SecureElementStatus::SUCCESS;
+    if (phNxpEse_ChannelAdd(&mChannels, resApduBuff.channelNumber,
+                            mClientCookie) == ESESTATUS_SUCCESS) {
+      sestatus = SecureElementStatus::SUCCESS;
+    } else {
+      ALOGE("%s: channel 0x%02x out of range", __func__,
+            resApduBuff.channelNumber);
+      resApduBuff.channelNumber = 0xff;
+      sestatus = SecureElementStatus::CHANNEL_NOT_AVAILABLE;
+    }
   } else if (((rspApdu.at(rspApdu.size() - 2) == 0x6E) ||
               (rspApdu.at(rspApdu.size() - 2) == 0x6D)) &&
              rspApdu.at(rspApdu.size() - 1) == 0x00) {
@@ -167,7 +172,7 @@ Return<void> WiredSe::openLogicalChannel(const hidl_vec<uint8_t> &aid,
   }
 
   if (sestatus != SecureElementStatus::SUCCESS) {
-    if (mOpenedchannelCount == 0) {
+    if (mChannels.count == 0) {
       sestatus = seHalDeInit();
     }
     /*If manageChannel is failed in any of above cases
@@ -181,7 +186,7 @@ Return<void> WiredSe::openLogicalChannel(const hidl_vec<uint8_t> &aid,
   status = WIREDSESTATUS_FAILED;
 
   std::vector<uint8_t> selectCommand(aid.size() + 5);
-  selectCommand.at(0) = resApduBuff.channelNumber;
+  selectCommand.at(0) = phNxpEse_ChannelCla(0x00, resApduBuff.channelNumber);
   selectCommand.at(1) = (uint8_t)0xA4;
   selectCommand.at(2) = 0x04;
   selectCommand.at(3) = p2;
@@ -297,9 +302,8 @@ Return<void> WiredSe::openBasicChannel(const hidl_vec<uint8_t> &aid, uint8_t p2,
     /*Status is success*/
     if (*(rspSelectApdu.end() - 2) == 0x90 &&
         *(rspSelectApdu.end() - 1) == 0x00) {
-      if (!mOpenedChannels[0]) {
-        mOpenedChannels[0] = true;
-        mOpenedchannelCount++;
+      if (!phNxpEse_ChannelIsOpen(&mChannels, DEFAULT_BASIC_CHANNEL)) {
+        phNxpEse_ChannelAdd(&mChannels, DEFAULT_BASIC_CHANNEL, mClientCookie);
       }
       result = rspSelectApdu;
       sestatus = SecureElementStatus::SUCCESS;
@@ -339,14 +343,13 @@ WiredSe::internalCloseChannel(uint8_t channelNumber) {
     return SecureElementStatus::FAILED;
   }
 
-  if (channelNumber < DEFAULT_BASIC_CHANNEL ||
-      channelNumber >= MAX_LOGICAL_CHANNELS) {
+  if (!phNxpEse_ChannelIsOpen(&mChannels, channelNumber)) {
     ALOGE("%s: invalid channel!!! 0x%02x", __func__, channelNumber);
 
     sestatus = SecureElementStatus::FAILED;
   } else if (channelNumber > DEFAULT_BASIC_CHANNEL) {
     std::vector<uint8_t> closeCommand(5);
-    closeCommand.at(0) = channelNumber;
+    closeCommand.at(0) = phNxpEse_ChannelCla(0x00, channelNumber);
     closeCommand.at(1) = (uint8_t)0x70;
     closeCommand.at(2) = (uint8_t)0x80;
     closeCommand.at(3) = channelNumber;
@@ -382,13 +385,10 @@ WiredSe::internalCloseChannel(uint8_t channelNumber) {
   }
   if ((channelNumber == DEFAULT_BASIC_CHANNEL) ||
       (sestatus == SecureElementStatus::SUCCESS)) {
-    if (mOpenedChannels[channelNumber]) {
-      mOpenedChannels[channelNumber] = false;
-      mOpenedchannelCount--;
-    }
+    phNxpEse_ChannelRemove(&mChannels, channelNumber);
   }
   /*If there are no channels remaining close secureElement*/
-  if (mOpenedchannelCount == 0) {
+  if (mChannels.count == 0) {
     sestatus = seHalDeInit();
   } else {
     sestatus = SecureElementStatus::SUCCESS;
@@ -407,15 +407,13 @@ WiredSe::closeChannel(uint8_t channelNumber) {
     return SecureElementStatus::FAILED;
   }
 
-  if (channelNumber < DEFAULT_BASIC_CHANNEL ||
-      channelNumber >= MAX_LOGICAL_CHANNELS) {
-    ALOGD("%s invalid channel!!! %d for %d", __func__, channelNumber,
-          mOpenedChannels[channelNumber]);
+  if (!phNxpEse_ChannelIsOpen(&mChannels, channelNumber)) {
+    ALOGD("%s invalid channel!!! %d", __func__, channelNumber);
 
     sestatus = SecureElementStatus::FAILED;
   } else if (channelNumber > DEFAULT_BASIC_CHANNEL) {
     std::vector<uint8_t> closeCommand(5);
-    closeCommand.at(0) = channelNumber;
+    closeCommand.at(0) = phNxpEse_ChannelCla(0x00, channelNumber);
     closeCommand.at(1) = (uint8_t)0x70;
     closeCommand.at(2) = (uint8_t)0x80;
     closeCommand.at(3) = channelNumber;
@@ -450,13 +448,10 @@ WiredSe::closeChannel(uint8_t channelNumber) {
   }
   if ((channelNumber == DEFAULT_BASIC_CHANNEL) ||
       (sestatus == SecureElementStatus::SUCCESS)) {
-    if (mOpenedChannels[channelNumber]) {
-      mOpenedChannels[channelNumber] = false;
-      mOpenedchannelCount--;
-    }
+    phNxpEse_ChannelRemove(&mChannels, channelNumber);
   }
   /*If there are no channels remaining close secureElement*/
-  if (mOpenedchannelCount == 0) {
+  if (mChannels.count == 0) {
     sestatus = seHalDeInit();
   } else {
     sestatus = SecureElementStatus::SUCCESS;
@@ -464,13 +459,23 @@ WiredSe::closeChannel(uint8_t channelNumber) {
   return sestatus;
 }
 
-void WiredSe::serviceDied(uint64_t /*cookie*/, const wp<IBase> & /*who*/) {
+void WiredSe::serviceDied(uint64_t cookie, const wp<IBase> & /*who*/) {
   ALOGE("%s: WiredSe serviceDied!!!", __func__);
-  SecureElementStatus sestatus = seHalDeInit();
-  if (sestatus != SecureElementStatus::SUCCESS) {
-    ALOGE("%s: seHalDeInit Faliled!!!", __func__);
+  /* Close what the dead client held; the last close releases the wired SE */
+  uint32_t owned = phNxpEse_ChannelOwnedMask(&mChannels, cookie);
+  if (owned == 0 && mChannels.count == 0 && mWiredSeHandle > 0) {
+    if (seHalDeInit() != SecureElementStatus::SUCCESS) {
+      ALOGE("%s: seHalDeInit Faliled!!!", __func__);
+    }
   }
-  if (gSeHalCallback != nullptr) {
+  for (uint8_t channelNumber = phNxpEse_ChannelNext(&owned);
+       channelNumber < PH_ESE_MAX_CHANNELS;
+       channelNumber = phNxpEse_ChannelNext(&owned)) {
+    if (internalCloseChannel(channelNumber) != SecureElementStatus::SUCCESS) {
+      ALOGE("%s: closing channel 0x%02x failed", __func__, channelNumber);
+    }
+  }
+  if (cookie == mClientCookie && gSeHalCallback != nullptr) {
     gSeHalCallback->unlinkToDeath(this);
   }
 }
@@ -511,10 +516,7 @@ WiredSe::seHalDeInit() {
 void WiredSe::resetWiredSeContext() {
   ALOGD("%s: Enter", __func__);
   mWiredSeHandle = 0;
-  for (uint8_t xx = 0; xx < MAX_LOGICAL_CHANNELS; xx++) {
-    mOpenedChannels[xx] = false;
-  }
-  mOpenedchannelCount = 0;
+  phNxpEse_ChannelReset(&mChannels);
   return;
 }
 
@@ -23,6 +23,7 @@
 #include <hardware/hardware.h>
 #include <hidl/MQDescriptor.h>
 #include <hidl/Status.h>
+#include <phNxpEse_Channel.h>
 #include <vendor/nxp/nxpwiredse/1.0/INxpWiredSeHalCallback.h>
 
 namespace vendor {
@@ -48,7 +49,7 @@ using android::base::StringPrintf;
 using ::vendor::nxp::nxpwiredse::V1_0::INxpWiredSeHalCallback;
 
 #ifndef MAX_LOGICAL_CHANNELS
-#define MAX_LOGICAL_CHANNELS 0x04
+#define MAX_LOGICAL_CHANNELS PH_ESE_MAX_CHANNELS
 #endif
 #ifndef MIN_APDU_LENGTH
 #define MIN_APDU_LENGTH 0x04
@@ -79,13 +80,13 @@ struct WiredSe : public ISecureElement, public hidl_death_recipient {
   Return<::android::hardware::secure_element::V1_0::SecureElementStatus>
   closeChannel(uint8_t channelNumber) override;
 
-  void serviceDied(uint64_t /*cookie*/, const wp<IBase> & /*who*/) override;
+  void serviceDied(uint64_t cookie, const wp<IBase> & /*who*/) override;
   static Return<void>
   setWiredSeCallback(const android::sp<INxpWiredSeHalCallback> &wiredCallback);
 
 private:
-  uint8_t mOpenedchannelCount = 0;
-  bool mOpenedChannels[MAX_LOGICAL_CHANNELS];
+  phNxpEse_ChannelTable_t mChannels;
+  uint64_t mClientCookie = PH_ESE_CHANNEL_NO_OWNER;
   int32_t mWiredSeHandle;
   static android::sp<INxpWiredSeHalCallback> sWiredCallbackHandle;
   Return<::android::hardware::secure_element::V1_0::SecureElementStatus>